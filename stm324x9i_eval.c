@@ -161,6 +161,37 @@ uint32_t BSP_GetVersion(void)
   return __STM324x9I_EVAL_BSP_VERSION;
 }
 
+/**
+  * @brief  Enables the DWT cycle counter used to time the driver events.
+  * @retval None
+  */
+void BSP_EnableCycleCounter(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+  * @brief  Gets the DWT cycle counter, enabled by BSP_EnableCycleCounter().
+  * @retval Cycle count, wraps around every 2^32 CPU cycles
+  */
+uint32_t BSP_GetCycleCount(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**
+  * @brief  Gets the time elapsed since a cycle count.
+  * @note   The difference is taken in cycles, so that a counter wrap does not
+  *         corrupt it, then converted: intervals up to 2^32 CPU cycles are valid.
+  * @param  StartCycles: Cycle count returned by BSP_GetCycleCount()
+  * @retval Elapsed time in us
+  */
+uint32_t BSP_GetElapsedUs(uint32_t StartCycles)
+{
+  return (DWT->CYCCNT - StartCycles) / (SystemCoreClock / 1000000);
+}
+
 /**
   * @brief  Configures LED GPIO.
   * @param  Led: LED to be configured. 
@@ -826,6 +857,20 @@ void CAMERA_IO_Write(uint8_t Addr, uint8_t Reg, uint8_t Value)
   I2Cx_Write(Addr, Reg, Value);
 }
 
+/**
+  * @brief  Camera writes consecutive registers in a single transaction.
+  * @note   The sensor must increment the register address after each byte.
+  * @param  Addr: I2C address
+  * @param  Reg: First register address 
+  * @param  Buffer: Pointer to the register values
+  * @param  Length: Number of registers to write
+  * @retval HAL status
+  */
+HAL_StatusTypeDef CAMERA_IO_WriteMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length)
+{
+  return (I2Cx_WriteMultiple(Addr, (uint16_t)Reg, I2C_MEMADD_SIZE_8BIT, Buffer, Length));
+}
+
 /**
   * @brief  Camera reads single data.
   * @param  Addr: I2C address
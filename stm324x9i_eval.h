@@ -284,6 +284,9 @@ typedef enum
   * @{
   */
 uint32_t         BSP_GetVersion(void);  
+void             BSP_EnableCycleCounter(void);
+uint32_t         BSP_GetCycleCount(void);
+uint32_t         BSP_GetElapsedUs(uint32_t StartCycles);
 void             BSP_LED_Init(Led_TypeDef Led);
 void             BSP_LED_On(Led_TypeDef Led);
 void             BSP_LED_Off(Led_TypeDef Led);
@@ -295,6 +298,9 @@ uint8_t          BSP_JOY_Init(JOYMode_TypeDef Joy_Mode);
 JOYState_TypeDef BSP_JOY_GetState(void);
 uint8_t          BSP_TS3510_IsDetected(void);
 
+/* CAMERA IO burst write, not part of the camera component link layer */
+HAL_StatusTypeDef CAMERA_IO_WriteMultiple(uint8_t Addr, uint8_t Reg, uint8_t *Buffer, uint16_t Length);
+
 /**
   * @}
   */
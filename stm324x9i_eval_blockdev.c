@@ -0,0 +1,1285 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_blockdev.c
+  * @author  MCD Application Team
+  * @brief   This file includes a common block device interface over the
+  *          memories mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver gives the uSD card, NOR, SRAM, SDRAM and EEPROM memories the
+     same block interface, so that a cache or a file system can be layered over
+     any of them. A RAM block device, working on any memory area, is provided
+     for the host test of such layers.
+   - Each memory is accessed through its driver structure: sd_blockdev_drv,
+     nor_blockdev_drv, sram_blockdev_drv, sdram_blockdev_drv, eeprom_blockdev_drv
+     and ram_blockdev_drv, which calls the corresponding BSP memory driver.
+
+2. Driver description:
+---------------------
+  + Driver structure
+     o Init() initializes the memory through its BSP driver. The RAM block device
+       memory is set by BSP_BLOCKDEV_RAM_Config() first.
+     o GetGeometry() returns the block size and count, the erase unit and the
+       data buffer alignment required by the memory. NOR blocks must be erased
+       before being written (BLOCKDEV_FLAG_ERASE_BEFORE_WRITE).
+     o Submit() queues a read, write or erase request and returns at once: the
+       request is checked against the geometry and is rejected if it does not
+       fit. Requests are served in submission order. On completion, the request
+       Status is set and its callback is called, from interrupt context for the
+       SD card.
+     o Process() must be called periodically: the SD card requests are issued
+       through the SD request queue, the other memories are accessed in polling
+       mode from Process(), one request per call.
+     o Cancel() completes a pending request with BLOCKDEV_ERROR and calls its
+       callback. A SD card transfer in progress is aborted.
+
+  + Helpers
+     o BSP_BLOCKDEV_Wait() calls Process() until the completion of a request or
+       BLOCKDEV_TIMEOUT, BSP_BLOCKDEV_Transfer() submits a request and waits for
+       it. A request still pending at the timeout is cancelled and the transfer
+       fails, a removed SD card never completing its requests.
+
+  + Test
+     o BSP_BLOCKDEV_Test() checks that a block device follows the interface:
+       geometry, rejection of the requests out of range, misaligned or not
+       aligned on the erase unit, data integrity, request order and callbacks.
+       It also measures the read and write throughput. The content of the test
+       area is lost.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_blockdev.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV STM324x9I EVAL BLOCKDEV
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Private_Types_Definitions STM324x9I EVAL BLOCKDEV Private Types Definitions
+  * @{
+  */
+typedef struct
+{
+  BLOCKDEV_RequestTypeDef *pHead;
+  BLOCKDEV_RequestTypeDef *pTail;
+}BLOCKDEV_QueueTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Private_FunctionPrototypes STM324x9I EVAL BLOCKDEV Private FunctionPrototypes
+  * @{
+  */
+static uint8_t  BLOCKDEV_Check(BLOCKDEV_GeometryTypeDef *pGeometry, BLOCKDEV_RequestTypeDef *pRequest);
+static uint32_t BLOCKDEV_Enqueue(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_RequestTypeDef *pRequest);
+static void     BLOCKDEV_Complete(BLOCKDEV_QueueTypeDef *pQueue, uint8_t Status);
+static void     BLOCKDEV_Poll(BLOCKDEV_QueueTypeDef *pQueue, uint8_t (*Transfer)(BLOCKDEV_RequestTypeDef *pRequest));
+static uint8_t  BLOCKDEV_Cancel(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  BLOCKDEV_Submit(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_GeometryTypeDef *pGeometry,
+                                BLOCKDEV_RequestTypeDef *pRequest);
+
+static uint8_t  SD_BlockDevInit(void);
+static void     SD_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  SD_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     SD_BlockDevProcess(void);
+static uint8_t  SD_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static void     SD_BlockDevStart(void);
+static void     SD_BlockDevCallback(SD_RequestTypeDef *pRequest);
+
+static uint8_t  NOR_BlockDevInit(void);
+static void     NOR_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  NOR_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     NOR_BlockDevProcess(void);
+static uint8_t  NOR_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  NOR_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest);
+
+static uint8_t  SRAM_BlockDevInit(void);
+static void     SRAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  SRAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     SRAM_BlockDevProcess(void);
+static uint8_t  SRAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  SRAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest);
+
+static uint8_t  SDRAM_BlockDevInit(void);
+static void     SDRAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  SDRAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     SDRAM_BlockDevProcess(void);
+static uint8_t  SDRAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  SDRAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest);
+
+static uint8_t  EEPROM_BlockDevInit(void);
+static void     EEPROM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  EEPROM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     EEPROM_BlockDevProcess(void);
+static uint8_t  EEPROM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  EEPROM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest);
+
+static uint8_t  RAM_BlockDevInit(void);
+static void     RAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry);
+static uint8_t  RAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest);
+static void     RAM_BlockDevProcess(void);
+static uint8_t  RAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest);
+static uint8_t  RAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest);
+
+static void     TEST_Check(BLOCKDEV_TestResultTypeDef *pResult, uint32_t Condition, uint32_t Check);
+static void     TEST_Fill(uint8_t *pData, uint32_t Size, uint32_t Seed);
+static uint32_t TEST_Compare(uint8_t *pData, uint32_t Size, uint32_t Seed);
+static void     TEST_Callback(BLOCKDEV_RequestTypeDef *pRequest);
+static uint32_t TEST_KBytesPerSec(uint32_t Bytes, uint32_t Cycles);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Exported_Variables STM324x9I EVAL BLOCKDEV Exported Variables
+  * @{
+  */
+BLOCKDEV_DrvTypeDef sd_blockdev_drv =
+{
+  SD_BlockDevInit,
+  SD_BlockDevGetGeometry,
+  SD_BlockDevSubmit,
+  SD_BlockDevProcess,
+  SD_BlockDevCancel
+};
+
+BLOCKDEV_DrvTypeDef nor_blockdev_drv =
+{
+  NOR_BlockDevInit,
+  NOR_BlockDevGetGeometry,
+  NOR_BlockDevSubmit,
+  NOR_BlockDevProcess,
+  NOR_BlockDevCancel
+};
+
+BLOCKDEV_DrvTypeDef sram_blockdev_drv =
+{
+  SRAM_BlockDevInit,
+  SRAM_BlockDevGetGeometry,
+  SRAM_BlockDevSubmit,
+  SRAM_BlockDevProcess,
+  SRAM_BlockDevCancel
+};
+
+BLOCKDEV_DrvTypeDef sdram_blockdev_drv =
+{
+  SDRAM_BlockDevInit,
+  SDRAM_BlockDevGetGeometry,
+  SDRAM_BlockDevSubmit,
+  SDRAM_BlockDevProcess,
+  SDRAM_BlockDevCancel
+};
+
+BLOCKDEV_DrvTypeDef eeprom_blockdev_drv =
+{
+  EEPROM_BlockDevInit,
+  EEPROM_BlockDevGetGeometry,
+  EEPROM_BlockDevSubmit,
+  EEPROM_BlockDevProcess,
+  EEPROM_BlockDevCancel
+};
+
+BLOCKDEV_DrvTypeDef ram_blockdev_drv =
+{
+  RAM_BlockDevInit,
+  RAM_BlockDevGetGeometry,
+  RAM_BlockDevSubmit,
+  RAM_BlockDevProcess,
+  RAM_BlockDevCancel
+};
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Private_Variables STM324x9I EVAL BLOCKDEV Private Variables
+  * @{
+  */
+static struct
+{
+  BLOCKDEV_QueueTypeDef Queue;
+  SD_RequestTypeDef     Request;     /* SD request of the queue head          */
+  __IO uint32_t         Cancelling;  /* Next request issued by the canceller  */
+}BlockDevSd;
+
+static BLOCKDEV_QueueTypeDef BlockDevNor;
+static BLOCKDEV_QueueTypeDef BlockDevSram;
+static BLOCKDEV_QueueTypeDef BlockDevSdram;
+static BLOCKDEV_QueueTypeDef BlockDevEeprom;
+
+static struct
+{
+  BLOCKDEV_QueueTypeDef Queue;
+  uint8_t               *pMemory;
+  uint32_t              BlockSize;
+  uint32_t              NbBlocks;
+}BlockDevRam;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Private_Functions STM324x9I EVAL BLOCKDEV Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Sets the memory of the RAM block device.
+  * @param  pMemory: Memory area of BlockSize x NbBlocks bytes
+  * @param  BlockSize: Block size in bytes
+  * @param  NbBlocks: Number of blocks
+  * @retval None
+  */
+void BSP_BLOCKDEV_RAM_Config(uint8_t *pMemory, uint32_t BlockSize, uint32_t NbBlocks)
+{
+  BlockDevRam.pMemory   = pMemory;
+  BlockDevRam.BlockSize = BlockSize;
+  BlockDevRam.NbBlocks  = NbBlocks;
+}
+
+/**
+  * @brief  Waits for the completion of a request.
+  * @param  pDriver: Pointer to the block device driver
+  * @param  pRequest: Pointer to the submitted request
+  * @retval Request status, BLOCKDEV_PENDING on timeout
+  */
+uint8_t BSP_BLOCKDEV_Wait(BLOCKDEV_DrvTypeDef *pDriver, BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while(pRequest->Status == BLOCKDEV_PENDING)
+  {
+    pDriver->Process();
+    if((HAL_GetTick() - tickstart) >= BLOCKDEV_TIMEOUT)
+    {
+      break;
+    }
+  }
+
+  return pRequest->Status;
+}
+
+/**
+  * @brief  Submits a request and waits for its completion.
+  * @param  pDriver: Pointer to the block device driver
+  * @param  Operation: BLOCKDEV_OP_READ, BLOCKDEV_OP_WRITE or BLOCKDEV_OP_ERASE
+  * @param  pData: Data buffer, unused for erase
+  * @param  Block: First block
+  * @param  NumOfBlocks: Number of blocks
+  * @retval BLOCKDEV status
+  */
+uint8_t BSP_BLOCKDEV_Transfer(BLOCKDEV_DrvTypeDef *pDriver, uint32_t Operation, uint8_t *pData,
+                              uint32_t Block, uint32_t NumOfBlocks)
+{
+  BLOCKDEV_RequestTypeDef request;
+
+  request.Operation   = Operation;
+  request.pData       = pData;
+  request.Block       = Block;
+  request.NumOfBlocks = NumOfBlocks;
+  request.Callback    = NULL;
+  request.pContext    = NULL;
+
+  if(pDriver->Submit(&request) != BLOCKDEV_OK)
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  /* The request lives on the stack: it must leave the queue before returning */
+  if(BSP_BLOCKDEV_Wait(pDriver, &request) == BLOCKDEV_PENDING)
+  {
+    pDriver->Cancel(&request);
+    return BLOCKDEV_ERROR;
+  }
+
+  return request.Status;
+}
+
+/**
+  * @brief  Checks the conformance of a block device and measures its throughput.
+  * @param  pDriver: Pointer to the block device driver, initialized
+  * @param  pConfig: Pointer to the test configuration
+  * @param  pResult: Pointer to the test result
+  * @retval BLOCKDEV_OK when every check passed
+  */
+uint8_t BSP_BLOCKDEV_Test(BLOCKDEV_DrvTypeDef *pDriver, BLOCKDEV_TestConfigTypeDef *pConfig,
+                          BLOCKDEV_TestResultTypeDef *pResult)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+  BLOCKDEV_RequestTypeDef request[2];
+  uint32_t calls[2];
+  uint32_t chunk, block, count, erase, start, cycles, index;
+  uint8_t *pWrite, *pRead;
+
+  pResult->Checks            = 0;
+  pResult->Failures          = 0;
+  pResult->FirstFailure      = BLOCKDEV_CHECK_NONE;
+  pResult->ReadKBytesPerSec  = 0;
+  pResult->WriteKBytesPerSec = 0;
+
+  BSP_EnableCycleCounter();
+
+  /* Geometry and test area */
+  pDriver->GetGeometry(&geometry);
+  erase = (geometry.EraseBlocks != 0) ? geometry.EraseBlocks : 1;
+  TEST_Check(pResult, (geometry.BlockSize != 0) && (geometry.NbBlocks != 0) && (geometry.Alignment != 0) &&
+             (geometry.Alignment <= 4) && ((geometry.Alignment & (geometry.Alignment - 1)) == 0) &&
+             (pConfig->NbBlocks != 0) && (pConfig->StartBlock < geometry.NbBlocks) &&
+             (pConfig->NbBlocks <= (geometry.NbBlocks - pConfig->StartBlock)) &&
+             ((pConfig->StartBlock % erase) == 0) && ((pConfig->NbBlocks % erase) == 0) &&
+             (pConfig->BufferSize >= (2 * geometry.BlockSize)), BLOCKDEV_CHECK_GEOMETRY);
+  if(pResult->Failures != 0)
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  chunk  = pConfig->BufferSize / (2 * geometry.BlockSize);
+  pWrite = pConfig->pBuffer;
+  pRead  = pConfig->pBuffer + (chunk * geometry.BlockSize);
+
+  /* Requests out of range or misaligned are rejected */
+  request[0].Operation   = BLOCKDEV_OP_READ;
+  request[0].pData       = pRead;
+  request[0].Block       = geometry.NbBlocks;
+  request[0].NumOfBlocks = 1;
+  request[0].Callback    = NULL;
+  TEST_Check(pResult, pDriver->Submit(&request[0]) != BLOCKDEV_OK, BLOCKDEV_CHECK_RANGE);
+  request[0].Block       = geometry.NbBlocks - 1;
+  request[0].NumOfBlocks = 2;
+  TEST_Check(pResult, pDriver->Submit(&request[0]) != BLOCKDEV_OK, BLOCKDEV_CHECK_RANGE);
+  request[0].NumOfBlocks = 0;
+  TEST_Check(pResult, pDriver->Submit(&request[0]) != BLOCKDEV_OK, BLOCKDEV_CHECK_RANGE);
+
+  if(geometry.Alignment > 1)
+  {
+    request[0].pData       = pRead + 1;
+    request[0].Block       = pConfig->StartBlock;
+    request[0].NumOfBlocks = 1;
+    TEST_Check(pResult, pDriver->Submit(&request[0]) != BLOCKDEV_OK, BLOCKDEV_CHECK_ALIGNMENT);
+  }
+
+  request[0].Operation   = BLOCKDEV_OP_ERASE;
+  request[0].Block       = pConfig->StartBlock + ((geometry.EraseBlocks > 1) ? 1 : 0);
+  request[0].NumOfBlocks = erase;
+  if((geometry.EraseBlocks == 0) || (geometry.EraseBlocks > 1))
+  {
+    TEST_Check(pResult, pDriver->Submit(&request[0]) != BLOCKDEV_OK, BLOCKDEV_CHECK_ERASE);
+  }
+
+  /* Write throughput, erases included */
+  start = BSP_GetCycleCount();
+  if(geometry.EraseBlocks != 0)
+  {
+    TEST_Check(pResult, BSP_BLOCKDEV_Transfer(pDriver, BLOCKDEV_OP_ERASE, NULL, pConfig->StartBlock,
+                                              pConfig->NbBlocks) == BLOCKDEV_OK, BLOCKDEV_CHECK_ERASE);
+  }
+  for(block = 0; block < pConfig->NbBlocks; block += count)
+  {
+    count = ((pConfig->NbBlocks - block) < chunk) ? (pConfig->NbBlocks - block) : chunk;
+    TEST_Fill(pWrite, count * geometry.BlockSize, block);
+    TEST_Check(pResult, BSP_BLOCKDEV_Transfer(pDriver, BLOCKDEV_OP_WRITE, pWrite, pConfig->StartBlock + block,
+                                              count) == BLOCKDEV_OK, BLOCKDEV_CHECK_DATA);
+  }
+  cycles = BSP_GetCycleCount() - start;
+  pResult->WriteKBytesPerSec = TEST_KBytesPerSec(pConfig->NbBlocks * geometry.BlockSize, cycles);
+
+  /* Read throughput, the data are compared afterwards */
+  cycles = 0;
+  for(block = 0; block < pConfig->NbBlocks; block += count)
+  {
+    count = ((pConfig->NbBlocks - block) < chunk) ? (pConfig->NbBlocks - block) : chunk;
+    start = BSP_GetCycleCount();
+    index = BSP_BLOCKDEV_Transfer(pDriver, BLOCKDEV_OP_READ, pRead, pConfig->StartBlock + block, count);
+    cycles += BSP_GetCycleCount() - start;
+    TEST_Check(pResult, (index == BLOCKDEV_OK) && (TEST_Compare(pRead, count * geometry.BlockSize, block) == 0),
+               BLOCKDEV_CHECK_DATA);
+  }
+  pResult->ReadKBytesPerSec = TEST_KBytesPerSec(pConfig->NbBlocks * geometry.BlockSize, cycles);
+
+  /* A read submitted after a write of the same block returns the written data */
+  if(geometry.EraseBlocks != 0)
+  {
+    BSP_BLOCKDEV_Transfer(pDriver, BLOCKDEV_OP_ERASE, NULL, pConfig->StartBlock, erase);
+  }
+  TEST_Fill(pWrite, geometry.BlockSize, 0x5A);
+  for(index = 0; index < 2; index++)
+  {
+    calls[index] = 0;
+    request[index].Operation   = (index == 0) ? BLOCKDEV_OP_WRITE : BLOCKDEV_OP_READ;
+    request[index].pData       = (index == 0) ? pWrite : pRead;
+    request[index].Block       = pConfig->StartBlock;
+    request[index].NumOfBlocks = 1;
+    request[index].Callback    = TEST_Callback;
+    request[index].pContext    = &calls[index];
+  }
+  if((pDriver->Submit(&request[0]) != BLOCKDEV_OK) || (pDriver->Submit(&request[1]) != BLOCKDEV_OK))
+  {
+    TEST_Check(pResult, 0, BLOCKDEV_CHECK_ORDER);
+  }
+  else
+  {
+    if((BSP_BLOCKDEV_Wait(pDriver, &request[0]) == BLOCKDEV_PENDING) ||
+       (BSP_BLOCKDEV_Wait(pDriver, &request[1]) == BLOCKDEV_PENDING))
+    {
+      /* The second request first, so that it is not issued */
+      pDriver->Cancel(&request[1]);
+      pDriver->Cancel(&request[0]);
+    }
+    TEST_Check(pResult, (request[0].Status == BLOCKDEV_OK) && (request[1].Status == BLOCKDEV_OK) &&
+               (TEST_Compare(pRead, geometry.BlockSize, 0x5A) == 0), BLOCKDEV_CHECK_ORDER);
+    TEST_Check(pResult, (calls[0] == 1) && (calls[1] == 1), BLOCKDEV_CHECK_CALLBACK);
+  }
+
+  return (pResult->Failures == 0) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Checks a request against the device geometry.
+  * @param  pGeometry: Pointer to the device geometry
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t BLOCKDEV_Check(BLOCKDEV_GeometryTypeDef *pGeometry, BLOCKDEV_RequestTypeDef *pRequest)
+{
+  if((pRequest->NumOfBlocks == 0) || (pRequest->Block >= pGeometry->NbBlocks) ||
+     (pRequest->NumOfBlocks > (pGeometry->NbBlocks - pRequest->Block)))
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  if(pRequest->Operation == BLOCKDEV_OP_ERASE)
+  {
+    if((pGeometry->EraseBlocks == 0) || ((pRequest->Block % pGeometry->EraseBlocks) != 0) ||
+       ((pRequest->NumOfBlocks % pGeometry->EraseBlocks) != 0))
+    {
+      return BLOCKDEV_ERROR;
+    }
+  }
+  else if(((pRequest->Operation != BLOCKDEV_OP_READ) && (pRequest->Operation != BLOCKDEV_OP_WRITE)) ||
+          (pRequest->pData == NULL) || (((uint32_t)pRequest->pData & (pGeometry->Alignment - 1)) != 0))
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  return BLOCKDEV_OK;
+}
+
+/**
+  * @brief  Appends a request to a device queue.
+  * @param  pQueue: Pointer to the device queue
+  * @param  pRequest: Pointer to the request
+  * @retval 1 when the queue was empty
+  */
+static uint32_t BLOCKDEV_Enqueue(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint32_t primask, empty;
+
+  pRequest->Status = BLOCKDEV_PENDING;
+  pRequest->pNext  = NULL;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  empty = (pQueue->pHead == NULL) ? 1 : 0;
+  if(empty != 0)
+  {
+    pQueue->pHead = pRequest;
+  }
+  else
+  {
+    pQueue->pTail->pNext = pRequest;
+  }
+  pQueue->pTail = pRequest;
+
+  __set_PRIMASK(primask);
+
+  return empty;
+}
+
+/**
+  * @brief  Completes the request at the head of a device queue.
+  * @param  pQueue: Pointer to the device queue
+  * @param  Status: BLOCKDEV_OK or BLOCKDEV_ERROR
+  * @retval None
+  */
+static void BLOCKDEV_Complete(BLOCKDEV_QueueTypeDef *pQueue, uint8_t Status)
+{
+  BLOCKDEV_RequestTypeDef *pRequest;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  pRequest = pQueue->pHead;
+  pQueue->pHead = pRequest->pNext;
+
+  __set_PRIMASK(primask);
+
+  /* The callback may submit the next request */
+  pRequest->Status = Status;
+  if(pRequest->Callback != NULL)
+  {
+    pRequest->Callback(pRequest);
+  }
+}
+
+/**
+  * @brief  Serves the request at the head of a device queue in polling mode.
+  * @param  pQueue: Pointer to the device queue
+  * @param  Transfer: Device transfer function
+  * @retval None
+  */
+static void BLOCKDEV_Poll(BLOCKDEV_QueueTypeDef *pQueue, uint8_t (*Transfer)(BLOCKDEV_RequestTypeDef *pRequest))
+{
+  if(pQueue->pHead != NULL)
+  {
+    BLOCKDEV_Complete(pQueue, Transfer(pQueue->pHead));
+  }
+}
+
+/**
+  * @brief  Removes a request from a device queue and completes it with an error.
+  * @param  pQueue: Pointer to the device queue
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV_OK when the request was cancelled, BLOCKDEV_ERROR when it had
+  *         already completed
+  */
+static uint8_t BLOCKDEV_Cancel(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_RequestTypeDef *previous = NULL, *request;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  request = pQueue->pHead;
+  while((request != NULL) && (request != pRequest))
+  {
+    previous = request;
+    request  = request->pNext;
+  }
+  if(request != NULL)
+  {
+    if(previous != NULL)
+    {
+      previous->pNext = pRequest->pNext;
+    }
+    else
+    {
+      pQueue->pHead = pRequest->pNext;
+    }
+    if(pQueue->pTail == pRequest)
+    {
+      pQueue->pTail = previous;
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  if(request == NULL)
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  pRequest->Status = BLOCKDEV_ERROR;
+  if(pRequest->Callback != NULL)
+  {
+    pRequest->Callback(pRequest);
+  }
+
+  return BLOCKDEV_OK;
+}
+
+/**
+  * @brief  Checks and queues a request of a device served in polling mode.
+  * @param  pQueue: Pointer to the device queue
+  * @param  pGeometry: Pointer to the device geometry
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t BLOCKDEV_Submit(BLOCKDEV_QueueTypeDef *pQueue, BLOCKDEV_GeometryTypeDef *pGeometry,
+                               BLOCKDEV_RequestTypeDef *pRequest)
+{
+  if(BLOCKDEV_Check(pGeometry, pRequest) != BLOCKDEV_OK)
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  BLOCKDEV_Enqueue(pQueue, pRequest);
+
+  return BLOCKDEV_OK;
+}
+
+/**
+  * @brief  Initializes the SD card block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t SD_BlockDevInit(void)
+{
+  BlockDevSd.Queue.pHead = NULL;
+
+  return (BSP_SD_Init() == MSD_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the SD card block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void SD_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  HAL_SD_CardInfoTypeDef info;
+
+  BSP_SD_GetCardInfo(&info);
+
+  /* Unaligned buffers are handled by the SD driver */
+  pGeometry->BlockSize   = BLOCKDEV_BLOCK_SIZE;
+  pGeometry->NbBlocks    = info.LogBlockNbr;
+  pGeometry->EraseBlocks = 1;
+  pGeometry->Alignment   = 1;
+  pGeometry->Flags       = 0;
+}
+
+/**
+  * @brief  Queues a request of the SD card block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SD_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  SD_BlockDevGetGeometry(&geometry);
+  if(BLOCKDEV_Check(&geometry, pRequest) != BLOCKDEV_OK)
+  {
+    return BLOCKDEV_ERROR;
+  }
+
+  if(BLOCKDEV_Enqueue(&BlockDevSd.Queue, pRequest) != 0)
+  {
+    SD_BlockDevStart();
+  }
+
+  return BLOCKDEV_OK;
+}
+
+/**
+  * @brief  Serves the SD card block device requests.
+  * @retval None
+  */
+static void SD_BlockDevProcess(void)
+{
+  BSP_SD_QueueProcess();
+}
+
+/**
+  * @brief  Cancels a SD card block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SD_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint8_t status;
+
+  /* Completions do not issue the next request while the queue is changed */
+  BlockDevSd.Cancelling = 1;
+
+  if((BlockDevSd.Queue.pHead == pRequest) && (BlockDevSd.Request.Status == SD_REQUEST_PENDING))
+  {
+    /* Issued to the SD request queue: its callback completes the request */
+    status = (BSP_SD_Cancel(&BlockDevSd.Request) == MSD_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+  }
+  else
+  {
+    status = BLOCKDEV_Cancel(&BlockDevSd.Queue, pRequest);
+  }
+
+  BlockDevSd.Cancelling = 0;
+  if((BlockDevSd.Queue.pHead != NULL) && (BlockDevSd.Request.Status != SD_REQUEST_PENDING))
+  {
+    SD_BlockDevStart();
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Issues the request at the head of the queue through the SD request queue.
+  * @retval None
+  */
+static void SD_BlockDevStart(void)
+{
+  BLOCKDEV_RequestTypeDef *pRequest;
+
+  while((pRequest = BlockDevSd.Queue.pHead) != NULL)
+  {
+    BlockDevSd.Request.Operation   = (pRequest->Operation == BLOCKDEV_OP_READ) ? SD_REQUEST_READ :
+                                     ((pRequest->Operation == BLOCKDEV_OP_WRITE) ? SD_REQUEST_WRITE : SD_REQUEST_ERASE);
+    BlockDevSd.Request.Priority    = SD_QUEUE_PRIORITIES - 1;
+    BlockDevSd.Request.pData       = (uint32_t *)pRequest->pData;
+    BlockDevSd.Request.BlockAddr   = pRequest->Block;
+    BlockDevSd.Request.NumOfBlocks = pRequest->NumOfBlocks;
+    BlockDevSd.Request.Callback    = SD_BlockDevCallback;
+    BlockDevSd.Request.pContext    = NULL;
+
+    if(BSP_SD_Submit(&BlockDevSd.Request) == MSD_OK)
+    {
+      break;
+    }
+
+    BLOCKDEV_Complete(&BlockDevSd.Queue, BLOCKDEV_ERROR);
+  }
+}
+
+/**
+  * @brief  Completes the SD card block device request and issues the next one.
+  * @param  pRequest: Pointer to the completed SD request
+  * @retval None
+  */
+static void SD_BlockDevCallback(SD_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_Complete(&BlockDevSd.Queue, (pRequest->Status == MSD_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR);
+
+  if(BlockDevSd.Cancelling == 0)
+  {
+    SD_BlockDevStart();
+  }
+}
+
+/**
+  * @brief  Initializes the NOR block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t NOR_BlockDevInit(void)
+{
+  BlockDevNor.pHead = NULL;
+
+  return (BSP_NOR_Init() == NOR_STATUS_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the NOR block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void NOR_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  pGeometry->BlockSize   = BLOCKDEV_BLOCK_SIZE;
+  pGeometry->NbBlocks    = BLOCKDEV_NOR_SIZE / BLOCKDEV_BLOCK_SIZE;
+  pGeometry->EraseBlocks = BLOCKDEV_NOR_ERASE_SIZE / BLOCKDEV_BLOCK_SIZE;
+  pGeometry->Alignment   = 2;
+  pGeometry->Flags       = BLOCKDEV_FLAG_ERASE_BEFORE_WRITE;
+}
+
+/**
+  * @brief  Queues a request of the NOR block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t NOR_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  NOR_BlockDevGetGeometry(&geometry);
+
+  return BLOCKDEV_Submit(&BlockDevNor, &geometry, pRequest);
+}
+
+/**
+  * @brief  Serves the next NOR block device request.
+  * @retval None
+  */
+static void NOR_BlockDevProcess(void)
+{
+  BLOCKDEV_Poll(&BlockDevNor, NOR_BlockDevTransfer);
+}
+
+/**
+  * @brief  Cancels a NOR block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t NOR_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  return BLOCKDEV_Cancel(&BlockDevNor, pRequest);
+}
+
+/**
+  * @brief  Transfers a NOR block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t NOR_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint32_t address = pRequest->Block * BLOCKDEV_BLOCK_SIZE;
+  uint32_t size = pRequest->NumOfBlocks * BLOCKDEV_BLOCK_SIZE;
+  uint8_t status = NOR_STATUS_OK;
+
+  switch(pRequest->Operation)
+  {
+  case BLOCKDEV_OP_READ:
+    status = BSP_NOR_ReadData(address, (uint16_t *)pRequest->pData, size / 2);
+    break;
+
+  case BLOCKDEV_OP_WRITE:
+    status = BSP_NOR_WriteData(address, (uint16_t *)pRequest->pData, size / 2);
+    break;
+
+  default:
+    for(; (size != 0) && (status == NOR_STATUS_OK); size -= BLOCKDEV_NOR_ERASE_SIZE)
+    {
+      status = BSP_NOR_Erase_Block(address);
+      address += BLOCKDEV_NOR_ERASE_SIZE;
+    }
+    break;
+  }
+
+  return (status == NOR_STATUS_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Initializes the SRAM block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t SRAM_BlockDevInit(void)
+{
+  BlockDevSram.pHead = NULL;
+
+  return (BSP_SRAM_Init() == SRAM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the SRAM block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void SRAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  pGeometry->BlockSize   = BLOCKDEV_BLOCK_SIZE;
+  pGeometry->NbBlocks    = SRAM_DEVICE_SIZE / BLOCKDEV_BLOCK_SIZE;
+  pGeometry->EraseBlocks = 0;
+  pGeometry->Alignment   = 2;
+  pGeometry->Flags       = 0;
+}
+
+/**
+  * @brief  Queues a request of the SRAM block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SRAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  SRAM_BlockDevGetGeometry(&geometry);
+
+  return BLOCKDEV_Submit(&BlockDevSram, &geometry, pRequest);
+}
+
+/**
+  * @brief  Serves the next SRAM block device request.
+  * @retval None
+  */
+static void SRAM_BlockDevProcess(void)
+{
+  BLOCKDEV_Poll(&BlockDevSram, SRAM_BlockDevTransfer);
+}
+
+/**
+  * @brief  Cancels a SRAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SRAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  return BLOCKDEV_Cancel(&BlockDevSram, pRequest);
+}
+
+/**
+  * @brief  Transfers a SRAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SRAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint32_t address = SRAM_DEVICE_ADDR + (pRequest->Block * BLOCKDEV_BLOCK_SIZE);
+  uint32_t size = (pRequest->NumOfBlocks * BLOCKDEV_BLOCK_SIZE) / 2;
+  uint8_t status;
+
+  if(pRequest->Operation == BLOCKDEV_OP_READ)
+  {
+    status = BSP_SRAM_ReadData(address, (uint16_t *)pRequest->pData, size);
+  }
+  else
+  {
+    status = BSP_SRAM_WriteData(address, (uint16_t *)pRequest->pData, size);
+  }
+
+  return (status == SRAM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Initializes the SDRAM block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t SDRAM_BlockDevInit(void)
+{
+  BlockDevSdram.pHead = NULL;
+
+  return (BSP_SDRAM_Init() == SDRAM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the SDRAM block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void SDRAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  pGeometry->BlockSize   = BLOCKDEV_BLOCK_SIZE;
+  pGeometry->NbBlocks    = SDRAM_DEVICE_SIZE / BLOCKDEV_BLOCK_SIZE;
+  pGeometry->EraseBlocks = 0;
+  pGeometry->Alignment   = 4;
+  pGeometry->Flags       = 0;
+}
+
+/**
+  * @brief  Queues a request of the SDRAM block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SDRAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  SDRAM_BlockDevGetGeometry(&geometry);
+
+  return BLOCKDEV_Submit(&BlockDevSdram, &geometry, pRequest);
+}
+
+/**
+  * @brief  Serves the next SDRAM block device request.
+  * @retval None
+  */
+static void SDRAM_BlockDevProcess(void)
+{
+  BLOCKDEV_Poll(&BlockDevSdram, SDRAM_BlockDevTransfer);
+}
+
+/**
+  * @brief  Cancels a SDRAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SDRAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  return BLOCKDEV_Cancel(&BlockDevSdram, pRequest);
+}
+
+/**
+  * @brief  Transfers a SDRAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t SDRAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint32_t address = SDRAM_DEVICE_ADDR + (pRequest->Block * BLOCKDEV_BLOCK_SIZE);
+  uint32_t size = (pRequest->NumOfBlocks * BLOCKDEV_BLOCK_SIZE) / 4;
+  uint8_t status;
+
+  if(pRequest->Operation == BLOCKDEV_OP_READ)
+  {
+    status = BSP_SDRAM_ReadData(address, (uint32_t *)pRequest->pData, size);
+  }
+  else
+  {
+    status = BSP_SDRAM_WriteData(address, (uint32_t *)pRequest->pData, size);
+  }
+
+  return (status == SDRAM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Initializes the EEPROM block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t EEPROM_BlockDevInit(void)
+{
+  BlockDevEeprom.pHead = NULL;
+
+  return (BSP_EEPROM_Init() == EEPROM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the EEPROM block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void EEPROM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  pGeometry->BlockSize   = BLOCKDEV_EEPROM_BLOCK_SIZE;
+  pGeometry->NbBlocks    = EEPROM_MAX_SIZE / BLOCKDEV_EEPROM_BLOCK_SIZE;
+  pGeometry->EraseBlocks = 0;
+  pGeometry->Alignment   = 1;
+  pGeometry->Flags       = 0;
+}
+
+/**
+  * @brief  Queues a request of the EEPROM block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t EEPROM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  EEPROM_BlockDevGetGeometry(&geometry);
+
+  return BLOCKDEV_Submit(&BlockDevEeprom, &geometry, pRequest);
+}
+
+/**
+  * @brief  Serves the next EEPROM block device request.
+  * @retval None
+  */
+static void EEPROM_BlockDevProcess(void)
+{
+  BLOCKDEV_Poll(&BlockDevEeprom, EEPROM_BlockDevTransfer);
+}
+
+/**
+  * @brief  Cancels an EEPROM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t EEPROM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  return BLOCKDEV_Cancel(&BlockDevEeprom, pRequest);
+}
+
+/**
+  * @brief  Transfers an EEPROM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t EEPROM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint16_t address = (uint16_t)(pRequest->Block * BLOCKDEV_EEPROM_BLOCK_SIZE);
+  uint16_t size = (uint16_t)(pRequest->NumOfBlocks * BLOCKDEV_EEPROM_BLOCK_SIZE);
+  uint32_t status;
+
+  if(pRequest->Operation == BLOCKDEV_OP_READ)
+  {
+    status = BSP_EEPROM_ReadBuffer(pRequest->pData, address, &size);
+  }
+  else
+  {
+    status = BSP_EEPROM_WriteBuffer(pRequest->pData, address, size);
+  }
+
+  return (status == EEPROM_OK) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Initializes the RAM block device.
+  * @retval BLOCKDEV status
+  */
+static uint8_t RAM_BlockDevInit(void)
+{
+  BlockDevRam.Queue.pHead = NULL;
+
+  return ((BlockDevRam.pMemory != NULL) && (BlockDevRam.BlockSize != 0)) ? BLOCKDEV_OK : BLOCKDEV_ERROR;
+}
+
+/**
+  * @brief  Gets the RAM block device geometry.
+  * @param  pGeometry: Pointer to the geometry
+  * @retval None
+  */
+static void RAM_BlockDevGetGeometry(BLOCKDEV_GeometryTypeDef *pGeometry)
+{
+  pGeometry->BlockSize   = BlockDevRam.BlockSize;
+  pGeometry->NbBlocks    = BlockDevRam.NbBlocks;
+  pGeometry->EraseBlocks = 0;
+  pGeometry->Alignment   = 1;
+  pGeometry->Flags       = 0;
+}
+
+/**
+  * @brief  Queues a request of the RAM block device.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t RAM_BlockDevSubmit(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  BLOCKDEV_GeometryTypeDef geometry;
+
+  RAM_BlockDevGetGeometry(&geometry);
+
+  return BLOCKDEV_Submit(&BlockDevRam.Queue, &geometry, pRequest);
+}
+
+/**
+  * @brief  Serves the next RAM block device request.
+  * @retval None
+  */
+static void RAM_BlockDevProcess(void)
+{
+  BLOCKDEV_Poll(&BlockDevRam.Queue, RAM_BlockDevTransfer);
+}
+
+/**
+  * @brief  Cancels a RAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t RAM_BlockDevCancel(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  return BLOCKDEV_Cancel(&BlockDevRam.Queue, pRequest);
+}
+
+/**
+  * @brief  Transfers a RAM block device request.
+  * @param  pRequest: Pointer to the request
+  * @retval BLOCKDEV status
+  */
+static uint8_t RAM_BlockDevTransfer(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  uint8_t *pMemory = BlockDevRam.pMemory + (pRequest->Block * BlockDevRam.BlockSize);
+  uint32_t size = pRequest->NumOfBlocks * BlockDevRam.BlockSize;
+  uint32_t index;
+
+  for(index = 0; index < size; index++)
+  {
+    if(pRequest->Operation == BLOCKDEV_OP_READ)
+    {
+      pRequest->pData[index] = pMemory[index];
+    }
+    else
+    {
+      pMemory[index] = pRequest->pData[index];
+    }
+  }
+
+  return BLOCKDEV_OK;
+}
+
+/**
+  * @brief  Records the result of a conformance check.
+  * @param  pResult: Pointer to the test result
+  * @param  Condition: Non zero when the check passed
+  * @param  Check: BLOCKDEV_CHECK_xxx
+  * @retval None
+  */
+static void TEST_Check(BLOCKDEV_TestResultTypeDef *pResult, uint32_t Condition, uint32_t Check)
+{
+  pResult->Checks++;
+  if(Condition == 0)
+  {
+    if(pResult->Failures == 0)
+    {
+      pResult->FirstFailure = Check;
+    }
+    pResult->Failures++;
+  }
+}
+
+/**
+  * @brief  Fills a buffer with the test pattern.
+  * @param  pData: Buffer
+  * @param  Size: Size in bytes
+  * @param  Seed: Pattern seed
+  * @retval None
+  */
+static void TEST_Fill(uint8_t *pData, uint32_t Size, uint32_t Seed)
+{
+  uint32_t index;
+
+  for(index = 0; index < Size; index++)
+  {
+    pData[index] = (uint8_t)((Seed * 0x9D) + (index * 7) + (index >> 8));
+  }
+}
+
+/**
+  * @brief  Compares a buffer with the test pattern.
+  * @param  pData: Buffer
+  * @param  Size: Size in bytes
+  * @param  Seed: Pattern seed
+  * @retval Number of differing bytes
+  */
+static uint32_t TEST_Compare(uint8_t *pData, uint32_t Size, uint32_t Seed)
+{
+  uint32_t index, errors = 0;
+
+  for(index = 0; index < Size; index++)
+  {
+    if(pData[index] != (uint8_t)((Seed * 0x9D) + (index * 7) + (index >> 8)))
+    {
+      errors++;
+    }
+  }
+
+  return errors;
+}
+
+/**
+  * @brief  Counts the completion callbacks of a test request.
+  * @param  pRequest: Pointer to the completed request
+  * @retval None
+  */
+static void TEST_Callback(BLOCKDEV_RequestTypeDef *pRequest)
+{
+  (*(uint32_t *)pRequest->pContext)++;
+}
+
+/**
+  * @brief  Converts a transfer size and duration to a throughput.
+  * @param  Bytes: Transferred bytes
+  * @param  Cycles: Transfer duration in CPU cycles
+  * @retval Throughput in KiB/s
+  */
+static uint32_t TEST_KBytesPerSec(uint32_t Bytes, uint32_t Cycles)
+{
+  if(Cycles == 0)
+  {
+    return 0;
+  }
+
+  return (uint32_t)(((uint64_t)Bytes * SystemCoreClock) / ((uint64_t)Cycles * 1024));
+}
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
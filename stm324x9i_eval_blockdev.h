@@ -0,0 +1,205 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_blockdev.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_blockdev.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_BLOCKDEV_H
+#define __STM324x9I_EVAL_BLOCKDEV_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sd.h"
+#include "stm324x9i_eval_nor.h"
+#include "stm324x9i_eval_sram.h"
+#include "stm324x9i_eval_sdram.h"
+#include "stm324x9i_eval_eeprom.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_BLOCKDEV
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Exported_Types STM324x9I EVAL BLOCKDEV Exported Types
+  * @{
+  */
+
+/**
+  * @brief  Block device geometry
+  */
+typedef struct
+{
+  uint32_t BlockSize;       /* Block size in bytes                                       */
+  uint32_t NbBlocks;        /* Number of blocks                                          */
+  uint32_t EraseBlocks;     /* Erase unit in blocks, 0 when the device has no erase      */
+  uint32_t Alignment;       /* Required data buffer alignment in bytes                   */
+  uint32_t Flags;           /* BLOCKDEV_FLAG_xxx                                         */
+}BLOCKDEV_GeometryTypeDef;
+
+/**
+  * @brief  Block device request, owned by the driver until its completion
+  */
+typedef struct __BLOCKDEV_RequestTypeDef
+{
+  uint32_t Operation;       /* BLOCKDEV_OP_READ, BLOCKDEV_OP_WRITE or BLOCKDEV_OP_ERASE  */
+  uint8_t  *pData;          /* Data buffer, unused for erase                             */
+  uint32_t Block;           /* First block                                               */
+  uint32_t NumOfBlocks;     /* Number of blocks                                          */
+  void     (*Callback)(struct __BLOCKDEV_RequestTypeDef *pRequest); /* Completion callback, can be NULL */
+  void     *pContext;       /* Caller context                                            */
+  __IO uint8_t Status;      /* BLOCKDEV_PENDING until completion, then BLOCKDEV_OK or BLOCKDEV_ERROR */
+  struct __BLOCKDEV_RequestTypeDef *pNext; /* Queue link, driver internal                */
+}BLOCKDEV_RequestTypeDef;
+
+/**
+  * @brief  Block device driver structure definition
+  */
+typedef struct
+{
+  uint8_t  (*Init)(void);
+  void     (*GetGeometry)(BLOCKDEV_GeometryTypeDef *pGeometry);
+  uint8_t  (*Submit)(BLOCKDEV_RequestTypeDef *pRequest);
+  void     (*Process)(void);
+  uint8_t  (*Cancel)(BLOCKDEV_RequestTypeDef *pRequest);
+}BLOCKDEV_DrvTypeDef;
+
+/**
+  * @brief  Block device test configuration
+  */
+typedef struct
+{
+  uint8_t  *pBuffer;        /* Test buffer, aligned on 4 bytes                           */
+  uint32_t BufferSize;      /* Test buffer size in bytes, at least two blocks            */
+  uint32_t StartBlock;      /* First block of the test area, aligned on the erase unit   */
+  uint32_t NbBlocks;        /* Size of the test area in blocks, multiple of the erase unit */
+}BLOCKDEV_TestConfigTypeDef;
+
+/**
+  * @brief  Block device test result
+  */
+typedef struct
+{
+  uint32_t Checks;          /* Conformance checks run                           */
+  uint32_t Failures;        /* Conformance checks failed                        */
+  uint32_t FirstFailure;    /* First failed check, BLOCKDEV_CHECK_xxx           */
+  uint32_t ReadKBytesPerSec;  /* Read throughput in KiB/s                       */
+  uint32_t WriteKBytesPerSec; /* Write throughput in KiB/s, erases included     */
+}BLOCKDEV_TestResultTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Exported_Constants STM324x9I EVAL BLOCKDEV Exported Constants
+  * @{
+  */
+/**
+  * @brief  Block device status definition
+  */
+#define BLOCKDEV_OK              ((uint8_t)0x00)
+#define BLOCKDEV_ERROR           ((uint8_t)0x01)
+#define BLOCKDEV_PENDING         ((uint8_t)0xFF)
+
+#define BLOCKDEV_OP_READ         ((uint32_t)0x00)
+#define BLOCKDEV_OP_WRITE        ((uint32_t)0x01)
+#define BLOCKDEV_OP_ERASE        ((uint32_t)0x02)
+
+/* Written blocks must have been erased before */
+#define BLOCKDEV_FLAG_ERASE_BEFORE_WRITE ((uint32_t)0x01)
+
+/* Conformance checks of BSP_BLOCKDEV_Test() */
+#define BLOCKDEV_CHECK_NONE      ((uint32_t)0x00)
+#define BLOCKDEV_CHECK_GEOMETRY  ((uint32_t)0x01)
+#define BLOCKDEV_CHECK_RANGE     ((uint32_t)0x02)
+#define BLOCKDEV_CHECK_ALIGNMENT ((uint32_t)0x03)
+#define BLOCKDEV_CHECK_ERASE     ((uint32_t)0x04)
+#define BLOCKDEV_CHECK_DATA      ((uint32_t)0x05)
+#define BLOCKDEV_CHECK_ORDER     ((uint32_t)0x06)
+#define BLOCKDEV_CHECK_CALLBACK  ((uint32_t)0x07)
+
+/* Completion timeout of a request in ms */
+#define BLOCKDEV_TIMEOUT         ((uint32_t)5000)
+
+/* NOR device geometry */
+#if !defined(BLOCKDEV_NOR_SIZE)
+ #define BLOCKDEV_NOR_SIZE        ((uint32_t)0x1000000)  /* NOR device size in Bytes       */
+#endif
+#if !defined(BLOCKDEV_NOR_ERASE_SIZE)
+ #define BLOCKDEV_NOR_ERASE_SIZE  ((uint32_t)0x20000)    /* NOR erase block size in Bytes */
+#endif
+
+/* Block sizes of the memory devices */
+#define BLOCKDEV_BLOCK_SIZE      ((uint32_t)512)
+#if !defined(BLOCKDEV_EEPROM_BLOCK_SIZE)
+ #define BLOCKDEV_EEPROM_BLOCK_SIZE ((uint32_t)32)
+#endif
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Exported_Variables STM324x9I EVAL BLOCKDEV Exported Variables
+  * @{
+  */
+extern BLOCKDEV_DrvTypeDef sd_blockdev_drv;
+extern BLOCKDEV_DrvTypeDef nor_blockdev_drv;
+extern BLOCKDEV_DrvTypeDef sram_blockdev_drv;
+extern BLOCKDEV_DrvTypeDef sdram_blockdev_drv;
+extern BLOCKDEV_DrvTypeDef eeprom_blockdev_drv;
+extern BLOCKDEV_DrvTypeDef ram_blockdev_drv;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_BLOCKDEV_Exported_Functions STM324x9I EVAL BLOCKDEV Exported Functions
+  * @{
+  */
+void    BSP_BLOCKDEV_RAM_Config(uint8_t *pMemory, uint32_t BlockSize, uint32_t NbBlocks);
+uint8_t BSP_BLOCKDEV_Wait(BLOCKDEV_DrvTypeDef *pDriver, BLOCKDEV_RequestTypeDef *pRequest);
+uint8_t BSP_BLOCKDEV_Transfer(BLOCKDEV_DrvTypeDef *pDriver, uint32_t Operation, uint8_t *pData,
+                              uint32_t Block, uint32_t NumOfBlocks);
+uint8_t BSP_BLOCKDEV_Test(BLOCKDEV_DrvTypeDef *pDriver, BLOCKDEV_TestConfigTypeDef *pConfig,
+                          BLOCKDEV_TestResultTypeDef *pResult);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_BLOCKDEV_H */
@@ -34,6 +34,20 @@
       - BSP_CAMERA_Resume()
       - BSP_CAMERA_Stop()
       
+  + Standby
+     o BSP_CAMERA_Standby() stops the capture and puts the sensor in standby
+       through the XSDN pin, keeping the DCMI and the IO expander configured.
+       A few output format registers are read back into a register image.
+     o BSP_CAMERA_Wakeup() releases the standby pin and compares the image
+       with the sensor registers. When the sensor kept its configuration,
+       the capture can be restarted without any further programming,
+       otherwise the sensor is reprogrammed with the resolution, the
+       registers written through the register sequence loader since
+       BSP_CAMERA_Init() (such as the YUV422 format) and the last contrast,
+       brightness and effect settings.
+     o The wakeup duration and the wakeup to first frame time are returned
+       by BSP_CAMERA_GetWakeupStats().
+      
   + Options
      o Increase or decrease on the fly the brightness and/or contrast
        using the following function:
@@ -41,6 +55,143 @@
      o Add a special effect on the fly using the following functions:
        - BSP_CAMERA_BlackWhiteConfig()
        - BSP_CAMERA_ColorEffectConfig()  
+
+  + Capture window
+     o A region of interest is captured with BSP_CAMERA_ConfigCrop(), the DMA
+       then only transfers the window (BSP_CAMERA_GetCaptureSize() returns the
+       buffer size to reserve). BSP_CAMERA_DisableCrop() restores the full frame.
+     o Frames can be decimated with BSP_CAMERA_ConfigCaptureRate() to capture
+       one frame out of two or four.
+
+  + Frame ring
+     o To capture continuously without the application reading a frame while
+       the DCMI overwrites it, reserve NbFrames consecutive frame buffers (e.g.
+       in SDRAM) and call BSP_CAMERA_RingInit() then BSP_CAMERA_RingStart()
+       instead of BSP_CAMERA_ContinuousStart().
+     o Each frame is captured in snapshot mode in its own slot; at the end of
+       the frame the capture is re-armed on the next free slot.
+     o Completed frames are taken in capture order with BSP_CAMERA_RingAcquire()
+       and given back with BSP_CAMERA_RingRelease(). When no slot is free, the
+       oldest ready frame is recycled and counted as dropped (see
+       BSP_CAMERA_RingGetStats()).
+
+  + Line streaming
+     o When the processing only needs a few lines at a time, the capture can
+       use a small circular buffer of RingLines lines instead of a full frame
+       buffer: start it with BSP_CAMERA_LineStreamStart().
+     o Every BatchLines lines, the lines are given to the user processing
+       implemented in BSP_CAMERA_LineBatchCallback(), called under the DCMI
+       interrupt. The processing must complete before the DMA wraps on the
+       batch, otherwise the batch is counted as an overflow and skipped (see
+       BSP_CAMERA_LineStreamGetStats()). A batch overwritten while it is
+       processed is also counted as an overflow.
+     o The laps of the DMA on the line buffer are counted by the DMA transfer
+       complete interrupt, raised above the DCMI interrupt while streaming, so
+       that a processing longer than RingLines lines is detected.
+
+  + YUV422 capture
+     o BSP_CAMERA_InitEx() with CAMERA_PIXEL_FORMAT_YUV422 configures the
+       sensor to output YUYV pixels instead of RGB565. The frame size is the
+       same, the RGB565 functions (motion detection, kernels, auto-exposure,
+       preview) must not be used on these frames.
+     o BSP_CAMERA_YUV422ToPlanar() splits YUYV lines into a Y plane and
+       optionally the U and V planes, horizontally subsampled. The Y plane
+       can be given to the CAMERA_PIXEL_FORMAT_Y8 kernels.
+     o BSP_CAMERA_PlanarStreamStart() starts the line streaming and splits
+       each batch of lines into the planes, at the batch position in the
+       frame, before calling BSP_CAMERA_LineBatchCallback(). The lines of the
+       planes can then be processed from the callback, or the complete
+       planes on the frame event.
+
+  + Telemetry
+     o The VSYNC events are timestamped with the DWT cycle counter.
+       BSP_CAMERA_GetTelemetry() returns the frame rate, the frame period
+       statistics and jitter histogram, and the VSYNC, frame, overrun,
+       synchronization and DMA error counts. BSP_CAMERA_ResetTelemetry()
+       restarts the counts.
+     o The period is timed from VSYNC to VSYNC, so neither the capture rate nor
+       the transfer end delays it. In snapshot mode the DCMI HAL disables the
+       VSYNC interrupt at the end of the frame: the frame events then time the
+       period.
+
+  + Motion detection
+     o BSP_CAMERA_MotionInit() configures the block size, the threshold and the
+       background and mask buffers, then BSP_CAMERA_MotionDetect() is called on
+       each frame (e.g. a frame acquired from the frame ring).
+     o The sum of absolute differences between the frame and the background
+       model is computed per block, four pixels at a time with the Cortex-M4
+       SIMD instructions (USADA8). RGB565 pixels are compared on their green
+       component, which carries most of the luminance.
+     o The background follows the scene slowly (1/4 of the difference per
+       frame) on the blocks that were not in motion in the previous frame.
+
+  + Frame processing kernels
+     o The following functions process the RGB565 frames of the capture path
+       (pBuffer, Width and Height of an acquired frame), reading and writing
+       32-bit words. Buffers must be word aligned and the width a multiple of
+       4 pixels (4 x Factor for the downscale):
+      - BSP_CAMERA_RGB565ToGray(): 8-bit luma plane
+      - BSP_CAMERA_RGB565ToYUV(): Y plane and horizontally subsampled U and V
+        planes (YUV 4:2:2 planar)
+      - BSP_CAMERA_Downscale(): 2x2 or 4x4 box filter, RGB565 or luma frames
+      - BSP_CAMERA_Histogram(): 256-bin luma histogram, optionally subsampled
+     o The luma and chroma are computed with the BT.601 full range integer
+       coefficients:
+         Y = (77 R + 150 G + 29 B + 128) >> 8
+         U = ((-43 R - 85 G + 128 B) >> 8) + 128
+         V = ((128 R - 107 G - 21 B) >> 8) + 128
+       where R, G and B are the RGB565 components expanded to 8 bits.
+
+  + Auto-exposure and white balance
+     o BSP_CAMERA_AutoInit() configures the target luma and the update rate,
+       then BSP_CAMERA_AutoProcess() is called on the live RGB565 frames.
+     o The exposure is corrected from the subsampled luma histogram by moving
+       the brightness level one step at a time through the camera driver
+       Config path (keeping the contrast set by
+       BSP_CAMERA_ContrastBrightnessConfig()).
+     o The white balance computes gray-world gains and programs the OV2640
+       manual white balance gains.
+     o The sensor is updated at most once per UpdatePeriod and only when a
+       setting changes, to keep the I2C bus available.
+
+  + Register sequences
+     o BSP_CAMERA_LoadRegisters() writes a table of register/value pairs to
+       the sensor. A shadow of the values written by the loader is kept per
+       register bank so that:
+      - registers already holding the target value are skipped,
+      - the bank select register is only written when the bank changes.
+       The sensor reset registers are never cached and a software reset
+       through COM7 invalidates the shadow. The shadow is also invalidated
+       each time the camera component driver programs the sensor.
+     o When CAMERA_SCCB_BURST_WRITE is set to 1, consecutive registers are
+       written in bursts of up to CAMERA_BURST_MAX_LENGTH bytes. This needs a
+       sensor incrementing the register address, which SCCB does not
+       guarantee, hence it is disabled by default.
+     o BSP_CAMERA_LoadRegisters_Start() followed by periodic calls to
+       BSP_CAMERA_LoadRegisters_Process() load a sequence without blocking:
+       each call issues a single I2C transaction and returns CAMERA_BUSY
+       until the sequence is complete. The I2C bus being shared by the BSP
+       drivers in polling mode, the transfers themselves remain blocking.
+     o The written, skipped and transaction counts and the duration of the
+       last sequence are returned by BSP_CAMERA_GetLoaderStats().
+
+  + Preview
+     o BSP_CAMERA_PreviewStart() displays the live video on an LCD layer
+       without CPU copies:
+      - When the layer is RGB565 with the camera frame size and the window
+        starts at (0,0), the layer scans out the camera buffer directly.
+      - Otherwise, each completed frame is converted by a DMA2D M2M_PFC
+        transfer into the layer window at (Xpos, Ypos). In this case the
+        function BSP_CAMERA_DMA2D_IRQHandler() must be called in the
+        DMA2D_IRQHandler() and the DMA2D must not be used by the LCD drawing
+        functions at the same time.
+     o Giving a NULL buffer previews the frames of the running frame ring. The
+       slot being converted is not recycled by the capture until the end of
+       the DMA2D transfer.
+     o BSP_CAMERA_PreviewStop() gives back its frame buffer to a layer which
+       was scanning out the camera buffer.
+     o The displayed frame rate and the frame end to display latency are
+       returned by BSP_CAMERA_PreviewGetStats().
       
 ------------------------------------------------------------------------------*/
 
@@ -65,6 +216,187 @@
 static DCMI_HandleTypeDef  hdcmi_eval;
        CAMERA_DrvTypeDef   *camera_drv;
 uint32_t current_resolution;
+
+/* Sensor output pixel format */
+static uint32_t CameraPixelFormat = CAMERA_PIXEL_FORMAT_RGB565;
+
+/* Captured window, full frame or crop window */
+static struct
+{
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t FullWidth;
+  uint32_t FullHeight;
+}CameraWindow;
+
+/* Camera frame ring slot states */
+#define CAMERA_SLOT_FREE         ((uint8_t)0x00)
+#define CAMERA_SLOT_CAPTURING    ((uint8_t)0x01)
+#define CAMERA_SLOT_READY        ((uint8_t)0x02)
+#define CAMERA_SLOT_HELD         ((uint8_t)0x03)
+
+/* Camera frame ring context */
+static struct
+{
+  uint32_t BufferAddress;
+  uint32_t FrameSize;
+  uint32_t NbFrames;
+  uint32_t Active;
+  uint32_t CaptureSlot;
+  uint32_t Sequence;
+  uint32_t Dropped;
+  __IO uint8_t  State[CAMERA_RING_MAX_FRAMES];
+  uint32_t Timestamp[CAMERA_RING_MAX_FRAMES];
+  uint32_t SlotSequence[CAMERA_RING_MAX_FRAMES];
+  uint32_t LastSlot;
+  __IO uint32_t PreviewSlot;   /* Slot read by the preview DMA2D transfer, CAMERA_RING_MAX_FRAMES if none */
+}CameraRing;
+
+/* Camera line streaming context */
+static struct
+{
+  uint32_t Active;
+  uint32_t Buffer;
+  uint32_t LineSize;
+  uint32_t RingLines;
+  uint32_t BatchLines;
+  __IO uint32_t Laps;       /* Laps of the DMA on the line buffer */
+  void (*XferCplt)(DMA_HandleTypeDef *hdma); /* DCMI handler of the DMA laps */
+  uint32_t WrittenLines;
+  uint32_t DeliveredLines;
+  uint8_t  *pY;             /* Planes of BSP_CAMERA_PlanarStreamStart() */
+  uint8_t  *pU;
+  uint8_t  *pV;
+  CAMERA_LineStreamStatsTypeDef Stats;
+}CameraLineStream;
+
+/* Camera telemetry context */
+static struct
+{
+  uint32_t LastCycles;      /* Start of the current frame period          */
+  uint32_t Started;         /* LastCycles is valid                         */
+  uint32_t VsyncSeen;       /* VSYNC received since the last frame event   */
+  uint32_t Periods;
+  CAMERA_TelemetryTypeDef Data;
+}CameraTelemetry;
+
+/* Camera motion detection context */
+static struct
+{
+  CAMERA_MotionConfigTypeDef Config;
+  uint32_t Frames;
+}CameraMotion;
+
+/* OV2640 registers of the manual white balance (DSP bank) */
+#define OV2640_BANK_SEL          ((uint8_t)0xFF)
+#define OV2640_BANK_DSP          ((uint8_t)0x00)
+#define OV2640_AWB_CTRL          ((uint8_t)0xC7)
+#define OV2640_AWB_MANUAL        ((uint8_t)0x40)
+#define OV2640_AWB_GAIN_R        ((uint8_t)0xCC)
+#define OV2640_AWB_GAIN_G        ((uint8_t)0xCD)
+#define OV2640_AWB_GAIN_B        ((uint8_t)0xCE)
+
+/* White balance gains range, 0x40 = 1.0 */
+#define CAMERA_AWB_GAIN_UNITY    ((uint32_t)0x40)
+#define CAMERA_AWB_GAIN_MIN      ((uint32_t)0x20)
+#define CAMERA_AWB_GAIN_MAX      ((uint32_t)0x7F)
+
+/* Camera auto-exposure and white balance context */
+static const uint32_t CameraBrightnessLevels[] = 
+{
+  CAMERA_BRIGHTNESS_LEVEL0, CAMERA_BRIGHTNESS_LEVEL1, CAMERA_BRIGHTNESS_LEVEL2,
+  CAMERA_BRIGHTNESS_LEVEL3, CAMERA_BRIGHTNESS_LEVEL4
+};
+static uint32_t CameraContrastLevel = CAMERA_CONTRAST_LEVEL2;
+static uint32_t CameraBrightnessLevel = CAMERA_BRIGHTNESS_LEVEL2;
+static struct
+{
+  CAMERA_AutoConfigTypeDef Config;
+  CAMERA_AutoStatusTypeDef Status;
+  uint32_t LastUpdate;
+  uint32_t Histogram[256];
+}CameraAuto;
+
+/* OV2640 register banks and reset registers */
+#define OV2640_BANK_SENSOR       ((uint8_t)0x01)
+#define OV2640_DSP_RESET         ((uint8_t)0xE0)
+#define OV2640_SENSOR_COM7       ((uint8_t)0x12)
+#define OV2640_COM7_SRST         ((uint8_t)0x80)
+
+/* Camera register sequence loader context, the shadow and the replay log are
+   cleared by BSP_CAMERA_Init() */
+#define CAMERA_SHADOW_BANKS      ((uint32_t)2)
+static struct
+{
+  uint8_t  Value[CAMERA_SHADOW_BANKS][256];
+  uint32_t Valid[CAMERA_SHADOW_BANKS][256 / 32];
+  uint32_t Replay[CAMERA_SHADOW_BANKS][256 / 32]; /* Registers written since BSP_CAMERA_Init(), kept by
+                                                     BSP_CAMERA_InvalidateRegisters() for STANDBY_Reload() */
+  uint32_t Bank;            /* CAMERA_SHADOW_BANKS when unknown */
+  const CAMERA_RegTypeDef *pSequence;
+  uint32_t Count;
+  uint32_t Index;
+  uint32_t StartCycles;
+  CAMERA_LoaderStatsTypeDef Stats;
+}CameraLoader;
+
+/* OV2640 output format registers (DSP bank) checked on wakeup */
+static const uint8_t CameraStandbyRegisters[] = 
+{
+  0xC0, /* HSIZE8 */
+  0xC1, /* VSIZE8 */
+  0x5A, /* ZMOW */
+  0x5B, /* ZMOH */
+  0x86, /* CTRL2 */
+  0x87, /* CTRL3 */
+  0xDA  /* IMAGE_MODE */
+};
+#define CAMERA_STANDBY_REGISTERS (sizeof(CameraStandbyRegisters) / sizeof(CameraStandbyRegisters[0]))
+
+/* OV2640 DSP settings of the YUYV output */
+static const CAMERA_RegTypeDef CameraYUV422Registers[] = 
+{
+  {0xFF, 0x00},  /* DSP bank */
+  {0xE0, 0x04},  /* DVP reset */
+  {0xDA, 0x00},  /* IMAGE_MODE: YUV422 */
+  {0xD7, 0x03},
+  {0x33, 0xA0},
+  {0xE5, 0x1F},
+  {0xE1, 0x67},
+  {0xE0, 0x00},  /* Release the reset */
+  {0x05, 0x00}   /* Use the DSP */
+};
+
+/* Camera standby context */
+static struct
+{
+  uint32_t Active;
+  uint8_t  Image[CAMERA_STANDBY_REGISTERS];
+  uint32_t Effect;          /* Last effect feature, 0xFFFFFFFF if none */
+  uint32_t EffectValue;
+  uint32_t WakeupStartCycles;
+  __IO uint32_t FirstFramePending;
+  CAMERA_WakeupStatsTypeDef Stats;
+}CameraStandby;
+
+/* Camera preview context */
+extern LTDC_HandleTypeDef hltdc_eval;
+static DMA2D_HandleTypeDef hdma2d_camera;
+static struct
+{
+  uint32_t Mode;
+  uint32_t Source;
+  uint32_t Destination;
+  uint32_t Width;
+  uint32_t Height;
+  __IO uint32_t Busy;
+  uint32_t LayerIndex;
+  uint32_t LayerAddress;    /* Layer frame buffer replaced in direct mode */
+  uint32_t FrameEndCycles;
+  uint32_t WindowStart;
+  uint32_t WindowFrames;
+  CAMERA_PreviewStatsTypeDef Stats;
+}CameraPreview;
 /**
   * @}
   */ 
@@ -72,7 +404,30 @@ uint32_t current_resolution;
 /** @defgroup STM324x9I_EVAL_CAMERA_Private_FunctionPrototypes STM324x9I EVAL CAMERA Private FunctionPrototypes
   * @{
   */
-static uint32_t GetSize(uint32_t resolution);
+static uint32_t GetSize(uint32_t Width, uint32_t Height);
+static void     RING_FrameEvent(void);
+static uint32_t RING_GetNextSlot(void);
+static void     GetResolution(uint32_t resolution, uint32_t *width, uint32_t *height);
+static void     LINESTREAM_LineEvent(void);
+static void     LINESTREAM_LapEvent(DMA_HandleTypeDef *hdma);
+static void     LINESTREAM_Update(void);
+static void     TELEMETRY_FrameEvent(void);
+static void     TELEMETRY_PeriodEvent(void);
+static uint32_t MOTION_LoadLuma4(uint8_t *pFrame, uint32_t Offset);
+static uint32_t MOTION_Sad4(uint32_t Pixels, uint32_t Background, uint32_t Sum);
+static uint32_t MOTION_Blend4(uint32_t Pixels, uint32_t Background);
+static uint32_t KERNEL_Luma(uint32_t Pixel);
+static void     KERNEL_Expand(uint32_t Pixel, int32_t *R, int32_t *G, int32_t *B);
+static uint32_t AUTO_Gain(uint32_t Current, uint32_t Reference, uint32_t Channel);
+static void     PREVIEW_FrameEvent(uint32_t frame, uint32_t slot);
+static void     PREVIEW_RestoreLayer(void);
+static void     PREVIEW_Displayed(void);
+static void     PREVIEW_TransferComplete(DMA2D_HandleTypeDef *hdma2d);
+static uint32_t LOADER_IsCached(uint8_t Reg, uint8_t Value);
+static uint8_t  LOADER_WriteNext(void);
+static uint8_t  CAMERA_StopCapture(void);
+static void     STANDBY_Reload(void);
+static void     LOADER_ClearReplay(void);
 /**
   * @}
   */ 
@@ -87,11 +442,27 @@ static uint32_t GetSize(uint32_t resolution);
   * @retval Camera status
   */
 uint8_t BSP_CAMERA_Init(uint32_t Resolution)
+{ 
+  return (BSP_CAMERA_InitEx(Resolution, CAMERA_PIXEL_FORMAT_RGB565));
+}
+
+/**
+  * @brief  Initializes the camera with the given output pixel format.
+  * @param  Resolution: Camera Resolution 
+  * @param  PixelFormat: CAMERA_PIXEL_FORMAT_RGB565 or CAMERA_PIXEL_FORMAT_YUV422
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_InitEx(uint32_t Resolution, uint32_t PixelFormat)
 { 
   DCMI_HandleTypeDef *phdcmi;
   
   uint8_t ret = CAMERA_ERROR;
   
+  if((PixelFormat != CAMERA_PIXEL_FORMAT_RGB565) && (PixelFormat != CAMERA_PIXEL_FORMAT_YUV422))
+  {
+    return CAMERA_ERROR;
+  }
+  
   /* Get the DCMI handle structure */
   phdcmi = &hdcmi_eval;
   
@@ -115,210 +486,2187 @@ uint8_t BSP_CAMERA_Init(uint32_t Resolution)
   /* Check if the camera is plugged */
   if(BSP_IO_ReadPin(CAM_PLUG_PIN))
   {
-    return CAMERA_ERROR;
+    return CAMERA_ERROR;
+  }
+  
+  /* DCMI Initialization */
+  BSP_CAMERA_MspInit();  
+  HAL_DCMI_Init(phdcmi);
+  
+  /* VSYNC events are counted by the telemetry */
+  __HAL_DCMI_ENABLE_IT(phdcmi, DCMI_IT_VSYNC);
+  
+  /* Enable the cycle counter used to timestamp the camera events */
+  BSP_EnableCycleCounter();
+  BSP_CAMERA_ResetTelemetry();
+  CameraStandby.Active = 0;
+  CameraStandby.Effect = 0xFFFFFFFF;
+  
+  if(ov2640_ReadID(CAMERA_I2C_ADDRESS) == OV2640_ID)
+  { 
+    /* Initialize the camera driver structure */
+    camera_drv = &ov2640_drv;     
+    
+    /* Camera Init */   
+    camera_drv->Init(CAMERA_I2C_ADDRESS, Resolution);
+    BSP_CAMERA_InvalidateRegisters();
+    LOADER_ClearReplay();
+    
+    /* Return CAMERA_OK status */
+    ret = CAMERA_OK;
+    
+    if(PixelFormat == CAMERA_PIXEL_FORMAT_YUV422)
+    {
+      ret = BSP_CAMERA_LoadRegisters(CameraYUV422Registers, sizeof(CameraYUV422Registers) / sizeof(CameraYUV422Registers[0]));
+    }
+  } 
+  
+  CameraPixelFormat = PixelFormat;
+  
+  current_resolution = Resolution;
+  
+  /* Capture the full frame until a crop window is configured */
+  GetResolution(Resolution, &CameraWindow.FullWidth, &CameraWindow.FullHeight);
+  CameraWindow.Width  = CameraWindow.FullWidth;
+  CameraWindow.Height = CameraWindow.FullHeight;
+  
+  return ret;
+}
+
+/**
+  * @brief  Starts the camera capture in continuous mode.
+  * @param  buff: pointer to the camera output buffer
+  */
+void BSP_CAMERA_ContinuousStart(uint8_t *buff)
+{ 
+  /* Start the camera capture */
+  HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_CONTINUOUS, (uint32_t)buff, GetSize(CameraWindow.Width, CameraWindow.Height));  
+}
+
+/**
+  * @brief  Starts the camera capture in snapshot mode.
+  * @param  buff: pointer to the camera output buffer
+  */
+void BSP_CAMERA_SnapshotStart(uint8_t *buff)
+{ 
+  /* Start the camera capture */
+  HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_SNAPSHOT, (uint32_t)buff, GetSize(CameraWindow.Width, CameraWindow.Height));  
+}
+
+/**
+  * @brief Suspend the CAMERA capture 
+  */
+void BSP_CAMERA_Suspend(void) 
+{
+  /* Suspend the Camera Capture */
+  HAL_DCMI_Suspend(&hdcmi_eval);
+}
+
+/**
+  * @brief Resume the CAMERA capture
+  */
+void BSP_CAMERA_Resume(void) 
+{
+  /* Start the Camera Capture */
+  HAL_DCMI_Resume(&hdcmi_eval);
+}
+
+/**
+  * @brief  Stop the CAMERA capture 
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_Stop(void) 
+{
+  uint8_t ret = CAMERA_StopCapture();
+  
+  /* Initialize IO */
+  BSP_IO_Init();
+  
+  /* Reset the camera STANDBY pin */
+  BSP_IO_ConfigPin(XSDN_PIN, IO_MODE_OUTPUT);
+  BSP_IO_WritePin(XSDN_PIN, RESET);  
+  
+  return ret;
+}
+
+/**
+  * @brief  Stops the capture and puts the camera in standby.
+  * @note   The DCMI, the capture window and the IO expander configuration
+  *         are kept for BSP_CAMERA_Wakeup().
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_Standby(void) 
+{
+  uint32_t index = 0;
+  uint8_t ret = CAMERA_ERROR;
+  
+  if((camera_drv == NULL) || (CameraStandby.Active != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  ret = CAMERA_StopCapture();
+  
+  /* Save the output format registers to check them on wakeup */
+  CAMERA_IO_Write(CAMERA_I2C_ADDRESS, OV2640_BANK_SEL, OV2640_BANK_DSP);
+  CameraLoader.Bank = OV2640_BANK_DSP;
+  for(index = 0; index < CAMERA_STANDBY_REGISTERS; index++)
+  {
+    CameraStandby.Image[index] = CAMERA_IO_Read(CAMERA_I2C_ADDRESS, CameraStandbyRegisters[index]);
+  }
+  
+  /* Reset the camera STANDBY pin */
+  BSP_IO_WritePin(XSDN_PIN, RESET);
+  CameraStandby.Active = 1;
+  
+  return ret;
+}
+
+/**
+  * @brief  Wakes the camera up from standby.
+  * @note   The sensor is only reprogrammed when it lost its configuration.
+  *         The capture is then restarted by the application.
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_Wakeup(void) 
+{
+  uint32_t start = BSP_GetCycleCount();
+  uint32_t index = 0;
+  
+  if(CameraStandby.Active == 0)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  /* Set the camera STANDBY pin */
+  BSP_IO_WritePin(XSDN_PIN, SET);
+  HAL_Delay(CAMERA_WAKEUP_DELAY);
+  
+  /* Compare the sensor registers with the image saved on standby */
+  CAMERA_IO_Write(CAMERA_I2C_ADDRESS, OV2640_BANK_SEL, OV2640_BANK_DSP);
+  CameraLoader.Bank = OV2640_BANK_DSP;
+  for(index = 0; index < CAMERA_STANDBY_REGISTERS; index++)
+  {
+    if(CAMERA_IO_Read(CAMERA_I2C_ADDRESS, CameraStandbyRegisters[index]) != CameraStandby.Image[index])
+    {
+      STANDBY_Reload();
+      CameraStandby.Stats.Reloads++;
+      break;
+    }
+  }
+  
+  CameraStandby.Active = 0;
+  CameraStandby.WakeupStartCycles = start;
+  CameraStandby.Stats.FirstFrameUs = 0;
+  CameraStandby.FirstFramePending = 1;
+  CameraStandby.Stats.WakeupUs = BSP_GetElapsedUs(start);
+  CameraStandby.Stats.Wakeups++;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the camera standby and wakeup statistics.
+  * @param  pStats: Pointer to the statistics structure
+  */
+void BSP_CAMERA_GetWakeupStats(CAMERA_WakeupStatsTypeDef *pStats)
+{
+  *pStats = CameraStandby.Stats;
+}
+
+/**
+  * @brief  Configures the camera contrast and brightness.
+  * @param  contrast_level: Contrast level
+  *          This parameter can be one of the following values:
+  *            @arg  CAMERA_CONTRAST_LEVEL4: for contrast +2
+  *            @arg  CAMERA_CONTRAST_LEVEL3: for contrast +1
+  *            @arg  CAMERA_CONTRAST_LEVEL2: for contrast  0
+  *            @arg  CAMERA_CONTRAST_LEVEL1: for contrast -1
+  *            @arg  CAMERA_CONTRAST_LEVEL0: for contrast -2
+  * @param  brightness_level: Contrast level
+  *          This parameter can be one of the following values:
+  *            @arg  CAMERA_BRIGHTNESS_LEVEL4: for brightness +2
+  *            @arg  CAMERA_BRIGHTNESS_LEVEL3: for brightness +1
+  *            @arg  CAMERA_BRIGHTNESS_LEVEL2: for brightness  0
+  *            @arg  CAMERA_BRIGHTNESS_LEVEL1: for brightness -1
+  *            @arg  CAMERA_BRIGHTNESS_LEVEL0: for brightness -2    
+  */
+void BSP_CAMERA_ContrastBrightnessConfig(uint32_t contrast_level, uint32_t brightness_level)
+{
+  if(camera_drv->Config != NULL)
+  {
+    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_CONTRAST_BRIGHTNESS, contrast_level, brightness_level);
+    BSP_CAMERA_InvalidateRegisters();
+  }  
+  
+  /* The auto-exposure keeps the contrast selected by the application */
+  CameraContrastLevel = contrast_level;
+  CameraBrightnessLevel = brightness_level;
+}
+
+/**
+  * @brief  Configures the camera white balance.
+  * @param  Mode: black_white mode
+  *          This parameter can be one of the following values:
+  *            @arg  CAMERA_BLACK_WHITE_BW
+  *            @arg  CAMERA_BLACK_WHITE_NEGATIVE
+  *            @arg  CAMERA_BLACK_WHITE_BW_NEGATIVE
+  *            @arg  CAMERA_BLACK_WHITE_NORMAL       
+  */
+void BSP_CAMERA_BlackWhiteConfig(uint32_t Mode)
+{
+  if(camera_drv->Config != NULL)
+  {
+    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_BLACK_WHITE, Mode, 0);
+    BSP_CAMERA_InvalidateRegisters();
+    CameraStandby.Effect      = CAMERA_BLACK_WHITE;
+    CameraStandby.EffectValue = Mode;
+  }  
+}
+
+/**
+  * @brief  Configures the camera color effect.
+  * @param  Effect: Color effect
+  *          This parameter can be one of the following values:
+  *            @arg  CAMERA_COLOR_EFFECT_ANTIQUE               
+  *            @arg  CAMERA_COLOR_EFFECT_BLUE        
+  *            @arg  CAMERA_COLOR_EFFECT_GREEN    
+  *            @arg  CAMERA_COLOR_EFFECT_RED        
+  */
+void BSP_CAMERA_ColorEffectConfig(uint32_t Effect)
+{
+  if(camera_drv->Config != NULL)
+  {
+    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_COLOR_EFFECT, Effect, 0);
+    BSP_CAMERA_InvalidateRegisters();
+    CameraStandby.Effect      = CAMERA_COLOR_EFFECT;
+    CameraStandby.EffectValue = Effect;
+  }  
+}
+
+/**
+  * @brief  Writes a register sequence to the camera sensor.
+  * @note   The registers already holding the target value are skipped.
+  * @param  pSequence: Pointer to the register/value pairs
+  * @param  Count: Number of pairs
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_LoadRegisters(const CAMERA_RegTypeDef *pSequence, uint32_t Count)
+{
+  uint8_t status = BSP_CAMERA_LoadRegisters_Start(pSequence, Count);
+  
+  while(status == CAMERA_OK)
+  {
+    status = BSP_CAMERA_LoadRegisters_Process();
+    if(status == CAMERA_BUSY)
+    {
+      status = CAMERA_OK;
+    }
+    else
+    {
+      break;
+    }
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Starts loading a register sequence without blocking.
+  * @note   The sequence is written by BSP_CAMERA_LoadRegisters_Process() and
+  *         must remain valid until it returns CAMERA_OK.
+  * @param  pSequence: Pointer to the register/value pairs
+  * @param  Count: Number of pairs
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_LoadRegisters_Start(const CAMERA_RegTypeDef *pSequence, uint32_t Count)
+{
+  if((pSequence == NULL) || (Count == 0) || (camera_drv == NULL) ||
+     (CameraLoader.Index < CameraLoader.Count))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraLoader.pSequence = pSequence;
+  CameraLoader.Count     = Count;
+  CameraLoader.Index     = 0;
+  CameraLoader.StartCycles = BSP_GetCycleCount();
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Writes the next registers of the sequence started by
+  *         BSP_CAMERA_LoadRegisters_Start().
+  * @note   A single I2C transaction is issued per call.
+  * @retval CAMERA_BUSY while registers remain to be written, CAMERA_OK once
+  *         the sequence is complete, CAMERA_ERROR on I2C error or when no
+  *         sequence is started.
+  */
+uint8_t BSP_CAMERA_LoadRegisters_Process(void)
+{
+  if(CameraLoader.Index >= CameraLoader.Count)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  if(LOADER_WriteNext() != CAMERA_OK)
+  {
+    /* Abort the sequence, the sensor state is unknown */
+    CameraLoader.Count = 0;
+    CameraLoader.Index = 0;
+    BSP_CAMERA_InvalidateRegisters();
+    return CAMERA_ERROR;
+  }
+  
+  if(CameraLoader.Index < CameraLoader.Count)
+  {
+    return CAMERA_BUSY;
+  }
+  
+  CameraLoader.Stats.DurationUs = BSP_GetElapsedUs(CameraLoader.StartCycles);
+  CameraLoader.Count = 0;
+  CameraLoader.Index = 0;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Invalidates the shadow of the sensor registers.
+  * @note   To be called when the sensor is programmed or reset outside of
+  *         the register sequence loader.
+  */
+void BSP_CAMERA_InvalidateRegisters(void)
+{
+  uint32_t bank = 0, index = 0;
+  
+  for(bank = 0; bank < CAMERA_SHADOW_BANKS; bank++)
+  {
+    for(index = 0; index < (256 / 32); index++)
+    {
+      CameraLoader.Valid[bank][index] = 0;
+    }
+  }
+  CameraLoader.Bank = CAMERA_SHADOW_BANKS;
+}
+
+/**
+  * @brief  Gets the register sequence loader statistics.
+  * @param  pStats: Pointer to the statistics structure
+  */
+void BSP_CAMERA_GetLoaderStats(CAMERA_LoaderStatsTypeDef *pStats)
+{
+  *pStats = CameraLoader.Stats;
+}
+
+/**
+  * @brief  Configures the DCMI crop window.
+  * @note   Only the window is transferred by the DMA, which reduces the DMA
+  *         and memory bandwidth. To be called while the capture is stopped.
+  * @param  Xpos: Horizontal start of the window, in pixels
+  * @param  Ypos: Vertical start of the window, in lines
+  * @param  Width: Window width in pixels
+  * @param  Height: Window height in lines
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_ConfigCrop(uint32_t Xpos, uint32_t Ypos, uint32_t Width, uint32_t Height)
+{
+  if((Width == 0) || (Height == 0) ||
+     ((Xpos + Width) > CameraWindow.FullWidth) || ((Ypos + Height) > CameraWindow.FullHeight) ||
+     (GetSize(Width, Height) == 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  /* Horizontal values are given in pixel clocks, sizes are minus one */
+  if(HAL_DCMI_ConfigCROP(&hdcmi_eval, Xpos * CAMERA_BYTES_PER_PIXEL, Ypos,
+                         (Width * CAMERA_BYTES_PER_PIXEL) - 1, Height - 1) != HAL_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  if(HAL_DCMI_EnableCROP(&hdcmi_eval) != HAL_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraWindow.Width  = Width;
+  CameraWindow.Height = Height;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Disables the DCMI crop window, the full frame is captured.
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_DisableCrop(void)
+{
+  if(HAL_DCMI_DisableCROP(&hdcmi_eval) != HAL_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraWindow.Width  = CameraWindow.FullWidth;
+  CameraWindow.Height = CameraWindow.FullHeight;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Configures the DCMI frame decimation.
+  * @note   To be called while the capture is stopped.
+  * @param  CaptureRate: Frames captured
+  *          This parameter can be one of the following values:
+  *            @arg  CAMERA_CAPTURE_ALL_FRAMES
+  *            @arg  CAMERA_CAPTURE_1_OF_2_FRAMES
+  *            @arg  CAMERA_CAPTURE_1_OF_4_FRAMES
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_ConfigCaptureRate(uint32_t CaptureRate)
+{
+  if((CaptureRate != CAMERA_CAPTURE_ALL_FRAMES) && (CaptureRate != CAMERA_CAPTURE_1_OF_2_FRAMES) &&
+     (CaptureRate != CAMERA_CAPTURE_1_OF_4_FRAMES))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  hdcmi_eval.Init.CaptureRate = CaptureRate;
+  
+  /* The capture rate is applied on the next capture start */
+  MODIFY_REG(hdcmi_eval.Instance->CR, DCMI_CR_FCRC, CaptureRate);
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the size of a captured frame.
+  * @retval Frame size in bytes for the current capture window.
+  */
+uint32_t BSP_CAMERA_GetCaptureSize(void)
+{
+  return (GetSize(CameraWindow.Width, CameraWindow.Height) * 4);
+}
+
+/**
+  * @brief  Initializes the camera frame ring.
+  * @note   BSP_CAMERA_Init() must be called before, the frame size is derived
+  *         from the current capture window.
+  * @param  BufferAddress: Start address of NbFrames consecutive frame buffers
+  *         (word aligned, e.g. in SDRAM)
+  * @param  NbFrames: Number of frames in the ring, from 2 to CAMERA_RING_MAX_FRAMES
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_RingInit(uint32_t BufferAddress, uint32_t NbFrames)
+{
+  uint32_t index = 0;
+  
+  if((NbFrames < 2) || (NbFrames > CAMERA_RING_MAX_FRAMES) || ((BufferAddress & 0x3) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraRing.Active        = 0;
+  CameraRing.BufferAddress = BufferAddress;
+  CameraRing.FrameSize     = GetSize(CameraWindow.Width, CameraWindow.Height) * 4;
+  CameraRing.NbFrames      = NbFrames;
+  CameraRing.CaptureSlot   = 0;
+  CameraRing.Sequence      = 0;
+  CameraRing.Dropped       = 0;
+  CameraRing.PreviewSlot   = CAMERA_RING_MAX_FRAMES;
+  
+  for(index = 0; index < CAMERA_RING_MAX_FRAMES; index++)
+  {
+    CameraRing.State[index]        = CAMERA_SLOT_FREE;
+    CameraRing.Timestamp[index]    = 0;
+    CameraRing.SlotSequence[index] = 0;
+  }
+  
+  return (CameraRing.FrameSize != 0) ? CAMERA_OK : CAMERA_ERROR;
+}
+
+/**
+  * @brief  Starts the camera capture into the frame ring.
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_RingStart(void)
+{
+  if(CameraRing.NbFrames == 0)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraRing.CaptureSlot = 0;
+  CameraRing.State[0]    = CAMERA_SLOT_CAPTURING;
+  CameraRing.Active      = 1;
+  
+  /* Each frame is captured in its own slot, the frame event re-arms the capture */
+  if(HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_SNAPSHOT, CameraRing.BufferAddress, GetSize(CameraWindow.Width, CameraWindow.Height)) != HAL_OK)
+  {
+    CameraRing.Active   = 0;
+    CameraRing.State[0] = CAMERA_SLOT_FREE;
+    return CAMERA_ERROR;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the oldest completed frame of the ring.
+  * @note   The frame is owned by the caller and will not be overwritten until
+  *         it is given back using BSP_CAMERA_RingRelease().
+  * @param  pFrame: Pointer to the frame descriptor to fill
+  * @retval CAMERA_OK if a frame is returned, CAMERA_ERROR if no frame is ready
+  */
+uint8_t BSP_CAMERA_RingAcquire(CAMERA_FrameTypeDef *pFrame)
+{
+  uint32_t index = 0;
+  uint32_t oldest = CAMERA_RING_MAX_FRAMES;
+  uint8_t ret = CAMERA_ERROR;
+  
+  /* The frame event updates the slot states from the DCMI interrupt */
+  HAL_NVIC_DisableIRQ(DCMI_IRQn);
+  
+  for(index = 0; index < CameraRing.NbFrames; index++)
+  {
+    if(CameraRing.State[index] == CAMERA_SLOT_READY)
+    {
+      if((oldest == CAMERA_RING_MAX_FRAMES) ||
+         ((int32_t)(CameraRing.SlotSequence[index] - CameraRing.SlotSequence[oldest]) < 0))
+      {
+        oldest = index;
+      }
+    }
+  }
+  
+  if(oldest != CAMERA_RING_MAX_FRAMES)
+  {
+    CameraRing.State[oldest] = CAMERA_SLOT_HELD;
+    
+    pFrame->pBuffer   = (uint8_t *)(CameraRing.BufferAddress + (oldest * CameraRing.FrameSize));
+    pFrame->Size      = CameraRing.FrameSize;
+    pFrame->Width     = CameraWindow.Width;
+    pFrame->Height    = CameraWindow.Height;
+    pFrame->Timestamp = CameraRing.Timestamp[oldest];
+    pFrame->Sequence  = CameraRing.SlotSequence[oldest];
+    pFrame->Index     = oldest;
+    ret = CAMERA_OK;
+  }
+  
+  HAL_NVIC_EnableIRQ(DCMI_IRQn);
+  
+  return ret;
+}
+
+/**
+  * @brief  Gives back a frame previously returned by BSP_CAMERA_RingAcquire().
+  * @param  pFrame: Pointer to the acquired frame descriptor
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_RingRelease(CAMERA_FrameTypeDef *pFrame)
+{
+  if((pFrame->Index >= CameraRing.NbFrames) || (CameraRing.State[pFrame->Index] != CAMERA_SLOT_HELD))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraRing.State[pFrame->Index] = CAMERA_SLOT_FREE;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the camera frame ring statistics.
+  * @param  pStats: Pointer to the statistics structure to fill
+  */
+void BSP_CAMERA_RingGetStats(CAMERA_RingStatsTypeDef *pStats)
+{
+  uint32_t index = 0;
+  
+  pStats->CapturedFrames = CameraRing.Sequence;
+  pStats->DroppedFrames  = CameraRing.Dropped;
+  pStats->PendingFrames  = 0;
+  
+  for(index = 0; index < CameraRing.NbFrames; index++)
+  {
+    if(CameraRing.State[index] == CAMERA_SLOT_READY)
+    {
+      pStats->PendingFrames++;
+    }
+  }
+}
+
+/**
+  * @brief  Starts the camera capture in line streaming mode.
+  * @note   The capture window height must be a multiple of RingLines and
+  *         RingLines a multiple of BatchLines. The buffer holds RingLines lines
+  *         of the capture window (use RingLines = 2 x BatchLines for a double
+  *         buffering).
+  * @param  buff: Pointer to the circular line buffer
+  * @param  RingLines: Number of lines of the circular buffer
+  * @param  BatchLines: Number of lines given at once to BSP_CAMERA_LineBatchCallback()
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_LineStreamStart(uint8_t *buff, uint32_t RingLines, uint32_t BatchLines)
+{
+  uint32_t line_size = CameraWindow.Width * CAMERA_BYTES_PER_PIXEL;
+  
+  if((BatchLines == 0) || (RingLines < (2 * BatchLines)) || ((RingLines % BatchLines) != 0) ||
+     ((CameraWindow.Height % RingLines) != 0) || ((line_size % 4) != 0) ||
+     (((line_size * RingLines) / 4) > 0xFFFF))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraLineStream.Buffer         = (uint32_t)buff;
+  CameraLineStream.LineSize       = line_size;
+  CameraLineStream.RingLines      = RingLines;
+  CameraLineStream.BatchLines     = BatchLines;
+  CameraLineStream.Laps           = 0;
+  CameraLineStream.WrittenLines   = 0;
+  CameraLineStream.DeliveredLines = 0;
+  CameraLineStream.Stats.DeliveredBatches = 0;
+  CameraLineStream.Stats.Overflows        = 0;
+  CameraLineStream.Stats.LostLines        = 0;
+  CameraLineStream.pY = NULL;
+  
+  /* The circular DMA wraps on the line buffer, the frames follow each other
+     in the buffer as the frame height is a multiple of the buffer lines */
+  if(HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_CONTINUOUS, (uint32_t)buff, (line_size * RingLines) / 4) != HAL_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  /* The laps are counted by the DMA interrupt, which preempts the batch
+     processing run under the DCMI interrupt */
+  CameraLineStream.XferCplt = hdcmi_eval.DMA_Handle->XferCpltCallback;
+  hdcmi_eval.DMA_Handle->XferCpltCallback = LINESTREAM_LapEvent;
+  HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 0x0E, 0);
+  
+  CameraLineStream.Active = 1;
+  __HAL_DCMI_ENABLE_IT(&hdcmi_eval, DCMI_IT_LINE);
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Starts the camera line streaming with the YUYV lines split into
+  *         planes as they are captured.
+  * @note   The camera must be initialized in CAMERA_PIXEL_FORMAT_YUV422, the
+  *         capture window width must be a multiple of 8. The planes are
+  *         written at the position of the lines in the frame.
+  * @param  buff: Pointer to the circular line buffer
+  * @param  RingLines: Number of lines of the circular buffer
+  * @param  BatchLines: Number of lines split at once
+  * @param  pY: Pointer to the Y plane, Width x Height bytes, word aligned
+  * @param  pU: Pointer to the U plane, Width/2 x Height bytes, or NULL
+  * @param  pV: Pointer to the V plane, Width/2 x Height bytes, or NULL
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_PlanarStreamStart(uint8_t *buff, uint32_t RingLines, uint32_t BatchLines, uint8_t *pY, uint8_t *pU, uint8_t *pV)
+{
+  if((CameraPixelFormat != CAMERA_PIXEL_FORMAT_YUV422) || (pY == NULL) || ((CameraWindow.Width % 8) != 0) ||
+     (((uint32_t)pY & 0x3) != 0) || (((uint32_t)pU & 0x3) != 0) || (((uint32_t)pV & 0x3) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  if(BSP_CAMERA_LineStreamStart(buff, RingLines, BatchLines) != CAMERA_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraLineStream.pU = pU;
+  CameraLineStream.pV = pV;
+  CameraLineStream.pY = pY;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the camera line streaming statistics.
+  * @param  pStats: Pointer to the statistics structure to fill
+  */
+void BSP_CAMERA_LineStreamGetStats(CAMERA_LineStreamStatsTypeDef *pStats)
+{
+  *pStats = CameraLineStream.Stats;
+}
+
+/**
+  * @brief  Gets the camera frame timing and error telemetry.
+  * @param  pTelemetry: Pointer to the telemetry structure to fill
+  */
+void BSP_CAMERA_GetTelemetry(CAMERA_TelemetryTypeDef *pTelemetry)
+{
+  HAL_NVIC_DisableIRQ(DCMI_IRQn);
+  *pTelemetry = CameraTelemetry.Data;
+  HAL_NVIC_EnableIRQ(DCMI_IRQn);
+}
+
+/**
+  * @brief  Resets the camera frame timing and error telemetry.
+  */
+void BSP_CAMERA_ResetTelemetry(void)
+{
+  uint32_t index = 0;
+  
+  HAL_NVIC_DisableIRQ(DCMI_IRQn);
+  
+  CameraTelemetry.LastCycles          = 0;
+  CameraTelemetry.Started             = 0;
+  CameraTelemetry.VsyncSeen           = 0;
+  CameraTelemetry.Periods             = 0;
+  CameraTelemetry.Data.VsyncEvents    = 0;
+  CameraTelemetry.Data.FrameEvents    = 0;
+  CameraTelemetry.Data.FrameRate      = 0;
+  CameraTelemetry.Data.LastPeriodUs   = 0;
+  CameraTelemetry.Data.MeanPeriodUs   = 0;
+  CameraTelemetry.Data.MinPeriodUs    = 0xFFFFFFFF;
+  CameraTelemetry.Data.MaxPeriodUs    = 0;
+  CameraTelemetry.Data.OverrunErrors  = 0;
+  CameraTelemetry.Data.SyncErrors     = 0;
+  CameraTelemetry.Data.DmaErrors      = 0;
+  
+  for(index = 0; index < CAMERA_JITTER_BINS; index++)
+  {
+    CameraTelemetry.Data.JitterHistogram[index] = 0;
+  }
+  
+  HAL_NVIC_EnableIRQ(DCMI_IRQn);
+}
+
+/**
+  * @brief  Initializes the motion detection.
+  * @note   The background model is initialized from the first processed frame.
+  * @param  pConfig: Pointer to the motion detection configuration
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_MotionInit(CAMERA_MotionConfigTypeDef *pConfig)
+{
+  if((pConfig->BlockSize == 0) || ((pConfig->BlockSize % 4) != 0) ||
+     (pConfig->Width == 0) || ((pConfig->Width % pConfig->BlockSize) != 0) ||
+     (pConfig->Height == 0) || ((pConfig->Height % pConfig->BlockSize) != 0) ||
+     ((pConfig->PixelFormat != CAMERA_PIXEL_FORMAT_RGB565) && (pConfig->PixelFormat != CAMERA_PIXEL_FORMAT_Y8)) ||
+     (pConfig->pBackground == NULL) || (((uint32_t)pConfig->pBackground & 0x3) != 0) || (pConfig->pMask == NULL))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraMotion.Config = *pConfig;
+  CameraMotion.Frames = 0;
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Runs the motion detection on a frame.
+  * @param  pFrame: Pointer to the frame, word aligned
+  * @param  pResult: Pointer to the result structure to fill, can be NULL
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_MotionDetect(uint8_t *pFrame, CAMERA_MotionResultTypeDef *pResult)
+{
+  CAMERA_MotionConfigTypeDef *config = &CameraMotion.Config;
+  uint32_t *background = (uint32_t *)config->pBackground;
+  uint32_t words_per_line = config->Width / 4;
+  uint32_t words_per_block = config->BlockSize / 4;
+  uint32_t blocks_per_line = config->Width / config->BlockSize;
+  uint32_t limit = config->Threshold * config->BlockSize * config->BlockSize;
+  uint32_t start = BSP_GetCycleCount();
+  uint32_t motion_blocks = 0;
+  uint32_t block_x = 0, block_y = 0, line = 0, word = 0;
+  uint32_t offset = 0, sad = 0, pixels = 0;
+  uint8_t *mask = NULL;
+  
+  if((pFrame == NULL) || (((uint32_t)pFrame & 0x3) != 0) || (config->pMask == NULL))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  for(block_y = 0; block_y < (config->Height / config->BlockSize); block_y++)
+  {
+    for(block_x = 0; block_x < blocks_per_line; block_x++)
+    {
+      mask = &config->pMask[(block_y * blocks_per_line) + block_x];
+      sad = 0;
+      
+      for(line = 0; line < config->BlockSize; line++)
+      {
+        /* Word offset of the first four pixels of the block line */
+        offset = (((block_y * config->BlockSize) + line) * words_per_line) + (block_x * words_per_block);
+        
+        for(word = 0; word < words_per_block; word++, offset++)
+        {
+          pixels = MOTION_LoadLuma4(pFrame, offset);
+          
+          if(CameraMotion.Frames == 0)
+          {
+            background[offset] = pixels;
+          }
+          else
+          {
+            sad = MOTION_Sad4(pixels, background[offset], sad);
+            
+            /* Selective update: blocks in motion do not pollute the background */
+            if(*mask == 0)
+            {
+              background[offset] = MOTION_Blend4(pixels, background[offset]);
+            }
+          }
+        }
+      }
+      
+      *mask = (sad > limit) ? 1 : 0;
+      motion_blocks += *mask;
+    }
+  }
+  
+  CameraMotion.Frames++;
+  
+  if(pResult != NULL)
+  {
+    pResult->MotionBlocks = motion_blocks;
+    pResult->ProcessUs    = BSP_GetElapsedUs(start);
+    pResult->Frames       = CameraMotion.Frames;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Converts an RGB565 frame to an 8-bit luma plane.
+  * @param  pSrc: Pointer to the RGB565 frame
+  * @param  pDst: Pointer to the luma plane, Width x Height bytes
+  * @param  Width: Frame width in pixels, multiple of 4
+  * @param  Height: Frame height in lines
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_RGB565ToGray(uint8_t *pSrc, uint8_t *pDst, uint32_t Width, uint32_t Height)
+{
+  uint32_t *src = (uint32_t *)pSrc;
+  uint32_t *dst = (uint32_t *)pDst;
+  uint32_t count = (Width * Height) / 4;
+  uint32_t first = 0, second = 0;
+  
+  if(((Width % 4) != 0) || ((((uint32_t)pSrc | (uint32_t)pDst) & 0x3) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  /* Four pixels per iteration: two words read, one word written */
+  while(count--)
+  {
+    first  = *src++;
+    second = *src++;
+    *dst++ = KERNEL_Luma(first & 0xFFFF)          | (KERNEL_Luma(first >> 16) << 8) |
+             (KERNEL_Luma(second & 0xFFFF) << 16) | (KERNEL_Luma(second >> 16) << 24);
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Converts an RGB565 frame to YUV 4:2:2 planar.
+  * @note   The chroma of two adjacent pixels is computed on their mean color.
+  * @param  pSrc: Pointer to the RGB565 frame
+  * @param  pY: Pointer to the Y plane, Width x Height bytes
+  * @param  pU: Pointer to the U plane, Width/2 x Height bytes
+  * @param  pV: Pointer to the V plane, Width/2 x Height bytes
+  * @param  Width: Frame width in pixels, multiple of 4
+  * @param  Height: Frame height in lines
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_RGB565ToYUV(uint8_t *pSrc, uint8_t *pY, uint8_t *pU, uint8_t *pV, uint32_t Width, uint32_t Height)
+{
+  uint32_t *src = (uint32_t *)pSrc;
+  uint32_t *y_plane = (uint32_t *)pY;
+  uint16_t *u_plane = (uint16_t *)pU;
+  uint16_t *v_plane = (uint16_t *)pV;
+  uint32_t count = (Width * Height) / 4;
+  uint32_t pair[2] = {0};
+  uint32_t luma = 0, u = 0, v = 0, index = 0;
+  int32_t r0 = 0, g0 = 0, b0 = 0, r1 = 0, g1 = 0, b1 = 0;
+  
+  if(((Width % 4) != 0) || ((((uint32_t)pSrc | (uint32_t)pY) & 0x3) != 0) ||
+     ((((uint32_t)pU | (uint32_t)pV) & 0x1) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  while(count--)
+  {
+    pair[0] = *src++;
+    pair[1] = *src++;
+    luma = 0;
+    u = 0;
+    v = 0;
+    
+    for(index = 0; index < 2; index++)
+    {
+      KERNEL_Expand(pair[index] & 0xFFFF, &r0, &g0, &b0);
+      KERNEL_Expand(pair[index] >> 16, &r1, &g1, &b1);
+      
+      luma |= ((((77 * r0) + (150 * g0) + (29 * b0) + 128) >> 8) << (16 * index)) |
+              ((((77 * r1) + (150 * g1) + (29 * b1) + 128) >> 8) << ((16 * index) + 8));
+      
+      /* Mean color of the pixel pair */
+      r0 = (r0 + r1 + 1) >> 1;
+      g0 = (g0 + g1 + 1) >> 1;
+      b0 = (b0 + b1 + 1) >> 1;
+      
+      u |= (uint32_t)((((-43 * r0) - (85 * g0) + (128 * b0)) >> 8) + 128) << (8 * index);
+      v |= (uint32_t)((((128 * r0) - (107 * g0) - (21 * b0)) >> 8) + 128) << (8 * index);
+    }
+    
+    *y_plane++ = luma;
+    *u_plane++ = (uint16_t)u;
+    *v_plane++ = (uint16_t)v;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Splits YUYV lines into a Y plane and optional U and V planes.
+  * @param  pSrc: Pointer to the YUYV lines, word aligned
+  * @param  pY: Pointer to the Y plane, word aligned
+  * @param  pU: Pointer to the U plane (Width/2 bytes per line), word aligned,
+  *         or NULL
+  * @param  pV: Pointer to the V plane (Width/2 bytes per line), word aligned,
+  *         or NULL
+  * @param  Width: Line width in pixels, multiple of 8
+  * @param  Height: Number of lines
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_YUV422ToPlanar(uint8_t *pSrc, uint8_t *pY, uint8_t *pU, uint8_t *pV, uint32_t Width, uint32_t Height)
+{
+  uint32_t *src = (uint32_t *)pSrc;
+  uint32_t *y = (uint32_t *)pY, *u = (uint32_t *)pU, *v = (uint32_t *)pV;
+  uint32_t count = 0, index = 0, w0 = 0, w1 = 0, luma = 0, next = 0, cb = 0, cr = 0;
+  
+  if(((Width % 8) != 0) || (((uint32_t)pSrc & 0x3) != 0) || (((uint32_t)pY & 0x3) != 0) ||
+     (((uint32_t)pU & 0x3) != 0) || (((uint32_t)pV & 0x3) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  /* 8 pixels (4 source words) per iteration: 2 Y words, 1 U and 1 V word */
+  for(count = (Width * Height) / 8; count > 0; count--)
+  {
+    cb = 0;
+    cr = 0;
+    for(index = 0; index < 2; index++)
+    {
+      /* Y0 U Y1 V, Y2 U Y3 V */
+      w0 = *src++;
+      w1 = *src++;
+      
+      luma = w0 & 0x00FF00FF;
+      luma = (luma | (luma >> 8)) & 0xFFFF;
+      w0 >>= 8;
+      next = w1 & 0x00FF00FF;
+      luma |= ((next | (next >> 8)) & 0xFFFF) << 16;
+      w1 >>= 8;
+      *y++ = luma;
+      
+      cb |= ((w0 & 0xFF) | ((w1 & 0xFF) << 8)) << (16 * index);
+      cr |= (((w0 >> 16) & 0xFF) | (((w1 >> 16) & 0xFF) << 8)) << (16 * index);
+    }
+    
+    if(u != NULL)
+    {
+      *u++ = cb;
+    }
+    if(v != NULL)
+    {
+      *v++ = cr;
+    }
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Downscales a frame with a box filter.
+  * @note   Each output pixel is the rounded mean of Factor x Factor pixels.
+  * @param  pSrc: Pointer to the source frame
+  * @param  pDst: Pointer to the destination frame, (Width/Factor) x (Height/Factor) pixels
+  * @param  Width: Source width in pixels, multiple of 4 x Factor
+  * @param  Height: Source height in lines, multiple of Factor
+  * @param  PixelFormat: CAMERA_PIXEL_FORMAT_RGB565 or CAMERA_PIXEL_FORMAT_Y8
+  * @param  Factor: Downscale factor, 2 or 4
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_Downscale(uint8_t *pSrc, uint8_t *pDst, uint32_t Width, uint32_t Height, uint32_t PixelFormat, uint32_t Factor)
+{
+  uint32_t *src = (uint32_t *)pSrc;
+  uint32_t shift = (Factor == 2) ? 2 : 4;
+  uint32_t round = 1 << (shift - 1);
+  uint32_t words_per_line = 0, out_y = 0, column = 0, line = 0, word = 0;
+  uint32_t pixels = 0, sum = 0, r = 0, g = 0, b = 0;
+  uint32_t *in = NULL;
+  
+  if(((Factor != 2) && (Factor != 4)) || ((Width % (4 * Factor)) != 0) || ((Height % Factor) != 0) ||
+     ((((uint32_t)pSrc | (uint32_t)pDst) & 0x3) != 0))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  if(PixelFormat == CAMERA_PIXEL_FORMAT_Y8)
+  {
+    uint8_t *dst = pDst;
+    words_per_line = Width / 4;
+    
+    for(out_y = 0; out_y < (Height / Factor); out_y++)
+    {
+      for(column = 0; column < words_per_line; column++)
+      {
+        /* Horizontal pair sums of Factor lines in the two 16-bit lanes */
+        sum = 0;
+        for(line = 0; line < Factor; line++)
+        {
+          pixels = src[(((out_y * Factor) + line) * words_per_line) + column];
+          sum += (pixels & 0x00FF00FF) + ((pixels >> 8) & 0x00FF00FF);
+        }
+        
+        if(Factor == 2)
+        {
+          *dst++ = (uint8_t)(((sum & 0xFFFF) + round) >> shift);
+          *dst++ = (uint8_t)(((sum >> 16) + round) >> shift);
+        }
+        else
+        {
+          *dst++ = (uint8_t)(((sum & 0xFFFF) + (sum >> 16) + round) >> shift);
+        }
+      }
+    }
+  }
+  else if(PixelFormat == CAMERA_PIXEL_FORMAT_RGB565)
+  {
+    uint16_t *dst = (uint16_t *)pDst;
+    words_per_line = Width / 2;
+    
+    for(out_y = 0; out_y < (Height / Factor); out_y++)
+    {
+      for(column = 0; column < words_per_line; column += (Factor / 2))
+      {
+        /* Components of the two pixels of each word summed in 16-bit lanes */
+        r = 0;
+        g = 0;
+        b = 0;
+        for(line = 0; line < Factor; line++)
+        {
+          in = &src[(((out_y * Factor) + line) * words_per_line) + column];
+          for(word = 0; word < (Factor / 2); word++)
+          {
+            pixels = in[word];
+            r += (pixels >> 11) & 0x001F001F;
+            g += (pixels >> 5) & 0x003F003F;
+            b += pixels & 0x001F001F;
+          }
+        }
+        
+        r = ((r & 0xFFFF) + (r >> 16) + round) >> shift;
+        g = ((g & 0xFFFF) + (g >> 16) + round) >> shift;
+        b = ((b & 0xFFFF) + (b >> 16) + round) >> shift;
+        *dst++ = (uint16_t)((r << 11) | (g << 5) | b);
+      }
+    }
+  }
+  else
+  {
+    return CAMERA_ERROR;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Computes the luma histogram of a frame.
+  * @param  pSrc: Pointer to the frame
+  * @param  Width: Frame width in pixels, multiple of 4
+  * @param  Height: Frame height in lines
+  * @param  PixelFormat: CAMERA_PIXEL_FORMAT_RGB565 or CAMERA_PIXEL_FORMAT_Y8
+  * @param  Step: Subsampling step in lines and in groups of 4 pixels, 1 to
+  *         process all the pixels
+  * @param  pHistogram: Pointer to the 256-bin histogram to fill
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_Histogram(uint8_t *pSrc, uint32_t Width, uint32_t Height, uint32_t PixelFormat, uint32_t Step, uint32_t *pHistogram)
+{
+  uint32_t *src = (uint32_t *)pSrc;
+  uint32_t line = 0, column = 0, offset = 0, pixels = 0, index = 0;
+  
+  if((Step == 0) || ((Width % 4) != 0) || (((uint32_t)pSrc & 0x3) != 0) ||
+     ((PixelFormat != CAMERA_PIXEL_FORMAT_RGB565) && (PixelFormat != CAMERA_PIXEL_FORMAT_Y8)))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  for(index = 0; index < 256; index++)
+  {
+    pHistogram[index] = 0;
+  }
+  
+  for(line = 0; line < Height; line += Step)
+  {
+    for(column = 0; column < (Width / 4); column += Step)
+    {
+      if(PixelFormat == CAMERA_PIXEL_FORMAT_Y8)
+      {
+        pixels = src[(line * (Width / 4)) + column];
+        pHistogram[pixels & 0xFF]++;
+        pHistogram[(pixels >> 8) & 0xFF]++;
+        pHistogram[(pixels >> 16) & 0xFF]++;
+        pHistogram[pixels >> 24]++;
+      }
+      else
+      {
+        offset = (line * (Width / 2)) + (2 * column);
+        pixels = src[offset];
+        pHistogram[KERNEL_Luma(pixels & 0xFFFF)]++;
+        pHistogram[KERNEL_Luma(pixels >> 16)]++;
+        pixels = src[offset + 1];
+        pHistogram[KERNEL_Luma(pixels & 0xFFFF)]++;
+        pHistogram[KERNEL_Luma(pixels >> 16)]++;
+      }
+    }
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Initializes the auto-exposure and white balance loop.
+  * @note   The brightness starts from the middle level and the white balance
+  *         gains from unity.
+  * @param  pConfig: Pointer to the auto-exposure configuration
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_AutoInit(CAMERA_AutoConfigTypeDef *pConfig)
+{
+  if((pConfig->Step == 0) || (pConfig->TargetLuma > 255) || (camera_drv == NULL))
+  {
+    return CAMERA_ERROR;
+  }
+  
+  CameraAuto.Config                = *pConfig;
+  CameraAuto.Status.MeanLuma       = 0;
+  CameraAuto.Status.Brightness     = 2;
+  CameraAuto.Status.RedGain        = CAMERA_AWB_GAIN_UNITY;
+  CameraAuto.Status.GreenGain      = CAMERA_AWB_GAIN_UNITY;
+  CameraAuto.Status.BlueGain       = CAMERA_AWB_GAIN_UNITY;
+  CameraAuto.Status.SensorUpdates  = 0;
+  CameraAuto.Status.Converged      = 0;
+  CameraAuto.LastUpdate            = HAL_GetTick() - pConfig->UpdatePeriod;
+  
+  BSP_CAMERA_ContrastBrightnessConfig(CameraContrastLevel, CameraBrightnessLevels[CameraAuto.Status.Brightness]);
+  
+  if(pConfig->WhiteBalance == ENABLE)
+  {
+    /* Switch the DSP to the manual white balance gains */
+    CAMERA_RegTypeDef sequence[] =
+    {
+      {OV2640_BANK_SEL,   OV2640_BANK_DSP},
+      {OV2640_AWB_CTRL,   OV2640_AWB_MANUAL},
+      {OV2640_AWB_GAIN_R, (uint8_t)CAMERA_AWB_GAIN_UNITY},
+      {OV2640_AWB_GAIN_G, (uint8_t)CAMERA_AWB_GAIN_UNITY},
+      {OV2640_AWB_GAIN_B, (uint8_t)CAMERA_AWB_GAIN_UNITY}
+    };
+    
+    return BSP_CAMERA_LoadRegisters(sequence, sizeof(sequence) / sizeof(sequence[0]));
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Runs one iteration of the auto-exposure and white balance loop.
+  * @param  pFrame: Pointer to the RGB565 frame, word aligned
+  * @param  Width: Frame width in pixels, multiple of 4
+  * @param  Height: Frame height in lines
+  * @param  pStatus: Pointer to the status structure to fill, can be NULL
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_AutoProcess(uint8_t *pFrame, uint32_t Width, uint32_t Height, CAMERA_AutoStatusTypeDef *pStatus)
+{
+  CAMERA_AutoConfigTypeDef *config = &CameraAuto.Config;
+  CAMERA_AutoStatusTypeDef *status = &CameraAuto.Status;
+  uint16_t *pixels = (uint16_t *)pFrame;
+  uint32_t count = 0, sum = 0, clipped = 0, index = 0, line = 0, column = 0;
+  uint32_t brightness = status->Brightness;
+  uint32_t red = 0, green = 0, blue = 0;
+  uint32_t gain_r = status->RedGain, gain_g = status->GreenGain, gain_b = status->BlueGain;
+  int32_t r = 0, g = 0, b = 0;
+  
+  if(BSP_CAMERA_Histogram(pFrame, Width, Height, CAMERA_PIXEL_FORMAT_RGB565, config->Step, CameraAuto.Histogram) != CAMERA_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  for(index = 0; index < 256; index++)
+  {
+    count += CameraAuto.Histogram[index];
+    sum   += CameraAuto.Histogram[index] * index;
+  }
+  
+  /* Highlights clipped by the sensor */
+  for(index = 250; index < 256; index++)
+  {
+    clipped += CameraAuto.Histogram[index];
+  }
+  
+  status->MeanLuma = (count != 0) ? (sum / count) : 0;
+  
+  /* Exposure: one brightness level per update, an image with more than 1/16
+     of clipped highlights is considered too bright */
+  if(((status->MeanLuma + config->Tolerance) < config->TargetLuma) && (clipped < (count / 16)))
+  {
+    status->Converged = 0;
+    if(brightness < 4)
+    {
+      brightness++;
+    }
+  }
+  else if((status->MeanLuma > (config->TargetLuma + config->Tolerance)) || (clipped >= (count / 16)))
+  {
+    status->Converged = 0;
+    if(brightness > 0)
+    {
+      brightness--;
+    }
+  }
+  else
+  {
+    status->Converged = 1;
+  }
+  
+  /* White balance: gray-world gains on the subsampled pixels */
+  if(config->WhiteBalance == ENABLE)
+  {
+    for(line = 0; line < Height; line += config->Step)
+    {
+      for(column = 0; column < Width; column += (4 * config->Step))
+      {
+        KERNEL_Expand(pixels[(line * Width) + column], &r, &g, &b);
+        red   += (uint32_t)r;
+        green += (uint32_t)g;
+        blue  += (uint32_t)b;
+      }
+    }
+    
+    gain_r = AUTO_Gain(status->RedGain, green, red);
+    gain_b = AUTO_Gain(status->BlueGain, green, blue);
+  }
+  
+  /* Rate limited sensor update, only for the changed settings */
+  if((HAL_GetTick() - CameraAuto.LastUpdate) >= config->UpdatePeriod)
+  {
+    if(brightness != status->Brightness)
+    {
+      status->Brightness = brightness;
+      BSP_CAMERA_ContrastBrightnessConfig(CameraContrastLevel, CameraBrightnessLevels[brightness]);
+      status->SensorUpdates++;
+      CameraAuto.LastUpdate = HAL_GetTick();
+    }
+    
+    if((gain_r != status->RedGain) || (gain_g != status->GreenGain) || (gain_b != status->BlueGain))
+    {
+      CAMERA_RegTypeDef sequence[] =
+      {
+        {OV2640_BANK_SEL,   OV2640_BANK_DSP},
+        {OV2640_AWB_GAIN_R, (uint8_t)gain_r},
+        {OV2640_AWB_GAIN_G, (uint8_t)gain_g},
+        {OV2640_AWB_GAIN_B, (uint8_t)gain_b}
+      };
+      
+      status->RedGain   = gain_r;
+      status->GreenGain = gain_g;
+      status->BlueGain  = gain_b;
+      BSP_CAMERA_LoadRegisters(sequence, sizeof(sequence) / sizeof(sequence[0]));
+      status->SensorUpdates++;
+      CameraAuto.LastUpdate = HAL_GetTick();
+    }
+  }
+  
+  if(pStatus != NULL)
+  {
+    *pStatus = *status;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Starts the camera preview on an LCD layer.
+  * @note   The LCD layer must be initialized, the camera frame must fit in the
+  *         layer at the given position.
+  * @param  buff: Pointer to the camera output buffer, the continuous capture is
+  *         started on it. If NULL, the frames of the running frame ring are
+  *         displayed.
+  * @param  LayerIndex: LCD layer receiving the video
+  * @param  Xpos: X position of the video window in the layer
+  * @param  Ypos: Y position of the video window in the layer
+  * @retval Preview mode, CAMERA_PREVIEW_NONE in case of error
+  */
+uint32_t BSP_CAMERA_PreviewStart(uint8_t *buff, uint32_t LayerIndex, uint16_t Xpos, uint16_t Ypos)
+{
+  LTDC_LayerCfgTypeDef *layer = &hltdc_eval.LayerCfg[LayerIndex];
+  uint32_t bytes_per_pixel = 0;
+  
+  PREVIEW_RestoreLayer();
+  CameraPreview.Mode = CAMERA_PREVIEW_NONE;
+  
+  if((LayerIndex >= MAX_LAYER_NUMBER) || ((buff == NULL) && (CameraRing.Active == 0)))
+  {
+    return CAMERA_PREVIEW_NONE;
+  }
+  
+  CameraPreview.Width  = CameraWindow.Width;
+  CameraPreview.Height = CameraWindow.Height;
+  
+  if(((Xpos + CameraPreview.Width) > layer->ImageWidth) || ((Ypos + CameraPreview.Height) > layer->ImageHeight))
+  {
+    return CAMERA_PREVIEW_NONE;
+  }
+  
+  switch(layer->PixelFormat)
+  {
+  case LTDC_PIXEL_FORMAT_ARGB8888:
+    bytes_per_pixel = 4;
+    hdma2d_camera.Init.ColorMode = DMA2D_ARGB8888;
+    break;
+  case LTDC_PIXEL_FORMAT_RGB888:
+    bytes_per_pixel = 3;
+    hdma2d_camera.Init.ColorMode = DMA2D_RGB888;
+    break;
+  case LTDC_PIXEL_FORMAT_RGB565:
+    bytes_per_pixel = 2;
+    hdma2d_camera.Init.ColorMode = DMA2D_RGB565;
+    break;
+  default:
+    return CAMERA_PREVIEW_NONE;
+  }
+  
+  CameraPreview.Stats.DisplayedFrames = 0;
+  CameraPreview.Stats.SkippedFrames   = 0;
+  CameraPreview.Stats.FrameRate       = 0;
+  CameraPreview.Stats.LatencyUs       = 0;
+  CameraPreview.Stats.MaxLatencyUs    = 0;
+  CameraPreview.Busy         = 0;
+  CameraPreview.WindowStart  = HAL_GetTick();
+  CameraPreview.WindowFrames = 0;
+  CameraPreview.Source       = (uint32_t)buff;
+  CameraPreview.Destination  = layer->FBStartAdress + (((Ypos * layer->ImageWidth) + Xpos) * bytes_per_pixel);
+  
+  if((buff != NULL) && (bytes_per_pixel == 2) && (Xpos == 0) && (Ypos == 0) &&
+     (layer->ImageWidth == CameraPreview.Width) && (layer->ImageHeight == CameraPreview.Height))
+  {
+    /* Same format and size: the layer scans out the camera buffer until the
+       preview is stopped */
+    CameraPreview.LayerIndex   = LayerIndex;
+    CameraPreview.LayerAddress = layer->FBStartAdress;
+    BSP_LCD_SetLayerAddress(LayerIndex, (uint32_t)buff);
+    CameraPreview.Mode = CAMERA_PREVIEW_DIRECT;
+  }
+  else
+  {
+    /* Configure the DMA2D conversion from the RGB565 camera frame */
+    hdma2d_camera.Instance          = DMA2D;
+    hdma2d_camera.Init.Mode         = DMA2D_M2M_PFC;
+    hdma2d_camera.Init.OutputOffset = layer->ImageWidth - CameraPreview.Width;
+    hdma2d_camera.XferCpltCallback  = PREVIEW_TransferComplete;
+    
+    hdma2d_camera.LayerCfg[1].AlphaMode      = DMA2D_NO_MODIF_ALPHA;
+    hdma2d_camera.LayerCfg[1].InputAlpha     = 0xFF;
+    hdma2d_camera.LayerCfg[1].InputColorMode = CM_RGB565;
+    hdma2d_camera.LayerCfg[1].InputOffset    = 0;
+    
+    if((HAL_DMA2D_Init(&hdma2d_camera) != HAL_OK) || (HAL_DMA2D_ConfigLayer(&hdma2d_camera, 1) != HAL_OK))
+    {
+      return CAMERA_PREVIEW_NONE;
+    }
+    
+    HAL_NVIC_SetPriority(DMA2D_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+    
+    CameraPreview.Mode = CAMERA_PREVIEW_DMA2D;
+  }
+  
+  if(buff != NULL)
+  {
+    BSP_CAMERA_ContinuousStart(buff);
+  }
+  
+  return CameraPreview.Mode;
+}
+
+/**
+  * @brief  Stops the camera preview, the capture keeps running.
+  * @retval Camera status
+  */
+uint8_t BSP_CAMERA_PreviewStop(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+  
+  PREVIEW_RestoreLayer();
+  CameraPreview.Mode = CAMERA_PREVIEW_NONE;
+  
+  /* Wait for the last conversion to complete */
+  while(CameraPreview.Busy != 0)
+  {
+    if((HAL_GetTick() - tickstart) > 100)
+    {
+      return CAMERA_TIMEOUT;
+    }
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Gets the camera preview statistics.
+  * @param  pStats: Pointer to the statistics structure to fill
+  */
+void BSP_CAMERA_PreviewGetStats(CAMERA_PreviewStatsTypeDef *pStats)
+{
+  *pStats = CameraPreview.Stats;
+}
+
+/**
+  * @brief  Handles DCMI interrupt request.
+  */
+void BSP_CAMERA_IRQHandler(void) 
+{
+  HAL_DCMI_IRQHandler(&hdcmi_eval);
+}
+
+/**
+  * @brief  Handles DMA interrupt request.
+  */
+void BSP_CAMERA_DMA_IRQHandler(void) 
+{
+  HAL_DMA_IRQHandler(hdcmi_eval.DMA_Handle);
+}
+
+/**
+  * @brief  Handles DMA2D interrupt request of the camera preview.
+  */
+void BSP_CAMERA_DMA2D_IRQHandler(void) 
+{
+  HAL_DMA2D_IRQHandler(&hdma2d_camera);
+}
+
+/**
+  * @brief  Get the capture size of a window.
+  * @note   The RGB565 pixels are transferred as 32-bit words by the DMA.
+  * @param  Width: Window width in pixels
+  * @param  Height: Window height in lines
+  * @retval capture size in words, 0 if the window cannot be transferred.
+  */
+static uint32_t GetSize(uint32_t Width, uint32_t Height)
+{ 
+  uint32_t size = (Width * Height * CAMERA_BYTES_PER_PIXEL) / 4;
+  uint32_t xfer_size = size;
+  uint32_t xfer_count = 1;
+  
+  /* The whole window must be a multiple of a word */
+  if(((Width * Height * CAMERA_BYTES_PER_PIXEL) % 4) != 0)
+  {
+    return 0;
+  }
+  
+  /* Above 0xFFFF words the DCMI HAL splits the transfer into equal halves,
+     the window must be split without remainder */
+  while(xfer_size > 0xFFFF)
+  {
+    xfer_size  = xfer_size / 2;
+    xfer_count = xfer_count * 2;
+  }
+  
+  if((xfer_size * xfer_count) != size)
+  {
+    return 0;
+  }
+  
+  return size;
+}
+
+/**
+  * @brief  Selects the ring slot that receives the next frame.
+  * @note   A free slot is preferred, otherwise the oldest ready frame is
+  *         recycled and counted as dropped.
+  * @retval Slot index, CAMERA_RING_MAX_FRAMES if no slot is free or ready
+  */
+static uint32_t RING_GetNextSlot(void)
+{
+  uint32_t index = 0;
+  uint32_t slot = 0;
+  uint32_t oldest = CAMERA_RING_MAX_FRAMES;
+  
+  for(index = 1; index <= CameraRing.NbFrames; index++)
+  {
+    slot = (CameraRing.CaptureSlot + index) % CameraRing.NbFrames;
+    
+    /* The preview DMA2D transfer reads this frame */
+    if(slot == CameraRing.PreviewSlot)
+    {
+      continue;
+    }
+    
+    if(CameraRing.State[slot] == CAMERA_SLOT_FREE)
+    {
+      return slot;
+    }
+    
+    if(CameraRing.State[slot] == CAMERA_SLOT_READY)
+    {
+      if((oldest == CAMERA_RING_MAX_FRAMES) ||
+         ((int32_t)(CameraRing.SlotSequence[slot] - CameraRing.SlotSequence[oldest]) < 0))
+      {
+        oldest = slot;
+      }
+    }
+  }
+  
+  if(oldest != CAMERA_RING_MAX_FRAMES)
+  {
+    CameraRing.Dropped++;
+  }
+  
+  return oldest;
+}
+
+/**
+  * @brief  Handles the end of a frame captured into the ring.
+  */
+static void RING_FrameEvent(void)
+{
+  uint32_t slot = CameraRing.CaptureSlot;
+  uint32_t next = 0;
+  
+  /* Publish the completed frame */
+  CameraRing.LastSlot           = slot;
+  CameraRing.Timestamp[slot]    = HAL_GetTick();
+  CameraRing.SlotSequence[slot] = CameraRing.Sequence++;
+  CameraRing.State[slot]        = CAMERA_SLOT_READY;
+  
+  /* The completed frame is ready, hence a slot is always found: when every
+     other slot is held, the completed frame itself is recycled */
+  next = RING_GetNextSlot();
+  CameraRing.State[next] = CAMERA_SLOT_CAPTURING;
+  CameraRing.CaptureSlot = next;
+  
+  /* Re-arm the capture on the selected slot: the snapshot is over, stopping
+     only releases the circular DMA stream and the handle state */
+  HAL_DCMI_Stop(&hdcmi_eval);
+  HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_SNAPSHOT,
+                     CameraRing.BufferAddress + (next * CameraRing.FrameSize),
+                     GetSize(CameraWindow.Width, CameraWindow.Height));
+}
+
+/**
+  * @brief  Get the frame width and height.
+  * @param  resolution: the current resolution.
+  * @param  width: Pointer to the frame width in pixels
+  * @param  height: Pointer to the frame height in lines
+  */
+static void GetResolution(uint32_t resolution, uint32_t *width, uint32_t *height)
+{
+  switch (resolution)
+  {
+  case CAMERA_R160x120:
+    *width  = 160;
+    *height = 120;
+    break;
+  case CAMERA_R320x240:
+    *width  = 320;
+    *height = 240;
+    break;
+  case CAMERA_R480x272:
+    *width  = 480;
+    *height = 272;
+    break;
+  case CAMERA_R640x480:
+    *width  = 640;
+    *height = 480;
+    break;
+  default:
+    *width  = 0;
+    *height = 0;
+    break;
+  }
+}
+
+/**
+  * @brief  Delivers the line batches written by the DMA.
+  * @note   The written lines are computed from the DMA laps and counter, so
+  *         that line events missed while the processing runs do not
+  *         desynchronize the stream.
+  */
+static void LINESTREAM_LineEvent(void)
+{
+  uint32_t pending = 0;
+  uint32_t lost = 0;
+  uint32_t first = 0;
+  uint32_t line = 0;
+  
+  LINESTREAM_Update();
+  pending = CameraLineStream.WrittenLines - CameraLineStream.DeliveredLines;
+  
+  while(pending >= CameraLineStream.BatchLines)
+  {
+    if(pending >= CameraLineStream.RingLines)
+    {
+      /* The oldest batches were overwritten: restart from the last full batch */
+      lost = pending - (pending % CameraLineStream.BatchLines) - CameraLineStream.BatchLines;
+      CameraLineStream.DeliveredLines += lost;
+      CameraLineStream.Stats.LostLines += lost;
+      CameraLineStream.Stats.Overflows++;
+    }
+    
+    first = CameraLineStream.DeliveredLines % CameraLineStream.RingLines;
+    line  = CameraLineStream.DeliveredLines % CameraWindow.Height;
+    
+    if(CameraLineStream.pY != NULL)
+    {
+      BSP_CAMERA_YUV422ToPlanar((uint8_t *)(CameraLineStream.Buffer + (first * CameraLineStream.LineSize)),
+                                CameraLineStream.pY + (line * CameraWindow.Width),
+                                (CameraLineStream.pU != NULL) ? (CameraLineStream.pU + ((line * CameraWindow.Width) / 2)) : NULL,
+                                (CameraLineStream.pV != NULL) ? (CameraLineStream.pV + ((line * CameraWindow.Width) / 2)) : NULL,
+                                CameraWindow.Width, CameraLineStream.BatchLines);
+    }
+    
+    BSP_CAMERA_LineBatchCallback((uint8_t *)(CameraLineStream.Buffer + (first * CameraLineStream.LineSize)),
+                                 line, CameraLineStream.BatchLines);
+    
+    /* The DMA reached the batch while it was processed: it was overwritten */
+    LINESTREAM_Update();
+    if((CameraLineStream.WrittenLines - CameraLineStream.DeliveredLines) >= CameraLineStream.RingLines)
+    {
+      CameraLineStream.Stats.LostLines += CameraLineStream.BatchLines;
+      CameraLineStream.Stats.Overflows++;
+    }
+    
+    CameraLineStream.DeliveredLines += CameraLineStream.BatchLines;
+    CameraLineStream.Stats.DeliveredBatches++;
+    pending = CameraLineStream.WrittenLines - CameraLineStream.DeliveredLines;
+  }
+}
+
+/**
+  * @brief  Counts a lap of the DMA on the line buffer.
+  * @param  hdma: DMA handle
+  */
+static void LINESTREAM_LapEvent(DMA_HandleTypeDef *hdma)
+{
+  CameraLineStream.Laps++;
+  
+  CameraLineStream.XferCplt(hdma);
+}
+
+/**
+  * @brief  Updates the lines completely written by the DMA.
+  */
+static void LINESTREAM_Update(void)
+{
+  uint32_t ring_size = CameraLineStream.LineSize * CameraLineStream.RingLines;
+  uint32_t laps, position, written;
+  
+  /* Position and laps from the same lap */
+  do
+  {
+    laps     = CameraLineStream.Laps;
+    position = (ring_size - (__HAL_DMA_GET_COUNTER(hdcmi_eval.DMA_Handle) * 4)) / CameraLineStream.LineSize;
+  }
+  while(laps != CameraLineStream.Laps);
+  
+  written = (laps * CameraLineStream.RingLines) + position;
+  
+  /* The DMA wrapped but its interrupt is not served yet */
+  if((int32_t)(written - CameraLineStream.WrittenLines) < 0)
+  {
+    written += CameraLineStream.RingLines;
+  }
+  
+  CameraLineStream.WrittenLines = written;
+}
+
+/**
+  * @brief  Counts a frame event, which times the frame period in snapshot mode.
+  */
+static void TELEMETRY_FrameEvent(void)
+{
+  CameraTelemetry.Data.FrameEvents++;
+  
+  /* The frame events are thinned out by the capture rate and delayed by the
+     transfer end: they only time the period when no VSYNC interrupt comes */
+  if(CameraTelemetry.VsyncSeen == 0)
+  {
+    TELEMETRY_PeriodEvent();
+  }
+  CameraTelemetry.VsyncSeen = 0;
+}
+
+/**
+  * @brief  Updates the frame period statistics at the start of a frame period.
+  */
+static void TELEMETRY_PeriodEvent(void)
+{
+  uint32_t now = BSP_GetCycleCount();
+  uint32_t period = BSP_GetElapsedUs(CameraTelemetry.LastCycles);
+  uint32_t deviation = 0;
+  uint32_t bin = 0;
+  
+  CameraTelemetry.LastCycles = now;
+  
+  /* The first period has no previous timestamp */
+  if(CameraTelemetry.Started == 0)
+  {
+    CameraTelemetry.Started = 1;
+    return;
   }
   
-  /* DCMI Initialization */
-  BSP_CAMERA_MspInit();  
-  HAL_DCMI_Init(phdcmi);
+  CameraTelemetry.Data.LastPeriodUs = period;
+  if(period < CameraTelemetry.Data.MinPeriodUs)
+  {
+    CameraTelemetry.Data.MinPeriodUs = period;
+  }
+  if(period > CameraTelemetry.Data.MaxPeriodUs)
+  {
+    CameraTelemetry.Data.MaxPeriodUs = period;
+  }
   
-  if(ov2640_ReadID(CAMERA_I2C_ADDRESS) == OV2640_ID)
-  { 
-    /* Initialize the camera driver structure */
-    camera_drv = &ov2640_drv;     
-    
-    /* Camera Init */   
-    camera_drv->Init(CAMERA_I2C_ADDRESS, Resolution);
+  if(CameraTelemetry.Periods == 0)
+  {
+    CameraTelemetry.Data.MeanPeriodUs = period;
+  }
+  else
+  {
+    /* Jitter against the mean of the previous periods */
+    deviation = (period > CameraTelemetry.Data.MeanPeriodUs) ?
+                (period - CameraTelemetry.Data.MeanPeriodUs) : (CameraTelemetry.Data.MeanPeriodUs - period);
+    bin = deviation / CAMERA_JITTER_BIN_US;
+    if(bin >= CAMERA_JITTER_BINS)
+    {
+      bin = CAMERA_JITTER_BINS - 1;
+    }
+    CameraTelemetry.Data.JitterHistogram[bin]++;
     
-    /* Return CAMERA_OK status */
-    ret = CAMERA_OK;
-  } 
-  
-  current_resolution = Resolution;
+    /* Running mean over the last 16 periods */
+    CameraTelemetry.Data.MeanPeriodUs = (int32_t)CameraTelemetry.Data.MeanPeriodUs +
+                                        (((int32_t)period - (int32_t)CameraTelemetry.Data.MeanPeriodUs) / 16);
+  }
+  CameraTelemetry.Periods++;
   
-  return ret;
+  if(CameraTelemetry.Data.MeanPeriodUs != 0)
+  {
+    CameraTelemetry.Data.FrameRate = 100000000 / CameraTelemetry.Data.MeanPeriodUs;
+  }
 }
 
 /**
-  * @brief  Starts the camera capture in continuous mode.
-  * @param  buff: pointer to the camera output buffer
+  * @brief  Loads four luma pixels packed in a word.
+  * @param  pFrame: Pointer to the frame
+  * @param  Offset: Offset of the four pixels, in words of luma
+  * @retval Four 8-bit luma values, first pixel in the low byte
   */
-void BSP_CAMERA_ContinuousStart(uint8_t *buff)
-{ 
-  /* Start the camera capture */
-  HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_CONTINUOUS, (uint32_t)buff, GetSize(current_resolution));  
+static uint32_t MOTION_LoadLuma4(uint8_t *pFrame, uint32_t Offset)
+{
+  uint32_t first = 0, second = 0;
+  
+  if(CameraMotion.Config.PixelFormat == CAMERA_PIXEL_FORMAT_Y8)
+  {
+    return ((uint32_t *)pFrame)[Offset];
+  }
+  
+  /* Two RGB565 pixels per word: keep the 6-bit green of each one, scaled
+     to 8 bits, in bytes 0 and 1 */
+  first  = ((uint32_t *)pFrame)[2 * Offset];
+  second = ((uint32_t *)pFrame)[(2 * Offset) + 1];
+  first  = ((first >> 3) & 0x000000FC) | ((first >> 11) & 0x0000FC00);
+  second = ((second >> 3) & 0x000000FC) | ((second >> 11) & 0x0000FC00);
+  
+  return (first | (second << 16));
 }
 
 /**
-  * @brief  Starts the camera capture in snapshot mode.
-  * @param  buff: pointer to the camera output buffer
+  * @brief  Accumulates the absolute differences of four packed pixels.
+  * @param  Pixels: Four packed pixels
+  * @param  Background: Four packed background pixels
+  * @param  Sum: Accumulator
+  * @retval Updated accumulator
   */
-void BSP_CAMERA_SnapshotStart(uint8_t *buff)
-{ 
-  /* Start the camera capture */
-  HAL_DCMI_Start_DMA(&hdcmi_eval, DCMI_MODE_SNAPSHOT, (uint32_t)buff, GetSize(current_resolution));  
+static uint32_t MOTION_Sad4(uint32_t Pixels, uint32_t Background, uint32_t Sum)
+{
+#if (__CORTEX_M >= 0x04)
+  return __USADA8(Pixels, Background, Sum);
+#else
+  uint32_t index = 0;
+  int32_t diff = 0;
+  
+  for(index = 0; index < 32; index += 8)
+  {
+    diff = (int32_t)((Pixels >> index) & 0xFF) - (int32_t)((Background >> index) & 0xFF);
+    Sum += (diff < 0) ? -diff : diff;
+  }
+  return Sum;
+#endif
 }
 
 /**
-  * @brief Suspend the CAMERA capture 
+  * @brief  Moves four packed background pixels by 1/4 toward the frame.
+  * @param  Pixels: Four packed pixels
+  * @param  Background: Four packed background pixels
+  * @retval Updated background pixels
   */
-void BSP_CAMERA_Suspend(void) 
+static uint32_t MOTION_Blend4(uint32_t Pixels, uint32_t Background)
 {
-  /* Suspend the Camera Capture */
-  HAL_DCMI_Suspend(&hdcmi_eval);
+#if (__CORTEX_M >= 0x04)
+  return __UHADD8(Background, __UHADD8(Background, Pixels));
+#else
+  /* Per-byte halving add without carries between the bytes */
+  uint32_t half = (Background & Pixels) + (((Background ^ Pixels) >> 1) & 0x7F7F7F7F);
+  return ((Background & half) + (((Background ^ half) >> 1) & 0x7F7F7F7F));
+#endif
 }
 
 /**
-  * @brief Resume the CAMERA capture
+  * @brief  Expands an RGB565 pixel to 8-bit components.
+  * @param  Pixel: RGB565 pixel
+  * @param  R: Pointer to the red component
+  * @param  G: Pointer to the green component
+  * @param  B: Pointer to the blue component
   */
-void BSP_CAMERA_Resume(void) 
+static void KERNEL_Expand(uint32_t Pixel, int32_t *R, int32_t *G, int32_t *B)
 {
-  /* Start the Camera Capture */
-  HAL_DCMI_Resume(&hdcmi_eval);
+  *R = (int32_t)(((Pixel >> 8) & 0xF8) | ((Pixel >> 13) & 0x07));
+  *G = (int32_t)(((Pixel >> 3) & 0xFC) | ((Pixel >> 9) & 0x03));
+  *B = (int32_t)(((Pixel << 3) & 0xF8) | ((Pixel >> 2) & 0x07));
 }
 
 /**
-  * @brief  Stop the CAMERA capture 
-  * @retval Camera status
+  * @brief  Computes the luma of an RGB565 pixel.
+  * @param  Pixel: RGB565 pixel
+  * @retval 8-bit luma
   */
-uint8_t BSP_CAMERA_Stop(void) 
+static uint32_t KERNEL_Luma(uint32_t Pixel)
 {
-  DCMI_HandleTypeDef *phdcmi;
+  int32_t r = 0, g = 0, b = 0;
   
-  uint8_t ret = CAMERA_ERROR;
+  KERNEL_Expand(Pixel, &r, &g, &b);
   
-  /* Get the DCMI handle structure */
-  phdcmi = &hdcmi_eval;
+  return (uint32_t)(((77 * r) + (150 * g) + (29 * b) + 128) >> 8);
+}
+
+/**
+  * @brief  Computes the next white balance gain of a channel.
+  * @note   The gain moves half way toward the gray-world gain, and is left
+  *         unchanged below a 1/32 difference to avoid useless sensor updates.
+  * @param  Current: Gain currently applied
+  * @param  Reference: Sum of the green component
+  * @param  Channel: Sum of the corrected channel component
+  * @retval New gain
+  */
+static uint32_t AUTO_Gain(uint32_t Current, uint32_t Reference, uint32_t Channel)
+{
+  uint32_t target = 0;
   
-  if(HAL_DCMI_Stop(phdcmi) == HAL_OK)
+  if(Channel == 0)
   {
-    ret = CAMERA_OK;
+    return Current;
   }
   
-  /* Initialize IO */
-  BSP_IO_Init();
+  /* The channel sum was measured with the current gain applied */
+  target = (uint32_t)(((uint64_t)Current * Reference) / Channel);
   
-  /* Reset the camera STANDBY pin */
-  BSP_IO_ConfigPin(XSDN_PIN, IO_MODE_OUTPUT);
-  BSP_IO_WritePin(XSDN_PIN, RESET);  
+  if(target < CAMERA_AWB_GAIN_MIN)
+  {
+    target = CAMERA_AWB_GAIN_MIN;
+  }
+  if(target > CAMERA_AWB_GAIN_MAX)
+  {
+    target = CAMERA_AWB_GAIN_MAX;
+  }
   
-  return ret;
+  if(((target > Current) ? (target - Current) : (Current - target)) < (CAMERA_AWB_GAIN_UNITY / 32))
+  {
+    return Current;
+  }
+  
+  return ((Current + target + 1) / 2);
 }
 
 /**
-  * @brief  Configures the camera contrast and brightness.
-  * @param  contrast_level: Contrast level
-  *          This parameter can be one of the following values:
-  *            @arg  CAMERA_CONTRAST_LEVEL4: for contrast +2
-  *            @arg  CAMERA_CONTRAST_LEVEL3: for contrast +1
-  *            @arg  CAMERA_CONTRAST_LEVEL2: for contrast  0
-  *            @arg  CAMERA_CONTRAST_LEVEL1: for contrast -1
-  *            @arg  CAMERA_CONTRAST_LEVEL0: for contrast -2
-  * @param  brightness_level: Contrast level
-  *          This parameter can be one of the following values:
-  *            @arg  CAMERA_BRIGHTNESS_LEVEL4: for brightness +2
-  *            @arg  CAMERA_BRIGHTNESS_LEVEL3: for brightness +1
-  *            @arg  CAMERA_BRIGHTNESS_LEVEL2: for brightness  0
-  *            @arg  CAMERA_BRIGHTNESS_LEVEL1: for brightness -1
-  *            @arg  CAMERA_BRIGHTNESS_LEVEL0: for brightness -2    
+  * @brief  Updates the preview on a completed frame.
+  * @param  frame: Address of the completed frame
+  * @param  slot: Ring slot of the frame, CAMERA_RING_MAX_FRAMES out of ring mode
   */
-void BSP_CAMERA_ContrastBrightnessConfig(uint32_t contrast_level, uint32_t brightness_level)
+static void PREVIEW_FrameEvent(uint32_t frame, uint32_t slot)
 {
-  if(camera_drv->Config != NULL)
+  CameraPreview.FrameEndCycles = BSP_GetCycleCount();
+  
+  if(CameraPreview.Mode == CAMERA_PREVIEW_DIRECT)
   {
-    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_CONTRAST_BRIGHTNESS, contrast_level, brightness_level);
-  }  
+    /* The LTDC already scans out the camera buffer */
+    PREVIEW_Displayed();
+  }
+  else if((CameraPreview.Busy != 0) ||
+          ((slot != CAMERA_RING_MAX_FRAMES) && (CameraRing.State[slot] == CAMERA_SLOT_CAPTURING)))
+  {
+    /* Previous conversion running, or frame recycled by the capture */
+    CameraPreview.Stats.SkippedFrames++;
+  }
+  else
+  {
+    /* The ring slot is not recycled until the end of the conversion */
+    CameraPreview.Busy     = 1;
+    CameraRing.PreviewSlot = slot;
+    if(HAL_DMA2D_Start_IT(&hdma2d_camera, frame, CameraPreview.Destination,
+                          CameraPreview.Width, CameraPreview.Height) != HAL_OK)
+    {
+      CameraRing.PreviewSlot = CAMERA_RING_MAX_FRAMES;
+      CameraPreview.Busy     = 0;
+      CameraPreview.Stats.SkippedFrames++;
+    }
+  }
 }
 
 /**
-  * @brief  Configures the camera white balance.
-  * @param  Mode: black_white mode
-  *          This parameter can be one of the following values:
-  *            @arg  CAMERA_BLACK_WHITE_BW
-  *            @arg  CAMERA_BLACK_WHITE_NEGATIVE
-  *            @arg  CAMERA_BLACK_WHITE_BW_NEGATIVE
-  *            @arg  CAMERA_BLACK_WHITE_NORMAL       
+  * @brief  Accounts a frame made visible on the LCD layer.
   */
-void BSP_CAMERA_BlackWhiteConfig(uint32_t Mode)
+static void PREVIEW_Displayed(void)
 {
-  if(camera_drv->Config != NULL)
+  uint32_t latency = BSP_GetElapsedUs(CameraPreview.FrameEndCycles);
+  uint32_t elapsed = HAL_GetTick() - CameraPreview.WindowStart;
+  
+  CameraPreview.Stats.DisplayedFrames++;
+  CameraPreview.Stats.LatencyUs = latency;
+  if(latency > CameraPreview.Stats.MaxLatencyUs)
   {
-    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_BLACK_WHITE, Mode, 0);
-  }  
+    CameraPreview.Stats.MaxLatencyUs = latency;
+  }
+  
+  /* Frame rate computed over one second windows */
+  CameraPreview.WindowFrames++;
+  if(elapsed >= 1000)
+  {
+    CameraPreview.Stats.FrameRate = (CameraPreview.WindowFrames * 1000) / elapsed;
+    CameraPreview.WindowFrames    = 0;
+    CameraPreview.WindowStart    += elapsed;
+  }
 }
 
 /**
-  * @brief  Configures the camera color effect.
-  * @param  Effect: Color effect
-  *          This parameter can be one of the following values:
-  *            @arg  CAMERA_COLOR_EFFECT_ANTIQUE               
-  *            @arg  CAMERA_COLOR_EFFECT_BLUE        
-  *            @arg  CAMERA_COLOR_EFFECT_GREEN    
-  *            @arg  CAMERA_COLOR_EFFECT_RED        
+  * @brief  DMA2D preview transfer complete callback.
+  * @param  hdma2d: DMA2D handle
   */
-void BSP_CAMERA_ColorEffectConfig(uint32_t Effect)
+static void PREVIEW_TransferComplete(DMA2D_HandleTypeDef *hdma2d)
 {
-  if(camera_drv->Config != NULL)
-  {
-    camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_COLOR_EFFECT, Effect, 0);
-  }  
+  PREVIEW_Displayed();
+  CameraRing.PreviewSlot = CAMERA_RING_MAX_FRAMES;
+  CameraPreview.Busy     = 0;
 }
 
 /**
-  * @brief  Handles DCMI interrupt request.
+  * @brief  Gives back its frame buffer to the layer scanning out the camera
+  *         buffer in direct preview mode.
   */
-void BSP_CAMERA_IRQHandler(void) 
+static void PREVIEW_RestoreLayer(void)
 {
-  HAL_DCMI_IRQHandler(&hdcmi_eval);
+  if(CameraPreview.Mode == CAMERA_PREVIEW_DIRECT)
+  {
+    BSP_LCD_SetLayerAddress(CameraPreview.LayerIndex, CameraPreview.LayerAddress);
+  }
 }
 
 /**
-  * @brief  Handles DMA interrupt request.
+  * @brief  Checks whether a sensor register already holds a value.
+  * @param  Reg: Register address in the selected bank
+  * @param  Value: Target value
+  * @retval 1 if the write can be skipped, 0 otherwise
   */
-void BSP_CAMERA_DMA_IRQHandler(void) 
+static uint32_t LOADER_IsCached(uint8_t Reg, uint8_t Value)
 {
-  HAL_DMA_IRQHandler(hdcmi_eval.DMA_Handle);
+  uint32_t bank = CameraLoader.Bank;
+  
+  if(bank >= CAMERA_SHADOW_BANKS)
+  {
+    return 0;
+  }
+  
+  /* The reset registers trigger an action on each write */
+  if(((bank == OV2640_BANK_DSP) && (Reg == OV2640_DSP_RESET)) ||
+     ((bank == OV2640_BANK_SENSOR) && (Reg == OV2640_SENSOR_COM7)))
+  {
+    return 0;
+  }
+  
+  return (((CameraLoader.Valid[bank][Reg / 32] & (1UL << (Reg % 32))) != 0) &&
+          (CameraLoader.Value[bank][Reg] == Value));
 }
 
 /**
-  * @brief  Get the capture size.
-  * @param  resolution: the current resolution.
-  * @retval capture size.
+  * @brief  Writes the next register, or the next burst of consecutive
+  *         registers, of the current sequence and updates the shadow.
+  * @retval Camera status
   */
-static uint32_t GetSize(uint32_t resolution)
-{ 
-  uint32_t size = 0;
+static uint8_t LOADER_WriteNext(void)
+{
+  const CAMERA_RegTypeDef *seq = &CameraLoader.pSequence[CameraLoader.Index];
+  uint8_t  data[CAMERA_BURST_MAX_LENGTH];
+  uint32_t length = 1, index = 0, bank = CameraLoader.Bank;
   
-  /* Get capture size */
-  switch (resolution)
+  /* Bank select, only written when the bank changes */
+  if(seq[0].Reg == OV2640_BANK_SEL)
   {
-  case CAMERA_R160x120:
+    CameraLoader.Index++;
+    if(bank == (uint32_t)(seq[0].Value & OV2640_BANK_SENSOR))
     {
-      size =  0x2580;
+      CameraLoader.Stats.Skipped++;
+      return CAMERA_OK;
     }
-    break;    
-  case CAMERA_R320x240:
+    CAMERA_IO_Write(CAMERA_I2C_ADDRESS, OV2640_BANK_SEL, seq[0].Value);
+    CameraLoader.Bank = (uint32_t)(seq[0].Value & OV2640_BANK_SENSOR);
+    CameraLoader.Stats.Written++;
+    CameraLoader.Stats.Transactions++;
+    return CAMERA_OK;
+  }
+  
+  /* Skip the registers already at the target value */
+  if(LOADER_IsCached(seq[0].Reg, seq[0].Value))
+  {
+    CameraLoader.Index++;
+    CameraLoader.Stats.Skipped++;
+    return CAMERA_OK;
+  }
+  
+  data[0] = seq[0].Value;
+  
+#if (CAMERA_SCCB_BURST_WRITE == 1)
+  /* Extend the write to the following consecutive registers */
+  while(((CameraLoader.Index + length) < CameraLoader.Count) &&
+        (length < CAMERA_BURST_MAX_LENGTH) &&
+        (seq[length].Reg == (uint8_t)(seq[0].Reg + length)) &&
+        (seq[length].Reg != OV2640_BANK_SEL))
+  {
+    data[length] = seq[length].Value;
+    length++;
+  }
+  
+  if(length > 1)
+  {
+    if(CAMERA_IO_WriteMultiple(CAMERA_I2C_ADDRESS, seq[0].Reg, data, (uint16_t)length) != HAL_OK)
     {
-      size =  0x9600;
+      return CAMERA_ERROR;
     }
-    break;
-  case CAMERA_R480x272:
+  }
+  else
+#endif
+  {
+    CAMERA_IO_Write(CAMERA_I2C_ADDRESS, seq[0].Reg, data[0]);
+  }
+  
+  CameraLoader.Index += length;
+  CameraLoader.Stats.Written += length;
+  CameraLoader.Stats.Transactions++;
+  
+  if(bank < CAMERA_SHADOW_BANKS)
+  {
+    for(index = 0; index < length; index++)
     {
-      size =  0xFF00;
+      /* A sensor software reset restores the default register values */
+      if((bank == OV2640_BANK_SENSOR) && (seq[index].Reg == OV2640_SENSOR_COM7) &&
+         ((seq[index].Value & OV2640_COM7_SRST) != 0))
+      {
+        BSP_CAMERA_InvalidateRegisters();
+        LOADER_ClearReplay();
+        CameraLoader.Bank = bank;
+      }
+      CameraLoader.Value[bank][seq[index].Reg] = seq[index].Value;
+      CameraLoader.Valid[bank][seq[index].Reg / 32] |= (1UL << (seq[index].Reg % 32));
+      CameraLoader.Replay[bank][seq[index].Reg / 32] |= (1UL << (seq[index].Reg % 32));
     }
-    break;
-  case CAMERA_R640x480:
-    {
-      size =  0x25800;
-    }    
-    break;
-  default:
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Stops the capture and the features re-arming it.
+  * @retval Camera status
+  */
+static uint8_t CAMERA_StopCapture(void)
+{
+  /* Prevent the frame event from re-arming the capture */
+  CameraRing.Active = 0;
+  PREVIEW_RestoreLayer();
+  CameraPreview.Mode = CAMERA_PREVIEW_NONE;
+  CameraLineStream.Active = 0;
+  __HAL_DCMI_DISABLE_IT(&hdcmi_eval, DCMI_IT_LINE);
+  HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 0x0F, 0);
+  
+  if(HAL_DCMI_Stop(&hdcmi_eval) != HAL_OK)
+  {
+    return CAMERA_ERROR;
+  }
+  
+  return CAMERA_OK;
+}
+
+/**
+  * @brief  Reprograms a sensor that lost its configuration in standby.
+  * @note   The registers written through the sequence loader since
+  *         BSP_CAMERA_Init() (YUV422 format, manual white balance, user
+  *         sequences) are replayed from the replay log, which the Config
+  *         functions do not clear. The contrast, brightness and effect are
+  *         applied last, as they are the most recently updated settings.
+  */
+static void STANDBY_Reload(void)
+{
+  uint32_t bank = 0, reg = 0;
+  
+  camera_drv->Init(CAMERA_I2C_ADDRESS, current_resolution);
+  
+  for(bank = 0; bank < CAMERA_SHADOW_BANKS; bank++)
+  {
+    CAMERA_IO_Write(CAMERA_I2C_ADDRESS, OV2640_BANK_SEL, (uint8_t)bank);
+    
+    for(reg = 0; reg < OV2640_BANK_SEL; reg++)
     {
-      break;
+      if(((CameraLoader.Replay[bank][reg / 32] & (1UL << (reg % 32))) != 0) &&
+         !(((bank == OV2640_BANK_DSP) && (reg == OV2640_DSP_RESET)) ||
+           ((bank == OV2640_BANK_SENSOR) && (reg == OV2640_SENSOR_COM7))))
+      {
+        CAMERA_IO_Write(CAMERA_I2C_ADDRESS, (uint8_t)reg, CameraLoader.Value[bank][reg]);
+      }
     }
   }
   
-  return size;
+  camera_drv->Config(CAMERA_I2C_ADDRESS, CAMERA_CONTRAST_BRIGHTNESS, CameraContrastLevel, CameraBrightnessLevel);
+  if(CameraStandby.Effect != 0xFFFFFFFF)
+  {
+    camera_drv->Config(CAMERA_I2C_ADDRESS, CameraStandby.Effect, CameraStandby.EffectValue, 0);
+  }
+  
+  /* The Config functions may have overwritten replayed registers */
+  BSP_CAMERA_InvalidateRegisters();
+}
+
+/**
+  * @brief  Clears the log of the registers replayed by STANDBY_Reload().
+  */
+static void LOADER_ClearReplay(void)
+{
+  uint32_t bank = 0, index = 0;
+  
+  for(bank = 0; bank < CAMERA_SHADOW_BANKS; bank++)
+  {
+    for(index = 0; index < (256 / 32); index++)
+    {
+      CameraLoader.Replay[bank][index] = 0;
+    }
+  }
 }
 
 /**
@@ -429,6 +2777,11 @@ __weak void BSP_CAMERA_MspInit(void)
   */
 void HAL_DCMI_LineEventCallback(DCMI_HandleTypeDef *hdcmi)
 {        
+  if(CameraLineStream.Active != 0)
+  {
+    LINESTREAM_LineEvent();
+  }
+  
   BSP_CAMERA_LineEventCallback();
 }
 
@@ -442,12 +2795,30 @@ __weak void BSP_CAMERA_LineEventCallback(void)
    */
 }
 
+/**
+  * @brief  Line batch callback of the line streaming mode.
+  * @param  pLines: Pointer to the first line of the batch
+  * @param  FirstLine: Index of the first line of the batch in the frame
+  * @param  NbLines: Number of lines of the batch
+  */
+__weak void BSP_CAMERA_LineBatchCallback(uint8_t *pLines, uint32_t FirstLine, uint32_t NbLines)
+{
+  /* NOTE : This function Should not be modified, when the callback is needed,
+            the BSP_CAMERA_LineBatchCallback could be implemented in the user file
+   */
+}
+
 /**
   * @brief  VSYNC event callback
   * @param  hdcmi: pointer to the DCMI handle  
   */
 void HAL_DCMI_VsyncEventCallback(DCMI_HandleTypeDef *hdcmi)
 {        
+  /* Every sensor frame starts with VSYNC, whatever the capture rate */
+  TELEMETRY_PeriodEvent();
+  CameraTelemetry.Data.VsyncEvents++;
+  CameraTelemetry.VsyncSeen = 1;
+  
   BSP_CAMERA_VsyncEventCallback();
 }
 
@@ -467,6 +2838,33 @@ __weak void BSP_CAMERA_VsyncEventCallback(void)
   */
 void HAL_DCMI_FrameEventCallback(DCMI_HandleTypeDef *hdcmi)
 {        
+  TELEMETRY_FrameEvent();
+  
+  
+  if(CameraStandby.FirstFramePending != 0)
+  {
+    CameraStandby.FirstFramePending = 0;
+    CameraStandby.Stats.FirstFrameUs = BSP_GetElapsedUs(CameraStandby.WakeupStartCycles);
+  }
+  
+  if(CameraRing.Active != 0)
+  {
+    RING_FrameEvent();
+  }
+  
+  if(CameraPreview.Mode != CAMERA_PREVIEW_NONE)
+  {
+    if(CameraPreview.Source != 0)
+    {
+      PREVIEW_FrameEvent(CameraPreview.Source, CAMERA_RING_MAX_FRAMES);
+    }
+    else
+    {
+      /* In ring mode the preview shows the frame that has just completed */
+      PREVIEW_FrameEvent(CameraRing.BufferAddress + (CameraRing.LastSlot * CameraRing.FrameSize), CameraRing.LastSlot);
+    }
+  }
+  
   BSP_CAMERA_FrameEventCallback();
 }
 
@@ -486,6 +2884,24 @@ __weak void BSP_CAMERA_FrameEventCallback(void)
   */
 void HAL_DCMI_ErrorCallback(DCMI_HandleTypeDef *hdcmi)
 {        
+  uint32_t error = HAL_DCMI_GetError(hdcmi);
+  
+  if((error & HAL_DCMI_ERROR_OVR) != 0)
+  {
+    CameraTelemetry.Data.OverrunErrors++;
+  }
+  if((error & HAL_DCMI_ERROR_SYNC) != 0)
+  {
+    CameraTelemetry.Data.SyncErrors++;
+  }
+  if((error & HAL_DCMI_ERROR_DMA) != 0)
+  {
+    CameraTelemetry.Data.DmaErrors++;
+  }
+  
+  /* Count each error once */
+  hdcmi->ErrorCode = HAL_DCMI_ERROR_NONE;
+  
   BSP_CAMERA_ErrorCallback();
 }
 
@@ -32,6 +32,9 @@
 /* Include IO Driver */
 #include "stm324x9i_eval_io.h"   
 
+/* Include LCD Driver (camera preview) */
+#include "stm324x9i_eval_lcd.h"
+
 /** @addtogroup BSP
   * @{
   */
@@ -55,8 +58,160 @@ typedef enum
 {
   CAMERA_OK       = 0x00,
   CAMERA_ERROR    = 0x01,
-  CAMERA_TIMEOUT  = 0x02 
+  CAMERA_TIMEOUT  = 0x02,
+  CAMERA_BUSY     = 0x03
 }Camera_StatusTypeDef;
+
+/** 
+  * @brief  Camera frame descriptor returned by the frame ring  
+  */
+typedef struct
+{
+  uint8_t  *pBuffer;        /* Start address of the captured frame           */
+  uint32_t Size;            /* Frame size in bytes                           */
+  uint32_t Width;           /* Frame width in pixels                         */
+  uint32_t Height;          /* Frame height in lines                         */
+  uint32_t Timestamp;       /* HAL tick (ms) at which the frame completed    */
+  uint32_t Sequence;        /* Frame sequence number since the ring start    */
+  uint32_t Index;           /* Ring slot index, to be given back on release  */
+}CAMERA_FrameTypeDef;
+
+/** 
+  * @brief  Camera sensor register/value pair  
+  */
+typedef struct
+{
+  uint8_t Reg;
+  uint8_t Value;
+}CAMERA_RegTypeDef;
+
+/** 
+  * @brief  Camera register sequence loader statistics  
+  */
+typedef struct
+{
+  uint32_t Written;         /* Registers written to the sensor                */
+  uint32_t Skipped;         /* Registers already at the target value          */
+  uint32_t Transactions;    /* I2C transactions issued                        */
+  uint32_t DurationUs;      /* Duration of the last completed sequence (us)   */
+}CAMERA_LoaderStatsTypeDef;
+
+/** 
+  * @brief  Camera standby and wakeup statistics  
+  */
+typedef struct
+{
+  uint32_t Wakeups;         /* Wakeups from standby                           */
+  uint32_t Reloads;         /* Wakeups that had to reprogram the sensor       */
+  uint32_t WakeupUs;        /* Duration of the last BSP_CAMERA_Wakeup() (us)  */
+  uint32_t FirstFrameUs;    /* Last wakeup to first frame (us), 0 if pending  */
+}CAMERA_WakeupStatsTypeDef;
+
+/** 
+  * @brief  Camera frame ring statistics  
+  */
+typedef struct
+{
+  uint32_t CapturedFrames;  /* Frames completed by the DCMI                  */
+  uint32_t DroppedFrames;   /* Ready frames overwritten before being acquired */
+  uint32_t PendingFrames;   /* Frames ready and not yet acquired             */
+}CAMERA_RingStatsTypeDef;
+
+/** 
+  * @brief  Camera line streaming statistics  
+  */
+typedef struct
+{
+  uint32_t DeliveredBatches; /* Line batches given to BSP_CAMERA_LineBatchCallback */
+  uint32_t Overflows;        /* Batches overwritten before being delivered       */
+  uint32_t LostLines;        /* Lines lost because of the overflows              */
+}CAMERA_LineStreamStatsTypeDef;
+
+/* Camera telemetry frame period jitter histogram: the last bin gathers the
+   deviations above (CAMERA_JITTER_BINS - 1) x CAMERA_JITTER_BIN_US */
+#define CAMERA_JITTER_BINS       ((uint32_t)8)
+#define CAMERA_JITTER_BIN_US     ((uint32_t)250)
+
+/** 
+  * @brief  Camera frame timing and error telemetry  
+  */
+typedef struct
+{
+  uint32_t VsyncEvents;     /* VSYNC events received                          */
+  uint32_t FrameEvents;     /* Frame events received                          */
+  uint32_t FrameRate;       /* Frames per second x100, from the mean period   */
+  uint32_t LastPeriodUs;    /* Last VSYNC to VSYNC frame period (us)          */
+  uint32_t MeanPeriodUs;    /* Running mean of the frame period (us)          */
+  uint32_t MinPeriodUs;     /* Shortest frame period (us)                     */
+  uint32_t MaxPeriodUs;     /* Longest frame period (us)                      */
+  uint32_t JitterHistogram[CAMERA_JITTER_BINS]; /* |period - mean|, bins of CAMERA_JITTER_BIN_US */
+  uint32_t OverrunErrors;   /* DCMI FIFO overruns (DMA not fast enough)       */
+  uint32_t SyncErrors;      /* Embedded synchronization errors                */
+  uint32_t DmaErrors;       /* DMA transfer errors                            */
+}CAMERA_TelemetryTypeDef;
+
+/** 
+  * @brief  Camera motion detection configuration  
+  */
+typedef struct
+{
+  uint32_t Width;           /* Frame width in pixels, multiple of BlockSize   */
+  uint32_t Height;          /* Frame height in lines, multiple of BlockSize   */
+  uint32_t PixelFormat;     /* CAMERA_PIXEL_FORMAT_RGB565 or _Y8              */
+  uint32_t BlockSize;       /* Block size in pixels, multiple of 4            */
+  uint32_t Threshold;       /* Mean absolute difference per pixel (0..255)
+                               above which a block is in motion               */
+  uint8_t  *pBackground;    /* Background model, Width x Height bytes         */
+  uint8_t  *pMask;          /* Motion mask, one byte per block (1 = motion)   */
+}CAMERA_MotionConfigTypeDef;
+
+/** 
+  * @brief  Camera motion detection result  
+  */
+typedef struct
+{
+  uint32_t MotionBlocks;    /* Blocks in motion in the last frame             */
+  uint32_t ProcessUs;       /* Processing time of the last frame (us)         */
+  uint32_t Frames;          /* Frames processed since the initialization      */
+}CAMERA_MotionResultTypeDef;
+
+/** 
+  * @brief  Camera auto-exposure and white balance configuration  
+  */
+typedef struct
+{
+  uint32_t TargetLuma;      /* Mean luma to reach (0..255)                    */
+  uint32_t Tolerance;       /* Dead band around the target, no correction     */
+  uint32_t UpdatePeriod;    /* Minimum delay between two sensor updates (ms)  */
+  uint32_t Step;            /* Statistics subsampling step, 1 for all pixels  */
+  uint32_t WhiteBalance;    /* ENABLE to run the gray-world white balance     */
+}CAMERA_AutoConfigTypeDef;
+
+/** 
+  * @brief  Camera auto-exposure and white balance status  
+  */
+typedef struct
+{
+  uint32_t MeanLuma;        /* Mean luma of the last processed frame          */
+  uint32_t Brightness;      /* Brightness level applied (0..4)                */
+  uint32_t RedGain;         /* Red gain applied, 0x40 = 1.0                   */
+  uint32_t GreenGain;       /* Green gain applied, 0x40 = 1.0                 */
+  uint32_t BlueGain;        /* Blue gain applied, 0x40 = 1.0                  */
+  uint32_t SensorUpdates;   /* Sensor updates issued over I2C                 */
+  uint32_t Converged;       /* 1 when the luma is within the tolerance        */
+}CAMERA_AutoStatusTypeDef;
+
+/** 
+  * @brief  Camera preview statistics  
+  */
+typedef struct
+{
+  uint32_t DisplayedFrames; /* Frames transferred to the LCD layer           */
+  uint32_t SkippedFrames;   /* Frames not displayed, previous copy not done  */
+  uint32_t FrameRate;       /* Displayed frames per second, last second      */
+  uint32_t LatencyUs;       /* Last frame end to display buffer update (us)  */
+  uint32_t MaxLatencyUs;    /* Worst latency since the preview start (us)    */
+}CAMERA_PreviewStatsTypeDef;
   
 /**
   * @}
@@ -69,6 +224,39 @@ typedef enum
 #define RESOLUTION_R320x240      CAMERA_R320x240      /* QVGA Resolution      */
 #define RESOLUTION_R480x272      CAMERA_R480x272      /* 480x272 Resolution   */
 #define RESOLUTION_R640x480      CAMERA_R640x480      /* VGA Resolution       */
+
+/* Bytes per pixel of the captured RGB565 frames */
+#define CAMERA_BYTES_PER_PIXEL   ((uint32_t)2)
+
+/* Register sequence loader: set to 1 when the sensor auto-increments the
+   register address, contiguous registers are then written in bursts */
+#if !defined(CAMERA_SCCB_BURST_WRITE)
+ #define CAMERA_SCCB_BURST_WRITE  0
+#endif
+#define CAMERA_BURST_MAX_LENGTH  ((uint32_t)16)
+
+/* Sensor settling time after the release of the standby pin (ms) */
+#if !defined(CAMERA_WAKEUP_DELAY)
+ #define CAMERA_WAKEUP_DELAY      ((uint32_t)2)
+#endif
+
+/* Camera frame pixel formats */
+#define CAMERA_PIXEL_FORMAT_RGB565    ((uint32_t)0x00)  /* RGB565 output of the sensor  */
+#define CAMERA_PIXEL_FORMAT_Y8        ((uint32_t)0x01)  /* 8-bit luma plane             */
+#define CAMERA_PIXEL_FORMAT_YUV422    ((uint32_t)0x02)  /* YUYV output of the sensor    */
+
+/* Camera frame decimation */
+#define CAMERA_CAPTURE_ALL_FRAMES     DCMI_CR_ALL_FRAME
+#define CAMERA_CAPTURE_1_OF_2_FRAMES  DCMI_CR_ALTERNATE_2_FRAME
+#define CAMERA_CAPTURE_1_OF_4_FRAMES  DCMI_CR_ALTERNATE_4_FRAME
+
+/* Maximum number of frames handled by the camera frame ring */
+#define CAMERA_RING_MAX_FRAMES   ((uint32_t)8)
+
+/* Camera preview modes */
+#define CAMERA_PREVIEW_NONE      ((uint32_t)0x00)  /* Preview not running                */
+#define CAMERA_PREVIEW_DMA2D     ((uint32_t)0x01)  /* Frame converted by DMA2D to layer  */
+#define CAMERA_PREVIEW_DIRECT    ((uint32_t)0x02)  /* Layer scans out the frame buffer   */
 /**
   * @}
   */
@@ -77,11 +265,15 @@ typedef enum
   * @{
   */    
 uint8_t BSP_CAMERA_Init(uint32_t Resolution);  
+uint8_t BSP_CAMERA_InitEx(uint32_t Resolution, uint32_t PixelFormat);
 void    BSP_CAMERA_ContinuousStart(uint8_t *buff);
 void    BSP_CAMERA_SnapshotStart(uint8_t *buff);
 void    BSP_CAMERA_Suspend(void);
 void    BSP_CAMERA_Resume(void);
 uint8_t BSP_CAMERA_Stop(void); 
+uint8_t BSP_CAMERA_Standby(void);
+uint8_t BSP_CAMERA_Wakeup(void);
+void    BSP_CAMERA_GetWakeupStats(CAMERA_WakeupStatsTypeDef *pStats);
 void    BSP_CAMERA_LineEventCallback(void);
 void    BSP_CAMERA_VsyncEventCallback(void);
 void    BSP_CAMERA_FrameEventCallback(void);
@@ -92,10 +284,62 @@ void    BSP_CAMERA_ContrastBrightnessConfig(uint32_t contrast_level, uint32_t br
 void    BSP_CAMERA_BlackWhiteConfig(uint32_t Mode);
 void    BSP_CAMERA_ColorEffectConfig(uint32_t Effect);
 
+/* Camera register sequence loader functions prototype */
+uint8_t BSP_CAMERA_LoadRegisters(const CAMERA_RegTypeDef *pSequence, uint32_t Count);
+uint8_t BSP_CAMERA_LoadRegisters_Start(const CAMERA_RegTypeDef *pSequence, uint32_t Count);
+uint8_t BSP_CAMERA_LoadRegisters_Process(void);
+void    BSP_CAMERA_InvalidateRegisters(void);
+void    BSP_CAMERA_GetLoaderStats(CAMERA_LoaderStatsTypeDef *pStats);
+
+/* Camera capture window functions prototype */
+uint8_t  BSP_CAMERA_ConfigCrop(uint32_t Xpos, uint32_t Ypos, uint32_t Width, uint32_t Height);
+uint8_t  BSP_CAMERA_DisableCrop(void);
+uint8_t  BSP_CAMERA_ConfigCaptureRate(uint32_t CaptureRate);
+uint32_t BSP_CAMERA_GetCaptureSize(void);
+
+/* Camera frame ring functions prototype */
+uint8_t BSP_CAMERA_RingInit(uint32_t BufferAddress, uint32_t NbFrames);
+uint8_t BSP_CAMERA_RingStart(void);
+uint8_t BSP_CAMERA_RingAcquire(CAMERA_FrameTypeDef *pFrame);
+uint8_t BSP_CAMERA_RingRelease(CAMERA_FrameTypeDef *pFrame);
+void    BSP_CAMERA_RingGetStats(CAMERA_RingStatsTypeDef *pStats);
+
+/* Camera line streaming functions prototype */
+uint8_t BSP_CAMERA_LineStreamStart(uint8_t *buff, uint32_t RingLines, uint32_t BatchLines);
+void    BSP_CAMERA_LineStreamGetStats(CAMERA_LineStreamStatsTypeDef *pStats);
+void    BSP_CAMERA_LineBatchCallback(uint8_t *pLines, uint32_t FirstLine, uint32_t NbLines);
+uint8_t BSP_CAMERA_PlanarStreamStart(uint8_t *buff, uint32_t RingLines, uint32_t BatchLines, uint8_t *pY, uint8_t *pU, uint8_t *pV);
+
+/* Camera telemetry functions prototype */
+void    BSP_CAMERA_GetTelemetry(CAMERA_TelemetryTypeDef *pTelemetry);
+void    BSP_CAMERA_ResetTelemetry(void);
+
+/* Camera motion detection functions prototype */
+uint8_t BSP_CAMERA_MotionInit(CAMERA_MotionConfigTypeDef *pConfig);
+uint8_t BSP_CAMERA_MotionDetect(uint8_t *pFrame, CAMERA_MotionResultTypeDef *pResult);
+
+/* Camera frame processing kernels prototype */
+uint8_t BSP_CAMERA_RGB565ToGray(uint8_t *pSrc, uint8_t *pDst, uint32_t Width, uint32_t Height);
+uint8_t BSP_CAMERA_RGB565ToYUV(uint8_t *pSrc, uint8_t *pY, uint8_t *pU, uint8_t *pV, uint32_t Width, uint32_t Height);
+uint8_t BSP_CAMERA_YUV422ToPlanar(uint8_t *pSrc, uint8_t *pY, uint8_t *pU, uint8_t *pV, uint32_t Width, uint32_t Height);
+uint8_t BSP_CAMERA_Downscale(uint8_t *pSrc, uint8_t *pDst, uint32_t Width, uint32_t Height, uint32_t PixelFormat, uint32_t Factor);
+uint8_t BSP_CAMERA_Histogram(uint8_t *pSrc, uint32_t Width, uint32_t Height, uint32_t PixelFormat, uint32_t Step, uint32_t *pHistogram);
+
+/* Camera auto-exposure and white balance functions prototype */
+uint8_t BSP_CAMERA_AutoInit(CAMERA_AutoConfigTypeDef *pConfig);
+uint8_t BSP_CAMERA_AutoProcess(uint8_t *pFrame, uint32_t Width, uint32_t Height, CAMERA_AutoStatusTypeDef *pStatus);
+
+/* Camera preview functions prototype */
+uint32_t BSP_CAMERA_PreviewStart(uint8_t *buff, uint32_t LayerIndex, uint16_t Xpos, uint16_t Ypos);
+uint8_t  BSP_CAMERA_PreviewStop(void);
+void     BSP_CAMERA_PreviewGetStats(CAMERA_PreviewStatsTypeDef *pStats);
+
 /* To be called in DCMI_IRQHandler function */
 void    BSP_CAMERA_IRQHandler(void);
 /* To be called in DMA2_Stream1_IRQHandler function */
 void    BSP_CAMERA_DMA_IRQHandler(void);
+/* To be called in DMA2D_IRQHandler function when the preview is used */
+void    BSP_CAMERA_DMA2D_IRQHandler(void);
    
 /**
   * @}
@@ -0,0 +1,686 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_integrity.c
+  * @author  MCD Application Team
+  * @brief   This file includes the block integrity layer of the uSD card and
+  *          NOR memory mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver detects the silent corruption of the data stored on the SD
+     card and the NOR memory: a CRC32 is recorded for each block written through
+     it and checked when the block is read back.
+   - The SD card and NOR drivers must be initialized by the application. The
+     protected blocks must only be written through this driver, or have their
+     CRC recorded again with BSP_INTEGRITY_NOR_Update() for the NOR memory.
+
+2. Driver description:
+---------------------
+  + CRC computation
+     o The CRC32 (polynomial 0x04C11DB7, initial value 0xFFFFFFFF) is computed
+       over 32-bit words by the CRC peripheral, which is also used by the PDM
+       library of the audio driver to unlock it.
+     o When the HAL CRC module is not enabled, or INTEGRITY_CRC_SOFTWARE is
+       defined, the same CRC is computed in software with slice-by-8 tables built
+       on first use (8 Kbytes of RAM).
+     o The computation time is measured with the DWT cycle counter and returned
+       per MiB by BSP_INTEGRITY_GetStats(), as the throughput cost of the layer.
+
+  + CRC tables
+     o The CRC of each protected block is kept in a table provided by the
+       application, of BSP_INTEGRITY_TABLE_SIZE() bytes. A null CRC means that
+       no CRC is recorded: the block is read without verification. A block whose
+       CRC is null has 0xFFFFFFFF recorded instead, and is checked against it.
+     o The SD table can be stored on the card from SdTableBlock, outside the
+       protected blocks, after a header block identifying the protected blocks.
+       It is loaded by BSP_INTEGRITY_Init(), or cleared and stored when the header
+       does not match, and the modified parts are stored by BSP_INTEGRITY_SD_Sync().
+     o The NOR table is kept in RAM only. BSP_INTEGRITY_NOR_Update() records the
+       CRCs of the current content of a range, after an erase for instance.
+
+  + Block read and write
+     o BSP_INTEGRITY_SD_ReadBlocks()/BSP_INTEGRITY_SD_WriteBlocks() and
+       BSP_INTEGRITY_NOR_ReadData()/BSP_INTEGRITY_NOR_WriteData() take the
+       parameters of the corresponding SD and NOR driver functions.
+     o A block failing its CRC is read again up to INTEGRITY_RETRIES times, the
+       SD block cache being invalidated first. INTEGRITY_CORRUPTED is returned
+       when a block still fails its CRC.
+     o The NOR blocks are verified from the data returned to the caller: whole
+       blocks are read into the caller buffer when it is word aligned, partial
+       blocks into a scratch block and copied from it once verified.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_integrity.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY STM324x9I EVAL INTEGRITY
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Private_Defines STM324x9I EVAL INTEGRITY Private Defines
+  * @{
+  */
+#if defined(HAL_CRC_MODULE_ENABLED) && !defined(INTEGRITY_CRC_SOFTWARE)
+ #define INTEGRITY_CRC_HARDWARE
+#endif
+
+#define INTEGRITY_CRC_POLYNOMIAL  ((uint32_t)0x04C11DB7)
+#define INTEGRITY_MAGIC           ((uint32_t)0x43524354)
+
+/* CRCs per SD block of the CRC tables */
+#define INTEGRITY_CRCS_PER_BLOCK  (INTEGRITY_SD_BLOCK_SIZE / 4)
+
+/* Recorded in place of a null CRC, which marks a block without CRC */
+#define INTEGRITY_CRC_NULL        ((uint32_t)0xFFFFFFFF)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Private_Variables STM324x9I EVAL INTEGRITY Private Variables
+  * @{
+  */
+static struct
+{
+  INTEGRITY_ConfigTypeDef Config;
+  uint32_t DirtyFirst;      /* First modified SD table block                    */
+  uint32_t DirtyLast;       /* Last modified SD table block, below DirtyFirst if none */
+  uint64_t Cycles[2];       /* CRC computation cycles of each device            */
+  INTEGRITY_StatsTypeDef Stats[2];
+}Integrity;
+
+/* NOR block read for its CRC */
+static uint32_t IntegrityNorBlock[INTEGRITY_NOR_BLOCK_SIZE / 4];
+
+/* Header block of the stored SD table */
+static uint32_t IntegrityHeader[INTEGRITY_SD_BLOCK_SIZE / 4];
+
+#if defined(INTEGRITY_CRC_HARDWARE)
+static CRC_HandleTypeDef hcrc;
+#else
+static uint32_t IntegrityCrcTable[8][256];
+static uint32_t IntegrityCrcReady = 0;
+#endif
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Private_FunctionPrototypes STM324x9I EVAL INTEGRITY Private FunctionPrototypes
+  * @{
+  */
+static uint32_t INTEGRITY_Compute(uint32_t Device, uint32_t *pData, uint32_t NumOfWords);
+static uint8_t  INTEGRITY_NOR_Check(uint32_t Index, uint32_t *pBlock);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Private_Functions STM324x9I EVAL INTEGRITY Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the block integrity layer.
+  * @param  pConfig: Pointer to the configuration
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_Init(INTEGRITY_ConfigTypeDef *pConfig)
+{
+  uint32_t blocks, index;
+  uint32_t loaded = 0;
+
+  if(((pConfig->pSdTable != NULL) && (pConfig->SdNbBlocks == 0)) ||
+     ((pConfig->pNorTable != NULL) &&
+      ((pConfig->NorSize == 0) || ((pConfig->NorStartAddress % INTEGRITY_NOR_BLOCK_SIZE) != 0) ||
+       ((pConfig->NorSize % INTEGRITY_NOR_BLOCK_SIZE) != 0))))
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  /* The stored SD table and its header must not be protected by themselves */
+  blocks = BSP_INTEGRITY_TABLE_SIZE(pConfig->SdNbBlocks) / INTEGRITY_SD_BLOCK_SIZE;
+  if((pConfig->pSdTable != NULL) && (pConfig->SdTableBlock != INTEGRITY_NO_STORAGE) &&
+     ((pConfig->SdTableBlock + blocks + 1) > pConfig->SdStartBlock) &&
+     (pConfig->SdTableBlock < (pConfig->SdStartBlock + pConfig->SdNbBlocks)))
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  Integrity.Config     = *pConfig;
+  Integrity.DirtyFirst = 1;
+  Integrity.DirtyLast  = 0;
+
+  for(index = 0; index < 2; index++)
+  {
+    Integrity.Cycles[index]           = 0;
+    Integrity.Stats[index].Verified   = 0;
+    Integrity.Stats[index].Unverified = 0;
+    Integrity.Stats[index].Recorded   = 0;
+    Integrity.Stats[index].Mismatches = 0;
+    Integrity.Stats[index].Recovered  = 0;
+    Integrity.Stats[index].Failures   = 0;
+    Integrity.Stats[index].CrcBytes   = 0;
+    Integrity.Stats[index].CrcUs      = 0;
+    Integrity.Stats[index].CrcUsPerMB = 0;
+  }
+
+  BSP_EnableCycleCounter();
+
+#if defined(INTEGRITY_CRC_HARDWARE)
+  /* The CRC peripheral may already be enabled by the audio driver */
+  __HAL_RCC_CRC_CLK_ENABLE();
+  hcrc.Instance = CRC;
+  if(HAL_CRC_Init(&hcrc) != HAL_OK)
+  {
+    return INTEGRITY_ERROR;
+  }
+#endif
+
+  if(pConfig->pSdTable != NULL)
+  {
+    if(pConfig->SdTableBlock != INTEGRITY_NO_STORAGE)
+    {
+      if(BSP_SD_ReadBlocks(IntegrityHeader, pConfig->SdTableBlock, 1, SD_DATATIMEOUT) != MSD_OK)
+      {
+        return INTEGRITY_ERROR;
+      }
+
+      if((IntegrityHeader[0] == INTEGRITY_MAGIC) && (IntegrityHeader[1] == pConfig->SdStartBlock) &&
+         (IntegrityHeader[2] == pConfig->SdNbBlocks))
+      {
+        loaded = 1;
+        if(BSP_SD_ReadBlocks(pConfig->pSdTable, pConfig->SdTableBlock + 1, blocks, SD_DATATIMEOUT) != MSD_OK)
+        {
+          return INTEGRITY_ERROR;
+        }
+      }
+    }
+
+    /* No CRC recorded yet */
+    for(index = 0; (loaded == 0) && (index < ((blocks * INTEGRITY_SD_BLOCK_SIZE) / 4)); index++)
+    {
+      pConfig->pSdTable[index] = 0;
+    }
+
+    if((loaded == 0) && (pConfig->SdTableBlock != INTEGRITY_NO_STORAGE))
+    {
+      for(index = 0; index < (INTEGRITY_SD_BLOCK_SIZE / 4); index++)
+      {
+        IntegrityHeader[index] = 0;
+      }
+      IntegrityHeader[0] = INTEGRITY_MAGIC;
+      IntegrityHeader[1] = pConfig->SdStartBlock;
+      IntegrityHeader[2] = pConfig->SdNbBlocks;
+
+      if((BSP_SD_WriteBlocks(pConfig->pSdTable, pConfig->SdTableBlock + 1, blocks, SD_DATATIMEOUT) != MSD_OK) ||
+         (BSP_SD_WriteBlocks(IntegrityHeader, pConfig->SdTableBlock, 1, SD_DATATIMEOUT) != MSD_OK))
+      {
+        return INTEGRITY_ERROR;
+      }
+    }
+  }
+
+  if(pConfig->pNorTable != NULL)
+  {
+    for(index = 0; index < (pConfig->NorSize / INTEGRITY_NOR_BLOCK_SIZE); index++)
+    {
+      pConfig->pNorTable[index] = 0;
+    }
+  }
+
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  Computes the CRC32 of a word buffer.
+  * @param  pData: Pointer to the words
+  * @param  NumOfWords: Number of words
+  * @retval CRC32
+  */
+uint32_t BSP_INTEGRITY_Crc32(uint32_t *pData, uint32_t NumOfWords)
+{
+#if defined(INTEGRITY_CRC_HARDWARE)
+  if(hcrc.Instance == NULL)
+  {
+    __HAL_RCC_CRC_CLK_ENABLE();
+    hcrc.Instance = CRC;
+    HAL_CRC_Init(&hcrc);
+  }
+
+  return HAL_CRC_Calculate(&hcrc, pData, NumOfWords);
+#else
+  uint32_t crc = 0xFFFFFFFF;
+  uint32_t value, index, bit;
+
+  if(IntegrityCrcReady == 0)
+  {
+    /* Table 0 processes a byte, table n the byte followed by n null bytes */
+    for(index = 0; index < 256; index++)
+    {
+      value = index << 24;
+      for(bit = 0; bit < 8; bit++)
+      {
+        value = ((value & 0x80000000) != 0) ? ((value << 1) ^ INTEGRITY_CRC_POLYNOMIAL) : (value << 1);
+      }
+      IntegrityCrcTable[0][index] = value;
+    }
+    for(index = 0; index < 256; index++)
+    {
+      for(bit = 1; bit < 8; bit++)
+      {
+        value = IntegrityCrcTable[bit - 1][index];
+        IntegrityCrcTable[bit][index] = (value << 8) ^ IntegrityCrcTable[0][value >> 24];
+      }
+    }
+    IntegrityCrcReady = 1;
+  }
+
+  /* Words are processed most significant byte first, as by the CRC peripheral */
+  for(; NumOfWords >= 2; NumOfWords -= 2)
+  {
+    value = crc ^ pData[0];
+    crc   = IntegrityCrcTable[7][value >> 24] ^ IntegrityCrcTable[6][(value >> 16) & 0xFF] ^
+            IntegrityCrcTable[5][(value >> 8) & 0xFF] ^ IntegrityCrcTable[4][value & 0xFF] ^
+            IntegrityCrcTable[3][pData[1] >> 24] ^ IntegrityCrcTable[2][(pData[1] >> 16) & 0xFF] ^
+            IntegrityCrcTable[1][(pData[1] >> 8) & 0xFF] ^ IntegrityCrcTable[0][pData[1] & 0xFF];
+    pData += 2;
+  }
+  if(NumOfWords != 0)
+  {
+    value = crc ^ pData[0];
+    crc   = IntegrityCrcTable[3][value >> 24] ^ IntegrityCrcTable[2][(value >> 16) & 0xFF] ^
+            IntegrityCrcTable[1][(value >> 8) & 0xFF] ^ IntegrityCrcTable[0][value & 0xFF];
+  }
+
+  return crc;
+#endif
+}
+
+/**
+  * @brief  Reads block(s) from the SD card and verifies their CRC.
+  * @param  pData: Pointer to the buffer that will contain the data, word aligned
+  * @param  ReadAddr: Address from where data is to be read
+  * @param  NumOfBlocks: Number of SD blocks to read
+  * @param  Timeout: Timeout for read operation
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  INTEGRITY_StatsTypeDef *pStats = &Integrity.Stats[INTEGRITY_DEVICE_SD];
+  uint32_t *pBlock;
+  uint32_t block, expected, retry;
+  uint8_t status = INTEGRITY_OK;
+
+  if(BSP_SD_ReadBlocks(pData, ReadAddr, NumOfBlocks, Timeout) != MSD_OK)
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  for(block = ReadAddr; block < (ReadAddr + NumOfBlocks); block++)
+  {
+    pBlock = pData + ((block - ReadAddr) * (INTEGRITY_SD_BLOCK_SIZE / 4));
+
+    expected = 0;
+    if((Integrity.Config.pSdTable != NULL) && (block >= Integrity.Config.SdStartBlock) &&
+       (block < (Integrity.Config.SdStartBlock + Integrity.Config.SdNbBlocks)))
+    {
+      expected = Integrity.Config.pSdTable[block - Integrity.Config.SdStartBlock];
+    }
+
+    if(expected == 0)
+    {
+      pStats->Unverified++;
+      continue;
+    }
+
+    if(INTEGRITY_Compute(INTEGRITY_DEVICE_SD, pBlock, INTEGRITY_SD_BLOCK_SIZE / 4) == expected)
+    {
+      pStats->Verified++;
+      continue;
+    }
+
+    /* Read the block again from the card, not from the block cache */
+    pStats->Mismatches++;
+    for(retry = 0; retry < INTEGRITY_RETRIES; retry++)
+    {
+      BSP_SD_CacheInvalidate();
+      if((BSP_SD_ReadBlocks(pBlock, block, 1, Timeout) == MSD_OK) &&
+         (INTEGRITY_Compute(INTEGRITY_DEVICE_SD, pBlock, INTEGRITY_SD_BLOCK_SIZE / 4) == expected))
+      {
+        break;
+      }
+    }
+
+    if(retry < INTEGRITY_RETRIES)
+    {
+      pStats->Recovered++;
+      pStats->Verified++;
+    }
+    else
+    {
+      pStats->Failures++;
+      status = INTEGRITY_CORRUPTED;
+    }
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Writes block(s) to the SD card and records their CRC.
+  * @param  pData: Pointer to the buffer that will contain the data to transmit, word aligned
+  * @param  WriteAddr: Address from where data is to be written
+  * @param  NumOfBlocks: Number of SD blocks to write
+  * @param  Timeout: Timeout for write operation
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  uint32_t block, index;
+
+  if(BSP_SD_WriteBlocks(pData, WriteAddr, NumOfBlocks, Timeout) != MSD_OK)
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  if(Integrity.Config.pSdTable == NULL)
+  {
+    return INTEGRITY_OK;
+  }
+
+  for(block = WriteAddr; block < (WriteAddr + NumOfBlocks); block++)
+  {
+    if((block < Integrity.Config.SdStartBlock) ||
+       (block >= (Integrity.Config.SdStartBlock + Integrity.Config.SdNbBlocks)))
+    {
+      continue;
+    }
+
+    index = block - Integrity.Config.SdStartBlock;
+    Integrity.Config.pSdTable[index] = INTEGRITY_Compute(INTEGRITY_DEVICE_SD, pData + ((block - WriteAddr) * (INTEGRITY_SD_BLOCK_SIZE / 4)),
+                                                         INTEGRITY_SD_BLOCK_SIZE / 4);
+    Integrity.Stats[INTEGRITY_DEVICE_SD].Recorded++;
+
+    /* Table blocks to store */
+    index /= INTEGRITY_CRCS_PER_BLOCK;
+    if(Integrity.DirtyFirst > Integrity.DirtyLast)
+    {
+      Integrity.DirtyFirst = index;
+      Integrity.DirtyLast  = index;
+    }
+    else if(index < Integrity.DirtyFirst)
+    {
+      Integrity.DirtyFirst = index;
+    }
+    else if(index > Integrity.DirtyLast)
+    {
+      Integrity.DirtyLast = index;
+    }
+  }
+
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  Stores the modified parts of the SD CRC table on the card.
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_SD_Sync(void)
+{
+  if((Integrity.Config.pSdTable == NULL) || (Integrity.Config.SdTableBlock == INTEGRITY_NO_STORAGE) ||
+     (Integrity.DirtyFirst > Integrity.DirtyLast))
+  {
+    return INTEGRITY_OK;
+  }
+
+  if(BSP_SD_WriteBlocks(Integrity.Config.pSdTable + (Integrity.DirtyFirst * INTEGRITY_CRCS_PER_BLOCK),
+                        Integrity.Config.SdTableBlock + 1 + Integrity.DirtyFirst,
+                        Integrity.DirtyLast - Integrity.DirtyFirst + 1, SD_DATATIMEOUT) != MSD_OK)
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  Integrity.DirtyFirst = 1;
+  Integrity.DirtyLast  = 0;
+
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  Reads an amount of data from the NOR device and verifies the CRC of its blocks.
+  * @param  uwStartAddress: Read start address
+  * @param  pData: Pointer to data to be read
+  * @param  uwDataSize: Size of data to read, in half-words
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_NOR_ReadData(uint32_t uwStartAddress, uint16_t *pData, uint32_t uwDataSize)
+{
+  uint32_t start = Integrity.Config.NorStartAddress;
+  uint32_t end = start + Integrity.Config.NorSize;
+  uint32_t finish = uwStartAddress + (uwDataSize * 2);
+  uint32_t address, block, next, index;
+  uint16_t *pBlock;
+  uint8_t result, status = INTEGRITY_OK;
+
+  for(address = uwStartAddress; address < finish; address = next)
+  {
+    block = address - (address % INTEGRITY_NOR_BLOCK_SIZE);
+    next  = block + INTEGRITY_NOR_BLOCK_SIZE;
+    if(next > finish)
+    {
+      next = finish;
+    }
+
+    result = INTEGRITY_OK;
+    if((Integrity.Config.pNorTable == NULL) || (block < start) || (block >= end))
+    {
+      /* Not protected */
+      if(BSP_NOR_ReadData(address, pData, (next - address) / 2) != NOR_STATUS_OK)
+      {
+        result = INTEGRITY_ERROR;
+      }
+    }
+    else if((address == block) && ((next - block) == INTEGRITY_NOR_BLOCK_SIZE) && (((uint32_t)pData & 3) == 0))
+    {
+      /* Whole block, verified in the caller buffer */
+      result = INTEGRITY_NOR_Check((block - start) / INTEGRITY_NOR_BLOCK_SIZE, (uint32_t *)pData);
+    }
+    else
+    {
+      /* Partial or unaligned block, verified in the scratch block then copied */
+      result = INTEGRITY_NOR_Check((block - start) / INTEGRITY_NOR_BLOCK_SIZE, IntegrityNorBlock);
+      pBlock = (uint16_t *)IntegrityNorBlock + ((address - block) / 2);
+      for(index = 0; index < ((next - address) / 2); index++)
+      {
+        pData[index] = pBlock[index];
+      }
+    }
+
+    if(result == INTEGRITY_ERROR)
+    {
+      return INTEGRITY_ERROR;
+    }
+    if(result == INTEGRITY_CORRUPTED)
+    {
+      status = INTEGRITY_CORRUPTED;
+    }
+
+    pData += (next - address) / 2;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Writes an amount of data to the NOR device and records the CRC of its blocks.
+  * @param  uwStartAddress: Write start address
+  * @param  pData: Pointer to data to be written
+  * @param  uwDataSize: Size of data to write, in half-words
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_NOR_WriteData(uint32_t uwStartAddress, uint16_t *pData, uint32_t uwDataSize)
+{
+  if(BSP_NOR_WriteData(uwStartAddress, pData, uwDataSize) != NOR_STATUS_OK)
+  {
+    return INTEGRITY_ERROR;
+  }
+
+  return BSP_INTEGRITY_NOR_Update(uwStartAddress, uwDataSize);
+}
+
+/**
+  * @brief  Records the CRC of the current content of the NOR blocks of a range.
+  * @param  uwStartAddress: Start address of the range
+  * @param  uwDataSize: Size of the range, in half-words
+  * @retval INTEGRITY status
+  */
+uint8_t BSP_INTEGRITY_NOR_Update(uint32_t uwStartAddress, uint32_t uwDataSize)
+{
+  uint32_t start = Integrity.Config.NorStartAddress;
+  uint32_t end = start + Integrity.Config.NorSize;
+  uint32_t address;
+
+  if((Integrity.Config.pNorTable == NULL) || (uwDataSize == 0))
+  {
+    return INTEGRITY_OK;
+  }
+
+  address = uwStartAddress - (uwStartAddress % INTEGRITY_NOR_BLOCK_SIZE);
+  for(; address < (uwStartAddress + (uwDataSize * 2)); address += INTEGRITY_NOR_BLOCK_SIZE)
+  {
+    if((address < start) || (address >= end))
+    {
+      continue;
+    }
+
+    if(BSP_NOR_ReadData(address, (uint16_t *)IntegrityNorBlock, INTEGRITY_NOR_BLOCK_SIZE / 2) != NOR_STATUS_OK)
+    {
+      return INTEGRITY_ERROR;
+    }
+
+    Integrity.Config.pNorTable[(address - start) / INTEGRITY_NOR_BLOCK_SIZE] =
+      INTEGRITY_Compute(INTEGRITY_DEVICE_NOR, IntegrityNorBlock, INTEGRITY_NOR_BLOCK_SIZE / 4);
+    Integrity.Stats[INTEGRITY_DEVICE_NOR].Recorded++;
+  }
+
+  return INTEGRITY_OK;
+}
+
+/**
+  * @brief  Gets the block integrity statistics of a device.
+  * @param  Device: INTEGRITY_DEVICE_SD or INTEGRITY_DEVICE_NOR
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_INTEGRITY_GetStats(uint32_t Device, INTEGRITY_StatsTypeDef *pStats)
+{
+  *pStats = Integrity.Stats[Device];
+
+  pStats->CrcUs      = (uint32_t)(Integrity.Cycles[Device] / (SystemCoreClock / 1000000));
+  pStats->CrcUsPerMB = 0;
+  if(pStats->CrcBytes != 0)
+  {
+    pStats->CrcUsPerMB = (uint32_t)(((uint64_t)pStats->CrcUs * 1048576) / pStats->CrcBytes);
+  }
+}
+
+/**
+  * @brief  Computes the CRC32 of a block and accounts for its computation time.
+  * @param  Device: INTEGRITY_DEVICE_SD or INTEGRITY_DEVICE_NOR
+  * @param  pData: Pointer to the block
+  * @param  NumOfWords: Block size in words
+  * @retval CRC32 as recorded in the tables, never null
+  */
+static uint32_t INTEGRITY_Compute(uint32_t Device, uint32_t *pData, uint32_t NumOfWords)
+{
+  uint32_t start = BSP_GetCycleCount();
+  uint32_t crc = BSP_INTEGRITY_Crc32(pData, NumOfWords);
+
+  Integrity.Cycles[Device] += BSP_GetCycleCount() - start;
+  Integrity.Stats[Device].CrcBytes += NumOfWords * 4;
+
+  return (crc != 0) ? crc : INTEGRITY_CRC_NULL;
+}
+
+/**
+  * @brief  Reads a NOR block and verifies its CRC, reading it again on mismatch.
+  * @param  Index: Block index in the protected range
+  * @param  pBlock: Pointer to the block buffer, word aligned
+  * @retval INTEGRITY status
+  */
+static uint8_t INTEGRITY_NOR_Check(uint32_t Index, uint32_t *pBlock)
+{
+  INTEGRITY_StatsTypeDef *pStats = &Integrity.Stats[INTEGRITY_DEVICE_NOR];
+  uint32_t expected = Integrity.Config.pNorTable[Index];
+  uint32_t address = Integrity.Config.NorStartAddress + (Index * INTEGRITY_NOR_BLOCK_SIZE);
+  uint32_t retry;
+
+  for(retry = 0; retry <= INTEGRITY_RETRIES; retry++)
+  {
+    if(BSP_NOR_ReadData(address, (uint16_t *)pBlock, INTEGRITY_NOR_BLOCK_SIZE / 2) != NOR_STATUS_OK)
+    {
+      return INTEGRITY_ERROR;
+    }
+
+    if(expected == 0)
+    {
+      pStats->Unverified++;
+      return INTEGRITY_OK;
+    }
+
+    if(INTEGRITY_Compute(INTEGRITY_DEVICE_NOR, pBlock, INTEGRITY_NOR_BLOCK_SIZE / 4) == expected)
+    {
+      pStats->Verified++;
+      if(retry != 0)
+      {
+        pStats->Recovered++;
+      }
+      return INTEGRITY_OK;
+    }
+
+    if(retry == 0)
+    {
+      pStats->Mismatches++;
+    }
+  }
+
+  pStats->Failures++;
+
+  return INTEGRITY_CORRUPTED;
+}
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,146 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_integrity.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_integrity.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_INTEGRITY_H
+#define __STM324x9I_EVAL_INTEGRITY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sd.h"
+#include "stm324x9i_eval_nor.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_INTEGRITY
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Exported_Types STM324x9I EVAL INTEGRITY Exported Types
+  * @{
+  */
+
+/**
+  * @brief  Block integrity configuration
+  */
+typedef struct
+{
+  uint32_t *pSdTable;       /* SD CRC table, BSP_INTEGRITY_TABLE_SIZE(SdNbBlocks) bytes, NULL to disable */
+  uint32_t SdStartBlock;    /* First protected SD block                                          */
+  uint32_t SdNbBlocks;      /* Number of protected SD blocks                                     */
+  uint32_t SdTableBlock;    /* First SD block of the stored CRC table, INTEGRITY_NO_STORAGE if none */
+  uint32_t *pNorTable;      /* NOR CRC table, BSP_INTEGRITY_TABLE_SIZE(NorSize / INTEGRITY_NOR_BLOCK_SIZE) bytes, NULL to disable */
+  uint32_t NorStartAddress; /* First protected NOR byte, aligned on INTEGRITY_NOR_BLOCK_SIZE      */
+  uint32_t NorSize;         /* Protected NOR size in bytes, multiple of INTEGRITY_NOR_BLOCK_SIZE  */
+}INTEGRITY_ConfigTypeDef;
+
+/**
+  * @brief  Block integrity statistics of a device
+  */
+typedef struct
+{
+  uint32_t Verified;        /* Blocks read and verified                         */
+  uint32_t Unverified;      /* Blocks read without recorded CRC                 */
+  uint32_t Recorded;        /* Block CRCs recorded on writes                    */
+  uint32_t Mismatches;      /* Block reads failing their CRC                    */
+  uint32_t Recovered;       /* Mismatches corrected by a read retry             */
+  uint32_t Failures;        /* Blocks still failing their CRC after the retries */
+  uint32_t CrcBytes;        /* Bytes processed by the CRC computation           */
+  uint32_t CrcUs;           /* Time spent in the CRC computation (us)           */
+  uint32_t CrcUsPerMB;      /* CRC computation cost per MiB (us)                */
+}INTEGRITY_StatsTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Exported_Constants STM324x9I EVAL INTEGRITY Exported Constants
+  * @{
+  */
+/**
+  * @brief  Block integrity status definition
+  */
+#define INTEGRITY_OK             ((uint8_t)0x00)
+#define INTEGRITY_ERROR          ((uint8_t)0x01)
+#define INTEGRITY_CORRUPTED      ((uint8_t)0x02)
+
+#define INTEGRITY_DEVICE_SD      ((uint32_t)0x00)
+#define INTEGRITY_DEVICE_NOR     ((uint32_t)0x01)
+
+#define INTEGRITY_NO_STORAGE     ((uint32_t)0xFFFFFFFF)
+
+/* Size of a protected block, SD card block and NOR block */
+#define INTEGRITY_SD_BLOCK_SIZE  ((uint32_t)512)
+#if !defined(INTEGRITY_NOR_BLOCK_SIZE)
+ #define INTEGRITY_NOR_BLOCK_SIZE ((uint32_t)512)
+#endif
+
+/* Read retries of a block failing its CRC */
+#if !defined(INTEGRITY_RETRIES)
+ #define INTEGRITY_RETRIES       ((uint32_t)2)
+#endif
+
+/* CRC table memory size: one CRC per block, rounded up to whole SD blocks */
+#define BSP_INTEGRITY_TABLE_SIZE(NbBlocks)  (((((NbBlocks) * 4) + INTEGRITY_SD_BLOCK_SIZE - 1) / \
+                                              INTEGRITY_SD_BLOCK_SIZE) * INTEGRITY_SD_BLOCK_SIZE)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_INTEGRITY_Exported_Functions STM324x9I EVAL INTEGRITY Exported Functions
+  * @{
+  */
+uint8_t  BSP_INTEGRITY_Init(INTEGRITY_ConfigTypeDef *pConfig);
+uint32_t BSP_INTEGRITY_Crc32(uint32_t *pData, uint32_t NumOfWords);
+uint8_t  BSP_INTEGRITY_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+uint8_t  BSP_INTEGRITY_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+uint8_t  BSP_INTEGRITY_SD_Sync(void);
+uint8_t  BSP_INTEGRITY_NOR_ReadData(uint32_t uwStartAddress, uint16_t *pData, uint32_t uwDataSize);
+uint8_t  BSP_INTEGRITY_NOR_WriteData(uint32_t uwStartAddress, uint16_t *pData, uint32_t uwDataSize);
+uint8_t  BSP_INTEGRITY_NOR_Update(uint32_t uwStartAddress, uint32_t uwDataSize);
+void     BSP_INTEGRITY_GetStats(uint32_t Device, INTEGRITY_StatsTypeDef *pStats);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_INTEGRITY_H */
@@ -0,0 +1,1197 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_mjpeg.c
+  * @author  MCD Application Team
+  * @brief   This file includes the Motion-JPEG recorder of the camera frames
+  *          to the SD card mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver records the RGB565 frames of the camera frame ring as a
+     Motion-JPEG AVI file written to the SD card.
+   - The camera (BSP_CAMERA_Init(), BSP_CAMERA_RingInit()) and the SD card
+     (BSP_SD_Init()) drivers must be initialized by the application.
+
+2. Driver description:
+---------------------
+  + Initialization steps:
+     o BSP_MJPEG_Init() computes the quantization and Huffman tables of the
+       given quality and saves the buffers of the recorder:
+      - two write buffers of MJPEG_WRITE_BUFFER_SIZE bytes,
+      - the encoded frame buffer,
+      - the AVI index, two words per frame.
+       These buffers can be located in the SDRAM.
+     o BSP_MJPEG_Start() starts a recording of Width x Height frames, both
+       multiple of 16, at the SD block StartBlock. The camera frame ring is
+       started by the application.
+
+  + Recording
+     o BSP_MJPEG_Process() is called from the application main loop. Each call
+       acquires the oldest completed frame of the ring, encodes it and gives
+       the ring slot back, so that the capture of the next frames continues
+       during the encoding.
+     o The encoded frames are appended to the write buffers. Each full buffer
+       is written to the SD card in a single DMA transfer while the next one
+       is filled.
+     o BSP_MJPEG_Process() returns MJPEG_FULL when the reserved SD area or the
+       AVI index is full, then BSP_MJPEG_Stop() writes the index and the final
+       AVI headers. The file spans from StartBlock and its size is given by
+       the RIFF header.
+     o The recorded frame rate, the mean encoded frame size and the encoding
+       time are returned by BSP_MJPEG_GetStats().
+
+  + Encoder
+     o BSP_MJPEG_EncodeFrame() encodes a RGB565 frame into a baseline JFIF
+       image, YCbCr 4:2:0, with the integer LLM forward DCT, the quantization
+       tables of the JPEG standard scaled to the quality and the standard
+       Huffman tables.
+     o The quantization divisions are replaced by multiplications by the
+       reciprocals computed by BSP_MJPEG_Init().
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_mjpeg.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG STM324x9I EVAL MJPEG
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Private_Variables STM324x9I EVAL MJPEG Private Variables
+  * @{
+  */
+extern SD_HandleTypeDef uSdHandle;
+
+/* Zigzag to natural order of the coefficients */
+static const uint8_t MjpegNaturalOrder[64] =
+{
+   0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* Quantization tables of the JPEG standard (Annex K), natural order */
+static const uint8_t MjpegQuantTables[2][64] =
+{
+  {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+  },
+  {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+  }
+};
+
+/* Huffman tables of the JPEG standard (Annex K): code counts per length */
+static const uint8_t MjpegDcBits[2][16] =
+{
+  {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0},
+  {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0}
+};
+
+static const uint8_t MjpegDcValues[12] =
+{
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+
+static const uint8_t MjpegAcBits[2][16] =
+{
+  {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D},
+  {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77}
+};
+
+static const uint8_t MjpegAcValues[2][162] =
+{
+  {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+  },
+  {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+  }
+};
+
+/* Quantization reciprocals precision */
+#define MJPEG_RECIP_SHIFT        18
+
+/* Integer DCT constants, 13-bit fixed point */
+#define DCT_CONST_BITS           13
+#define DCT_PASS1_BITS           2
+#define DCT_FIX_0_298631336      ((int32_t)2446)
+#define DCT_FIX_0_390180644      ((int32_t)3196)
+#define DCT_FIX_0_541196100      ((int32_t)4433)
+#define DCT_FIX_0_765366865      ((int32_t)6270)
+#define DCT_FIX_0_899976223      ((int32_t)7373)
+#define DCT_FIX_1_175875602      ((int32_t)9633)
+#define DCT_FIX_1_501321110      ((int32_t)12299)
+#define DCT_FIX_1_847759065      ((int32_t)15137)
+#define DCT_FIX_1_961570560      ((int32_t)16069)
+#define DCT_FIX_2_053119869      ((int32_t)16819)
+#define DCT_FIX_2_562915447      ((int32_t)20995)
+#define DCT_FIX_3_072711026      ((int32_t)25172)
+#define DCT_DESCALE(x, n)        (((x) + (1L << ((n) - 1))) >> (n))
+
+/* Encoder context: tables of BSP_MJPEG_Init() and bit writer */
+static struct
+{
+  uint32_t Ready;
+  uint8_t  Quant[2][64];          /* Zigzag order */
+  uint32_t Recip[2][64];          /* Reciprocals of 8 x Quant, zigzag order */
+  uint16_t DcCode[2][12];
+  uint8_t  DcSize[2][12];
+  uint16_t AcCode[2][256];
+  uint8_t  AcSize[2][256];
+  uint8_t  *pOut;
+  uint8_t  *pEnd;
+  uint32_t BitBuffer;
+  uint32_t BitCount;
+  uint32_t Overflow;
+  int32_t  Block[6][64];          /* 4 Y, Cb and Cr blocks of a MCU */
+}MjpegEncoder;
+
+/* AVI file layout: headers padded to one SD block, then the movi list */
+#define AVI_HEADER_SIZE          MJPEG_BLOCK_SIZE
+#define AVI_HDRL_SIZE            ((uint32_t)192)
+#define AVI_STRL_SIZE            ((uint32_t)116)
+#define AVI_JUNK_OFFSET          ((uint32_t)212)
+#define AVIF_HASINDEX            ((uint32_t)0x00000010)
+#define AVIIF_KEYFRAME           ((uint32_t)0x00000010)
+
+/* Recorder context */
+static struct
+{
+  MJPEG_ConfigTypeDef Config;
+  uint32_t Active;
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t Buffer;                /* Write buffer being filled */
+  uint32_t Fill;
+  uint32_t NextBlock;
+  uint32_t WritePending;
+  uint32_t MoviSize;              /* Size of the frame chunks */
+  uint32_t EncodedBytes;
+  uint32_t StartTick;
+  MJPEG_StatsTypeDef Stats;
+}MjpegRecorder;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Private_FunctionPrototypes STM324x9I EVAL MJPEG Private FunctionPrototypes
+  * @{
+  */
+static void     ENCODER_BuildHuffman(const uint8_t *pBits, const uint8_t *pValues, uint16_t *pCode, uint8_t *pSize);
+static void     ENCODER_PutByte(uint8_t Value);
+static void     ENCODER_PutBits(uint32_t Code, uint32_t Size);
+static void     ENCODER_WriteHeaders(uint32_t Width, uint32_t Height);
+static void     ENCODER_LoadMcu(uint16_t *pSrc, uint32_t Width);
+static void     ENCODER_Dct(int32_t *pBlock);
+static void     ENCODER_EncodeBlock(int32_t *pBlock, uint32_t Table, int32_t *pPredictor);
+static void     AVI_Put32(uint8_t *pBuffer, uint32_t Value);
+static void     AVI_PutFourCC(uint8_t *pBuffer, const char *pId);
+static void     AVI_BuildHeader(uint8_t *pBuffer);
+static uint8_t  STREAM_Write(const uint8_t *pData, uint32_t Size);
+static uint8_t  STREAM_Flush(void);
+static uint8_t  STREAM_WaitWrite(void);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Private_Functions STM324x9I EVAL MJPEG Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the MJPEG recorder and the encoder tables.
+  * @param  pConfig: Pointer to the recorder configuration
+  * @retval MJPEG status
+  */
+uint8_t BSP_MJPEG_Init(MJPEG_ConfigTypeDef *pConfig)
+{
+  uint32_t table = 0, index = 0, scale = 0, quant = 0;
+
+  if((pConfig->Quality == 0) || (pConfig->Quality > 100) || (pConfig->FrameRate == 0) ||
+     (pConfig->pWriteBuffer == NULL) || (((uint32_t)pConfig->pWriteBuffer & 0x3) != 0) ||
+     (pConfig->pFrameBuffer == NULL) || (pConfig->FrameBufferSize < 2) ||
+     (pConfig->pIndex == NULL) || (pConfig->MaxFrames == 0) ||
+     (pConfig->NbBlocks < ((2 * MJPEG_WRITE_BUFFER_SIZE) / MJPEG_BLOCK_SIZE)) ||
+     (MjpegRecorder.Active != 0))
+  {
+    return MJPEG_ERROR;
+  }
+
+  MjpegRecorder.Config = *pConfig;
+
+  /* Quality scaling of the standard tables */
+  scale = (pConfig->Quality < 50) ? (5000 / pConfig->Quality) : (200 - (2 * pConfig->Quality));
+
+  for(table = 0; table < 2; table++)
+  {
+    for(index = 0; index < 64; index++)
+    {
+      quant = ((MjpegQuantTables[table][MjpegNaturalOrder[index]] * scale) + 50) / 100;
+      if(quant == 0)
+      {
+        quant = 1;
+      }
+      else if(quant > 255)
+      {
+        quant = 255;
+      }
+
+      MjpegEncoder.Quant[table][index] = (uint8_t)quant;
+
+      /* The DCT output is scaled by 8 */
+      MjpegEncoder.Recip[table][index] = ((1UL << MJPEG_RECIP_SHIFT) + (4 * quant)) / (8 * quant);
+    }
+
+    ENCODER_BuildHuffman(MjpegDcBits[table], MjpegDcValues, MjpegEncoder.DcCode[table], MjpegEncoder.DcSize[table]);
+    ENCODER_BuildHuffman(MjpegAcBits[table], MjpegAcValues[table], MjpegEncoder.AcCode[table], MjpegEncoder.AcSize[table]);
+  }
+
+  MjpegEncoder.Ready = 1;
+
+  return MJPEG_OK;
+}
+
+/**
+  * @brief  Starts a recording.
+  * @note   The frames of the camera frame ring must have the given size.
+  * @param  Width: Frame width in pixels, multiple of 16
+  * @param  Height: Frame height in lines, multiple of 16
+  * @retval MJPEG status
+  */
+uint8_t BSP_MJPEG_Start(uint32_t Width, uint32_t Height)
+{
+  if((MjpegEncoder.Ready == 0) || (MjpegRecorder.Active != 0) ||
+     (Width == 0) || ((Width % 16) != 0) || (Height == 0) || ((Height % 16) != 0))
+  {
+    return MJPEG_ERROR;
+  }
+
+  MjpegRecorder.Width        = Width;
+  MjpegRecorder.Height       = Height;
+  MjpegRecorder.Buffer       = 0;
+  MjpegRecorder.NextBlock    = MjpegRecorder.Config.StartBlock;
+  MjpegRecorder.WritePending = 0;
+  MjpegRecorder.MoviSize     = 0;
+  MjpegRecorder.EncodedBytes = 0;
+  MjpegRecorder.StartTick    = HAL_GetTick();
+
+  MjpegRecorder.Stats.Frames        = 0;
+  MjpegRecorder.Stats.Skipped       = 0;
+  MjpegRecorder.Stats.Bytes         = 0;
+  MjpegRecorder.Stats.BytesPerFrame = 0;
+  MjpegRecorder.Stats.EncodeUs      = 0;
+  MjpegRecorder.Stats.MaxEncodeUs   = 0;
+  MjpegRecorder.Stats.FrameRate     = 0;
+  MjpegRecorder.Stats.WriteStalls   = 0;
+
+  /* The headers are rewritten with the final values by BSP_MJPEG_Stop() */
+  AVI_BuildHeader(MjpegRecorder.Config.pWriteBuffer);
+  MjpegRecorder.Fill   = AVI_HEADER_SIZE;
+  MjpegRecorder.Active = 1;
+
+  return MJPEG_OK;
+}
+
+/**
+  * @brief  Records the oldest completed frame of the camera frame ring.
+  * @retval MJPEG_OK if a frame is recorded or no frame is ready, MJPEG_FULL
+  *         when the file or the index is full, MJPEG_ERROR on SD error.
+  */
+uint8_t BSP_MJPEG_Process(void)
+{
+  CAMERA_FrameTypeDef frame;
+  uint8_t  chunk[8];
+  uint32_t start = 0, size = 0, padded = 0, used = 0, elapsed = 0;
+  uint8_t  status = MJPEG_OK;
+
+  if(MjpegRecorder.Active == 0)
+  {
+    return MJPEG_ERROR;
+  }
+
+  if(BSP_CAMERA_RingAcquire(&frame) != CAMERA_OK)
+  {
+    return MJPEG_OK;
+  }
+
+  if((frame.Width != MjpegRecorder.Width) || (frame.Height != MjpegRecorder.Height))
+  {
+    BSP_CAMERA_RingRelease(&frame);
+    return MJPEG_ERROR;
+  }
+
+  /* One byte is kept for the chunk padding */
+  start = BSP_GetCycleCount();
+  size = BSP_MJPEG_EncodeFrame(frame.pBuffer, frame.Width, frame.Height, MjpegRecorder.Config.pFrameBuffer,
+                               MjpegRecorder.Config.FrameBufferSize - 1);
+  MjpegRecorder.Stats.EncodeUs = BSP_GetElapsedUs(start);
+
+  /* The slot is given back to the capture as soon as the frame is encoded */
+  BSP_CAMERA_RingRelease(&frame);
+
+  if(MjpegRecorder.Stats.EncodeUs > MjpegRecorder.Stats.MaxEncodeUs)
+  {
+    MjpegRecorder.Stats.MaxEncodeUs = MjpegRecorder.Stats.EncodeUs;
+  }
+
+  if(size == 0)
+  {
+    MjpegRecorder.Stats.Skipped++;
+    return MJPEG_OK;
+  }
+
+  /* Keep room for the chunk and the complete index */
+  padded = (size + 1) & ~1UL;
+  used = ((MjpegRecorder.NextBlock - MjpegRecorder.Config.StartBlock) * MJPEG_BLOCK_SIZE) + MjpegRecorder.Fill +
+         8 + padded + 8 + (16 * (MjpegRecorder.Stats.Frames + 1));
+  if((MjpegRecorder.Stats.Frames >= MjpegRecorder.Config.MaxFrames) ||
+     (used > (MjpegRecorder.Config.NbBlocks * MJPEG_BLOCK_SIZE)))
+  {
+    return MJPEG_FULL;
+  }
+
+  MjpegRecorder.Config.pFrameBuffer[size] = 0;
+  MjpegRecorder.Config.pIndex[2 * MjpegRecorder.Stats.Frames]       = 4 + MjpegRecorder.MoviSize;
+  MjpegRecorder.Config.pIndex[(2 * MjpegRecorder.Stats.Frames) + 1] = size;
+
+  AVI_PutFourCC(chunk, "00dc");
+  AVI_Put32(&chunk[4], size);
+
+  status = STREAM_Write(chunk, 8);
+  if(status == MJPEG_OK)
+  {
+    status = STREAM_Write(MjpegRecorder.Config.pFrameBuffer, padded);
+  }
+  if(status != MJPEG_OK)
+  {
+    return status;
+  }
+
+  MjpegRecorder.MoviSize += 8 + padded;
+  MjpegRecorder.EncodedBytes += size;
+  MjpegRecorder.Stats.Frames++;
+  MjpegRecorder.Stats.BytesPerFrame = MjpegRecorder.EncodedBytes / MjpegRecorder.Stats.Frames;
+
+  elapsed = HAL_GetTick() - MjpegRecorder.StartTick;
+  if(elapsed != 0)
+  {
+    MjpegRecorder.Stats.FrameRate = (uint32_t)(((uint64_t)MjpegRecorder.Stats.Frames * 100000) / elapsed);
+  }
+
+  return MJPEG_OK;
+}
+
+/**
+  * @brief  Stops the recording, writes the AVI index and the final headers.
+  * @retval MJPEG status
+  */
+uint8_t BSP_MJPEG_Stop(void)
+{
+  uint8_t  entry[16];
+  uint32_t index = 0;
+  uint8_t  *buffer;
+  uint8_t  status = MJPEG_OK;
+
+  if(MjpegRecorder.Active == 0)
+  {
+    return MJPEG_ERROR;
+  }
+  MjpegRecorder.Active = 0;
+
+  AVI_PutFourCC(entry, "idx1");
+  AVI_Put32(&entry[4], 16 * MjpegRecorder.Stats.Frames);
+  status = STREAM_Write(entry, 8);
+
+  AVI_PutFourCC(entry, "00dc");
+  AVI_Put32(&entry[4], AVIIF_KEYFRAME);
+  for(index = 0; (index < MjpegRecorder.Stats.Frames) && (status == MJPEG_OK); index++)
+  {
+    AVI_Put32(&entry[8], MjpegRecorder.Config.pIndex[2 * index]);
+    AVI_Put32(&entry[12], MjpegRecorder.Config.pIndex[(2 * index) + 1]);
+    status = STREAM_Write(entry, 16);
+  }
+
+  if(status == MJPEG_OK)
+  {
+    status = STREAM_Flush();
+  }
+  if(status == MJPEG_OK)
+  {
+    status = STREAM_WaitWrite();
+  }
+
+  /* Rewrite the first block with the final headers */
+  if(status == MJPEG_OK)
+  {
+    buffer = MjpegRecorder.Config.pWriteBuffer + (MjpegRecorder.Buffer * MJPEG_WRITE_BUFFER_SIZE);
+    AVI_BuildHeader(buffer);
+    if(BSP_SD_WriteBlocks_DMA((uint32_t *)buffer, MjpegRecorder.Config.StartBlock, 1) != MSD_OK)
+    {
+      return MJPEG_ERROR;
+    }
+    MjpegRecorder.WritePending = 1;
+    status = STREAM_WaitWrite();
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Gets the MJPEG recorder statistics.
+  * @param  pStats: Pointer to the statistics structure
+  */
+void BSP_MJPEG_GetStats(MJPEG_StatsTypeDef *pStats)
+{
+  *pStats = MjpegRecorder.Stats;
+}
+
+/**
+  * @brief  Encodes a RGB565 frame into a baseline JPEG image.
+  * @note   BSP_MJPEG_Init() must be called first to build the tables.
+  * @param  pSrc: Pointer to the RGB565 frame, word aligned
+  * @param  Width: Frame width in pixels, multiple of 16
+  * @param  Height: Frame height in lines, multiple of 16
+  * @param  pDst: Pointer to the JPEG output buffer
+  * @param  MaxSize: Size of the output buffer in bytes
+  * @retval Size of the JPEG image in bytes, 0 on error or if the image does
+  *         not fit in the output buffer
+  */
+uint32_t BSP_MJPEG_EncodeFrame(uint8_t *pSrc, uint32_t Width, uint32_t Height, uint8_t *pDst, uint32_t MaxSize)
+{
+  uint32_t column = 0, line = 0, block = 0;
+  int32_t  predictor[3] = {0, 0, 0};
+  uint16_t *src = (uint16_t *)pSrc;
+
+  if((MjpegEncoder.Ready == 0) || (Width == 0) || ((Width % 16) != 0) ||
+     (Height == 0) || ((Height % 16) != 0) || (((uint32_t)pSrc & 0x3) != 0))
+  {
+    return 0;
+  }
+
+  MjpegEncoder.pOut      = pDst;
+  MjpegEncoder.pEnd      = pDst + MaxSize;
+  MjpegEncoder.BitBuffer = 0;
+  MjpegEncoder.BitCount  = 0;
+  MjpegEncoder.Overflow  = 0;
+
+  ENCODER_WriteHeaders(Width, Height);
+
+  for(line = 0; line < Height; line += 16)
+  {
+    for(column = 0; column < Width; column += 16)
+    {
+      ENCODER_LoadMcu(&src[(line * Width) + column], Width);
+
+      for(block = 0; block < 4; block++)
+      {
+        ENCODER_EncodeBlock(MjpegEncoder.Block[block], 0, &predictor[0]);
+      }
+      ENCODER_EncodeBlock(MjpegEncoder.Block[4], 1, &predictor[1]);
+      ENCODER_EncodeBlock(MjpegEncoder.Block[5], 1, &predictor[2]);
+    }
+
+    if(MjpegEncoder.Overflow != 0)
+    {
+      return 0;
+    }
+  }
+
+  /* Pad the last byte with 1 bits and end the image */
+  ENCODER_PutBits(0x7F, 7);
+  ENCODER_PutByte(0xFF);
+  ENCODER_PutByte(0xD9);
+
+  if(MjpegEncoder.Overflow != 0)
+  {
+    return 0;
+  }
+
+  return (uint32_t)(MjpegEncoder.pOut - pDst);
+}
+
+/**
+  * @brief  Computes the codes of a Huffman table.
+  * @param  pBits: Number of codes of each length, 1 to 16
+  * @param  pValues: Symbols in code order
+  * @param  pCode: Code of each symbol
+  * @param  pSize: Code length of each symbol
+  */
+static void ENCODER_BuildHuffman(const uint8_t *pBits, const uint8_t *pValues, uint16_t *pCode, uint8_t *pSize)
+{
+  uint32_t length = 0, count = 0, index = 0, code = 0;
+
+  for(length = 1; length <= 16; length++)
+  {
+    for(count = 0; count < pBits[length - 1]; count++)
+    {
+      pCode[pValues[index]] = (uint16_t)code;
+      pSize[pValues[index]] = (uint8_t)length;
+      code++;
+      index++;
+    }
+    code <<= 1;
+  }
+}
+
+/**
+  * @brief  Writes a byte to the JPEG output buffer.
+  * @param  Value: Byte to write
+  */
+static void ENCODER_PutByte(uint8_t Value)
+{
+  if(MjpegEncoder.pOut < MjpegEncoder.pEnd)
+  {
+    *MjpegEncoder.pOut++ = Value;
+  }
+  else
+  {
+    MjpegEncoder.Overflow = 1;
+  }
+}
+
+/**
+  * @brief  Writes bits to the entropy coded data, with 0xFF byte stuffing.
+  * @param  Code: Bits to write, right aligned
+  * @param  Size: Number of bits, up to 16
+  */
+static void ENCODER_PutBits(uint32_t Code, uint32_t Size)
+{
+  uint8_t value = 0;
+
+  MjpegEncoder.BitBuffer = (MjpegEncoder.BitBuffer << Size) | (Code & ((1UL << Size) - 1));
+  MjpegEncoder.BitCount += Size;
+
+  while(MjpegEncoder.BitCount >= 8)
+  {
+    MjpegEncoder.BitCount -= 8;
+    value = (uint8_t)(MjpegEncoder.BitBuffer >> MjpegEncoder.BitCount);
+    ENCODER_PutByte(value);
+    if(value == 0xFF)
+    {
+      ENCODER_PutByte(0x00);
+    }
+  }
+}
+
+/**
+  * @brief  Writes the JPEG headers up to the start of scan.
+  * @param  Width: Image width in pixels
+  * @param  Height: Image height in lines
+  */
+static void ENCODER_WriteHeaders(uint32_t Width, uint32_t Height)
+{
+  static const uint8_t jfif[20] =
+  {
+    0xFF, 0xD8,                                     /* SOI */
+    0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,  /* APP0 */
+    0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00
+  };
+  static const uint8_t sos[14] =
+  {
+    0xFF, 0xDA, 0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00
+  };
+  uint32_t index = 0, table = 0;
+
+  for(index = 0; index < sizeof(jfif); index++)
+  {
+    ENCODER_PutByte(jfif[index]);
+  }
+
+  /* DQT, luma and chroma tables */
+  ENCODER_PutByte(0xFF);
+  ENCODER_PutByte(0xDB);
+  ENCODER_PutByte(0x00);
+  ENCODER_PutByte(0x84);
+  for(table = 0; table < 2; table++)
+  {
+    ENCODER_PutByte((uint8_t)table);
+    for(index = 0; index < 64; index++)
+    {
+      ENCODER_PutByte(MjpegEncoder.Quant[table][index]);
+    }
+  }
+
+  /* SOF0, YCbCr 4:2:0 */
+  ENCODER_PutByte(0xFF);
+  ENCODER_PutByte(0xC0);
+  ENCODER_PutByte(0x00);
+  ENCODER_PutByte(0x11);
+  ENCODER_PutByte(0x08);
+  ENCODER_PutByte((uint8_t)(Height >> 8));
+  ENCODER_PutByte((uint8_t)Height);
+  ENCODER_PutByte((uint8_t)(Width >> 8));
+  ENCODER_PutByte((uint8_t)Width);
+  ENCODER_PutByte(0x03);
+  for(index = 1; index <= 3; index++)
+  {
+    ENCODER_PutByte((uint8_t)index);
+    ENCODER_PutByte((index == 1) ? 0x22 : 0x11);
+    ENCODER_PutByte((index == 1) ? 0x00 : 0x01);
+  }
+
+  /* DHT, DC and AC tables of luma and chroma */
+  ENCODER_PutByte(0xFF);
+  ENCODER_PutByte(0xC4);
+  ENCODER_PutByte(0x01);
+  ENCODER_PutByte(0xA2);
+  for(table = 0; table < 2; table++)
+  {
+    ENCODER_PutByte((uint8_t)table);
+    for(index = 0; index < 16; index++)
+    {
+      ENCODER_PutByte(MjpegDcBits[table][index]);
+    }
+    for(index = 0; index < 12; index++)
+    {
+      ENCODER_PutByte(MjpegDcValues[index]);
+    }
+
+    ENCODER_PutByte((uint8_t)(0x10 | table));
+    for(index = 0; index < 16; index++)
+    {
+      ENCODER_PutByte(MjpegAcBits[table][index]);
+    }
+    for(index = 0; index < 162; index++)
+    {
+      ENCODER_PutByte(MjpegAcValues[table][index]);
+    }
+  }
+
+  for(index = 0; index < sizeof(sos); index++)
+  {
+    ENCODER_PutByte(sos[index]);
+  }
+}
+
+/**
+  * @brief  Converts a 16x16 RGB565 MCU into 4 Y blocks and the 2x2 averaged
+  *         Cb and Cr blocks, level shifted.
+  * @param  pSrc: Pointer to the top left pixel of the MCU, word aligned
+  * @param  Width: Frame width in pixels
+  */
+static void ENCODER_LoadMcu(uint16_t *pSrc, uint32_t Width)
+{
+  uint32_t *src;
+  uint32_t line = 0, column = 0, pixels = 0, pixel = 0, half = 0;
+  int32_t  r = 0, g = 0, b = 0, cb = 0, cr = 0;
+  int32_t  *y, *pcb, *pcr;
+
+  for(line = 0; line < 16; line++)
+  {
+    src = (uint32_t *)&pSrc[line * Width];
+    y   = &MjpegEncoder.Block[(line / 8) * 2][(line % 8) * 8];
+    pcb = &MjpegEncoder.Block[4][(line / 2) * 8];
+    pcr = &MjpegEncoder.Block[5][(line / 2) * 8];
+
+    for(column = 0; column < 8; column++)
+    {
+      /* Two horizontal pixels sharing the chroma samples */
+      pixels = src[column];
+      cb = 0;
+      cr = 0;
+      for(half = 0; half < 2; half++)
+      {
+        pixel = (half == 0) ? (pixels & 0xFFFF) : (pixels >> 16);
+        r = (int32_t)(((pixel >> 8) & 0xF8) | (pixel >> 13));
+        g = (int32_t)(((pixel >> 3) & 0xFC) | ((pixel >> 9) & 0x03));
+        b = (int32_t)(((pixel << 3) & 0xF8) | ((pixel >> 2) & 0x07));
+
+        y[((column / 4) * 64) + ((column % 4) * 2) + half] = (((77 * r) + (150 * g) + (29 * b) + 128) >> 8) - 128;
+        cb += (-43 * r) - (85 * g) + (128 * b);
+        cr += (128 * r) - (107 * g) - (21 * b);
+      }
+
+      if((line % 2) == 0)
+      {
+        pcb[column] = cb;
+        pcr[column] = cr;
+      }
+      else
+      {
+        pcb[column] = (pcb[column] + cb + 512) >> 10;
+        pcr[column] = (pcr[column] + cr + 512) >> 10;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Computes the 8x8 forward DCT in place, integer LLM algorithm.
+  * @note   The coefficients are scaled by 8.
+  * @param  pBlock: Pointer to the level shifted samples
+  */
+static void ENCODER_Dct(int32_t *pBlock)
+{
+  int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  int32_t tmp10, tmp11, tmp12, tmp13;
+  int32_t z1, z2, z3, z4, z5;
+  int32_t *data;
+  uint32_t index = 0;
+
+  /* Rows, results scaled by 2^PASS1_BITS */
+  for(index = 0; index < 8; index++)
+  {
+    data = &pBlock[index * 8];
+
+    tmp0 = data[0] + data[7];
+    tmp7 = data[0] - data[7];
+    tmp1 = data[1] + data[6];
+    tmp6 = data[1] - data[6];
+    tmp2 = data[2] + data[5];
+    tmp5 = data[2] - data[5];
+    tmp3 = data[3] + data[4];
+    tmp4 = data[3] - data[4];
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    data[0] = (tmp10 + tmp11) << DCT_PASS1_BITS;
+    data[4] = (tmp10 - tmp11) << DCT_PASS1_BITS;
+
+    z1 = (tmp12 + tmp13) * DCT_FIX_0_541196100;
+    data[2] = DCT_DESCALE(z1 + (tmp13 * DCT_FIX_0_765366865), DCT_CONST_BITS - DCT_PASS1_BITS);
+    data[6] = DCT_DESCALE(z1 - (tmp12 * DCT_FIX_1_847759065), DCT_CONST_BITS - DCT_PASS1_BITS);
+
+    z1 = tmp4 + tmp7;
+    z2 = tmp5 + tmp6;
+    z3 = tmp4 + tmp6;
+    z4 = tmp5 + tmp7;
+    z5 = (z3 + z4) * DCT_FIX_1_175875602;
+
+    tmp4 *= DCT_FIX_0_298631336;
+    tmp5 *= DCT_FIX_2_053119869;
+    tmp6 *= DCT_FIX_3_072711026;
+    tmp7 *= DCT_FIX_1_501321110;
+    z1 *= -DCT_FIX_0_899976223;
+    z2 *= -DCT_FIX_2_562915447;
+    z3 = (z3 * -DCT_FIX_1_961570560) + z5;
+    z4 = (z4 * -DCT_FIX_0_390180644) + z5;
+
+    data[7] = DCT_DESCALE(tmp4 + z1 + z3, DCT_CONST_BITS - DCT_PASS1_BITS);
+    data[5] = DCT_DESCALE(tmp5 + z2 + z4, DCT_CONST_BITS - DCT_PASS1_BITS);
+    data[3] = DCT_DESCALE(tmp6 + z2 + z3, DCT_CONST_BITS - DCT_PASS1_BITS);
+    data[1] = DCT_DESCALE(tmp7 + z1 + z4, DCT_CONST_BITS - DCT_PASS1_BITS);
+  }
+
+  /* Columns, the PASS1_BITS scaling is removed */
+  for(index = 0; index < 8; index++)
+  {
+    data = &pBlock[index];
+
+    tmp0 = data[0] + data[56];
+    tmp7 = data[0] - data[56];
+    tmp1 = data[8] + data[48];
+    tmp6 = data[8] - data[48];
+    tmp2 = data[16] + data[40];
+    tmp5 = data[16] - data[40];
+    tmp3 = data[24] + data[32];
+    tmp4 = data[24] - data[32];
+
+    tmp10 = tmp0 + tmp3;
+    tmp13 = tmp0 - tmp3;
+    tmp11 = tmp1 + tmp2;
+    tmp12 = tmp1 - tmp2;
+
+    data[0]  = DCT_DESCALE(tmp10 + tmp11, DCT_PASS1_BITS);
+    data[32] = DCT_DESCALE(tmp10 - tmp11, DCT_PASS1_BITS);
+
+    z1 = (tmp12 + tmp13) * DCT_FIX_0_541196100;
+    data[16] = DCT_DESCALE(z1 + (tmp13 * DCT_FIX_0_765366865), DCT_CONST_BITS + DCT_PASS1_BITS);
+    data[48] = DCT_DESCALE(z1 - (tmp12 * DCT_FIX_1_847759065), DCT_CONST_BITS + DCT_PASS1_BITS);
+
+    z1 = tmp4 + tmp7;
+    z2 = tmp5 + tmp6;
+    z3 = tmp4 + tmp6;
+    z4 = tmp5 + tmp7;
+    z5 = (z3 + z4) * DCT_FIX_1_175875602;
+
+    tmp4 *= DCT_FIX_0_298631336;
+    tmp5 *= DCT_FIX_2_053119869;
+    tmp6 *= DCT_FIX_3_072711026;
+    tmp7 *= DCT_FIX_1_501321110;
+    z1 *= -DCT_FIX_0_899976223;
+    z2 *= -DCT_FIX_2_562915447;
+    z3 = (z3 * -DCT_FIX_1_961570560) + z5;
+    z4 = (z4 * -DCT_FIX_0_390180644) + z5;
+
+    data[56] = DCT_DESCALE(tmp4 + z1 + z3, DCT_CONST_BITS + DCT_PASS1_BITS);
+    data[40] = DCT_DESCALE(tmp5 + z2 + z4, DCT_CONST_BITS + DCT_PASS1_BITS);
+    data[24] = DCT_DESCALE(tmp6 + z2 + z3, DCT_CONST_BITS + DCT_PASS1_BITS);
+    data[8]  = DCT_DESCALE(tmp7 + z1 + z4, DCT_CONST_BITS + DCT_PASS1_BITS);
+  }
+}
+
+/**
+  * @brief  Transforms, quantizes and Huffman codes a block.
+  * @param  pBlock: Pointer to the level shifted samples
+  * @param  Table: 0 for luma, 1 for chroma tables
+  * @param  pPredictor: Pointer to the DC predictor of the component
+  */
+static void ENCODER_EncodeBlock(int32_t *pBlock, uint32_t Table, int32_t *pPredictor)
+{
+  const uint32_t *recip = MjpegEncoder.Recip[Table];
+  uint32_t index = 0, run = 0, magnitude = 0, nbits = 0, symbol = 0;
+  int32_t  coef = 0, value = 0;
+
+  ENCODER_Dct(pBlock);
+
+  for(index = 0; index < 64; index++)
+  {
+    coef = pBlock[MjpegNaturalOrder[index]];
+
+    /* Rounded quantization of the magnitude */
+    if(coef < 0)
+    {
+      value = -(int32_t)((((uint32_t)-coef * recip[index]) + (1UL << (MJPEG_RECIP_SHIFT - 1))) >> MJPEG_RECIP_SHIFT);
+    }
+    else
+    {
+      value = (int32_t)((((uint32_t)coef * recip[index]) + (1UL << (MJPEG_RECIP_SHIFT - 1))) >> MJPEG_RECIP_SHIFT);
+    }
+
+    if(index == 0)
+    {
+      /* DC difference */
+      coef = value - *pPredictor;
+      *pPredictor = value;
+    }
+    else if(value == 0)
+    {
+      run++;
+      continue;
+    }
+    else
+    {
+      /* Runs longer than 15 zeros use the ZRL symbol */
+      while(run > 15)
+      {
+        ENCODER_PutBits(MjpegEncoder.AcCode[Table][0xF0], MjpegEncoder.AcSize[Table][0xF0]);
+        run -= 16;
+      }
+      coef = value;
+    }
+
+    magnitude = (coef < 0) ? (uint32_t)-coef : (uint32_t)coef;
+    nbits = (magnitude == 0) ? 0 : (32 - __CLZ(magnitude));
+
+    /* Negative values are coded as the one's complement */
+    if(coef < 0)
+    {
+      coef--;
+    }
+
+    if(index == 0)
+    {
+      ENCODER_PutBits(MjpegEncoder.DcCode[Table][nbits], MjpegEncoder.DcSize[Table][nbits]);
+    }
+    else
+    {
+      symbol = (run << 4) | nbits;
+      ENCODER_PutBits(MjpegEncoder.AcCode[Table][symbol], MjpegEncoder.AcSize[Table][symbol]);
+      run = 0;
+    }
+    ENCODER_PutBits((uint32_t)coef, nbits);
+  }
+
+  /* End of block */
+  if(run != 0)
+  {
+    ENCODER_PutBits(MjpegEncoder.AcCode[Table][0x00], MjpegEncoder.AcSize[Table][0x00]);
+  }
+}
+
+/**
+  * @brief  Writes a little endian 32-bit value.
+  * @param  pBuffer: Pointer to the destination
+  * @param  Value: Value to write
+  */
+static void AVI_Put32(uint8_t *pBuffer, uint32_t Value)
+{
+  pBuffer[0] = (uint8_t)Value;
+  pBuffer[1] = (uint8_t)(Value >> 8);
+  pBuffer[2] = (uint8_t)(Value >> 16);
+  pBuffer[3] = (uint8_t)(Value >> 24);
+}
+
+/**
+  * @brief  Writes a four character code.
+  * @param  pBuffer: Pointer to the destination
+  * @param  pId: Four character code
+  */
+static void AVI_PutFourCC(uint8_t *pBuffer, const char *pId)
+{
+  pBuffer[0] = (uint8_t)pId[0];
+  pBuffer[1] = (uint8_t)pId[1];
+  pBuffer[2] = (uint8_t)pId[2];
+  pBuffer[3] = (uint8_t)pId[3];
+}
+
+/**
+  * @brief  Builds the AVI headers block from the recording state.
+  * @note   The frame rate is the recorded one when available.
+  * @param  pBuffer: Pointer to a MJPEG_BLOCK_SIZE bytes buffer
+  */
+static void AVI_BuildHeader(uint8_t *pBuffer)
+{
+  uint32_t index = 0, rate = 0, frames = MjpegRecorder.Stats.Frames;
+  uint32_t width = MjpegRecorder.Width, height = MjpegRecorder.Height;
+  uint32_t riff = 0, suggested = MjpegRecorder.Config.FrameBufferSize + 8;
+  uint32_t *words = (uint32_t *)pBuffer;
+
+  /* Frame rate x100 */
+  rate = (MjpegRecorder.Stats.FrameRate != 0) ? MjpegRecorder.Stats.FrameRate : (MjpegRecorder.Config.FrameRate * 100);
+  riff = (AVI_HEADER_SIZE - 8) + MjpegRecorder.MoviSize + 8 + (16 * frames);
+
+  for(index = 0; index < (AVI_HEADER_SIZE / 4); index++)
+  {
+    words[index] = 0;
+  }
+
+  AVI_PutFourCC(&pBuffer[0], "RIFF");
+  AVI_Put32(&pBuffer[4], riff);
+  AVI_PutFourCC(&pBuffer[8], "AVI ");
+
+  /* Main header */
+  AVI_PutFourCC(&pBuffer[12], "LIST");
+  AVI_Put32(&pBuffer[16], AVI_HDRL_SIZE);
+  AVI_PutFourCC(&pBuffer[20], "hdrl");
+  AVI_PutFourCC(&pBuffer[24], "avih");
+  AVI_Put32(&pBuffer[28], 56);
+  AVI_Put32(&pBuffer[32], 100000000 / rate);
+  AVI_Put32(&pBuffer[36], (MjpegRecorder.Stats.BytesPerFrame * rate) / 100);
+  AVI_Put32(&pBuffer[44], AVIF_HASINDEX);
+  AVI_Put32(&pBuffer[48], frames);
+  AVI_Put32(&pBuffer[56], 1);
+  AVI_Put32(&pBuffer[60], suggested);
+  AVI_Put32(&pBuffer[64], width);
+  AVI_Put32(&pBuffer[68], height);
+
+  /* Video stream header */
+  AVI_PutFourCC(&pBuffer[88], "LIST");
+  AVI_Put32(&pBuffer[92], AVI_STRL_SIZE);
+  AVI_PutFourCC(&pBuffer[96], "strl");
+  AVI_PutFourCC(&pBuffer[100], "strh");
+  AVI_Put32(&pBuffer[104], 56);
+  AVI_PutFourCC(&pBuffer[108], "vids");
+  AVI_PutFourCC(&pBuffer[112], "MJPG");
+  AVI_Put32(&pBuffer[128], 100);
+  AVI_Put32(&pBuffer[132], rate);
+  AVI_Put32(&pBuffer[140], frames);
+  AVI_Put32(&pBuffer[144], suggested);
+  AVI_Put32(&pBuffer[148], 0xFFFFFFFF);
+  AVI_Put32(&pBuffer[160], (height << 16) | width);
+
+  /* Video stream format, BITMAPINFOHEADER */
+  AVI_PutFourCC(&pBuffer[164], "strf");
+  AVI_Put32(&pBuffer[168], 40);
+  AVI_Put32(&pBuffer[172], 40);
+  AVI_Put32(&pBuffer[176], width);
+  AVI_Put32(&pBuffer[180], height);
+  AVI_Put32(&pBuffer[184], (24 << 16) | 1);
+  AVI_PutFourCC(&pBuffer[188], "MJPG");
+  AVI_Put32(&pBuffer[192], width * height * 3);
+
+  /* Padding up to the movi list, the frames start on a block boundary */
+  AVI_PutFourCC(&pBuffer[AVI_JUNK_OFFSET], "JUNK");
+  AVI_Put32(&pBuffer[AVI_JUNK_OFFSET + 4], AVI_HEADER_SIZE - 12 - AVI_JUNK_OFFSET - 8);
+  AVI_PutFourCC(&pBuffer[AVI_HEADER_SIZE - 12], "LIST");
+  AVI_Put32(&pBuffer[AVI_HEADER_SIZE - 8], 4 + MjpegRecorder.MoviSize);
+  AVI_PutFourCC(&pBuffer[AVI_HEADER_SIZE - 4], "movi");
+}
+
+/**
+  * @brief  Appends data to the write buffers, full buffers are written to
+  *         the SD card.
+  * @param  pData: Pointer to the data
+  * @param  Size: Size of the data in bytes
+  * @retval MJPEG status
+  */
+static uint8_t STREAM_Write(const uint8_t *pData, uint32_t Size)
+{
+  uint8_t  *buffer;
+  uint32_t length = 0, index = 0;
+  uint8_t  status = MJPEG_OK;
+
+  while(Size > 0)
+  {
+    buffer = MjpegRecorder.Config.pWriteBuffer + (MjpegRecorder.Buffer * MJPEG_WRITE_BUFFER_SIZE) + MjpegRecorder.Fill;
+    length = MJPEG_WRITE_BUFFER_SIZE - MjpegRecorder.Fill;
+    if(length > Size)
+    {
+      length = Size;
+    }
+
+    for(index = 0; index < length; index++)
+    {
+      buffer[index] = pData[index];
+    }
+
+    MjpegRecorder.Fill += length;
+    pData += length;
+    Size -= length;
+
+    if(MjpegRecorder.Fill == MJPEG_WRITE_BUFFER_SIZE)
+    {
+      status = STREAM_Flush();
+      if(status != MJPEG_OK)
+      {
+        return status;
+      }
+    }
+  }
+
+  return MJPEG_OK;
+}
+
+/**
+  * @brief  Starts the DMA write of the current buffer, padded to a block, and
+  *         switches to the other buffer.
+  * @retval MJPEG status
+  */
+static uint8_t STREAM_Flush(void)
+{
+  uint8_t  *buffer = MjpegRecorder.Config.pWriteBuffer + (MjpegRecorder.Buffer * MJPEG_WRITE_BUFFER_SIZE);
+  uint32_t blocks = (MjpegRecorder.Fill + MJPEG_BLOCK_SIZE - 1) / MJPEG_BLOCK_SIZE;
+
+  if(blocks == 0)
+  {
+    return MJPEG_OK;
+  }
+
+  while(MjpegRecorder.Fill < (blocks * MJPEG_BLOCK_SIZE))
+  {
+    buffer[MjpegRecorder.Fill++] = 0;
+  }
+
+  /* The other buffer must have been written */
+  if(STREAM_WaitWrite() != MJPEG_OK)
+  {
+    return MJPEG_ERROR;
+  }
+
+  if((MjpegRecorder.NextBlock + blocks) > (MjpegRecorder.Config.StartBlock + MjpegRecorder.Config.NbBlocks))
+  {
+    return MJPEG_FULL;
+  }
+
+  if(BSP_SD_WriteBlocks_DMA((uint32_t *)buffer, MjpegRecorder.NextBlock, blocks) != MSD_OK)
+  {
+    return MJPEG_ERROR;
+  }
+
+  MjpegRecorder.WritePending = 1;
+  MjpegRecorder.NextBlock += blocks;
+  MjpegRecorder.Stats.Bytes += blocks * MJPEG_BLOCK_SIZE;
+  MjpegRecorder.Buffer ^= 1;
+  MjpegRecorder.Fill = 0;
+
+  return MJPEG_OK;
+}
+
+/**
+  * @brief  Waits for the end of the pending SD write.
+  * @retval MJPEG status
+  */
+static uint8_t STREAM_WaitWrite(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  if(MjpegRecorder.WritePending == 0)
+  {
+    return MJPEG_OK;
+  }
+
+  if(HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY)
+  {
+    MjpegRecorder.Stats.WriteStalls++;
+  }
+
+  /* End of the DMA transfer, then end of the card programming */
+  while((HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY) || (BSP_SD_GetCardState() != SD_TRANSFER_OK))
+  {
+    if((HAL_GetTick() - tickstart) >= MJPEG_SD_TIMEOUT)
+    {
+      return MJPEG_ERROR;
+    }
+  }
+
+  MjpegRecorder.WritePending = 0;
+
+  return MJPEG_OK;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
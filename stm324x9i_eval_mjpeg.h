@@ -0,0 +1,133 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_mjpeg.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_mjpeg.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_MJPEG_H
+#define __STM324x9I_EVAL_MJPEG_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_camera.h"
+#include "stm324x9i_eval_sd.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_MJPEG
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Exported_Types STM324x9I EVAL MJPEG Exported Types
+  * @{
+  */
+
+/**
+  * @brief  MJPEG recorder configuration
+  */
+typedef struct
+{
+  uint32_t Quality;         /* JPEG quality, 1 to 100                          */
+  uint32_t FrameRate;       /* Nominal frame rate written in the AVI headers   */
+  uint32_t StartBlock;      /* First SD block of the AVI file                  */
+  uint32_t NbBlocks;        /* Number of SD blocks reserved for the file       */
+  uint8_t  *pWriteBuffer;   /* 2 x MJPEG_WRITE_BUFFER_SIZE bytes, word aligned */
+  uint8_t  *pFrameBuffer;   /* Encoded frame buffer, word aligned              */
+  uint32_t FrameBufferSize; /* Size of the encoded frame buffer in bytes       */
+  uint32_t *pIndex;         /* AVI index, 2 words per frame                    */
+  uint32_t MaxFrames;       /* Number of frames of the index                   */
+}MJPEG_ConfigTypeDef;
+
+/**
+  * @brief  MJPEG recorder statistics
+  */
+typedef struct
+{
+  uint32_t Frames;          /* Recorded frames                                */
+  uint32_t Skipped;         /* Frames exceeding the encoded frame buffer      */
+  uint32_t Bytes;           /* Bytes written to the SD card                   */
+  uint32_t BytesPerFrame;   /* Mean encoded frame size                        */
+  uint32_t EncodeUs;        /* Encoding time of the last frame (us)           */
+  uint32_t MaxEncodeUs;     /* Maximum encoding time (us)                     */
+  uint32_t FrameRate;       /* Recorded frames per second x100                */
+  uint32_t WriteStalls;     /* Waits for the completion of a SD write         */
+}MJPEG_StatsTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Exported_Constants STM324x9I EVAL MJPEG Exported Constants
+  * @{
+  */
+/**
+  * @brief  MJPEG status definition
+  */
+#define MJPEG_OK                 ((uint8_t)0x00)
+#define MJPEG_ERROR              ((uint8_t)0x01)
+#define MJPEG_FULL               ((uint8_t)0x02)
+
+/* Size of each of the two SD write buffers, multiple of the SD block size */
+#if !defined(MJPEG_WRITE_BUFFER_SIZE)
+ #define MJPEG_WRITE_BUFFER_SIZE  ((uint32_t)32768)
+#endif
+
+/* SD block size and write completion timeout (ms) */
+#define MJPEG_BLOCK_SIZE         ((uint32_t)512)
+#define MJPEG_SD_TIMEOUT         ((uint32_t)1000)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_MJPEG_Exported_Functions STM324x9I EVAL MJPEG Exported Functions
+  * @{
+  */
+uint8_t  BSP_MJPEG_Init(MJPEG_ConfigTypeDef *pConfig);
+uint8_t  BSP_MJPEG_Start(uint32_t Width, uint32_t Height);
+uint8_t  BSP_MJPEG_Process(void);
+uint8_t  BSP_MJPEG_Stop(void);
+void     BSP_MJPEG_GetStats(MJPEG_StatsTypeDef *pStats);
+uint32_t BSP_MJPEG_EncodeFrame(uint8_t *pSrc, uint32_t Width, uint32_t Height, uint8_t *pDst, uint32_t MaxSize);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_MJPEG_H */
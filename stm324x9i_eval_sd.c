@@ -41,6 +41,12 @@
        plugged/unplugged in/from the evaluation board. The SD detection interrupt
        is handled by calling the function BSP_SD_DetectIT() which is called in the IRQ
        handler file, the user callback is implemented in the function BSP_SD_DetectCallback().
+     o Once the interrupt mode is configured, BSP_SD_IsDetected() returns a cached
+       presence state instead of reading the detect pin through the I2C IO expander.
+       A pin change signalled by BSP_SD_DetectIT() is accepted after the pin has been
+       stable for SD_DETECT_DEBOUNCE ms, and increments the generation returned by
+       BSP_SD_GetDetectGeneration() so that upper layers can invalidate their caches
+       on card swap. Pin reads and avoided reads are counted by BSP_SD_GetDetectStats().
      o The function BSP_SD_GetCardInfo() is used to get the micro SD card information 
        which is stored in the structure "HAL_SD_CardInfoTypeDef".
   
@@ -58,6 +64,89 @@
           the number of blocks to erase.
         o The SD runtime status is returned when calling the function BSP_SD_GetCardState().
 
+     + Block cache
+        o A set-associative block cache is enabled by calling BSP_SD_CacheInit() with a
+          memory area of BSP_SD_CACHE_SIZE() bytes, typically located in SDRAM. Reads
+          issued with BSP_SD_ReadBlocks() are then served from the cache and runs of
+          missed blocks are fetched with a single multi-block command.
+        o A read starting at the block following the previous read is detected as
+          sequential and the next ReadAhead blocks are fetched in the same command.
+        o BSP_SD_ReadBlocks_DMA() completes immediately when every block is cached,
+          otherwise the cached leading blocks are copied, the following ones are
+          read from the card and cached when the DMA transfer completes.
+        o Writes and erases keep the cached blocks coherent, the cache is invalidated
+          by BSP_SD_Init() and on card detection events.
+        o Hit, miss and read-ahead accuracy counters are returned by BSP_SD_GetCacheStats().
+
+     + Write-back buffer
+        o BSP_SD_WriteBackInit() enables the buffering of the blocks written with
+          BSP_SD_WriteBlocks(). A block written again while buffered is updated in
+          place, adjacent dirty blocks are coalesced into multi-block DMA writes.
+        o Dirty blocks are written to the card when BSP_SD_WriteBackProcess() finds
+          them older than FlushTimeout, on BSP_SD_Sync() and when the buffer is full.
+        o BSP_SD_DetectIT() only requests a flush, performed by the next call to
+          BSP_SD_WriteBackProcess() while the card is present. The dirty blocks are
+          dropped, and counted as lost, once the card removal has been debounced.
+        o Dirty blocks are never written to a card inserted after a removal edge:
+          they are dropped by the next flush, buffered write or BSP_SD_Init(). The
+          application must call BSP_SD_Sync() before re-initializing the card.
+        o BSP_SD_WriteBarrier() guarantees that the blocks written before the barrier
+          reach the card before the blocks written after it.
+        o Reads, erases and DMA writes of buffered blocks synchronise the buffer first.
+
+     + Request queue
+        o BSP_SD_Submit() queues a read, write or erase request and returns at once.
+          Requests are served by priority class, in submission order within a class,
+          and the request callback is called on completion, from interrupt context
+          for DMA transfers.
+        o The next request is started from the completion interrupt. When the card is
+          still programming, or for erases which are blocking, it is started by
+          BSP_SD_QueueProcess() which must be called periodically.
+        o Queued requests bypass the block cache, whose blocks are invalidated by
+          queued writes and erases. Buffered dirty blocks are written back before a
+          queued request on the same blocks is accepted.
+        o BSP_SD_Cancel() fails a request that the caller stops waiting for, for
+          instance after a timeout: requests of a removed card would otherwise stay
+          queued until a card is ready again.
+        o Latency statistics of each priority class are returned by BSP_SD_GetQueueStats().
+
+     + DMA buffers
+        o Every DMA transfer checks its buffer. Word aligned buffers are transferred
+          directly. Unaligned buffers are transferred with byte wide DMA memory
+          accesses, the DMA FIFO packing them into words for the SDIO.
+        o Buffers the DMA cannot reach (CCM data RAM) are transferred through the
+          bounce buffer given to BSP_SD_BounceInit(), in chunks of its size. A
+          write chunk is delayed while the card is programming: the SD_TIMx timer
+          then polls the card every SD_BOUNCE_RESUME_PERIOD us and starts the chunk
+          once the card is ready. BSP_SD_BounceIRQHandler() must be called in the
+          SD_TIMx_IRQHandler(). BSP_SD_GetCardState() reports SD_TRANSFER_BUSY
+          until the last chunk.
+        o The transfer complete callbacks are called once, after the last chunk.
+
+     + Bus tuning
+        o BSP_SD_TuneBus() switches the card to high-speed mode with CMD6 when it
+          supports it, then selects the fastest SDIO clock, undivided SDIOCLK in
+          high-speed mode, at which test blocks are read back without error. The
+          test blocks are either read at the initial clock as reference, or
+          written with a test pattern when a scratch area is available.
+        o A transfer failing with a CRC error lowers the SDIO clock to the next
+          slower setting, polling transfers being retried once.
+        o The bus settings and CRC error counters are returned by BSP_SD_GetBusInfo().
+
+     + Background erase
+        o BSP_SD_EraseInit() configures the table of freed ranges and the idle time
+          after which background erases may run. The erase group size is the erase
+          sector size of the card CSD.
+        o BSP_SD_Trim() records blocks freed by the application, merging adjacent
+          and overlapping ranges. Blocks written again are removed from the ranges.
+        o BSP_SD_EraseProcess() must be called periodically. When no transfer has
+          been issued for IdleTime ms, it erases up to SD_ERASE_MAX_GROUPS erase
+          groups aligned on the erase group size. Partial groups wait for their
+          neighbours to be freed.
+        o A foreground operation arriving while the card is busy erasing waits for
+          the end of the erase: this delay is reported with the erase backlog by
+          BSP_SD_GetEraseStats().
+
  
 ------------------------------------------------------------------------------*/ 
 
@@ -76,15 +165,192 @@
   * @{
   */ 
 
+/** @defgroup STM324x9I_EVAL_SD_Private_Types SD Private Types
+  * @{
+  */
+typedef struct
+{
+  uint32_t Block;           /* Cached block address       */
+  uint32_t Stamp;           /* Last access, for LRU       */
+  uint32_t Flags;           /* SD_CACHE_LINE_xxx flags    */
+}SD_CacheTagTypeDef;
+
+typedef struct
+{
+  uint32_t Block;           /* Buffered block address           */
+  uint32_t Epoch;           /* Barrier epoch of the write       */
+  uint32_t Valid;           /* Slot holds a dirty block         */
+}SD_WriteBackTagTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SD_Private_Defines SD Private Defines
+  * @{
+  */
+#define SD_CACHE_LINE_VALID       ((uint32_t)0x01)
+#define SD_CACHE_LINE_PREFETCHED  ((uint32_t)0x02)
+#define SD_CACHE_NO_LINE          ((uint32_t)0xFFFFFFFF)
+#define SD_CACHE_BLOCK_WORDS      (SD_CACHE_BLOCK_SIZE / 4)
+#define SD_WRITEBACK_NO_SLOT      ((uint32_t)0xFFFFFFFF)
+#define SD_SWITCH_HIGH_SPEED      ((uint32_t)0x80FFFFF1)
+#define SD_SWITCH_STATUS_SIZE     ((uint32_t)64)
+/**
+  * @}
+  */
+
 /** @defgroup STM324x9I_EVAL_SD_Private_Variables SD Private Variables
   * @{
   */
 SD_HandleTypeDef uSdHandle;
 
+static struct
+{
+  uint32_t           *pData;        /* Cached blocks, NULL when the cache is disabled */
+  uint32_t           *pStaging;     /* Multi-block read staging area                  */
+  SD_CacheTagTypeDef *pTags;
+  uint32_t           NbSets;
+  uint32_t           Ways;
+  uint32_t           ReadAhead;
+  uint32_t           StagingBlocks;
+  uint32_t           Stamp;
+  uint32_t           NextBlock;     /* Block following the previous read              */
+  uint32_t           *pPending;     /* Buffer of the DMA read in progress             */
+  uint32_t           PendingBlock;
+  uint32_t           PendingCount;
+  SD_CacheStatsTypeDef Stats;
+}SdCache;
+
+static struct
+{
+  uint32_t               *pData;    /* Dirty blocks, NULL when write-back is disabled */
+  uint32_t               *pStaging; /* Coalesced write area                           */
+  SD_WriteBackTagTypeDef *pTags;
+  uint32_t               NbBlocks;
+  uint32_t               MaxBurst;
+  uint32_t               FlushTimeout;
+  uint32_t               Epoch;
+  uint32_t               Dirty;     /* Number of dirty blocks                         */
+  uint32_t               DirtyTick; /* Tick of the oldest dirty block                 */
+  uint32_t               DetectFlush; /* Flush requested by a card detection event    */
+  __IO uint32_t          Flushing;  /* Transfers of a flush in progress               */
+  __IO uint32_t          Removed;   /* Card removed while blocks were dirty           */
+  SD_WriteBackStatsTypeDef Stats;
+}SdWriteBack;
+
+static struct
+{
+  SD_RequestTypeDef *pHead[SD_QUEUE_PRIORITIES];
+  SD_RequestTypeDef *pTail[SD_QUEUE_PRIORITIES];
+  SD_RequestTypeDef *pActive;       /* Request being transferred */
+  struct
+  {
+    uint32_t Submitted;
+    uint32_t Completed;
+    uint32_t Errors;
+    uint32_t TotalUs;
+    uint32_t MaxUs;
+    uint32_t Histogram[SD_QUEUE_HISTO_BUCKETS];
+  }Class[SD_QUEUE_PRIORITIES];
+}SdQueue;
+
+static struct
+{
+  uint32_t *pBuffer;        /* Bounce buffer, NULL when not configured         */
+  uint32_t NbBlocks;
+  uint8_t  *pUser;          /* Caller buffer of the bounced transfer           */
+  uint32_t Block;           /* Next block to transfer                          */
+  uint32_t Remaining;       /* Blocks left, including the chunk in progress    */
+  uint32_t Chunk;           /* Blocks of the chunk in progress                 */
+  uint32_t Write;           /* Direction of the bounced transfer               */
+  uint32_t Deferred;        /* Write chunk waiting for the card                */
+  DMA_HandleTypeDef *hdmaByte; /* DMA stream set to byte memory accesses, or NULL */
+  SD_BounceStatsTypeDef Stats;
+}SdBounce;
+
+/* SDIO clock dividers tried from the fastest, after the undivided clock */
+static const uint8_t SdBusDividers[] = {0, 1, 2, 4, 8};
+
+static struct
+{
+  uint32_t Tuning;          /* Transfers of the tuning in progress */
+  SD_BusInfoTypeDef Info;
+}SdBus;
+
+static struct
+{
+  SD_EraseRangeTypeDef *pRanges;  /* Freed ranges sorted by address, NULL when disabled */
+  uint32_t             MaxRanges;
+  uint32_t             NbRanges;
+  uint32_t             IdleTime;
+  uint32_t             LastIoTick;  /* Tick of the last foreground operation            */
+  uint32_t             Busy;        /* Card busy with a background erase                */
+  uint32_t             EraseCycles; /* Start of the background erase in progress        */
+  SD_EraseStatsTypeDef Stats;
+}SdErase;
+
+static struct
+{
+  uint32_t Enabled;         /* Detect pin interrupt configured             */
+  uint32_t Valid;           /* State holds the current presence            */
+  uint8_t  State;           /* Accepted presence state                     */
+  uint8_t  Sample;          /* Last pin state read on an interrupt         */
+  uint8_t  Removed;         /* Card seen removed since State was accepted  */
+  uint8_t  Pending;         /* Pin change waiting for the debounce time    */
+  uint32_t EdgeTick;        /* Tick of the last pin change                 */
+  SD_DetectStatsTypeDef Stats;
+}SdDetect;
+
 /**
   * @}
   */ 
 
+/** @defgroup STM324x9I_EVAL_SD_Private_FunctionPrototypes SD Private Function Prototypes
+  * @{
+  */
+static uint32_t CACHE_Lookup(uint32_t Block);
+static void     CACHE_Insert(uint32_t Block, uint32_t *pSrc, uint32_t Flags);
+static void     CACHE_Update(uint32_t *pSrc, uint32_t Block, uint32_t NumOfBlocks);
+static void     CACHE_InvalidateRange(uint32_t StartBlock, uint32_t EndBlock);
+static uint8_t  CACHE_Read(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+static void     CACHE_CopyBlock(uint32_t *pDst, uint32_t *pSrc);
+static uint32_t WRITEBACK_Find(uint32_t Block, uint32_t Epoch);
+static uint32_t WRITEBACK_Overlaps(uint32_t StartBlock, uint32_t EndBlock);
+static uint8_t  WRITEBACK_Write(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+static uint8_t  WRITEBACK_Flush(void);
+static uint8_t  BUS_WaitTransfer(void);
+static void     WRITEBACK_Discard(void);
+static uint32_t WRITEBACK_DropRemoved(void);
+static SD_RequestTypeDef *QUEUE_Dequeue(void);
+static void     QUEUE_StartNext(void);
+static void     QUEUE_Complete(uint8_t Status);
+static void     QUEUE_Finish(SD_RequestTypeDef *pRequest, uint8_t Status);
+static uint32_t QUEUE_Percentile(uint32_t Priority, uint32_t Percent);
+static HAL_StatusTypeDef BOUNCE_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks);
+static HAL_StatusTypeDef BOUNCE_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks);
+static HAL_StatusTypeDef BOUNCE_Start(uint32_t *pData, uint32_t Addr, uint32_t NumOfBlocks, uint32_t Write);
+static HAL_StatusTypeDef BOUNCE_StartChunk(void);
+static void     BOUNCE_SetByteMode(DMA_HandleTypeDef *hdma, uint32_t Enable);
+static uint32_t BOUNCE_Complete(void);
+static void     BOUNCE_Resume(void);
+static void     BOUNCE_TimerInit(void);
+static void     BOUNCE_Copy(uint8_t *pDst, uint8_t *pSrc, uint32_t Size);
+static HAL_StatusTypeDef BUS_ReadBlocks(uint8_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+static HAL_StatusTypeDef BUS_WriteBlocks(uint8_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout);
+static uint32_t BUS_Fallback(void);
+static void     BUS_SetClock(uint32_t Bypass, uint32_t ClockDiv);
+static uint8_t  BUS_SwitchHighSpeed(void);
+static uint8_t  BUS_Transfer(uint32_t *pData, uint32_t Block, uint32_t NumOfBlocks, uint32_t Write);
+static uint8_t  DETECT_ReadPin(void);
+static void     ERASE_Foreground(uint32_t StartBlock, uint32_t NumOfBlocks, uint32_t Write);
+static uint32_t ERASE_WaitCard(void);
+static void     ERASE_Remove(uint32_t StartBlock, uint32_t EndBlock);
+static void     ERASE_Insert(uint32_t Index, uint32_t Start, uint32_t Count);
+static void     ERASE_Delete(uint32_t Index);
+/**
+  * @}
+  */
+
 /** @defgroup STM324x9I_EVAL_SD_Private_Functions SD Private Functions
   * @{
   */
@@ -124,6 +390,22 @@ uint8_t BSP_SD_Init(void)
     SD_state = MSD_ERROR;
   }
   
+  /* A new card may have been inserted since the blocks were cached or written */
+  BSP_SD_CacheInvalidate();
+  if(SdWriteBack.Dirty != 0)
+  {
+    SdWriteBack.Stats.Lost += SdWriteBack.Dirty;
+    WRITEBACK_Discard();
+  }
+  SdWriteBack.Removed     = 0;
+  SdWriteBack.DetectFlush = 0;
+  
+  /* The card starts in default speed mode at the initial clock */
+  SdBus.Info.HighSpeed   = 0;
+  SdBus.Info.ClockBypass = 0;
+  SdBus.Info.ClockDiv    = SDIO_TRANSFER_CLK_DIV;
+  SdBus.Info.ClockHz     = SD_SDIOCLK_HZ / (SDIO_TRANSFER_CLK_DIV + 2);
+  
   /* Configure SD Bus width */
   if(SD_state == MSD_OK)
   {
@@ -150,6 +432,9 @@ uint8_t BSP_SD_ITConfig(void)
   /* Configure Interrupt mode for SD detection pin */  
   BSP_IO_ConfigPin(SD_DETECT_PIN, IO_MODE_IT_FALLING_EDGE);
   
+  /* The presence state is now kept up to date by BSP_SD_DetectIT() */
+  SdDetect.Enabled = 1;
+  
   return 0;
 }
 
@@ -159,15 +444,78 @@ uint8_t BSP_SD_ITConfig(void)
  */
 uint8_t BSP_SD_IsDetected(void)
 {
-  __IO uint8_t status = SD_PRESENT;
+  uint32_t primask, edgetick;
+  uint8_t sample;
   
-  /* Check SD card detect pin */
-  if(BSP_IO_ReadPin(SD_DETECT_PIN))
+  if((SdDetect.Enabled == 0) || (SdDetect.Valid == 0))
   {
-    status = SD_NOT_PRESENT;
+    /* No interrupt to keep a cached state up to date */
+    SdDetect.State   = DETECT_ReadPin();
+    SdDetect.Removed = 0;
+    SdDetect.Valid   = SdDetect.Enabled;
+    return SdDetect.State;
   }
   
-  return status;
+  if((SdDetect.Pending == 0) || ((HAL_GetTick() - SdDetect.EdgeTick) < SD_DETECT_DEBOUNCE))
+  {
+    SdDetect.Stats.Avoided++;
+    return SdDetect.State;
+  }
+  
+  /* The pin changed more than the debounce time ago: accept it if it is stable */
+  edgetick = SdDetect.EdgeTick;
+  sample = DETECT_ReadPin();
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if(SdDetect.EdgeTick == edgetick)
+  {
+    if(sample != SdDetect.Sample)
+    {
+      /* Changed without interrupt: wait for another debounce time */
+      SdDetect.Stats.Bounces++;
+      SdDetect.Sample   = sample;
+      SdDetect.EdgeTick = HAL_GetTick();
+    }
+    else
+    {
+      if((sample != SdDetect.State) || (SdDetect.Removed != 0))
+      {
+        SdDetect.Stats.Generation++;
+      }
+      SdDetect.State   = sample;
+      SdDetect.Removed = 0;
+      SdDetect.Pending = 0;
+    }
+  }
+  
+  __set_PRIMASK(primask);
+  
+  return SdDetect.State;
+}
+
+/**
+  * @brief  Gets the card detection generation.
+  * @note   The generation changes on each accepted card insertion or removal.
+  * @retval Generation counter
+  */
+uint32_t BSP_SD_GetDetectGeneration(void)
+{
+  /* Accept a debounced pin change */
+  BSP_SD_IsDetected();
+  
+  return SdDetect.Stats.Generation;
+}
+
+/**
+  * @brief  Gets the SD card detection statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SD_GetDetectStats(SD_DetectStatsTypeDef *pStats)
+{
+  *pStats = SdDetect.Stats;
 }
 
 /** @brief  SD detect IT treatment.
@@ -181,6 +529,36 @@ void BSP_SD_DetectIT(void)
   /* To re-enable IT */
   BSP_SD_ITConfig();
   
+  /* The presence change is accepted once the pin is stable */
+  SdDetect.Stats.Interrupts++;
+  if(SdDetect.Pending != 0)
+  {
+    SdDetect.Stats.Bounces++;
+  }
+  SdDetect.Sample = DETECT_ReadPin();
+  if(SdDetect.Sample != SD_PRESENT)
+  {
+    SdDetect.Removed = 1;
+  }
+  SdDetect.EdgeTick = HAL_GetTick();
+  SdDetect.Pending  = 1;
+  
+  /* The dirty blocks are written back by BSP_SD_WriteBackProcess(), the
+     transfer cannot complete at the priority of this interrupt */
+  if(SdWriteBack.Dirty != 0)
+  {
+    SdWriteBack.DetectFlush = 1;
+    
+    /* The card inserted next may be another one: never write it these blocks */
+    if(SdDetect.Sample != SD_PRESENT)
+    {
+      SdWriteBack.Removed = 1;
+    }
+  }
+  
+  /* Cached blocks belong to the card that was removed */
+  BSP_SD_CacheInvalidate();
+  
   /* SD detect IT callback */
   BSP_SD_DetectCallback();
 }
@@ -205,7 +583,23 @@ __weak void BSP_SD_DetectCallback(void)
   */
 uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
 {
-  if(HAL_SD_ReadBlocks(&uSdHandle, (uint8_t *)pData, ReadAddr, NumOfBlocks, Timeout) != HAL_OK)
+  ERASE_Foreground(ReadAddr, NumOfBlocks, 0);
+  
+  /* Buffered blocks must reach the card before being read back */
+  if(WRITEBACK_Overlaps(ReadAddr, ReadAddr + NumOfBlocks - 1) != 0)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  if(SdCache.pData != NULL)
+  {
+    return CACHE_Read(pData, ReadAddr, NumOfBlocks, Timeout);
+  }
+  
+  if(BUS_ReadBlocks((uint8_t *)pData, ReadAddr, NumOfBlocks, Timeout) != HAL_OK)
   {
     return MSD_ERROR;
   }
@@ -225,12 +619,22 @@ uint8_t BSP_SD_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBloc
   */
 uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
 {
-  if(HAL_SD_WriteBlocks(&uSdHandle, (uint8_t *)pData, WriteAddr, NumOfBlocks, Timeout) != HAL_OK)
+  ERASE_Foreground(WriteAddr, NumOfBlocks, 1);
+  
+  if(SdWriteBack.pData != NULL)
+  {
+    return WRITEBACK_Write(pData, WriteAddr, NumOfBlocks, Timeout);
+  }
+  
+  if(BUS_WriteBlocks((uint8_t *)pData, WriteAddr, NumOfBlocks, Timeout) != HAL_OK)
   {
+    /* The card content of the range is unknown */
+    CACHE_InvalidateRange(WriteAddr, WriteAddr + NumOfBlocks - 1);
     return MSD_ERROR;
   }
   else
   {
+    CACHE_Update(pData, WriteAddr, NumOfBlocks);
     return MSD_OK;
   }
 }
@@ -244,9 +648,58 @@ uint8_t BSP_SD_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBl
   */
 uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
 {  
+  uint32_t index;
+  
+  ERASE_Foreground(ReadAddr, NumOfBlocks, 0);
+  
+  if(WRITEBACK_Overlaps(ReadAddr, ReadAddr + NumOfBlocks - 1) != 0)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  if(SdCache.pData != NULL)
+  {
+    for(index = 0; index < NumOfBlocks; index++)
+    {
+      if(CACHE_Lookup(ReadAddr + index) == SD_CACHE_NO_LINE)
+      {
+        break;
+      }
+    }
+    
+    if(index == NumOfBlocks)
+    {
+      /* Every block is cached: complete the transfer without the card */
+      CACHE_Read(pData, ReadAddr, NumOfBlocks, SD_DATATIMEOUT);
+      BSP_SD_ReadCpltCallback();
+      return MSD_OK;
+    }
+    
+    /* Cached leading blocks are copied, the card read starts at the first miss */
+    if(index != 0)
+    {
+      CACHE_Read(pData, ReadAddr, index, SD_DATATIMEOUT);
+      pData       += index * SD_CACHE_BLOCK_WORDS;
+      ReadAddr    += index;
+      NumOfBlocks -= index;
+    }
+    
+    /* The blocks are cached by the Rx transfer complete callback */
+    SdCache.pPending     = pData;
+    SdCache.PendingBlock = ReadAddr;
+    SdCache.PendingCount = NumOfBlocks;
+    SdCache.NextBlock    = ReadAddr + NumOfBlocks;
+    SdCache.Stats.Misses += NumOfBlocks;
+    SdCache.Stats.ReadCommands++;
+  }
+  
   /* Read block(s) in DMA transfer mode */
-  if(HAL_SD_ReadBlocks_DMA(&uSdHandle, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK)
+  if(BOUNCE_ReadBlocks(pData, ReadAddr, NumOfBlocks) != HAL_OK)
   {
+    SdCache.PendingCount = 0;
     return MSD_ERROR;
   }
   else
@@ -264,9 +717,24 @@ uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOf
   */
 uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
 { 
+  ERASE_Foreground(WriteAddr, NumOfBlocks, 1);
+  
+  /* Keep the order of the buffered writes */
+  if(SdWriteBack.Dirty != 0)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  /* The cached copies hold the new content from now on */
+  CACHE_Update(pData, WriteAddr, NumOfBlocks);
+  
   /* Write block(s) in DMA transfer mode */
-  if(HAL_SD_WriteBlocks_DMA(&uSdHandle, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK)
+  if(BOUNCE_WriteBlocks(pData, WriteAddr, NumOfBlocks) != HAL_OK)
   {
+    CACHE_InvalidateRange(WriteAddr, WriteAddr + NumOfBlocks - 1);
     return MSD_ERROR;
   }
   else
@@ -283,6 +751,18 @@ uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint32_t Num
   */
 uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr)
 {
+  ERASE_Foreground(StartAddr, EndAddr - StartAddr + 1, 1);
+  
+  if(SdWriteBack.Dirty != 0)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  CACHE_InvalidateRange(StartAddr, EndAddr);
+  
   if(HAL_SD_Erase(&uSdHandle, StartAddr, EndAddr) != HAL_OK)
   {
     return MSD_ERROR;
@@ -294,138 +774,2346 @@ uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr)
 }
 
 /**
-  * @brief  Initializes the SD MSP.
-  * @param  hsd: SD handle
-  * @param  Params : pointer on additional configuration parameters, can be NULL.
+  * @brief  Enables the SD block cache.
+  * @param  pConfig: Pointer to the cache configuration
+  * @note   The cache memory must hold BSP_SD_CACHE_SIZE(NbLines, ReadAhead) bytes.
+  *         Blocks map to sets by their low address bits, so that a sequential run
+  *         spreads over all the sets.
+  * @retval SD status
   */
-__weak void BSP_SD_MspInit(SD_HandleTypeDef *hsd, void *Params)
+uint8_t BSP_SD_CacheInit(SD_CacheConfigTypeDef *pConfig)
 {
-  static DMA_HandleTypeDef dmaRxHandle;
-  static DMA_HandleTypeDef dmaTxHandle;
-  GPIO_InitTypeDef GPIO_Init_Structure;
-  
-  /* Enable SDIO clock */
-  __HAL_RCC_SDIO_CLK_ENABLE();
-  
-  /* Enable DMA2 clocks */
-  __DMAx_TxRx_CLK_ENABLE();
-
-  /* Enable GPIOs clock */
-  __HAL_RCC_GPIOC_CLK_ENABLE();
-  __HAL_RCC_GPIOD_CLK_ENABLE();
-  
-  /* Common GPIO configuration */
-  GPIO_Init_Structure.Mode      = GPIO_MODE_AF_PP;
-  GPIO_Init_Structure.Pull      = GPIO_PULLUP;
-  GPIO_Init_Structure.Speed     = GPIO_SPEED_HIGH;
-  GPIO_Init_Structure.Alternate = GPIO_AF12_SDIO;
-  
-  /* GPIOC configuration */
-  GPIO_Init_Structure.Pin = GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_12;
-   
-  HAL_GPIO_Init(GPIOC, &GPIO_Init_Structure);
-
-  /* GPIOD configuration */
-  GPIO_Init_Structure.Pin = GPIO_PIN_2;
-  HAL_GPIO_Init(GPIOD, &GPIO_Init_Structure);
-
-  /* NVIC configuration for SDIO interrupts */
-  HAL_NVIC_SetPriority(SDIO_IRQn, 0x0E, 0);
-  HAL_NVIC_EnableIRQ(SDIO_IRQn);
-    
-  /* Configure DMA Rx parameters */
-  dmaRxHandle.Init.Channel             = SD_DMAx_Rx_CHANNEL;
-  dmaRxHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
-  dmaRxHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
-  dmaRxHandle.Init.MemInc              = DMA_MINC_ENABLE;
-  dmaRxHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-  dmaRxHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
-  dmaRxHandle.Init.Mode                = DMA_PFCTRL;
-  dmaRxHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
-  dmaRxHandle.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
-  dmaRxHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-  dmaRxHandle.Init.MemBurst            = DMA_MBURST_INC4;
-  dmaRxHandle.Init.PeriphBurst         = DMA_PBURST_INC4;
-  
-  dmaRxHandle.Instance = SD_DMAx_Rx_STREAM;
-  
-  /* Associate the DMA handle */
-  __HAL_LINKDMA(hsd, hdmarx, dmaRxHandle);
-  
-  /* Deinitialize the stream for new transfer */
-  HAL_DMA_DeInit(&dmaRxHandle);
-  
-  /* Configure the DMA stream */
-  HAL_DMA_Init(&dmaRxHandle);
-  
-  /* Configure DMA Tx parameters */
-  dmaTxHandle.Init.Channel             = SD_DMAx_Tx_CHANNEL;
-  dmaTxHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
-  dmaTxHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
-  dmaTxHandle.Init.MemInc              = DMA_MINC_ENABLE;
-  dmaTxHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
-  dmaTxHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
-  dmaTxHandle.Init.Mode                = DMA_PFCTRL;
-  dmaTxHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
-  dmaTxHandle.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
-  dmaTxHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
-  dmaTxHandle.Init.MemBurst            = DMA_MBURST_INC4;
-  dmaTxHandle.Init.PeriphBurst         = DMA_PBURST_INC4;
-  
-  dmaTxHandle.Instance = SD_DMAx_Tx_STREAM;
+  uint32_t nbsets;
   
-  /* Associate the DMA handle */
-  __HAL_LINKDMA(hsd, hdmatx, dmaTxHandle);
+  if((pConfig == NULL) || (pConfig->pBuffer == NULL) || (pConfig->Ways == 0) ||
+     (pConfig->NbLines < pConfig->Ways) || ((pConfig->NbLines % pConfig->Ways) != 0))
+  {
+    return MSD_ERROR;
+  }
   
-  /* Deinitialize the stream for new transfer */
-  HAL_DMA_DeInit(&dmaTxHandle);
+  nbsets = pConfig->NbLines / pConfig->Ways;
+  if((nbsets & (nbsets - 1)) != 0)
+  {
+    return MSD_ERROR;
+  }
   
-  /* Configure the DMA stream */
-  HAL_DMA_Init(&dmaTxHandle); 
+  SdCache.pData         = NULL;
+  SdCache.NbSets        = nbsets;
+  SdCache.Ways          = pConfig->Ways;
+  SdCache.ReadAhead     = pConfig->ReadAhead;
+  SdCache.StagingBlocks = pConfig->ReadAhead + SD_CACHE_STAGING_BLOCKS;
+  SdCache.pStaging      = pConfig->pBuffer + (pConfig->NbLines * SD_CACHE_BLOCK_WORDS);
+  SdCache.pTags         = (SD_CacheTagTypeDef *)(SdCache.pStaging + (SdCache.StagingBlocks * SD_CACHE_BLOCK_WORDS));
+  SdCache.Stamp         = 0;
+  SdCache.NextBlock     = SD_CACHE_NO_LINE;
+  SdCache.PendingCount  = 0;
+  SdCache.Stats.Hits           = 0;
+  SdCache.Stats.Misses         = 0;
+  SdCache.Stats.ReadCommands   = 0;
+  SdCache.Stats.Prefetched     = 0;
+  SdCache.Stats.PrefetchHits   = 0;
+  SdCache.Stats.SequentialRuns = 0;
+  SdCache.pData         = pConfig->pBuffer;
   
-  /* NVIC configuration for DMA transfer complete interrupt */
-  HAL_NVIC_SetPriority(SD_DMAx_Rx_IRQn, 0x0F, 0);
-  HAL_NVIC_EnableIRQ(SD_DMAx_Rx_IRQn);
+  BSP_SD_CacheInvalidate();
   
-  /* NVIC configuration for DMA transfer complete interrupt */
-  HAL_NVIC_SetPriority(SD_DMAx_Tx_IRQn, 0x0F, 0);
-  HAL_NVIC_EnableIRQ(SD_DMAx_Tx_IRQn);
+  return MSD_OK;
 }
 
 /**
-  * @brief  Gets the current SD card data status.
-  * @retval Data transfer state.
-  *          This value can be one of the following values:
-  *            @arg  SD_TRANSFER_OK: No data transfer is acting
-  *            @arg  SD_TRANSFER_BUSY: Data transfer is acting
+  * @brief  Disables the SD block cache.
+  * @retval None
   */
-uint8_t BSP_SD_GetCardState(void)
+void BSP_SD_CacheDeInit(void)
 {
-  return((HAL_SD_GetCardState(&uSdHandle) == HAL_SD_CARD_TRANSFER ) ? SD_TRANSFER_OK : SD_TRANSFER_BUSY);
+  SdCache.pData = NULL;
+  SdCache.PendingCount = 0;
 }
-  
 
 /**
-  * @brief  Get SD information about specific SD card.
-  * @param  CardInfo: Pointer to HAL_SD_CardInfoTypedef structure
-  * @retval None 
+  * @brief  Drops every cached block.
+  * @retval None
   */
-void BSP_SD_GetCardInfo(HAL_SD_CardInfoTypeDef *CardInfo)
+void BSP_SD_CacheInvalidate(void)
 {
-  /* Get SD card Information */
-  HAL_SD_GetCardInfo(&uSdHandle, CardInfo);
+  uint32_t index;
+  
+  if(SdCache.pData == NULL)
+  {
+    return;
+  }
+  
+  for(index = 0; index < (SdCache.NbSets * SdCache.Ways); index++)
+  {
+    SdCache.pTags[index].Flags = 0;
+  }
+  SdCache.NextBlock    = SD_CACHE_NO_LINE;
+  SdCache.PendingCount = 0;
 }
 
 /**
-  * @brief SD Abort callbacks
+  * @brief  Gets the SD block cache statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SD_GetCacheStats(SD_CacheStatsTypeDef *pStats)
+{
+  *pStats = SdCache.Stats;
+  
+  if(SdCache.Stats.Prefetched != 0)
+  {
+    pStats->PrefetchAccuracy = (SdCache.Stats.PrefetchHits * 100) / SdCache.Stats.Prefetched;
+  }
+  else
+  {
+    pStats->PrefetchAccuracy = 0;
+  }
+}
+
+/**
+  * @brief  Enables the SD write-back buffer.
+  * @param  pConfig: Pointer to the write-back configuration
+  * @note   The buffer memory must hold BSP_SD_WRITEBACK_SIZE(NbBlocks, MaxBurst) bytes.
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBackInit(SD_WriteBackConfigTypeDef *pConfig)
+{
+  uint32_t index;
+  
+  if((pConfig == NULL) || (pConfig->pBuffer == NULL) || (pConfig->NbBlocks == 0) || (pConfig->MaxBurst == 0))
+  {
+    return MSD_ERROR;
+  }
+  
+  /* Write back the blocks of a previous configuration */
+  if(BSP_SD_WriteBackDeInit() != MSD_OK)
+  {
+    return MSD_ERROR;
+  }
+  
+  SdWriteBack.NbBlocks     = pConfig->NbBlocks;
+  SdWriteBack.MaxBurst     = pConfig->MaxBurst;
+  SdWriteBack.FlushTimeout = pConfig->FlushTimeout;
+  SdWriteBack.pStaging     = pConfig->pBuffer + (pConfig->NbBlocks * SD_CACHE_BLOCK_WORDS);
+  SdWriteBack.pTags        = (SD_WriteBackTagTypeDef *)(SdWriteBack.pStaging + (pConfig->MaxBurst * SD_CACHE_BLOCK_WORDS));
+  SdWriteBack.Epoch        = 0;
+  SdWriteBack.Dirty        = 0;
+  SdWriteBack.Flushing     = 0;
+  SdWriteBack.Removed      = 0;
+  SdWriteBack.DetectFlush  = 0;
+  SdWriteBack.Stats.Writes         = 0;
+  SdWriteBack.Stats.Blocks         = 0;
+  SdWriteBack.Stats.Absorbed       = 0;
+  SdWriteBack.Stats.Bypassed       = 0;
+  SdWriteBack.Stats.CardWrites     = 0;
+  SdWriteBack.Stats.CardBlocks     = 0;
+  SdWriteBack.Stats.Barriers       = 0;
+  SdWriteBack.Stats.TimeoutFlushes = 0;
+  SdWriteBack.Stats.SyncFlushes    = 0;
+  SdWriteBack.Stats.FullFlushes    = 0;
+  SdWriteBack.Stats.DetectFlushes  = 0;
+  SdWriteBack.Stats.Lost           = 0;
+  
+  for(index = 0; index < SdWriteBack.NbBlocks; index++)
+  {
+    SdWriteBack.pTags[index].Valid = 0;
+  }
+  
+  SdWriteBack.pData = pConfig->pBuffer;
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Writes back the dirty blocks and disables the SD write-back buffer.
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBackDeInit(void)
+{
+  if(BSP_SD_Sync() != MSD_OK)
+  {
+    return MSD_ERROR;
+  }
+  
+  SdWriteBack.pData = NULL;
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Writes back the dirty blocks older than the flush timeout, or all of
+  *         them after a card detection event.
+  * @note   This function must be called periodically from the application loop.
+  * @retval SD status
+  */
+uint8_t BSP_SD_WriteBackProcess(void)
+{
+  if(WRITEBACK_DropRemoved() != 0)
+  {
+    return MSD_ERROR;
+  }
+  
+  if(SdWriteBack.DetectFlush != 0)
+  {
+    if(BSP_SD_IsDetected() != SD_PRESENT)
+    {
+      /* The card removal is accepted: the dirty blocks cannot be written */
+      SdWriteBack.DetectFlush = 0;
+      SdWriteBack.Stats.Lost += SdWriteBack.Dirty;
+      WRITEBACK_Discard();
+      return MSD_ERROR;
+    }
+    
+    /* The card is still present: a failed flush is retried on the next call */
+    SdWriteBack.DetectFlush = 0;
+    SdWriteBack.Stats.DetectFlushes++;
+    if(WRITEBACK_Flush() != MSD_OK)
+    {
+      SdWriteBack.DetectFlush = 1;
+      return MSD_ERROR;
+    }
+    return MSD_OK;
+  }
+  
+  if((SdWriteBack.Dirty != 0) && ((HAL_GetTick() - SdWriteBack.DirtyTick) >= SdWriteBack.FlushTimeout))
+  {
+    SdWriteBack.Stats.TimeoutFlushes++;
+    return WRITEBACK_Flush();
+  }
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Writes every dirty block to the card and waits for the completion.
+  * @retval SD status
+  */
+uint8_t BSP_SD_Sync(void)
+{
+  if(SdWriteBack.Dirty == 0)
+  {
+    return MSD_OK;
+  }
+  
+  SdWriteBack.Stats.SyncFlushes++;
+  
+  return WRITEBACK_Flush();
+}
+
+/**
+  * @brief  Orders the buffered writes: the blocks written before the barrier
+  *         reach the card before any block written after it.
+  * @retval None
+  */
+void BSP_SD_WriteBarrier(void)
+{
+  if(SdWriteBack.Dirty != 0)
+  {
+    SdWriteBack.Epoch++;
+    SdWriteBack.Stats.Barriers++;
+  }
+}
+
+/**
+  * @brief  Gets the SD write-back buffer statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SD_GetWriteBackStats(SD_WriteBackStatsTypeDef *pStats)
+{
+  *pStats = SdWriteBack.Stats;
+}
+
+/**
+  * @brief  Queues a read, write or erase request.
+  * @param  pRequest: Pointer to the request, which must stay valid until its completion
+  * @note   The request fields Operation, Priority, pData, BlockAddr, NumOfBlocks,
+  *         Callback and pContext are set by the caller. Status is SD_REQUEST_PENDING
+  *         until the completion, then MSD_OK or MSD_ERROR.
+  * @retval SD status
+  */
+uint8_t BSP_SD_Submit(SD_RequestTypeDef *pRequest)
+{
+  uint32_t primask;
+  
+  if((pRequest == NULL) || (pRequest->Priority >= SD_QUEUE_PRIORITIES) || (pRequest->NumOfBlocks == 0) ||
+     (pRequest->Operation > SD_REQUEST_ERASE) ||
+     ((pRequest->Operation != SD_REQUEST_ERASE) && (pRequest->pData == NULL)))
+  {
+    return MSD_ERROR;
+  }
+  
+  ERASE_Foreground(pRequest->BlockAddr, pRequest->NumOfBlocks, (pRequest->Operation != SD_REQUEST_READ) ? 1 : 0);
+  
+  /* Buffered blocks of the range must reach the card first */
+  if(WRITEBACK_Overlaps(pRequest->BlockAddr, pRequest->BlockAddr + pRequest->NumOfBlocks - 1) != 0)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  /* Latencies are measured with the DWT cycle counter */
+  BSP_EnableCycleCounter();
+  
+  pRequest->Status       = SD_REQUEST_PENDING;
+  pRequest->SubmitCycles = BSP_GetCycleCount();
+  pRequest->pNext        = NULL;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if(SdQueue.pTail[pRequest->Priority] != NULL)
+  {
+    SdQueue.pTail[pRequest->Priority]->pNext = pRequest;
+  }
+  else
+  {
+    SdQueue.pHead[pRequest->Priority] = pRequest;
+  }
+  SdQueue.pTail[pRequest->Priority] = pRequest;
+  SdQueue.Class[pRequest->Priority].Submitted++;
+  
+  __set_PRIMASK(primask);
+  
+  QUEUE_StartNext();
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Cancels a submitted request.
+  * @param  pRequest: Pointer to the request
+  * @note   A queued request is removed from the queue, the transfer of a request
+  *         in progress is aborted. The request completes with MSD_ERROR and its
+  *         callback is called. This function must not be called from interrupt
+  *         context.
+  * @retval MSD_OK when the request was cancelled, MSD_ERROR when it had already
+  *         completed
+  */
+uint8_t BSP_SD_Cancel(SD_RequestTypeDef *pRequest)
+{
+  SD_RequestTypeDef *previous = NULL, *request;
+  uint32_t primask;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if(pRequest->Status != SD_REQUEST_PENDING)
+  {
+    __set_PRIMASK(primask);
+    return MSD_ERROR;
+  }
+  
+  if(SdQueue.pActive != pRequest)
+  {
+    /* Still queued: unlink it from its class */
+    request = SdQueue.pHead[pRequest->Priority];
+    while(request != pRequest)
+    {
+      previous = request;
+      request  = request->pNext;
+    }
+    if(previous != NULL)
+    {
+      previous->pNext = pRequest->pNext;
+    }
+    else
+    {
+      SdQueue.pHead[pRequest->Priority] = pRequest->pNext;
+    }
+    if(SdQueue.pTail[pRequest->Priority] == pRequest)
+    {
+      SdQueue.pTail[pRequest->Priority] = previous;
+    }
+    
+    __set_PRIMASK(primask);
+    
+    QUEUE_Finish(pRequest, MSD_ERROR);
+    return MSD_OK;
+  }
+  
+  __set_PRIMASK(primask);
+  
+  /* In progress: stop the transfer. The abort also silences the completion
+     interrupt, so the transfer active now is the one that was aborted. */
+  HAL_SD_Abort(&uSdHandle);
+  BOUNCE_SetByteMode(NULL, 0);
+  SdBounce.Remaining = 0;
+  SdBounce.Deferred  = 0;
+  
+  if(SdQueue.pActive != NULL)
+  {
+    QUEUE_Complete(MSD_ERROR);
+  }
+  QUEUE_StartNext();
+  
+  return (pRequest->Status == MSD_ERROR) ? MSD_OK : MSD_ERROR;
+}
+
+/**
+  * @brief  Starts the next queued request when the card was not ready at the
+  *         previous completion, and runs queued erases.
+  * @note   This function must be called periodically from the application loop.
+  * @retval None
+  */
+void BSP_SD_QueueProcess(void)
+{
+  BOUNCE_Resume();
+  QUEUE_StartNext();
+}
+
+/**
+  * @brief  Checks whether the request queue is empty.
+  * @retval 1 when no request is queued or in progress, 0 otherwise
+  */
+uint8_t BSP_SD_IsQueueIdle(void)
+{
+  uint32_t priority;
+  
+  if(SdQueue.pActive != NULL)
+  {
+    return 0;
+  }
+  
+  for(priority = 0; priority < SD_QUEUE_PRIORITIES; priority++)
+  {
+    if(SdQueue.pHead[priority] != NULL)
+    {
+      return 0;
+    }
+  }
+  
+  return 1;
+}
+
+/**
+  * @brief  Gets the request queue statistics of a priority class.
+  * @param  Priority: Priority class
+  * @param  pStats: Pointer to the statistics structure
+  * @note   Percentiles are upper bounds taken from a power of 2 histogram.
+  * @retval None
+  */
+void BSP_SD_GetQueueStats(uint32_t Priority, SD_QueueStatsTypeDef *pStats)
+{
+  uint32_t done;
+  
+  if(Priority >= SD_QUEUE_PRIORITIES)
+  {
+    return;
+  }
+  
+  done = SdQueue.Class[Priority].Completed + SdQueue.Class[Priority].Errors;
+  
+  pStats->Submitted = SdQueue.Class[Priority].Submitted;
+  pStats->Completed = SdQueue.Class[Priority].Completed;
+  pStats->Errors    = SdQueue.Class[Priority].Errors;
+  pStats->MeanUs    = (done != 0) ? (SdQueue.Class[Priority].TotalUs / done) : 0;
+  pStats->P50Us     = QUEUE_Percentile(Priority, 50);
+  pStats->P99Us     = QUEUE_Percentile(Priority, 99);
+  pStats->MaxUs     = SdQueue.Class[Priority].MaxUs;
+}
+
+/**
+  * @brief  Finds the buffered copy of a block written in a given epoch.
+  * @param  Block: Block address
+  * @param  Epoch: Barrier epoch
+  * @retval Slot index or SD_WRITEBACK_NO_SLOT
+  */
+static uint32_t WRITEBACK_Find(uint32_t Block, uint32_t Epoch)
+{
+  uint32_t slot;
+  
+  for(slot = 0; slot < SdWriteBack.NbBlocks; slot++)
+  {
+    if((SdWriteBack.pTags[slot].Valid != 0) && (SdWriteBack.pTags[slot].Block == Block) &&
+       (SdWriteBack.pTags[slot].Epoch == Epoch))
+    {
+      return slot;
+    }
+  }
+  
+  return SD_WRITEBACK_NO_SLOT;
+}
+
+/**
+  * @brief  Checks whether a block range holds buffered blocks.
+  * @param  StartBlock: First block of the range
+  * @param  EndBlock: Last block of the range
+  * @retval 1 if a dirty block lies in the range, 0 otherwise
+  */
+static uint32_t WRITEBACK_Overlaps(uint32_t StartBlock, uint32_t EndBlock)
+{
+  uint32_t slot;
+  
+  if(SdWriteBack.Dirty == 0)
+  {
+    return 0;
+  }
+  
+  for(slot = 0; slot < SdWriteBack.NbBlocks; slot++)
+  {
+    if((SdWriteBack.pTags[slot].Valid != 0) && (SdWriteBack.pTags[slot].Block >= StartBlock) &&
+       (SdWriteBack.pTags[slot].Block <= EndBlock))
+    {
+      return 1;
+    }
+  }
+  
+  return 0;
+}
+
+/**
+  * @brief  Buffers block(s) written by the application.
+  * @param  pData: Pointer to the data to write
+  * @param  WriteAddr: First block to write
+  * @param  NumOfBlocks: Number of blocks to write
+  * @param  Timeout: Timeout of a direct card write
+  * @retval SD status
+  */
+static uint8_t WRITEBACK_Write(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  uint32_t index, slot;
+  
+  /* The new blocks are not dropped with the ones of a removed card */
+  WRITEBACK_DropRemoved();
+  
+  SdWriteBack.Stats.Writes++;
+  SdWriteBack.Stats.Blocks += NumOfBlocks;
+  
+  /* Large requests gain nothing from the buffer: write them directly, in order */
+  if(NumOfBlocks >= SdWriteBack.MaxBurst)
+  {
+    if(BSP_SD_Sync() != MSD_OK)
+    {
+      return MSD_ERROR;
+    }
+    
+    SdWriteBack.Stats.Bypassed += NumOfBlocks;
+    if(BUS_WriteBlocks((uint8_t *)pData, WriteAddr, NumOfBlocks, Timeout) != HAL_OK)
+    {
+      CACHE_InvalidateRange(WriteAddr, WriteAddr + NumOfBlocks - 1);
+      return MSD_ERROR;
+    }
+    CACHE_Update(pData, WriteAddr, NumOfBlocks);
+    
+    return MSD_OK;
+  }
+  
+  for(index = 0; index < NumOfBlocks; index++)
+  {
+    /* A block is only rewritten in place within the same barrier epoch */
+    slot = WRITEBACK_Find(WriteAddr + index, SdWriteBack.Epoch);
+    if(slot != SD_WRITEBACK_NO_SLOT)
+    {
+      SdWriteBack.Stats.Absorbed++;
+    }
+    else
+    {
+      if(SdWriteBack.Dirty == SdWriteBack.NbBlocks)
+      {
+        SdWriteBack.Stats.FullFlushes++;
+        if(WRITEBACK_Flush() != MSD_OK)
+        {
+          return MSD_ERROR;
+        }
+      }
+      
+      for(slot = 0; SdWriteBack.pTags[slot].Valid != 0; slot++)
+      {
+      }
+      
+      if(SdWriteBack.Dirty == 0)
+      {
+        SdWriteBack.DirtyTick = HAL_GetTick();
+      }
+      SdWriteBack.pTags[slot].Block = WriteAddr + index;
+      SdWriteBack.pTags[slot].Epoch = SdWriteBack.Epoch;
+      SdWriteBack.pTags[slot].Valid = 1;
+      SdWriteBack.Dirty++;
+    }
+    
+    CACHE_CopyBlock(SdWriteBack.pData + (slot * SD_CACHE_BLOCK_WORDS), pData + (index * SD_CACHE_BLOCK_WORDS));
+  }
+  
+  /* Cached reads see the buffered content */
+  CACHE_Update(pData, WriteAddr, NumOfBlocks);
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Writes every dirty block to the card, oldest barrier epoch first,
+  *         adjacent blocks of an epoch being coalesced into multi-block writes.
+  * @retval SD status
+  */
+static uint8_t WRITEBACK_Flush(void)
+{
+  SD_WriteBackTagTypeDef *tag;
+  uint32_t slot, epoch, first, count, age, oldest;
+  uint8_t status = MSD_OK;
+  
+  if(WRITEBACK_DropRemoved() != 0)
+  {
+    return MSD_ERROR;
+  }
+  
+  /* The flush transfers do not complete the application transfers */
+  SdWriteBack.Flushing = 1;
+  
+  while((SdWriteBack.Dirty != 0) && (status == MSD_OK))
+  {
+    /* Oldest epoch, then its lowest block */
+    oldest = 0;
+    epoch  = SdWriteBack.Epoch;
+    first  = 0xFFFFFFFF;
+    for(slot = 0; slot < SdWriteBack.NbBlocks; slot++)
+    {
+      tag = &SdWriteBack.pTags[slot];
+      if(tag->Valid == 0)
+      {
+        continue;
+      }
+      
+      age = SdWriteBack.Epoch - tag->Epoch;
+      if((age > oldest) || ((age == oldest) && (tag->Block < first)))
+      {
+        oldest = age;
+        epoch  = tag->Epoch;
+        first  = tag->Block;
+      }
+    }
+    
+    /* Gather the following blocks of the same epoch */
+    for(count = 0; count < SdWriteBack.MaxBurst; count++)
+    {
+      slot = WRITEBACK_Find(first + count, epoch);
+      if(slot == SD_WRITEBACK_NO_SLOT)
+      {
+        break;
+      }
+      CACHE_CopyBlock(SdWriteBack.pStaging + (count * SD_CACHE_BLOCK_WORDS),
+                      SdWriteBack.pData + (slot * SD_CACHE_BLOCK_WORDS));
+    }
+    
+    if(BOUNCE_WriteBlocks(SdWriteBack.pStaging, first, count) != HAL_OK)
+    {
+      status = MSD_ERROR;
+    }
+    
+    if(status == MSD_OK)
+    {
+      status = BUS_WaitTransfer();
+    }
+    
+    if(status == MSD_OK)
+    {
+      /* Release the written slots */
+      while(count != 0)
+      {
+        count--;
+        SdWriteBack.pTags[WRITEBACK_Find(first + count, epoch)].Valid = 0;
+        SdWriteBack.Dirty--;
+        SdWriteBack.Stats.CardBlocks++;
+      }
+      SdWriteBack.Stats.CardWrites++;
+    }
+  }
+  
+  SdWriteBack.Flushing = 0;
+  
+  /* Remaining blocks age from now */
+  SdWriteBack.DirtyTick = HAL_GetTick();
+  
+  return status;
+}
+
+/**
+  * @brief  Waits for the end of a card transfer.
+  * @retval SD status
+  */
+static uint8_t BUS_WaitTransfer(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+  
+  while((HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY) || (BSP_SD_GetCardState() != SD_TRANSFER_OK))
+  {
+    if((HAL_GetTick() - tickstart) >= SD_WRITEBACK_TIMEOUT)
+    {
+      return MSD_ERROR;
+    }
+  }
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Drops every dirty block.
+  * @retval None
+  */
+static void WRITEBACK_Discard(void)
+{
+  uint32_t slot;
+  
+  for(slot = 0; slot < SdWriteBack.NbBlocks; slot++)
+  {
+    SdWriteBack.pTags[slot].Valid = 0;
+  }
+  SdWriteBack.Dirty = 0;
+}
+
+/**
+  * @brief  Drops the dirty blocks of a card removed since they were written.
+  * @retval 1 when blocks were dropped, 0 otherwise
+  */
+static uint32_t WRITEBACK_DropRemoved(void)
+{
+  uint32_t primask, removed;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  removed = SdWriteBack.Removed;
+  SdWriteBack.Removed = 0;
+  __set_PRIMASK(primask);
+  
+  if(removed == 0)
+  {
+    return 0;
+  }
+  
+  SdWriteBack.DetectFlush = 0;
+  SdWriteBack.Stats.Lost += SdWriteBack.Dirty;
+  WRITEBACK_Discard();
+  
+  return 1;
+}
+
+/**
+  * @brief  Removes the next request to start from the queue.
+  * @retval Request, or NULL when a transfer is in progress, the card is busy or
+  *         the queue is empty
+  */
+static SD_RequestTypeDef *QUEUE_Dequeue(void)
+{
+  SD_RequestTypeDef *request = NULL;
+  uint32_t primask, priority;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  
+  if(SdQueue.pActive == NULL)
+  {
+    for(priority = 0; priority < SD_QUEUE_PRIORITIES; priority++)
+    {
+      if(SdQueue.pHead[priority] != NULL)
+      {
+        request = SdQueue.pHead[priority];
+        break;
+      }
+    }
+  }
+  
+  if(request != NULL)
+  {
+    /* Erases block the caller: keep them out of interrupt context. A direct
+       transfer may also be in progress, or the card still programming. */
+    if(((request->Operation == SD_REQUEST_ERASE) && (__get_IPSR() != 0)) ||
+       (HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY) ||
+       (BSP_SD_GetCardState() != SD_TRANSFER_OK))
+    {
+      request = NULL;
+    }
+    else
+    {
+      SdQueue.pHead[priority] = request->pNext;
+      if(SdQueue.pHead[priority] == NULL)
+      {
+        SdQueue.pTail[priority] = NULL;
+      }
+      SdQueue.pActive = request;
+    }
+  }
+  
+  __set_PRIMASK(primask);
+  
+  return request;
+}
+
+/**
+  * @brief  Starts the queued requests until a DMA transfer is in progress.
+  * @retval None
+  */
+static void QUEUE_StartNext(void)
+{
+  SD_RequestTypeDef *request;
+  
+  while((request = QUEUE_Dequeue()) != NULL)
+  {
+    if(request->Operation == SD_REQUEST_READ)
+    {
+      if(BOUNCE_ReadBlocks(request->pData, request->BlockAddr, request->NumOfBlocks) == HAL_OK)
+      {
+        return;
+      }
+      QUEUE_Complete(MSD_ERROR);
+    }
+    else if(request->Operation == SD_REQUEST_WRITE)
+    {
+      CACHE_InvalidateRange(request->BlockAddr, request->BlockAddr + request->NumOfBlocks - 1);
+      if(BOUNCE_WriteBlocks(request->pData, request->BlockAddr, request->NumOfBlocks) == HAL_OK)
+      {
+        return;
+      }
+      QUEUE_Complete(MSD_ERROR);
+    }
+    else
+    {
+      CACHE_InvalidateRange(request->BlockAddr, request->BlockAddr + request->NumOfBlocks - 1);
+      if(HAL_SD_Erase(&uSdHandle, request->BlockAddr, request->BlockAddr + request->NumOfBlocks - 1) == HAL_OK)
+      {
+        QUEUE_Complete(MSD_OK);
+      }
+      else
+      {
+        QUEUE_Complete(MSD_ERROR);
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Completes the request in progress.
+  * @param  Status: MSD_OK or MSD_ERROR
+  * @retval None
+  */
+static void QUEUE_Complete(uint8_t Status)
+{
+  SD_RequestTypeDef *request = SdQueue.pActive;
+  
+  SdQueue.pActive = NULL;
+  
+  QUEUE_Finish(request, Status);
+}
+
+/**
+  * @brief  Records the latency of a request removed from the queue and calls its callback.
+  * @param  pRequest: Pointer to the request
+  * @param  Status: MSD_OK or MSD_ERROR
+  * @retval None
+  */
+static void QUEUE_Finish(SD_RequestTypeDef *pRequest, uint8_t Status)
+{
+  uint32_t latency, bucket;
+  
+  latency = BSP_GetElapsedUs(pRequest->SubmitCycles);
+  bucket  = (latency != 0) ? (32 - __CLZ(latency)) : 0;
+  if(bucket >= SD_QUEUE_HISTO_BUCKETS)
+  {
+    bucket = SD_QUEUE_HISTO_BUCKETS - 1;
+  }
+  
+  if(Status == MSD_OK)
+  {
+    SdQueue.Class[pRequest->Priority].Completed++;
+  }
+  else
+  {
+    SdQueue.Class[pRequest->Priority].Errors++;
+  }
+  SdQueue.Class[pRequest->Priority].TotalUs += latency;
+  SdQueue.Class[pRequest->Priority].Histogram[bucket]++;
+  if(latency > SdQueue.Class[pRequest->Priority].MaxUs)
+  {
+    SdQueue.Class[pRequest->Priority].MaxUs = latency;
+  }
+  
+  pRequest->Status = Status;
+  if(pRequest->Callback != NULL)
+  {
+    pRequest->Callback(pRequest);
+  }
+}
+
+/**
+  * @brief  Computes a latency percentile from the histogram of a priority class.
+  * @param  Priority: Priority class
+  * @param  Percent: Percentile, 1 to 100
+  * @retval Upper bound of the percentile in us
+  */
+static uint32_t QUEUE_Percentile(uint32_t Priority, uint32_t Percent)
+{
+  uint32_t total = SdQueue.Class[Priority].Completed + SdQueue.Class[Priority].Errors;
+  uint32_t target, count = 0, bucket;
+  
+  if(total == 0)
+  {
+    return 0;
+  }
+  
+  target = ((total * Percent) + 99) / 100;
+  for(bucket = 0; bucket < SD_QUEUE_HISTO_BUCKETS; bucket++)
+  {
+    count += SdQueue.Class[Priority].Histogram[bucket];
+    if(count >= target)
+    {
+      break;
+    }
+  }
+  
+  /* Bucket n holds latencies below 2^n us */
+  if((bucket >= (SD_QUEUE_HISTO_BUCKETS - 1)) || ((1UL << bucket) > SdQueue.Class[Priority].MaxUs))
+  {
+    return SdQueue.Class[Priority].MaxUs;
+  }
+  
+  return (1UL << bucket);
+}
+
+/**
+  * @brief  Configures the bounce buffer of the DMA transfers of unreachable buffers.
+  * @param  pBuffer: Bounce buffer, word aligned, in DMA reachable memory
+  * @param  NbBlocks: Size of the bounce buffer in blocks
+  * @retval SD status
+  */
+uint8_t BSP_SD_BounceInit(uint32_t *pBuffer, uint32_t NbBlocks)
+{
+  if((pBuffer == NULL) || (NbBlocks == 0) || (((uint32_t)pBuffer & 0x3) != 0) ||
+     (((uint32_t)pBuffer < SD_DMA_UNREACHABLE_END) &&
+      (((uint32_t)pBuffer + (NbBlocks * SD_CACHE_BLOCK_SIZE)) > SD_DMA_UNREACHABLE_START)))
+  {
+    return MSD_ERROR;
+  }
+  
+  if(SdBounce.Remaining != 0)
+  {
+    return MSD_ERROR;
+  }
+  
+  SdBounce.pBuffer  = pBuffer;
+  SdBounce.NbBlocks = NbBlocks;
+  
+  BOUNCE_TimerInit();
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Gets the SD DMA buffer handling statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SD_GetBounceStats(SD_BounceStatsTypeDef *pStats)
+{
+  *pStats = SdBounce.Stats;
+}
+
+/**
+  * @brief  Handles the SD_TIMx interrupt: starts the delayed write chunk once
+  *         the card is ready.
+  * @retval None
+  */
+void BSP_SD_BounceIRQHandler(void)
+{
+  uint32_t primask;
+  
+  SD_TIMx->SR = ~TIM_SR_UIF;
+  
+  BOUNCE_Resume();
+  
+  /* Stop polling unless the next chunk was delayed in the meantime */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(SdBounce.Deferred == 0)
+  {
+    SD_TIMx->CR1 &= ~TIM_CR1_CEN;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Starts a DMA read, whatever the alignment and location of the buffer.
+  * @param  pData: Pointer to the buffer that will contain the data
+  * @param  ReadAddr: First block to read
+  * @param  NumOfBlocks: Number of blocks to read
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BOUNCE_ReadBlocks(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks)
+{
+  return BOUNCE_Start(pData, ReadAddr, NumOfBlocks, 0);
+}
+
+/**
+  * @brief  Starts a DMA write, whatever the alignment and location of the buffer.
+  * @param  pData: Pointer to the data to write
+  * @param  WriteAddr: First block to write
+  * @param  NumOfBlocks: Number of blocks to write
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BOUNCE_WriteBlocks(uint32_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks)
+{
+  return BOUNCE_Start(pData, WriteAddr, NumOfBlocks, 1);
+}
+
+/**
+  * @brief  Selects the DMA path of a transfer.
+  * @param  pData: Caller buffer
+  * @param  Addr: First block
+  * @param  NumOfBlocks: Number of blocks
+  * @param  Write: 1 for a write, 0 for a read
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BOUNCE_Start(uint32_t *pData, uint32_t Addr, uint32_t NumOfBlocks, uint32_t Write)
+{
+  uint32_t start = (uint32_t)pData;
+  uint32_t end   = start + (NumOfBlocks * SD_CACHE_BLOCK_SIZE);
+  HAL_StatusTypeDef status;
+  
+  if(SdBounce.Remaining != 0)
+  {
+    return HAL_BUSY;
+  }
+  
+  /* Unreachable buffer: copy through the bounce buffer */
+  if((start < SD_DMA_UNREACHABLE_END) && (end > SD_DMA_UNREACHABLE_START))
+  {
+    if(SdBounce.pBuffer == NULL)
+    {
+      return HAL_ERROR;
+    }
+    
+    SdBounce.pUser     = (uint8_t *)pData;
+    SdBounce.Block     = Addr;
+    SdBounce.Remaining = NumOfBlocks;
+    SdBounce.Write     = Write;
+    SdBounce.Stats.Bounced++;
+    SdBounce.Stats.BouncedBlocks += NumOfBlocks;
+    
+    return BOUNCE_StartChunk();
+  }
+  
+  /* Unaligned buffer: byte wide memory accesses, packed by the DMA FIFO */
+  if((start & 0x3) != 0)
+  {
+    BOUNCE_SetByteMode((Write != 0) ? uSdHandle.hdmatx : uSdHandle.hdmarx, 1);
+    SdBounce.Stats.Unaligned++;
+  }
+  else
+  {
+    SdBounce.Stats.Direct++;
+  }
+  
+  if(Write != 0)
+  {
+    status = HAL_SD_WriteBlocks_DMA(&uSdHandle, (uint8_t *)pData, Addr, NumOfBlocks);
+  }
+  else
+  {
+    status = HAL_SD_ReadBlocks_DMA(&uSdHandle, (uint8_t *)pData, Addr, NumOfBlocks);
+  }
+  
+  if(status != HAL_OK)
+  {
+    BOUNCE_SetByteMode(NULL, 0);
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Starts the DMA transfer of the next bounce buffer chunk.
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BOUNCE_StartChunk(void)
+{
+  HAL_StatusTypeDef status;
+  
+  SdBounce.Chunk = (SdBounce.Remaining < SdBounce.NbBlocks) ? SdBounce.Remaining : SdBounce.NbBlocks;
+  SdBounce.Stats.Chunks++;
+  
+  if(SdBounce.Write != 0)
+  {
+    BOUNCE_Copy((uint8_t *)SdBounce.pBuffer, SdBounce.pUser, SdBounce.Chunk * SD_CACHE_BLOCK_SIZE);
+    status = HAL_SD_WriteBlocks_DMA(&uSdHandle, (uint8_t *)SdBounce.pBuffer, SdBounce.Block, SdBounce.Chunk);
+  }
+  else
+  {
+    status = HAL_SD_ReadBlocks_DMA(&uSdHandle, (uint8_t *)SdBounce.pBuffer, SdBounce.Block, SdBounce.Chunk);
+  }
+  
+  if(status != HAL_OK)
+  {
+    SdBounce.Remaining = 0;
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Switches the memory side of a SD DMA stream between byte and word accesses.
+  * @param  hdma: DMA handle to switch to byte accesses, unused to restore
+  * @param  Enable: 1 for byte accesses, 0 to restore the word accesses
+  * @retval None
+  */
+static void BOUNCE_SetByteMode(DMA_HandleTypeDef *hdma, uint32_t Enable)
+{
+  if(Enable != 0)
+  {
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.MemBurst         = DMA_MBURST_SINGLE;
+    HAL_DMA_Init(hdma);
+    SdBounce.hdmaByte = hdma;
+  }
+  else if(SdBounce.hdmaByte != NULL)
+  {
+    SdBounce.hdmaByte->Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    SdBounce.hdmaByte->Init.MemBurst         = DMA_MBURST_INC4;
+    HAL_DMA_Init(SdBounce.hdmaByte);
+    SdBounce.hdmaByte = NULL;
+  }
+}
+
+/**
+  * @brief  Handles the end of a DMA transfer.
+  * @retval 1 when a bounced transfer goes on, 0 when the transfer is complete
+  */
+static uint32_t BOUNCE_Complete(void)
+{
+  BOUNCE_SetByteMode(NULL, 0);
+  
+  if(SdBounce.Remaining == 0)
+  {
+    return 0;
+  }
+  
+  if(SdBounce.Write == 0)
+  {
+    BOUNCE_Copy(SdBounce.pUser, (uint8_t *)SdBounce.pBuffer, SdBounce.Chunk * SD_CACHE_BLOCK_SIZE);
+  }
+  
+  SdBounce.pUser     += SdBounce.Chunk * SD_CACHE_BLOCK_SIZE;
+  SdBounce.Block     += SdBounce.Chunk;
+  SdBounce.Remaining -= SdBounce.Chunk;
+  
+  if(SdBounce.Remaining == 0)
+  {
+    return 0;
+  }
+  
+  /* The card programs the previous chunk: resume from the SD_TIMx interrupt */
+  if((SdBounce.Write != 0) && (HAL_SD_GetCardState(&uSdHandle) != HAL_SD_CARD_TRANSFER))
+  {
+    SdBounce.Deferred = 1;
+    SdBounce.Stats.Deferred++;
+    SD_TIMx->CNT  = 0;
+    SD_TIMx->CR1 |= TIM_CR1_CEN;
+    return 1;
+  }
+  
+  if(BOUNCE_StartChunk() != HAL_OK)
+  {
+    HAL_SD_ErrorCallback(&uSdHandle);
+  }
+  
+  return 1;
+}
+
+/**
+  * @brief  Starts a delayed write chunk once the card is ready.
+  * @retval None
+  */
+static void BOUNCE_Resume(void)
+{
+  uint32_t primask;
+  uint32_t resume = 0;
+  
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if((SdBounce.Deferred != 0) && (HAL_SD_GetCardState(&uSdHandle) == HAL_SD_CARD_TRANSFER))
+  {
+    SdBounce.Deferred = 0;
+    resume = 1;
+  }
+  __set_PRIMASK(primask);
+  
+  if((resume != 0) && (BOUNCE_StartChunk() != HAL_OK))
+  {
+    HAL_SD_ErrorCallback(&uSdHandle);
+  }
+}
+
+/**
+  * @brief  Configures the SD_TIMx timer polling the card while a write chunk
+  *         is delayed, stopped until a chunk is delayed.
+  * @retval None
+  */
+static void BOUNCE_TimerInit(void)
+{
+  uint32_t clock = HAL_RCC_GetPCLK1Freq();
+  
+  /* The APB1 timers run at twice the bus clock when it is divided */
+  if((RCC->CFGR & RCC_CFGR_PPRE1_2) != 0)
+  {
+    clock *= 2;
+  }
+  
+  SD_TIMx_CLK_ENABLE();
+  
+  /* 1 MHz counter, update every SD_BOUNCE_RESUME_PERIOD us */
+  SD_TIMx->CR1  = 0;
+  SD_TIMx->PSC  = (clock / 1000000) - 1;
+  SD_TIMx->ARR  = SD_BOUNCE_RESUME_PERIOD - 1;
+  SD_TIMx->EGR  = TIM_EGR_UG;
+  SD_TIMx->SR   = 0;
+  SD_TIMx->DIER = TIM_DIER_UIE;
+  
+  HAL_NVIC_SetPriority(SD_TIMx_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(SD_TIMx_IRQn);
+}
+
+/**
+  * @brief  Copies data between the bounce buffer and a caller buffer.
+  * @param  pDst: Destination
+  * @param  pSrc: Source
+  * @param  Size: Size in bytes, multiple of the block size
+  * @retval None
+  */
+static void BOUNCE_Copy(uint8_t *pDst, uint8_t *pSrc, uint32_t Size)
+{
+  uint32_t index;
+  
+  if((((uint32_t)pDst | (uint32_t)pSrc) & 0x3) == 0)
+  {
+    for(index = 0; index < Size; index += SD_CACHE_BLOCK_SIZE)
+    {
+      CACHE_CopyBlock((uint32_t *)(pDst + index), (uint32_t *)(pSrc + index));
+    }
+  }
+  else
+  {
+    for(index = 0; index < Size; index++)
+    {
+      pDst[index] = pSrc[index];
+    }
+  }
+}
+
+/**
+  * @brief  Switches the card to high-speed mode when supported and selects the
+  *         fastest SDIO clock passing a read-back verification.
+  * @param  pBuffer: Work buffer of 2 x SD_TUNE_BLOCKS blocks, word aligned, DMA reachable
+  * @param  TestBlock: First block of the SD_TUNE_BLOCKS test blocks
+  * @param  Mode: SD_TUNE_READ_ONLY to compare the test blocks with their content
+  *         read at the initial clock, SD_TUNE_WRITE_PATTERN to overwrite them with
+  *         a test pattern first
+  * @note   The request queue must be idle. Dirty write-back blocks are written first.
+  * @retval SD status
+  */
+uint8_t BSP_SD_TuneBus(uint32_t *pBuffer, uint32_t TestBlock, uint32_t Mode)
+{
+  uint32_t *reference = pBuffer;
+  uint32_t *readback  = pBuffer + (SD_TUNE_BLOCKS * SD_CACHE_BLOCK_WORDS);
+  uint32_t index, level, pass, value;
+  uint8_t status = MSD_OK;
+  
+  if((pBuffer == NULL) || (BSP_SD_IsQueueIdle() == 0) || (BSP_SD_Sync() != MSD_OK))
+  {
+    return MSD_ERROR;
+  }
+  
+  SdBus.Tuning = 1;
+  
+  /* Reference content at the initial clock */
+  BUS_SetClock(0, SDIO_TRANSFER_CLK_DIV);
+  if(Mode == SD_TUNE_WRITE_PATTERN)
+  {
+    /* Alternate each word with its complement to toggle every data line */
+    for(index = 0; index < (SD_TUNE_BLOCKS * SD_CACHE_BLOCK_WORDS); index++)
+    {
+      value = index * 0x9E3779B9;
+      reference[index] = ((index & 0x1) != 0) ? ~value : value;
+    }
+    CACHE_InvalidateRange(TestBlock, TestBlock + SD_TUNE_BLOCKS - 1);
+    status = BUS_Transfer(reference, TestBlock, SD_TUNE_BLOCKS, 1);
+  }
+  else
+  {
+    status = BUS_Transfer(reference, TestBlock, SD_TUNE_BLOCKS, 0);
+  }
+  
+  if(status == MSD_OK)
+  {
+    SdBus.Info.HighSpeed = (BUS_SwitchHighSpeed() == MSD_OK) ? 1 : 0;
+    
+    /* From the undivided clock, only allowed in high-speed mode, to the slowest divider */
+    status = MSD_ERROR;
+    for(level = (SdBus.Info.HighSpeed != 0) ? 0 : 1; (level <= sizeof(SdBusDividers)) && (status != MSD_OK); level++)
+    {
+      if(level == 0)
+      {
+        BUS_SetClock(1, 0);
+      }
+      else
+      {
+        BUS_SetClock(0, SdBusDividers[level - 1]);
+      }
+      
+      status = MSD_OK;
+      for(pass = 0; (pass < SD_TUNE_PASSES) && (status == MSD_OK); pass++)
+      {
+        status = BUS_Transfer(readback, TestBlock, SD_TUNE_BLOCKS, 0);
+        for(index = 0; (index < (SD_TUNE_BLOCKS * SD_CACHE_BLOCK_WORDS)) && (status == MSD_OK); index++)
+        {
+          if(readback[index] != reference[index])
+          {
+            status = MSD_ERROR;
+          }
+        }
+      }
+    }
+  }
+  
+  if(status != MSD_OK)
+  {
+    BUS_SetClock(0, SDIO_TRANSFER_CLK_DIV);
+  }
+  
+  SdBus.Tuning = 0;
+  
+  return status;
+}
+
+/**
+  * @brief  Gets the SD bus settings and error statistics.
+  * @param  pInfo: Pointer to the bus information structure
+  * @retval None
+  */
+void BSP_SD_GetBusInfo(SD_BusInfoTypeDef *pInfo)
+{
+  *pInfo = SdBus.Info;
+}
+
+/**
+  * @brief  Enables the background erase of the freed blocks.
+  * @param  pRanges: Table of freed ranges
+  * @param  MaxRanges: Number of entries of the table
+  * @param  IdleTime: Time without foreground operation before a background erase, in ms
+  * @retval SD status
+  */
+uint8_t BSP_SD_EraseInit(SD_EraseRangeTypeDef *pRanges, uint32_t MaxRanges, uint32_t IdleTime)
+{
+  HAL_SD_CardCSDTypeDef csd;
+  
+  if((pRanges == NULL) || (MaxRanges == 0) || (HAL_SD_GetCardCSD(&uSdHandle, &csd) != HAL_OK))
+  {
+    return MSD_ERROR;
+  }
+  
+  BSP_EnableCycleCounter();
+  
+  /* CSD SECTOR_SIZE: size of an erasable sector minus one, in blocks */
+  SdErase.Stats.EraseGroup = csd.EraseGrMul + 1;
+  SdErase.Stats.Backlog    = 0;
+  SdErase.Stats.Ranges     = 0;
+  SdErase.Stats.Trimmed    = 0;
+  SdErase.Stats.Erased     = 0;
+  SdErase.Stats.Erases     = 0;
+  SdErase.Stats.Rewritten  = 0;
+  SdErase.Stats.Dropped    = 0;
+  SdErase.Stats.MaxEraseUs = 0;
+  SdErase.Stats.Delayed    = 0;
+  SdErase.Stats.DelayUs    = 0;
+  SdErase.Stats.MaxDelayUs = 0;
+  
+  SdErase.MaxRanges  = MaxRanges;
+  SdErase.NbRanges   = 0;
+  SdErase.IdleTime   = IdleTime;
+  SdErase.LastIoTick = HAL_GetTick();
+  SdErase.Busy       = 0;
+  SdErase.pRanges    = pRanges;
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Records freed blocks, to be erased in background.
+  * @param  StartBlock: First freed block
+  * @param  NumOfBlocks: Number of freed blocks
+  * @retval None
+  */
+void BSP_SD_Trim(uint32_t StartBlock, uint32_t NumOfBlocks)
+{
+  SD_EraseRangeTypeDef *range;
+  uint32_t end = StartBlock + NumOfBlocks;
+  uint32_t index, first, last, smallest;
+  
+  if((SdErase.pRanges == NULL) || (NumOfBlocks == 0))
+  {
+    return;
+  }
+  
+  SdErase.Stats.Trimmed += NumOfBlocks;
+  
+  /* Ranges overlapping or adjacent to the freed blocks */
+  for(first = 0; (first < SdErase.NbRanges) &&
+      ((SdErase.pRanges[first].Start + SdErase.pRanges[first].Count) < StartBlock); first++)
+  {
+  }
+  for(last = first; (last < SdErase.NbRanges) && (SdErase.pRanges[last].Start <= end); last++)
+  {
+  }
+  
+  if(first == last)
+  {
+    if(SdErase.NbRanges == SdErase.MaxRanges)
+    {
+      /* Full table: keep the larger ranges */
+      smallest = 0;
+      for(index = 1; index < SdErase.NbRanges; index++)
+      {
+        if(SdErase.pRanges[index].Count < SdErase.pRanges[smallest].Count)
+        {
+          smallest = index;
+        }
+      }
+      
+      if(SdErase.pRanges[smallest].Count >= NumOfBlocks)
+      {
+        SdErase.Stats.Dropped += NumOfBlocks;
+        return;
+      }
+      
+      SdErase.Stats.Dropped += SdErase.pRanges[smallest].Count;
+      SdErase.Stats.Backlog -= SdErase.pRanges[smallest].Count;
+      ERASE_Delete(smallest);
+      if(smallest < first)
+      {
+        first--;
+      }
+    }
+    
+    ERASE_Insert(first, StartBlock, NumOfBlocks);
+    SdErase.Stats.Backlog += NumOfBlocks;
+    return;
+  }
+  
+  /* Merge the freed blocks and the ranges first to last - 1 into the first one */
+  range = &SdErase.pRanges[first];
+  for(index = first; index < last; index++)
+  {
+    SdErase.Stats.Backlog -= SdErase.pRanges[index].Count;
+    if((SdErase.pRanges[index].Start + SdErase.pRanges[index].Count) > end)
+    {
+      end = SdErase.pRanges[index].Start + SdErase.pRanges[index].Count;
+    }
+  }
+  if(range->Start < StartBlock)
+  {
+    StartBlock = range->Start;
+  }
+  range->Start = StartBlock;
+  range->Count = end - StartBlock;
+  SdErase.Stats.Backlog += range->Count;
+  
+  for(index = first + 1; index < last; index++)
+  {
+    ERASE_Delete(first + 1);
+  }
+}
+
+/**
+  * @brief  Erases freed blocks when the card is idle.
+  * @note   This function must be called periodically from the application loop.
+  * @retval SD status
+  */
+uint8_t BSP_SD_EraseProcess(void)
+{
+  SD_EraseRangeTypeDef *range;
+  uint32_t group = SdErase.Stats.EraseGroup;
+  uint32_t index, start, end, rewritten;
+  uint8_t status = MSD_OK;
+  
+  if(SdErase.pRanges == NULL)
+  {
+    return MSD_OK;
+  }
+  
+  /* End of the previous erase */
+  if((SdErase.Busy != 0) && (HAL_SD_GetCardState(&uSdHandle) == HAL_SD_CARD_TRANSFER))
+  {
+    ERASE_WaitCard();
+  }
+  
+  if((SdErase.Busy != 0) || ((HAL_GetTick() - SdErase.LastIoTick) < SdErase.IdleTime) ||
+     (BSP_SD_IsQueueIdle() == 0) || (SdWriteBack.Dirty != 0) || (SdBounce.Remaining != 0) ||
+     (HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY))
+  {
+    return MSD_OK;
+  }
+  
+  /* First range holding a complete erase group */
+  for(index = 0; index < SdErase.NbRanges; index++)
+  {
+    range = &SdErase.pRanges[index];
+    start = ((range->Start + group - 1) / group) * group;
+    end   = ((range->Start + range->Count) / group) * group;
+    
+    if(end > start)
+    {
+      if((end - start) > (SD_ERASE_MAX_GROUPS * group))
+      {
+        end = start + (SD_ERASE_MAX_GROUPS * group);
+      }
+      
+      CACHE_InvalidateRange(start, end - 1);
+      SdErase.EraseCycles = BSP_GetCycleCount();
+      if(HAL_SD_Erase(&uSdHandle, start, end - 1) != HAL_OK)
+      {
+        status = MSD_ERROR;
+      }
+      else
+      {
+        SdErase.Busy = 1;
+        SdErase.Stats.Erases++;
+        SdErase.Stats.Erased += end - start;
+      }
+      
+      /* The blocks are no longer waiting, even on error */
+      rewritten = SdErase.Stats.Rewritten;
+      ERASE_Remove(start, end - 1);
+      SdErase.Stats.Rewritten = rewritten;
+      break;
+    }
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Gets the SD background erase statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SD_GetEraseStats(SD_EraseStatsTypeDef *pStats)
+{
+  *pStats = SdErase.Stats;
+  pStats->Ranges = SdErase.NbRanges;
+}
+
+/**
+  * @brief  Reads block(s) in polling mode, once more at a lower clock after a CRC error.
+  * @param  pData: Pointer to the buffer that will contain the data
+  * @param  ReadAddr: First block to read
+  * @param  NumOfBlocks: Number of blocks to read
+  * @param  Timeout: Timeout for read operation
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BUS_ReadBlocks(uint8_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  HAL_StatusTypeDef status = HAL_SD_ReadBlocks(&uSdHandle, pData, ReadAddr, NumOfBlocks, Timeout);
+  
+  if((status != HAL_OK) && (BUS_Fallback() != 0))
+  {
+    status = HAL_SD_ReadBlocks(&uSdHandle, pData, ReadAddr, NumOfBlocks, Timeout);
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Writes block(s) in polling mode, once more at a lower clock after a CRC error.
+  * @param  pData: Pointer to the data to write
+  * @param  WriteAddr: First block to write
+  * @param  NumOfBlocks: Number of blocks to write
+  * @param  Timeout: Timeout for write operation
+  * @retval HAL status
+  */
+static HAL_StatusTypeDef BUS_WriteBlocks(uint8_t *pData, uint32_t WriteAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  HAL_StatusTypeDef status = HAL_SD_WriteBlocks(&uSdHandle, pData, WriteAddr, NumOfBlocks, Timeout);
+  
+  if((status != HAL_OK) && (BUS_Fallback() != 0))
+  {
+    status = HAL_SD_WriteBlocks(&uSdHandle, pData, WriteAddr, NumOfBlocks, Timeout);
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Lowers the SDIO clock after a transfer failed with a CRC error.
+  * @retval 1 when the clock was lowered, 0 otherwise
+  */
+static uint32_t BUS_Fallback(void)
+{
+  uint32_t index;
+  
+  if((SdBus.Tuning != 0) ||
+     ((HAL_SD_GetError(&uSdHandle) & (HAL_SD_ERROR_DATA_CRC_FAIL | HAL_SD_ERROR_CMD_CRC_FAIL)) == 0))
+  {
+    return 0;
+  }
+  
+  SdBus.Info.CrcErrors++;
+  
+  /* Bring the card back to the transfer state */
+  SDMMC_CmdStopTransfer(uSdHandle.Instance);
+  
+  for(index = 0; index < sizeof(SdBusDividers); index++)
+  {
+    if((SdBus.Info.ClockBypass != 0) || (SdBusDividers[index] > SdBus.Info.ClockDiv))
+    {
+      BUS_SetClock(0, SdBusDividers[index]);
+      SdBus.Info.Fallbacks++;
+      return 1;
+    }
+  }
+  
+  return 0;
+}
+
+/**
+  * @brief  Sets the SDIO clock, keeping the 4-bit bus.
+  * @param  Bypass: 1 to use the undivided SDIOCLK
+  * @param  ClockDiv: SDIO clock divider, SDIO_CK = SDIOCLK / (ClockDiv + 2)
+  * @retval None
+  */
+static void BUS_SetClock(uint32_t Bypass, uint32_t ClockDiv)
+{
+  SDIO_InitTypeDef Init = uSdHandle.Init;
+  
+  uSdHandle.Init.ClockBypass = (Bypass != 0) ? SDIO_CLOCK_BYPASS_ENABLE : SDIO_CLOCK_BYPASS_DISABLE;
+  uSdHandle.Init.ClockDiv    = ClockDiv;
+  
+  Init.ClockBypass = uSdHandle.Init.ClockBypass;
+  Init.ClockDiv    = ClockDiv;
+  Init.BusWide     = SDIO_BUS_WIDE_4B;
+  SDIO_Init(uSdHandle.Instance, Init);
+  
+  SdBus.Info.ClockBypass = Bypass;
+  SdBus.Info.ClockDiv    = ClockDiv;
+  SdBus.Info.ClockHz     = (Bypass != 0) ? SD_SDIOCLK_HZ : (SD_SDIOCLK_HZ / (ClockDiv + 2));
+}
+
+/**
+  * @brief  Switches the card to high-speed mode with CMD6.
+  * @retval SD status, MSD_ERROR when the card does not support high-speed mode
+  */
+static uint8_t BUS_SwitchHighSpeed(void)
+{
+  SDIO_DataInitTypeDef config;
+  uint32_t switchstatus[SD_SWITCH_STATUS_SIZE / 4];
+  uint32_t count = 0, index;
+  uint32_t tickstart;
+  uint8_t status = MSD_OK;
+  
+  /* The switch function status is a 64-byte data block */
+  if(SDMMC_CmdBlockLength(uSdHandle.Instance, SD_SWITCH_STATUS_SIZE) != HAL_SD_ERROR_NONE)
+  {
+    return MSD_ERROR;
+  }
+  
+  config.DataTimeOut   = SDMMC_DATATIMEOUT;
+  config.DataLength    = SD_SWITCH_STATUS_SIZE;
+  config.DataBlockSize = SDIO_DATABLOCK_SIZE_64B;
+  config.TransferDir   = SDIO_TRANSFER_DIR_TO_SDIO;
+  config.TransferMode  = SDIO_TRANSFER_MODE_BLOCK;
+  config.DPSM          = SDIO_DPSM_ENABLE;
+  SDIO_ConfigData(uSdHandle.Instance, &config);
+  
+  if(SDMMC_CmdSwitch(uSdHandle.Instance, SD_SWITCH_HIGH_SPEED) != HAL_SD_ERROR_NONE)
+  {
+    status = MSD_ERROR;
+  }
+  
+  tickstart = HAL_GetTick();
+  while((status == MSD_OK) &&
+        !__HAL_SD_GET_FLAG(&uSdHandle, SDIO_FLAG_RXOVERR | SDIO_FLAG_DCRCFAIL | SDIO_FLAG_DTIMEOUT | SDIO_FLAG_DBCKEND))
+  {
+    if(__HAL_SD_GET_FLAG(&uSdHandle, SDIO_FLAG_RXFIFOHF) && (count <= ((SD_SWITCH_STATUS_SIZE / 4) - 8)))
+    {
+      for(index = 0; index < 8; index++)
+      {
+        switchstatus[count++] = SDIO_ReadFIFO(uSdHandle.Instance);
+      }
+    }
+    
+    if((HAL_GetTick() - tickstart) >= SD_WRITEBACK_TIMEOUT)
+    {
+      status = MSD_ERROR;
+    }
+  }
+  
+  if((status == MSD_OK) && __HAL_SD_GET_FLAG(&uSdHandle, SDIO_FLAG_RXOVERR | SDIO_FLAG_DCRCFAIL | SDIO_FLAG_DTIMEOUT))
+  {
+    status = MSD_ERROR;
+  }
+  
+  /* Words left in the FIFO */
+  while((status == MSD_OK) && __HAL_SD_GET_FLAG(&uSdHandle, SDIO_FLAG_RXDAVL) && (count < (SD_SWITCH_STATUS_SIZE / 4)))
+  {
+    switchstatus[count++] = SDIO_ReadFIFO(uSdHandle.Instance);
+  }
+  
+  __HAL_SD_CLEAR_FLAG(&uSdHandle, SDIO_STATIC_FLAGS);
+  
+  /* Restore the data block length */
+  if(SDMMC_CmdBlockLength(uSdHandle.Instance, SD_CACHE_BLOCK_SIZE) != HAL_SD_ERROR_NONE)
+  {
+    status = MSD_ERROR;
+  }
+  
+  /* Function group 1 result, bits 379:376 of the status: 1 once in high-speed mode */
+  if((status != MSD_OK) || (count < (SD_SWITCH_STATUS_SIZE / 4)) || ((((uint8_t *)switchstatus)[16] & 0x0F) != 0x01))
+  {
+    return MSD_ERROR;
+  }
+  
+  /* The switch is effective 8 clocks after the end of the status block */
+  HAL_Delay(1);
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Transfers block(s) in DMA mode and waits for the completion.
+  * @param  pData: Data buffer
+  * @param  Block: First block
+  * @param  NumOfBlocks: Number of blocks
+  * @param  Write: 1 for a write, 0 for a read
+  * @retval SD status
+  */
+static uint8_t BUS_Transfer(uint32_t *pData, uint32_t Block, uint32_t NumOfBlocks, uint32_t Write)
+{
+  HAL_StatusTypeDef status;
+  
+  if(Write != 0)
+  {
+    status = BOUNCE_WriteBlocks(pData, Block, NumOfBlocks);
+  }
+  else
+  {
+    status = BOUNCE_ReadBlocks(pData, Block, NumOfBlocks);
+  }
+  
+  if((status != HAL_OK) || (BUS_WaitTransfer() != MSD_OK) || (HAL_SD_GetError(&uSdHandle) != HAL_SD_ERROR_NONE))
+  {
+    return MSD_ERROR;
+  }
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Reads the SD card detect pin through the IO expander.
+  * @retval SD_PRESENT or SD_NOT_PRESENT
+  */
+static uint8_t DETECT_ReadPin(void)
+{
+  __IO uint8_t status = SD_PRESENT;
+  
+  SdDetect.Stats.PinReads++;
+  
+  /* Check SD card detect pin */
+  if(BSP_IO_ReadPin(SD_DETECT_PIN))
+  {
+    status = SD_NOT_PRESENT;
+  }
+  
+  return status;
+}
+
+/**
+  * @brief  Prepares a foreground operation: waits for the end of a background
+  *         erase and removes the written blocks from the freed ranges.
+  * @param  StartBlock: First block of the operation
+  * @param  NumOfBlocks: Number of blocks of the operation
+  * @param  Write: 1 when the operation modifies the blocks
+  * @retval None
+  */
+static void ERASE_Foreground(uint32_t StartBlock, uint32_t NumOfBlocks, uint32_t Write)
+{
+  uint32_t delay;
+  
+  if(SdErase.pRanges == NULL)
+  {
+    return;
+  }
+  
+  SdErase.LastIoTick = HAL_GetTick();
+  
+  if(SdErase.Busy != 0)
+  {
+    delay = ERASE_WaitCard();
+    if(delay != 0)
+    {
+      SdErase.Stats.Delayed++;
+      SdErase.Stats.DelayUs += delay;
+      if(delay > SdErase.Stats.MaxDelayUs)
+      {
+        SdErase.Stats.MaxDelayUs = delay;
+      }
+    }
+  }
+  
+  if((Write != 0) && (NumOfBlocks != 0))
+  {
+    ERASE_Remove(StartBlock, StartBlock + NumOfBlocks - 1);
+  }
+}
+
+/**
+  * @brief  Waits for the end of the background erase.
+  * @retval Wait time in us
+  */
+static uint32_t ERASE_WaitCard(void)
+{
+  uint32_t start = BSP_GetCycleCount();
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t duration;
+  
+  while(HAL_SD_GetCardState(&uSdHandle) != HAL_SD_CARD_TRANSFER)
+  {
+    if((HAL_GetTick() - tickstart) >= SD_WRITEBACK_TIMEOUT)
+    {
+      break;
+    }
+  }
+  
+  duration = BSP_GetElapsedUs(SdErase.EraseCycles);
+  if(duration > SdErase.Stats.MaxEraseUs)
+  {
+    SdErase.Stats.MaxEraseUs = duration;
+  }
+  SdErase.Busy = 0;
+  
+  return BSP_GetElapsedUs(start);
+}
+
+/**
+  * @brief  Removes blocks from the freed ranges.
+  * @param  StartBlock: First block to remove
+  * @param  EndBlock: Last block to remove
+  * @retval None
+  */
+static void ERASE_Remove(uint32_t StartBlock, uint32_t EndBlock)
+{
+  SD_EraseRangeTypeDef *range;
+  uint32_t index = 0, end, removed;
+  
+  while(index < SdErase.NbRanges)
+  {
+    range = &SdErase.pRanges[index];
+    end   = range->Start + range->Count - 1;
+    
+    if((end < StartBlock) || (range->Start > EndBlock))
+    {
+      index++;
+      continue;
+    }
+    
+    if((range->Start >= StartBlock) && (end <= EndBlock))
+    {
+      /* Whole range */
+      removed = range->Count;
+      ERASE_Delete(index);
+    }
+    else if(range->Start >= StartBlock)
+    {
+      /* Head of the range */
+      removed       = EndBlock + 1 - range->Start;
+      range->Count -= removed;
+      range->Start  = EndBlock + 1;
+      index++;
+    }
+    else if(end <= EndBlock)
+    {
+      /* Tail of the range */
+      removed      = end + 1 - StartBlock;
+      range->Count = StartBlock - range->Start;
+      index++;
+    }
+    else
+    {
+      /* Middle of the range: split it, dropping the tail on a full table */
+      removed      = EndBlock + 1 - StartBlock;
+      range->Count = StartBlock - range->Start;
+      if(SdErase.NbRanges < SdErase.MaxRanges)
+      {
+        ERASE_Insert(index + 1, EndBlock + 1, end - EndBlock);
+      }
+      else
+      {
+        SdErase.Stats.Dropped += end - EndBlock;
+        SdErase.Stats.Backlog -= end - EndBlock;
+      }
+      index += 2;
+    }
+    
+    SdErase.Stats.Backlog   -= removed;
+    SdErase.Stats.Rewritten += removed;
+  }
+}
+
+/**
+  * @brief  Inserts a freed range in the table.
+  * @param  Index: Position of the new range
+  * @param  Start: First block
+  * @param  Count: Number of blocks
+  * @retval None
+  */
+static void ERASE_Insert(uint32_t Index, uint32_t Start, uint32_t Count)
+{
+  uint32_t index;
+  
+  for(index = SdErase.NbRanges; index > Index; index--)
+  {
+    SdErase.pRanges[index] = SdErase.pRanges[index - 1];
+  }
+  SdErase.pRanges[Index].Start = Start;
+  SdErase.pRanges[Index].Count = Count;
+  SdErase.NbRanges++;
+}
+
+/**
+  * @brief  Deletes a freed range from the table.
+  * @param  Index: Position of the range
+  * @retval None
+  */
+static void ERASE_Delete(uint32_t Index)
+{
+  for(; (Index + 1) < SdErase.NbRanges; Index++)
+  {
+    SdErase.pRanges[Index] = SdErase.pRanges[Index + 1];
+  }
+  SdErase.NbRanges--;
+}
+
+/**
+  * @brief  Finds the cache line of a block.
+  * @param  Block: Block address
+  * @retval Line index or SD_CACHE_NO_LINE
+  */
+static uint32_t CACHE_Lookup(uint32_t Block)
+{
+  uint32_t line = (Block & (SdCache.NbSets - 1)) * SdCache.Ways;
+  uint32_t way;
+  
+  for(way = 0; way < SdCache.Ways; way++, line++)
+  {
+    if(((SdCache.pTags[line].Flags & SD_CACHE_LINE_VALID) != 0) && (SdCache.pTags[line].Block == Block))
+    {
+      return line;
+    }
+  }
+  
+  return SD_CACHE_NO_LINE;
+}
+
+/**
+  * @brief  Stores a block in the cache, replacing the least recently used line of its set.
+  * @param  Block: Block address
+  * @param  pSrc: Block content
+  * @param  Flags: Additional line flags
+  * @retval None
+  */
+static void CACHE_Insert(uint32_t Block, uint32_t *pSrc, uint32_t Flags)
+{
+  SD_CacheTagTypeDef *tag;
+  uint32_t line = CACHE_Lookup(Block);
+  uint32_t first, way, age, oldest = 0;
+  
+  if(line == SD_CACHE_NO_LINE)
+  {
+    first = (Block & (SdCache.NbSets - 1)) * SdCache.Ways;
+    line  = first;
+    for(way = 0; way < SdCache.Ways; way++)
+    {
+      tag = &SdCache.pTags[first + way];
+      if((tag->Flags & SD_CACHE_LINE_VALID) == 0)
+      {
+        line = first + way;
+        break;
+      }
+      
+      age = SdCache.Stamp - tag->Stamp;
+      if(age >= oldest)
+      {
+        oldest = age;
+        line   = first + way;
+      }
+    }
+  }
+  
+  tag = &SdCache.pTags[line];
+  tag->Block = Block;
+  tag->Stamp = SdCache.Stamp++;
+  tag->Flags = SD_CACHE_LINE_VALID | Flags;
+  CACHE_CopyBlock(SdCache.pData + (line * SD_CACHE_BLOCK_WORDS), pSrc);
+}
+
+/**
+  * @brief  Refreshes the cached copies of written blocks.
+  * @param  pSrc: Written data
+  * @param  Block: First written block
+  * @param  NumOfBlocks: Number of written blocks
+  * @retval None
+  */
+static void CACHE_Update(uint32_t *pSrc, uint32_t Block, uint32_t NumOfBlocks)
+{
+  uint32_t index, line;
+  
+  if(SdCache.pData == NULL)
+  {
+    return;
+  }
+  
+  for(index = 0; index < NumOfBlocks; index++)
+  {
+    line = CACHE_Lookup(Block + index);
+    if(line != SD_CACHE_NO_LINE)
+    {
+      CACHE_CopyBlock(SdCache.pData + (line * SD_CACHE_BLOCK_WORDS), pSrc + (index * SD_CACHE_BLOCK_WORDS));
+    }
+  }
+}
+
+/**
+  * @brief  Drops the cached blocks of a range.
+  * @param  StartBlock: First block of the range
+  * @param  EndBlock: Last block of the range
+  * @retval None
+  */
+static void CACHE_InvalidateRange(uint32_t StartBlock, uint32_t EndBlock)
+{
+  uint32_t index;
+  
+  if(SdCache.pData == NULL)
+  {
+    return;
+  }
+  
+  for(index = 0; index < (SdCache.NbSets * SdCache.Ways); index++)
+  {
+    if((SdCache.pTags[index].Block >= StartBlock) && (SdCache.pTags[index].Block <= EndBlock))
+    {
+      SdCache.pTags[index].Flags = 0;
+    }
+  }
+}
+
+/**
+  * @brief  Reads block(s) through the cache.
+  * @param  pData: Pointer to the buffer that will contain the data
+  * @param  ReadAddr: First block to read
+  * @param  NumOfBlocks: Number of blocks to read
+  * @param  Timeout: Timeout of each card read command
+  * @retval SD status
+  */
+static uint8_t CACHE_Read(uint32_t *pData, uint32_t ReadAddr, uint32_t NumOfBlocks, uint32_t Timeout)
+{
+  SD_CacheTagTypeDef *tag;
+  uint32_t sequential = (ReadAddr == SdCache.NextBlock);
+  uint32_t index = 0, line, run, ahead, count;
+  uint32_t *pDst, *pRun, *pAhead;
+  
+  if(sequential != 0)
+  {
+    SdCache.Stats.SequentialRuns++;
+  }
+  SdCache.NextBlock = ReadAddr + NumOfBlocks;
+  
+  while(index < NumOfBlocks)
+  {
+    pDst = pData + (index * SD_CACHE_BLOCK_WORDS);
+    line = CACHE_Lookup(ReadAddr + index);
+    
+    if(line != SD_CACHE_NO_LINE)
+    {
+      tag = &SdCache.pTags[line];
+      if((tag->Flags & SD_CACHE_LINE_PREFETCHED) != 0)
+      {
+        tag->Flags &= ~SD_CACHE_LINE_PREFETCHED;
+        SdCache.Stats.PrefetchHits++;
+      }
+      tag->Stamp = SdCache.Stamp++;
+      CACHE_CopyBlock(pDst, SdCache.pData + (line * SD_CACHE_BLOCK_WORDS));
+      SdCache.Stats.Hits++;
+      index++;
+      continue;
+    }
+    
+    /* Gather the run of missed blocks */
+    for(run = 1; (index + run) < NumOfBlocks; run++)
+    {
+      if(CACHE_Lookup(ReadAddr + index + run) != SD_CACHE_NO_LINE)
+      {
+        break;
+      }
+    }
+    
+    /* Extend the last run of a sequential stream up to the next cached block */
+    ahead = 0;
+    if((sequential != 0) && ((index + run) == NumOfBlocks))
+    {
+      while((ahead < SdCache.ReadAhead) &&
+            ((SdCache.NextBlock + ahead) < uSdHandle.SdCard.BlockNbr) &&
+            (CACHE_Lookup(SdCache.NextBlock + ahead) == SD_CACHE_NO_LINE))
+      {
+        ahead++;
+      }
+    }
+    
+    if((run + ahead) <= SdCache.StagingBlocks)
+    {
+      /* Single command for the missed blocks and the read-ahead */
+      if(BUS_ReadBlocks((uint8_t *)SdCache.pStaging, ReadAddr + index, run + ahead, Timeout) != HAL_OK)
+      {
+        return MSD_ERROR;
+      }
+      SdCache.Stats.ReadCommands++;
+      
+      pRun   = SdCache.pStaging;
+      pAhead = SdCache.pStaging + (run * SD_CACHE_BLOCK_WORDS);
+      for(count = 0; count < run; count++)
+      {
+        CACHE_CopyBlock(pDst + (count * SD_CACHE_BLOCK_WORDS), pRun + (count * SD_CACHE_BLOCK_WORDS));
+      }
+    }
+    else
+    {
+      /* Long run: read it in place, then the read-ahead in the staging area */
+      if(BUS_ReadBlocks((uint8_t *)pDst, ReadAddr + index, run, Timeout) != HAL_OK)
+      {
+        return MSD_ERROR;
+      }
+      SdCache.Stats.ReadCommands++;
+      
+      pRun   = pDst;
+      pAhead = SdCache.pStaging;
+      if(ahead != 0)
+      {
+        if(BUS_ReadBlocks((uint8_t *)pAhead, SdCache.NextBlock, ahead, Timeout) != HAL_OK)
+        {
+          /* The requested blocks are valid, only the read-ahead is lost */
+          ahead = 0;
+        }
+        else
+        {
+          SdCache.Stats.ReadCommands++;
+        }
+      }
+    }
+    
+    for(count = 0; count < run; count++)
+    {
+      CACHE_Insert(ReadAddr + index + count, pRun + (count * SD_CACHE_BLOCK_WORDS), 0);
+    }
+    for(count = 0; count < ahead; count++)
+    {
+      CACHE_Insert(SdCache.NextBlock + count, pAhead + (count * SD_CACHE_BLOCK_WORDS), SD_CACHE_LINE_PREFETCHED);
+    }
+    
+    SdCache.Stats.Misses     += run;
+    SdCache.Stats.Prefetched += ahead;
+    index += run;
+  }
+  
+  return MSD_OK;
+}
+
+/**
+  * @brief  Copies a block.
+  * @param  pDst: Destination
+  * @param  pSrc: Source
+  * @retval None
+  */
+static void CACHE_CopyBlock(uint32_t *pDst, uint32_t *pSrc)
+{
+  uint32_t index;
+  
+  for(index = 0; index < SD_CACHE_BLOCK_WORDS; index += 4)
+  {
+    pDst[index]     = pSrc[index];
+    pDst[index + 1] = pSrc[index + 1];
+    pDst[index + 2] = pSrc[index + 2];
+    pDst[index + 3] = pSrc[index + 3];
+  }
+}
+
+/**
+  * @brief  Initializes the SD MSP.
+  * @param  hsd: SD handle
+  * @param  Params : pointer on additional configuration parameters, can be NULL.
+  */
+__weak void BSP_SD_MspInit(SD_HandleTypeDef *hsd, void *Params)
+{
+  static DMA_HandleTypeDef dmaRxHandle;
+  static DMA_HandleTypeDef dmaTxHandle;
+  GPIO_InitTypeDef GPIO_Init_Structure;
+  
+  /* Enable SDIO clock */
+  __HAL_RCC_SDIO_CLK_ENABLE();
+  
+  /* Enable DMA2 clocks */
+  __DMAx_TxRx_CLK_ENABLE();
+
+  /* Enable GPIOs clock */
+  __HAL_RCC_GPIOC_CLK_ENABLE();
+  __HAL_RCC_GPIOD_CLK_ENABLE();
+  
+  /* Common GPIO configuration */
+  GPIO_Init_Structure.Mode      = GPIO_MODE_AF_PP;
+  GPIO_Init_Structure.Pull      = GPIO_PULLUP;
+  GPIO_Init_Structure.Speed     = GPIO_SPEED_HIGH;
+  GPIO_Init_Structure.Alternate = GPIO_AF12_SDIO;
+  
+  /* GPIOC configuration */
+  GPIO_Init_Structure.Pin = GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_12;
+   
+  HAL_GPIO_Init(GPIOC, &GPIO_Init_Structure);
+
+  /* GPIOD configuration */
+  GPIO_Init_Structure.Pin = GPIO_PIN_2;
+  HAL_GPIO_Init(GPIOD, &GPIO_Init_Structure);
+
+  /* NVIC configuration for SDIO interrupts */
+  HAL_NVIC_SetPriority(SDIO_IRQn, 0x0E, 0);
+  HAL_NVIC_EnableIRQ(SDIO_IRQn);
+    
+  /* Configure DMA Rx parameters */
+  dmaRxHandle.Init.Channel             = SD_DMAx_Rx_CHANNEL;
+  dmaRxHandle.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  dmaRxHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+  dmaRxHandle.Init.MemInc              = DMA_MINC_ENABLE;
+  dmaRxHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  dmaRxHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+  dmaRxHandle.Init.Mode                = DMA_PFCTRL;
+  dmaRxHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+  dmaRxHandle.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
+  dmaRxHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+  dmaRxHandle.Init.MemBurst            = DMA_MBURST_INC4;
+  dmaRxHandle.Init.PeriphBurst         = DMA_PBURST_INC4;
+  
+  dmaRxHandle.Instance = SD_DMAx_Rx_STREAM;
+  
+  /* Associate the DMA handle */
+  __HAL_LINKDMA(hsd, hdmarx, dmaRxHandle);
+  
+  /* Deinitialize the stream for new transfer */
+  HAL_DMA_DeInit(&dmaRxHandle);
+  
+  /* Configure the DMA stream */
+  HAL_DMA_Init(&dmaRxHandle);
+  
+  /* Configure DMA Tx parameters */
+  dmaTxHandle.Init.Channel             = SD_DMAx_Tx_CHANNEL;
+  dmaTxHandle.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  dmaTxHandle.Init.PeriphInc           = DMA_PINC_DISABLE;
+  dmaTxHandle.Init.MemInc              = DMA_MINC_ENABLE;
+  dmaTxHandle.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  dmaTxHandle.Init.MemDataAlignment    = DMA_MDATAALIGN_WORD;
+  dmaTxHandle.Init.Mode                = DMA_PFCTRL;
+  dmaTxHandle.Init.Priority            = DMA_PRIORITY_VERY_HIGH;
+  dmaTxHandle.Init.FIFOMode            = DMA_FIFOMODE_ENABLE;
+  dmaTxHandle.Init.FIFOThreshold       = DMA_FIFO_THRESHOLD_FULL;
+  dmaTxHandle.Init.MemBurst            = DMA_MBURST_INC4;
+  dmaTxHandle.Init.PeriphBurst         = DMA_PBURST_INC4;
+  
+  dmaTxHandle.Instance = SD_DMAx_Tx_STREAM;
+  
+  /* Associate the DMA handle */
+  __HAL_LINKDMA(hsd, hdmatx, dmaTxHandle);
+  
+  /* Deinitialize the stream for new transfer */
+  HAL_DMA_DeInit(&dmaTxHandle);
+  
+  /* Configure the DMA stream */
+  HAL_DMA_Init(&dmaTxHandle); 
+  
+  /* NVIC configuration for DMA transfer complete interrupt */
+  HAL_NVIC_SetPriority(SD_DMAx_Rx_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(SD_DMAx_Rx_IRQn);
+  
+  /* NVIC configuration for DMA transfer complete interrupt */
+  HAL_NVIC_SetPriority(SD_DMAx_Tx_IRQn, 0x0F, 0);
+  HAL_NVIC_EnableIRQ(SD_DMAx_Tx_IRQn);
+}
+
+/**
+  * @brief  Gets the current SD card data status.
+  * @retval Data transfer state.
+  *          This value can be one of the following values:
+  *            @arg  SD_TRANSFER_OK: No data transfer is acting
+  *            @arg  SD_TRANSFER_BUSY: Data transfer is acting
+  */
+uint8_t BSP_SD_GetCardState(void)
+{
+  /* A bounced transfer is complete after its last chunk */
+  if(SdBounce.Remaining != 0)
+  {
+    BOUNCE_Resume();
+    return SD_TRANSFER_BUSY;
+  }
+  
+  return((HAL_SD_GetCardState(&uSdHandle) == HAL_SD_CARD_TRANSFER ) ? SD_TRANSFER_OK : SD_TRANSFER_BUSY);
+}
+  
+
+/**
+  * @brief  Get SD information about specific SD card.
+  * @param  CardInfo: Pointer to HAL_SD_CardInfoTypedef structure
+  * @retval None 
+  */
+void BSP_SD_GetCardInfo(HAL_SD_CardInfoTypeDef *CardInfo)
+{
+  /* Get SD card Information */
+  HAL_SD_GetCardInfo(&uSdHandle, CardInfo);
+}
+
+/**
+  * @brief SD Abort callbacks
   * @param hsd: SD handle
   * @retval None
   */
 void HAL_SD_AbortCallback(SD_HandleTypeDef *hsd)
 {
+  BOUNCE_SetByteMode(NULL, 0);
+  SdBounce.Remaining = 0;
+  SdBounce.Deferred  = 0;
+  
+  if(SdQueue.pActive != NULL)
+  {
+    QUEUE_Complete(MSD_ERROR);
+    QUEUE_StartNext();
+    return;
+  }
+  
   BSP_SD_AbortCallback();
 }
 
+/**
+  * @brief SD error callbacks
+  * @param hsd: SD handle
+  * @retval None
+  */
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+  /* Drop the remaining chunks of a bounced transfer */
+  BOUNCE_SetByteMode(NULL, 0);
+  SdBounce.Remaining = 0;
+  SdBounce.Deferred  = 0;
+  
+  /* Slow the bus down after a CRC error */
+  BUS_Fallback();
+  
+  if(SdQueue.pActive != NULL)
+  {
+    QUEUE_Complete(MSD_ERROR);
+    QUEUE_StartNext();
+  }
+}
+
 /**
   * @brief Tx Transfer completed callbacks
   * @param hsd: SD handle
@@ -433,6 +3121,18 @@ void HAL_SD_AbortCallback(SD_HandleTypeDef *hsd)
   */
 void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
 {
+  if((BOUNCE_Complete() != 0) || (SdBus.Tuning != 0) || (SdWriteBack.Flushing != 0))
+  {
+    return;
+  }
+  
+  if(SdQueue.pActive != NULL)
+  {
+    QUEUE_Complete(MSD_OK);
+    QUEUE_StartNext();
+    return;
+  }
+  
   BSP_SD_WriteCpltCallback();
 }
 
@@ -443,6 +3143,30 @@ void HAL_SD_TxCpltCallback(SD_HandleTypeDef *hsd)
   */
 void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd)
 {
+  uint32_t index;
+  
+  if((BOUNCE_Complete() != 0) || (SdBus.Tuning != 0))
+  {
+    return;
+  }
+  
+  if(SdQueue.pActive != NULL)
+  {
+    QUEUE_Complete(MSD_OK);
+    QUEUE_StartNext();
+    return;
+  }
+  
+  /* Cache the blocks of the completed DMA read */
+  if((SdCache.pData != NULL) && (SdCache.PendingCount != 0))
+  {
+    for(index = 0; index < SdCache.PendingCount; index++)
+    {
+      CACHE_Insert(SdCache.PendingBlock + index, SdCache.pPending + (index * SD_CACHE_BLOCK_WORDS), 0);
+    }
+    SdCache.PendingCount = 0;
+  }
+  
   BSP_SD_ReadCpltCallback();
 }
 
@@ -49,6 +49,158 @@
   * @brief SD Card information structure 
   */
 #define BSP_SD_CardInfo HAL_SD_CardInfoTypeDef
+
+/** 
+  * @brief SD block cache configuration
+  */
+typedef struct
+{
+  uint32_t *pBuffer;        /* Cache memory, BSP_SD_CACHE_SIZE() bytes, word aligned (SDRAM) */
+  uint32_t NbLines;         /* Number of cached blocks, NbLines / Ways must be a power of 2  */
+  uint32_t Ways;            /* Associativity                                                 */
+  uint32_t ReadAhead;       /* Blocks read ahead of a sequential stream, 0 to disable        */
+}SD_CacheConfigTypeDef;
+
+/** 
+  * @brief SD block cache statistics
+  */
+typedef struct
+{
+  uint32_t Hits;            /* Blocks served from the cache                     */
+  uint32_t Misses;          /* Blocks read from the card                        */
+  uint32_t ReadCommands;    /* Read commands issued to the card                 */
+  uint32_t Prefetched;      /* Blocks brought in by read-ahead                  */
+  uint32_t PrefetchHits;    /* Read-ahead blocks later requested                */
+  uint32_t PrefetchAccuracy;/* PrefetchHits / Prefetched in percent             */
+  uint32_t SequentialRuns;  /* Requests detected as continuing a sequential run */
+}SD_CacheStatsTypeDef;
+
+/** 
+  * @brief SD write-back buffer configuration
+  */
+typedef struct
+{
+  uint32_t *pBuffer;        /* Buffer memory, BSP_SD_WRITEBACK_SIZE() bytes, word aligned */
+  uint32_t NbBlocks;        /* Number of buffered dirty blocks                            */
+  uint32_t MaxBurst;        /* Maximum number of blocks of a coalesced card write         */
+  uint32_t FlushTimeout;    /* Maximum age of a dirty block in ms                         */
+}SD_WriteBackConfigTypeDef;
+
+/** 
+  * @brief SD write-back buffer statistics
+  */
+typedef struct
+{
+  uint32_t Writes;          /* Write requests                                   */
+  uint32_t Blocks;          /* Blocks written by the application                */
+  uint32_t Absorbed;        /* Blocks overwritten while still buffered          */
+  uint32_t Bypassed;        /* Blocks of large requests written directly        */
+  uint32_t CardWrites;      /* Write commands issued to the card                */
+  uint32_t CardBlocks;      /* Blocks written to the card                       */
+  uint32_t Barriers;        /* Ordering barriers                                */
+  uint32_t TimeoutFlushes;  /* Flushes of aged dirty blocks                     */
+  uint32_t SyncFlushes;     /* Explicit synchronisations                        */
+  uint32_t FullFlushes;     /* Flushes forced by a full buffer                  */
+  uint32_t DetectFlushes;   /* Flushes on card detection events                 */
+  uint32_t Lost;            /* Dirty blocks dropped after a card removal        */
+}SD_WriteBackStatsTypeDef;
+
+/** 
+  * @brief SD queued request, owned by the caller until its completion callback
+  */
+typedef struct __SD_RequestTypeDef
+{
+  uint32_t Operation;       /* SD_REQUEST_READ, SD_REQUEST_WRITE or SD_REQUEST_ERASE */
+  uint32_t Priority;        /* 0 (highest) to SD_QUEUE_PRIORITIES - 1                 */
+  uint32_t *pData;          /* Data buffer, unused for erase                         */
+  uint32_t BlockAddr;       /* First block                                           */
+  uint32_t NumOfBlocks;     /* Number of blocks                                      */
+  void     (*Callback)(struct __SD_RequestTypeDef *pRequest); /* Completion callback, can be NULL */
+  void     *pContext;       /* Caller context                                        */
+  __IO uint8_t Status;      /* SD_REQUEST_PENDING until completion, then MSD_OK or MSD_ERROR */
+  uint32_t SubmitCycles;    /* Submission time, driver internal                      */
+  struct __SD_RequestTypeDef *pNext; /* Queue link, driver internal                  */
+}SD_RequestTypeDef;
+
+/** 
+  * @brief SD request queue statistics of a priority class
+  */
+typedef struct
+{
+  uint32_t Submitted;       /* Requests submitted                               */
+  uint32_t Completed;       /* Requests completed successfully                  */
+  uint32_t Errors;          /* Requests completed with an error                 */
+  uint32_t MeanUs;          /* Mean submission to completion latency (us)       */
+  uint32_t P50Us;           /* Median latency upper bound (us)                  */
+  uint32_t P99Us;           /* 99th percentile latency upper bound (us)         */
+  uint32_t MaxUs;           /* Maximum latency (us)                             */
+}SD_QueueStatsTypeDef;
+
+/** 
+  * @brief SD DMA buffer handling statistics
+  */
+typedef struct
+{
+  uint32_t Direct;          /* Transfers with word aligned DMA capable buffers  */
+  uint32_t Unaligned;       /* Transfers with byte wide DMA memory accesses     */
+  uint32_t Bounced;         /* Transfers through the bounce buffer              */
+  uint32_t BouncedBlocks;   /* Blocks copied through the bounce buffer          */
+  uint32_t Chunks;          /* DMA transfers of the bounce buffer               */
+  uint32_t Deferred;        /* Chunks delayed while the card was programming    */
+}SD_BounceStatsTypeDef;
+
+/** 
+  * @brief SD bus configuration and error statistics
+  */
+typedef struct
+{
+  uint32_t HighSpeed;       /* 1 when the card is switched to high-speed mode   */
+  uint32_t ClockBypass;     /* 1 when SDIO_CK is the undivided SDIOCLK          */
+  uint32_t ClockDiv;        /* SDIO clock divider                               */
+  uint32_t ClockHz;         /* SDIO_CK frequency                                */
+  uint32_t CrcErrors;       /* Transfers failed with a CRC error                */
+  uint32_t Fallbacks;       /* Clock reductions after CRC errors                */
+}SD_BusInfoTypeDef;
+
+/** 
+  * @brief SD card detection statistics
+  */
+typedef struct
+{
+  uint32_t Generation;      /* Incremented on each card insertion or removal    */
+  uint32_t PinReads;        /* Detect pin reads through the IO expander         */
+  uint32_t Avoided;         /* Presence checks served from the cached state     */
+  uint32_t Interrupts;      /* Detect pin interrupts                            */
+  uint32_t Bounces;         /* Detect pin changes within the debounce time      */
+}SD_DetectStatsTypeDef;
+
+/** 
+  * @brief SD freed block range waiting for a background erase
+  */
+typedef struct
+{
+  uint32_t Start;           /* First freed block                                */
+  uint32_t Count;           /* Number of freed blocks                           */
+}SD_EraseRangeTypeDef;
+
+/** 
+  * @brief SD background erase statistics
+  */
+typedef struct
+{
+  uint32_t EraseGroup;      /* Erase group size in blocks                       */
+  uint32_t Backlog;         /* Freed blocks waiting for an erase                */
+  uint32_t Ranges;          /* Freed ranges waiting for an erase                */
+  uint32_t Trimmed;         /* Blocks freed by the application                  */
+  uint32_t Erased;          /* Blocks erased in background                      */
+  uint32_t Erases;          /* Background erase commands                        */
+  uint32_t Rewritten;       /* Freed blocks written again before their erase    */
+  uint32_t Dropped;         /* Freed blocks dropped on a full range table       */
+  uint32_t MaxEraseUs;      /* Longest background erase, busy time included     */
+  uint32_t Delayed;         /* Foreground operations delayed by an erase        */
+  uint32_t DelayUs;         /* Total foreground delay (us)                      */
+  uint32_t MaxDelayUs;      /* Longest foreground delay (us)                    */
+}SD_EraseStatsTypeDef;
 /**
   * @}
   */
@@ -73,6 +225,71 @@
 #define SD_NOT_PRESENT           ((uint8_t)0x00)
 
 #define SD_DATATIMEOUT           ((uint32_t)100000000)
+
+/* Time the detect pin must remain stable before a presence change is accepted, in ms */
+#if !defined(SD_DETECT_DEBOUNCE)
+ #define SD_DETECT_DEBOUNCE      ((uint32_t)50)
+#endif
+
+/* Longest run of missed blocks read together with the read-ahead in a single command */
+#if !defined(SD_CACHE_STAGING_BLOCKS)
+ #define SD_CACHE_STAGING_BLOCKS ((uint32_t)8)
+#endif
+
+/* SD block cache memory size: cached blocks, their tags and the read staging area */
+#define SD_CACHE_BLOCK_SIZE      ((uint32_t)512)
+#define SD_CACHE_TAG_SIZE        ((uint32_t)12)
+#define BSP_SD_CACHE_SIZE(NbLines, ReadAhead)  (((NbLines) * (SD_CACHE_BLOCK_SIZE + SD_CACHE_TAG_SIZE)) + \
+                                                (((ReadAhead) + SD_CACHE_STAGING_BLOCKS) * SD_CACHE_BLOCK_SIZE))
+
+/* SD write-back buffer memory size: dirty blocks, their tags and the coalescing area */
+#define SD_WRITEBACK_TAG_SIZE    ((uint32_t)12)
+#define BSP_SD_WRITEBACK_SIZE(NbBlocks, MaxBurst)  (((NbBlocks) * (SD_CACHE_BLOCK_SIZE + SD_WRITEBACK_TAG_SIZE)) + \
+                                                    ((MaxBurst) * SD_CACHE_BLOCK_SIZE))
+
+/* SD queued request operations and status */
+#define SD_REQUEST_READ          ((uint32_t)0x00)
+#define SD_REQUEST_WRITE         ((uint32_t)0x01)
+#define SD_REQUEST_ERASE         ((uint32_t)0x02)
+#define SD_REQUEST_PENDING       ((uint8_t)0xFF)
+
+/* Number of request priority classes, class 0 being served first */
+#if !defined(SD_QUEUE_PRIORITIES)
+ #define SD_QUEUE_PRIORITIES     ((uint32_t)4)
+#endif
+
+/* Number of latency histogram buckets, bucket n counting latencies below 2^n us */
+#define SD_QUEUE_HISTO_BUCKETS   ((uint32_t)24)
+
+/* Memory the SD DMA cannot reach (CCM data RAM) */
+#if !defined(SD_DMA_UNREACHABLE_START)
+ #define SD_DMA_UNREACHABLE_START ((uint32_t)0x10000000)
+ #define SD_DMA_UNREACHABLE_END   ((uint32_t)0x10010000)
+#endif
+
+/* SDIO kernel clock and bus tuning parameters */
+#if !defined(SD_SDIOCLK_HZ)
+ #define SD_SDIOCLK_HZ           ((uint32_t)48000000)
+#endif
+#define SD_TUNE_BLOCKS           ((uint32_t)8)
+#define SD_TUNE_PASSES           ((uint32_t)4)
+#define SD_TUNE_READ_ONLY        ((uint32_t)0x00)
+#define SD_TUNE_WRITE_PATTERN    ((uint32_t)0x01)
+
+/* Maximum number of erase groups of a background erase command */
+#if !defined(SD_ERASE_MAX_GROUPS)
+ #define SD_ERASE_MAX_GROUPS     ((uint32_t)32)
+#endif
+
+/* Completion timeout of a card transfer in ms */
+#if !defined(SD_WRITEBACK_TIMEOUT)
+ #define SD_WRITEBACK_TIMEOUT    ((uint32_t)1000)
+#endif
+
+/* Card polling period in us while a bounced write chunk is delayed */
+#if !defined(SD_BOUNCE_RESUME_PERIOD)
+ #define SD_BOUNCE_RESUME_PERIOD ((uint32_t)100)
+#endif
     
 /* DMA definitions for SD DMA transfer */
 #define __DMAx_TxRx_CLK_ENABLE            __HAL_RCC_DMA2_CLK_ENABLE
@@ -86,6 +303,12 @@
 #define BSP_SD_DMA_Tx_IRQHandler          DMA2_Stream6_IRQHandler   
 #define BSP_SD_DMA_Rx_IRQHandler          DMA2_Stream3_IRQHandler 
 #define SD_DetectIRQHandler()             HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_8)
+
+/* Timer resuming the bounced write chunks delayed while the card is programming */
+#define SD_TIMx                           TIM7
+#define SD_TIMx_CLK_ENABLE()              __HAL_RCC_TIM7_CLK_ENABLE()
+#define SD_TIMx_IRQn                      TIM7_IRQn
+#define SD_TIMx_IRQHandler                TIM7_IRQHandler
 /**
   * @}
   */
@@ -106,6 +329,32 @@ uint8_t BSP_SD_Erase(uint32_t StartAddr, uint32_t EndAddr);
 uint8_t BSP_SD_GetCardState(void);
 void    BSP_SD_GetCardInfo(HAL_SD_CardInfoTypeDef *CardInfo);
 uint8_t BSP_SD_IsDetected(void);
+uint32_t BSP_SD_GetDetectGeneration(void);
+void    BSP_SD_GetDetectStats(SD_DetectStatsTypeDef *pStats);
+uint8_t BSP_SD_CacheInit(SD_CacheConfigTypeDef *pConfig);
+void    BSP_SD_CacheDeInit(void);
+void    BSP_SD_CacheInvalidate(void);
+void    BSP_SD_GetCacheStats(SD_CacheStatsTypeDef *pStats);
+uint8_t BSP_SD_WriteBackInit(SD_WriteBackConfigTypeDef *pConfig);
+uint8_t BSP_SD_WriteBackDeInit(void);
+uint8_t BSP_SD_WriteBackProcess(void);
+uint8_t BSP_SD_Sync(void);
+void    BSP_SD_WriteBarrier(void);
+void    BSP_SD_GetWriteBackStats(SD_WriteBackStatsTypeDef *pStats);
+uint8_t BSP_SD_Submit(SD_RequestTypeDef *pRequest);
+uint8_t BSP_SD_Cancel(SD_RequestTypeDef *pRequest);
+void    BSP_SD_QueueProcess(void);
+uint8_t BSP_SD_IsQueueIdle(void);
+void    BSP_SD_GetQueueStats(uint32_t Priority, SD_QueueStatsTypeDef *pStats);
+uint8_t BSP_SD_BounceInit(uint32_t *pBuffer, uint32_t NbBlocks);
+void    BSP_SD_GetBounceStats(SD_BounceStatsTypeDef *pStats);
+void    BSP_SD_BounceIRQHandler(void);
+uint8_t BSP_SD_TuneBus(uint32_t *pBuffer, uint32_t TestBlock, uint32_t Mode);
+void    BSP_SD_GetBusInfo(SD_BusInfoTypeDef *pInfo);
+uint8_t BSP_SD_EraseInit(SD_EraseRangeTypeDef *pRanges, uint32_t MaxRanges, uint32_t IdleTime);
+void    BSP_SD_Trim(uint32_t StartBlock, uint32_t NumOfBlocks);
+uint8_t BSP_SD_EraseProcess(void);
+void    BSP_SD_GetEraseStats(SD_EraseStatsTypeDef *pStats);
 
 /* These functions can be modified in case the current settings (e.g. DMA stream)
    need to be changed for specific application needs */
@@ -0,0 +1,661 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdbench.c
+  * @author  MCD Application Team
+  * @brief   This file includes the throughput and latency benchmark of the
+  *          uSD card mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver measures the throughput and the request latencies of the SD
+     card through the BSP SD driver, to qualify cards.
+   - The SD card driver must be initialized by the application (BSP_SD_Init()).
+     The block cache and the write-back buffer of the SD driver are measured
+     with the card when they are enabled, and should be disabled to qualify
+     the card alone.
+
+2. Driver description:
+---------------------
+  + Configuration
+     o The test area of NbBlocks blocks from StartBlock receives the write and
+       erase requests, which are only run when SDBENCH_FLAG_WRITE and
+       SDBENCH_FLAG_ERASE are set: its content is lost.
+     o The transfer buffer must hold Blocks x Depth blocks of the largest test,
+       tests not fitting in it are skipped by BSP_SDBENCH_Run().
+
+  + Tests
+     o BSP_SDBENCH_RunTest() issues Requests requests of Blocks blocks with
+       sequential or random block addresses aligned to Blocks, through:
+      - SDBENCH_MODE_POLLING: BSP_SD_ReadBlocks()/BSP_SD_WriteBlocks()/BSP_SD_Erase(),
+      - SDBENCH_MODE_DMA: BSP_SD_ReadBlocks_DMA()/BSP_SD_WriteBlocks_DMA(),
+        waiting for each transfer,
+      - SDBENCH_MODE_QUEUE: BSP_SD_Submit(), keeping Depth requests in flight.
+     o A queue test timing out waits for the SD queue to complete the requests
+       in flight. When it does not, the test fails and no test is run until
+       the SD queue is idle. The latencies are those of the issued requests,
+       the others are counted as errors.
+     o The throughput and the mean, median, 95th and 99th percentile and
+       maximum latencies are computed from the DWT cycle counter.
+     o BSP_SDBENCH_Run() runs the read, write and erase tests over transfer
+       sizes of 1, 8, 64 and 256 blocks, the polling and DMA modes and the
+       queue with 4 requests in flight.
+
+  + Results
+     o Each result is returned in a SDBENCH_ResultTypeDef structure and, when
+       an Output function is configured, as a CSV line:
+         sdbench,op,access,mode,blocks,depth,requests,errors,kbps,mean_us,p50_us,p95_us,p99_us,max_us
+       preceded by a '#' header line, for regression tracking.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sdbench.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH STM324x9I EVAL SDBENCH
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Private_Variables STM324x9I EVAL SDBENCH Private Variables
+  * @{
+  */
+extern SD_HandleTypeDef uSdHandle;
+
+/* Transfer sizes in blocks of BSP_SDBENCH_Run() */
+static const uint16_t SdBenchSizes[] = {1, 8, 64, 256};
+
+/* Mode and depth pairs of BSP_SDBENCH_Run() */
+static const uint8_t SdBenchModes[][2] =
+{
+  {SDBENCH_MODE_POLLING, 1},
+  {SDBENCH_MODE_DMA,     1},
+  {SDBENCH_MODE_QUEUE,   4}
+};
+
+static const char * const SdBenchOperationNames[] = {"read", "write", "erase"};
+static const char * const SdBenchAccessNames[]    = {"seq", "random"};
+static const char * const SdBenchModeNames[]      = {"polling", "dma", "queue"};
+
+static struct
+{
+  SD_RequestTypeDef Request[SDBENCH_DEPTH_MAX];
+  uint32_t          Sample[SDBENCH_DEPTH_MAX];  /* Latency sample of each request slot */
+  uint32_t          Busy[SDBENCH_DEPTH_MAX];
+  uint32_t          *pLatency;
+  uint32_t          Seed;
+  __IO uint32_t     Stalled;    /* Requests left in the SD queue by a timed out test */
+}SdBench;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Private_FunctionPrototypes STM324x9I EVAL SDBENCH Private FunctionPrototypes
+  * @{
+  */
+static uint32_t BENCH_Address(SDBENCH_ConfigTypeDef *pConfig, uint32_t Access, uint32_t Blocks, uint32_t Index);
+static uint8_t  BENCH_Transfer(uint32_t Operation, uint32_t Mode, uint32_t *pData, uint32_t Block, uint32_t Blocks);
+static uint8_t  BENCH_WaitTransfer(void);
+static uint32_t BENCH_RunQueue(SDBENCH_ConfigTypeDef *pConfig, uint32_t Operation, uint32_t Access,
+                               uint32_t Blocks, uint32_t Depth, uint32_t *pErrors, uint32_t *pIssued);
+static uint8_t  BENCH_DrainQueue(void);
+static void     BENCH_RequestCallback(SD_RequestTypeDef *pRequest);
+static void     BENCH_Sort(uint32_t *pData, uint32_t Size);
+static char    *BENCH_PutString(char *pLine, const char *pString);
+static char    *BENCH_PutNumber(char *pLine, uint32_t Value);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Private_Functions STM324x9I EVAL SDBENCH Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Runs the benchmark test matrix.
+  * @param  pConfig: Pointer to the benchmark configuration
+  * @param  pResults: Array receiving the test results
+  * @param  MaxResults: Size of the result array
+  * @retval Number of tests run
+  */
+uint32_t BSP_SDBENCH_Run(SDBENCH_ConfigTypeDef *pConfig, SDBENCH_ResultTypeDef *pResults, uint32_t MaxResults)
+{
+  char line[SDBENCH_LINE_SIZE];
+  uint32_t operation, access, size, mode, blocks, depth;
+  uint32_t count = 0;
+
+  if(pConfig->Output != NULL)
+  {
+    BSP_SDBENCH_FormatHeader(line);
+    pConfig->Output(line);
+  }
+
+  for(operation = SDBENCH_OP_READ; operation <= SDBENCH_OP_ERASE; operation++)
+  {
+    if(((operation == SDBENCH_OP_WRITE) && ((pConfig->Flags & SDBENCH_FLAG_WRITE) == 0)) ||
+       ((operation == SDBENCH_OP_ERASE) && ((pConfig->Flags & SDBENCH_FLAG_ERASE) == 0)))
+    {
+      continue;
+    }
+
+    for(access = SDBENCH_ACCESS_SEQ; access <= SDBENCH_ACCESS_RANDOM; access++)
+    {
+      for(size = 0; size < (sizeof(SdBenchSizes) / sizeof(SdBenchSizes[0])); size++)
+      {
+        for(mode = 0; mode < (sizeof(SdBenchModes) / sizeof(SdBenchModes[0])); mode++)
+        {
+          blocks = SdBenchSizes[size];
+          depth  = SdBenchModes[mode][1];
+
+          /* Erases are blocking: a single mode */
+          if((operation == SDBENCH_OP_ERASE) && (SdBenchModes[mode][0] != SDBENCH_MODE_POLLING))
+          {
+            continue;
+          }
+
+          if((count >= MaxResults) || ((blocks * depth) > pConfig->BufferBlocks) || (blocks > pConfig->NbBlocks))
+          {
+            continue;
+          }
+
+          if(BSP_SDBENCH_RunTest(pConfig, operation, access, SdBenchModes[mode][0], blocks, depth,
+                                 &pResults[count]) != SDBENCH_OK)
+          {
+            continue;
+          }
+
+          if(pConfig->Output != NULL)
+          {
+            BSP_SDBENCH_FormatResult(&pResults[count], line);
+            pConfig->Output(line);
+          }
+          count++;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+/**
+  * @brief  Runs a benchmark test.
+  * @param  pConfig: Pointer to the benchmark configuration
+  * @param  Operation: SDBENCH_OP_READ, SDBENCH_OP_WRITE or SDBENCH_OP_ERASE
+  * @param  Access: SDBENCH_ACCESS_SEQ or SDBENCH_ACCESS_RANDOM
+  * @param  Mode: SDBENCH_MODE_POLLING, SDBENCH_MODE_DMA or SDBENCH_MODE_QUEUE
+  * @param  Blocks: Blocks per request
+  * @param  Depth: Requests in flight, 1 except for the queue mode
+  * @param  pResult: Pointer to the test result
+  * @retval SDBENCH status
+  */
+uint8_t BSP_SDBENCH_RunTest(SDBENCH_ConfigTypeDef *pConfig, uint32_t Operation, uint32_t Access, uint32_t Mode,
+                            uint32_t Blocks, uint32_t Depth, SDBENCH_ResultTypeDef *pResult)
+{
+  uint32_t index, start, elapsed = 0, errors = 0, count;
+  uint64_t total = 0;
+
+  if((pConfig->pBuffer == NULL) || (pConfig->pLatency == NULL) || (pConfig->Requests == 0) ||
+     (Blocks == 0) || (Blocks > pConfig->NbBlocks) || (Depth == 0) || (Depth > SDBENCH_DEPTH_MAX) ||
+     ((Blocks * Depth) > pConfig->BufferBlocks) || ((Mode != SDBENCH_MODE_QUEUE) && (Depth != 1)) ||
+     ((Operation == SDBENCH_OP_WRITE) && ((pConfig->Flags & SDBENCH_FLAG_WRITE) == 0)) ||
+     ((Operation == SDBENCH_OP_ERASE) && (((pConfig->Flags & SDBENCH_FLAG_ERASE) == 0) || (Mode != SDBENCH_MODE_POLLING))) ||
+     (Operation > SDBENCH_OP_ERASE))
+  {
+    return SDBENCH_ERROR;
+  }
+
+  /* The request slots are still linked in the SD queue */
+  if(SdBench.Stalled != 0)
+  {
+    if(BSP_SD_IsQueueIdle() == 0)
+    {
+      return SDBENCH_ERROR;
+    }
+    SdBench.Stalled = 0;
+  }
+
+  BSP_EnableCycleCounter();
+
+  SdBench.Seed     = 0x2545F491;
+  SdBench.pLatency = pConfig->pLatency;
+
+  if(Mode == SDBENCH_MODE_QUEUE)
+  {
+    elapsed = BENCH_RunQueue(pConfig, Operation, Access, Blocks, Depth, &errors, &count);
+    if(SdBench.Stalled != 0)
+    {
+      return SDBENCH_ERROR;
+    }
+  }
+  else
+  {
+    for(index = 0; index < pConfig->Requests; index++)
+    {
+      start = BSP_GetCycleCount();
+      if(BENCH_Transfer(Operation, Mode, pConfig->pBuffer, BENCH_Address(pConfig, Access, Blocks, index), Blocks) != SDBENCH_OK)
+      {
+        errors++;
+      }
+      pConfig->pLatency[index] = BSP_GetElapsedUs(start);
+      elapsed += pConfig->pLatency[index];
+    }
+    count = pConfig->Requests;
+  }
+
+  /* The requests a timed out test never issued have no latency */
+  for(index = 0; index < count; index++)
+  {
+    total += pConfig->pLatency[index];
+  }
+  BENCH_Sort(pConfig->pLatency, count);
+
+  pResult->Operation = Operation;
+  pResult->Access    = Access;
+  pResult->Mode      = Mode;
+  pResult->Blocks    = Blocks;
+  pResult->Depth     = Depth;
+  pResult->Requests  = pConfig->Requests;
+  pResult->Errors    = errors;
+  pResult->MeanUs    = (uint32_t)(total / count);
+  pResult->P50Us     = pConfig->pLatency[(count * 50) / 100];
+  pResult->P95Us     = pConfig->pLatency[(((count * 95) + 99) / 100) - 1];
+  pResult->P99Us     = pConfig->pLatency[(((count * 99) + 99) / 100) - 1];
+  pResult->MaxUs     = pConfig->pLatency[count - 1];
+
+  /* KiB/s of the successful requests */
+  if(elapsed != 0)
+  {
+    pResult->KBytesPerSec = (uint32_t)(((uint64_t)(pConfig->Requests - errors) * Blocks * SD_CACHE_BLOCK_SIZE * 1000000) /
+                                       ((uint64_t)elapsed * 1024));
+  }
+  else
+  {
+    pResult->KBytesPerSec = 0;
+  }
+
+  return SDBENCH_OK;
+}
+
+/**
+  * @brief  Formats the CSV header line of the results.
+  * @param  pLine: Line buffer of SDBENCH_LINE_SIZE characters
+  * @retval None
+  */
+void BSP_SDBENCH_FormatHeader(char *pLine)
+{
+  BENCH_PutString(pLine, "# sdbench,op,access,mode,blocks,depth,requests,errors,kbps,mean_us,p50_us,p95_us,p99_us,max_us");
+}
+
+/**
+  * @brief  Formats a test result as a CSV line.
+  * @param  pResult: Pointer to the test result
+  * @param  pLine: Line buffer of SDBENCH_LINE_SIZE characters
+  * @retval None
+  */
+void BSP_SDBENCH_FormatResult(SDBENCH_ResultTypeDef *pResult, char *pLine)
+{
+  uint32_t values[10];
+  uint32_t index;
+
+  values[0] = pResult->Blocks;
+  values[1] = pResult->Depth;
+  values[2] = pResult->Requests;
+  values[3] = pResult->Errors;
+  values[4] = pResult->KBytesPerSec;
+  values[5] = pResult->MeanUs;
+  values[6] = pResult->P50Us;
+  values[7] = pResult->P95Us;
+  values[8] = pResult->P99Us;
+  values[9] = pResult->MaxUs;
+
+  pLine = BENCH_PutString(pLine, "sdbench,");
+  pLine = BENCH_PutString(pLine, SdBenchOperationNames[pResult->Operation]);
+  pLine = BENCH_PutString(pLine, ",");
+  pLine = BENCH_PutString(pLine, SdBenchAccessNames[pResult->Access]);
+  pLine = BENCH_PutString(pLine, ",");
+  pLine = BENCH_PutString(pLine, SdBenchModeNames[pResult->Mode]);
+
+  for(index = 0; index < 10; index++)
+  {
+    pLine = BENCH_PutString(pLine, ",");
+    pLine = BENCH_PutNumber(pLine, values[index]);
+  }
+}
+
+/**
+  * @brief  Computes the block address of a request.
+  * @param  pConfig: Pointer to the benchmark configuration
+  * @param  Access: SDBENCH_ACCESS_SEQ or SDBENCH_ACCESS_RANDOM
+  * @param  Blocks: Blocks per request
+  * @param  Index: Request index
+  * @retval First block of the request, aligned to Blocks in the test area
+  */
+static uint32_t BENCH_Address(SDBENCH_ConfigTypeDef *pConfig, uint32_t Access, uint32_t Blocks, uint32_t Index)
+{
+  uint32_t slots = pConfig->NbBlocks / Blocks;
+
+  if(Access == SDBENCH_ACCESS_SEQ)
+  {
+    return pConfig->StartBlock + ((Index % slots) * Blocks);
+  }
+
+  /* xorshift32 */
+  SdBench.Seed ^= SdBench.Seed << 13;
+  SdBench.Seed ^= SdBench.Seed >> 17;
+  SdBench.Seed ^= SdBench.Seed << 5;
+
+  return pConfig->StartBlock + ((SdBench.Seed % slots) * Blocks);
+}
+
+/**
+  * @brief  Runs a request in polling or DMA mode.
+  * @param  Operation: SDBENCH_OP_READ, SDBENCH_OP_WRITE or SDBENCH_OP_ERASE
+  * @param  Mode: SDBENCH_MODE_POLLING or SDBENCH_MODE_DMA
+  * @param  pData: Transfer buffer
+  * @param  Block: First block
+  * @param  Blocks: Number of blocks
+  * @retval SDBENCH status
+  */
+static uint8_t BENCH_Transfer(uint32_t Operation, uint32_t Mode, uint32_t *pData, uint32_t Block, uint32_t Blocks)
+{
+  uint8_t status;
+
+  if(Operation == SDBENCH_OP_ERASE)
+  {
+    status = BSP_SD_Erase(Block, Block + Blocks - 1);
+  }
+  else if(Mode == SDBENCH_MODE_POLLING)
+  {
+    if(Operation == SDBENCH_OP_READ)
+    {
+      status = BSP_SD_ReadBlocks(pData, Block, Blocks, SD_DATATIMEOUT);
+    }
+    else
+    {
+      status = BSP_SD_WriteBlocks(pData, Block, Blocks, SD_DATATIMEOUT);
+    }
+  }
+  else
+  {
+    if(Operation == SDBENCH_OP_READ)
+    {
+      status = BSP_SD_ReadBlocks_DMA(pData, Block, Blocks);
+    }
+    else
+    {
+      status = BSP_SD_WriteBlocks_DMA(pData, Block, Blocks);
+    }
+
+    if(status == MSD_OK)
+    {
+      return BENCH_WaitTransfer();
+    }
+  }
+
+  /* The card may still program the written blocks */
+  if((status == MSD_OK) && (BENCH_WaitTransfer() != SDBENCH_OK))
+  {
+    status = MSD_ERROR;
+  }
+
+  return (status == MSD_OK) ? SDBENCH_OK : SDBENCH_ERROR;
+}
+
+/**
+  * @brief  Waits for the end of a transfer and for the card to be ready.
+  * @retval SDBENCH status
+  */
+static uint8_t BENCH_WaitTransfer(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while((HAL_SD_GetState(&uSdHandle) != HAL_SD_STATE_READY) || (BSP_SD_GetCardState() != SD_TRANSFER_OK))
+  {
+    if((HAL_GetTick() - tickstart) >= SDBENCH_TIMEOUT)
+    {
+      return SDBENCH_ERROR;
+    }
+  }
+
+  return (HAL_SD_GetError(&uSdHandle) == HAL_SD_ERROR_NONE) ? SDBENCH_OK : SDBENCH_ERROR;
+}
+
+/**
+  * @brief  Runs the requests of a test through the request queue.
+  * @param  pConfig: Pointer to the benchmark configuration
+  * @param  Operation: SDBENCH_OP_READ or SDBENCH_OP_WRITE
+  * @param  Access: SDBENCH_ACCESS_SEQ or SDBENCH_ACCESS_RANDOM
+  * @param  Blocks: Blocks per request
+  * @param  Depth: Requests in flight
+  * @param  pErrors: Pointer to the failed request counter
+  * @param  pIssued: Pointer to the number of requests issued, which have a latency
+  * @retval Elapsed time in us
+  */
+static uint32_t BENCH_RunQueue(SDBENCH_ConfigTypeDef *pConfig, uint32_t Operation, uint32_t Access,
+                               uint32_t Blocks, uint32_t Depth, uint32_t *pErrors, uint32_t *pIssued)
+{
+  SD_RequestTypeDef *request;
+  uint32_t cyclesperus = SystemCoreClock / 1000000;
+  uint32_t issued = 0, done = 0, slot;
+  uint32_t last, now, cycles = 0, elapsed = 0;
+  uint32_t tickstart = HAL_GetTick();
+
+  for(slot = 0; slot < Depth; slot++)
+  {
+    SdBench.Busy[slot] = 0;
+  }
+
+  last = BSP_GetCycleCount();
+  while(done < pConfig->Requests)
+  {
+    for(slot = 0; slot < Depth; slot++)
+    {
+      request = &SdBench.Request[slot];
+
+      /* Collect the completed request */
+      if((SdBench.Busy[slot] != 0) && (request->Status != SD_REQUEST_PENDING))
+      {
+        if(request->Status != MSD_OK)
+        {
+          (*pErrors)++;
+        }
+        SdBench.Busy[slot] = 0;
+        done++;
+        tickstart = HAL_GetTick();
+      }
+
+      /* Keep the queue full */
+      if((SdBench.Busy[slot] == 0) && (issued < pConfig->Requests))
+      {
+        request->Operation   = (Operation == SDBENCH_OP_READ) ? SD_REQUEST_READ : SD_REQUEST_WRITE;
+        request->Priority    = 0;
+        request->pData       = pConfig->pBuffer + (slot * Blocks * (SD_CACHE_BLOCK_SIZE / 4));
+        request->BlockAddr   = BENCH_Address(pConfig, Access, Blocks, issued);
+        request->NumOfBlocks = Blocks;
+        request->Callback    = BENCH_RequestCallback;
+        request->pContext    = NULL;
+        SdBench.Sample[slot] = issued;
+        SdBench.Busy[slot]   = 1;
+
+        if(BSP_SD_Submit(request) != MSD_OK)
+        {
+          pConfig->pLatency[issued] = 0;
+          request->Status = MSD_ERROR;
+        }
+        issued++;
+      }
+    }
+
+    BSP_SD_QueueProcess();
+
+    /* Wall time, accumulated in short steps to survive the counter wrap */
+    now     = BSP_GetCycleCount();
+    cycles += now - last;
+    last    = now;
+    if(cycles >= cyclesperus)
+    {
+      elapsed += cycles / cyclesperus;
+      cycles  %= cyclesperus;
+    }
+
+    if((HAL_GetTick() - tickstart) >= SDBENCH_TIMEOUT)
+    {
+      /* Requests still in flight are counted as failed, the slots are only
+         given back once the SD queue has completed them */
+      *pErrors += pConfig->Requests - done;
+      BENCH_DrainQueue();
+      break;
+    }
+  }
+
+  *pIssued = issued;
+
+  return elapsed;
+}
+
+/**
+  * @brief  Waits for the SD queue to complete the requests of a timed out test.
+  * @note   When the queue does not drain, the test is marked as stalled: the
+  *         latency buffer is no longer written and no test is run until the
+  *         queue is idle.
+  * @retval SDBENCH status
+  */
+static uint8_t BENCH_DrainQueue(void)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while(BSP_SD_IsQueueIdle() == 0)
+  {
+    BSP_SD_QueueProcess();
+
+    if((HAL_GetTick() - tickstart) >= SDBENCH_TIMEOUT)
+    {
+      SdBench.Stalled = 1;
+      return SDBENCH_ERROR;
+    }
+  }
+
+  return SDBENCH_OK;
+}
+
+/**
+  * @brief  Records the latency of a completed queued request.
+  * @param  pRequest: Completed request
+  * @retval None
+  */
+static void BENCH_RequestCallback(SD_RequestTypeDef *pRequest)
+{
+  uint32_t slot = pRequest - SdBench.Request;
+
+  /* The latency buffer may be reused by the application */
+  if(SdBench.Stalled != 0)
+  {
+    return;
+  }
+
+  SdBench.pLatency[SdBench.Sample[slot]] = BSP_GetElapsedUs(pRequest->SubmitCycles);
+}
+
+/**
+  * @brief  Sorts the latency samples in ascending order (shell sort).
+  * @param  pData: Samples
+  * @param  Size: Number of samples
+  * @retval None
+  */
+static void BENCH_Sort(uint32_t *pData, uint32_t Size)
+{
+  uint32_t gap, index, position, value;
+
+  for(gap = Size / 2; gap > 0; gap /= 2)
+  {
+    for(index = gap; index < Size; index++)
+    {
+      value = pData[index];
+      for(position = index; (position >= gap) && (pData[position - gap] > value); position -= gap)
+      {
+        pData[position] = pData[position - gap];
+      }
+      pData[position] = value;
+    }
+  }
+}
+
+/**
+  * @brief  Appends a string to a line.
+  * @param  pLine: End of the line
+  * @param  pString: String to append
+  * @retval New end of the line, null terminated
+  */
+static char *BENCH_PutString(char *pLine, const char *pString)
+{
+  while(*pString != '\0')
+  {
+    *pLine++ = *pString++;
+  }
+  *pLine = '\0';
+
+  return pLine;
+}
+
+/**
+  * @brief  Appends a decimal number to a line.
+  * @param  pLine: End of the line
+  * @param  Value: Number to append
+  * @retval New end of the line, null terminated
+  */
+static char *BENCH_PutNumber(char *pLine, uint32_t Value)
+{
+  char digits[10];
+  uint32_t count = 0;
+
+  do
+  {
+    digits[count++] = (char)('0' + (Value % 10));
+    Value /= 10;
+  } while(Value != 0);
+
+  while(count != 0)
+  {
+    *pLine++ = digits[--count];
+  }
+  *pLine = '\0';
+
+  return pLine;
+}
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
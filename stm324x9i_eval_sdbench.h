@@ -0,0 +1,149 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdbench.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_sdbench.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_SDBENCH_H
+#define __STM324x9I_EVAL_SDBENCH_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sd.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_SDBENCH
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Exported_Types STM324x9I EVAL SDBENCH Exported Types
+  * @{
+  */
+
+/**
+  * @brief  SD benchmark configuration
+  */
+typedef struct
+{
+  uint32_t *pBuffer;        /* Transfer buffer, word aligned, DMA reachable              */
+  uint32_t BufferBlocks;    /* Size of the transfer buffer in blocks                     */
+  uint32_t StartBlock;      /* First block of the test area                              */
+  uint32_t NbBlocks;        /* Size of the test area in blocks                           */
+  uint32_t Requests;        /* Requests per test                                         */
+  uint32_t *pLatency;       /* Latency samples, one word per request                     */
+  uint32_t Flags;           /* SDBENCH_FLAG_xxx, writes and erases destroy the test area */
+  void     (*Output)(char *pLine); /* Called with each CSV result line, can be NULL     */
+}SDBENCH_ConfigTypeDef;
+
+/**
+  * @brief  SD benchmark test result
+  */
+typedef struct
+{
+  uint32_t Operation;       /* SDBENCH_OP_xxx                                   */
+  uint32_t Access;          /* SDBENCH_ACCESS_xxx                               */
+  uint32_t Mode;            /* SDBENCH_MODE_xxx                                 */
+  uint32_t Blocks;          /* Blocks per request                               */
+  uint32_t Depth;           /* Requests in flight                               */
+  uint32_t Requests;        /* Completed requests                               */
+  uint32_t Errors;          /* Failed requests                                  */
+  uint32_t KBytesPerSec;    /* Throughput in KiB/s                              */
+  uint32_t MeanUs;          /* Mean request latency (us)                        */
+  uint32_t P50Us;           /* Median request latency (us)                      */
+  uint32_t P95Us;           /* 95th percentile request latency (us)             */
+  uint32_t P99Us;           /* 99th percentile request latency (us)             */
+  uint32_t MaxUs;           /* Maximum request latency (us)                     */
+}SDBENCH_ResultTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Exported_Constants STM324x9I EVAL SDBENCH Exported Constants
+  * @{
+  */
+/**
+  * @brief  SD benchmark status definition
+  */
+#define SDBENCH_OK               ((uint8_t)0x00)
+#define SDBENCH_ERROR            ((uint8_t)0x01)
+
+/**
+  * @brief  SD benchmark test parameters
+  */
+#define SDBENCH_OP_READ          ((uint32_t)0x00)
+#define SDBENCH_OP_WRITE         ((uint32_t)0x01)
+#define SDBENCH_OP_ERASE         ((uint32_t)0x02)
+
+#define SDBENCH_ACCESS_SEQ       ((uint32_t)0x00)
+#define SDBENCH_ACCESS_RANDOM    ((uint32_t)0x01)
+
+#define SDBENCH_MODE_POLLING     ((uint32_t)0x00)
+#define SDBENCH_MODE_DMA         ((uint32_t)0x01)
+#define SDBENCH_MODE_QUEUE       ((uint32_t)0x02)
+
+#define SDBENCH_FLAG_WRITE       ((uint32_t)0x01)
+#define SDBENCH_FLAG_ERASE       ((uint32_t)0x02)
+
+/* Maximum queue depth and request completion timeout (ms) */
+#define SDBENCH_DEPTH_MAX        ((uint32_t)8)
+#define SDBENCH_TIMEOUT          ((uint32_t)5000)
+
+/* Maximum length of a CSV result line, terminating null included */
+#define SDBENCH_LINE_SIZE        ((uint32_t)128)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDBENCH_Exported_Functions STM324x9I EVAL SDBENCH Exported Functions
+  * @{
+  */
+uint32_t BSP_SDBENCH_Run(SDBENCH_ConfigTypeDef *pConfig, SDBENCH_ResultTypeDef *pResults, uint32_t MaxResults);
+uint8_t  BSP_SDBENCH_RunTest(SDBENCH_ConfigTypeDef *pConfig, uint32_t Operation, uint32_t Access, uint32_t Mode,
+                             uint32_t Blocks, uint32_t Depth, SDBENCH_ResultTypeDef *pResult);
+void     BSP_SDBENCH_FormatHeader(char *pLine);
+void     BSP_SDBENCH_FormatResult(SDBENCH_ResultTypeDef *pResult, char *pLine);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_SDBENCH_H */
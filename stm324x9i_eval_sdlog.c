@@ -0,0 +1,879 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdlog.c
+  * @author  MCD Application Team
+  * @brief   This file includes a log-structured record store on the uSD card
+  *          mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver stores timestamped records, such as telemetry samples, in a raw
+     area of the SD card without file system: records are only appended, in
+     large sequential writes.
+   - The SD card driver must be initialized by the application (BSP_SD_Init()).
+     The writes are issued through the SD request queue (BSP_SD_Submit()).
+   - The log area must not be used by a file system.
+
+2. Driver description:
+---------------------
+  + Layout
+     o The log area is divided in NbSegments segments of SegmentBlocks blocks,
+       aligned on the erase group size of the card. Segments are written in
+       turn, the oldest one being erased when the log is full.
+     o The first block of a segment is its header: magic, sequence number and
+       timestamp of the first record. Records follow, each one made of its
+       length, a checksum, its timestamp and its data, padded to 4 bytes.
+       The length is stored in 16 bits: records are up to 64 KBytes - 1.
+       Timestamps must not decrease.
+
+  + Initialization
+     o BSP_SDLOG_Init() reads the segment headers to rebuild the segment index,
+       then scans the records of the last segment to find the end of the log.
+       A record torn by a power loss fails its checksum and ends the log.
+       The duration of this recovery is returned by BSP_SDLOG_GetStats().
+
+  + Writing
+     o BSP_SDLOG_Append() copies the record in one of two write buffers of
+       BufferBlocks blocks. A full buffer is written with a single multi-block
+       DMA request while the records are copied in the other one.
+     o BSP_SDLOG_Flush() writes the records still buffered and waits for the
+       end of the writes: only flushed records survive a power loss.
+
+  + Reading
+     o BSP_SDLOG_Seek() finds the segment of a timestamp in the segment index by
+       binary search, then the first record not older than the timestamp.
+     o BSP_SDLOG_Read() returns the records in order, from the oldest one when
+       no seek was done, until SDLOG_END. Buffered records are not read.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sdlog.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG STM324x9I EVAL SDLOG
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Private_Variables STM324x9I EVAL SDLOG Private Variables
+  * @{
+  */
+extern SD_HandleTypeDef uSdHandle;
+
+static struct
+{
+  SDLOG_ConfigTypeDef Config;
+  uint8_t           *pHalf[2];    /* Write buffers                                   */
+  uint8_t           *pRead;       /* Read block                                      */
+  uint32_t          ReadBlock;    /* Card block held by pRead, 0xFFFFFFFF when none  */
+  SD_RequestTypeDef Request[2];   /* Write request of each write buffer              */
+  SD_RequestTypeDef Erase;
+  uint32_t          Half;         /* Write buffer being filled                       */
+  uint32_t          HalfBase;     /* Segment block of the first block of the buffer  */
+  uint32_t          Fill;         /* Bytes in the write buffer                       */
+  uint32_t          Head;         /* Segment being written                           */
+  uint32_t          Count;        /* Segments holding records                        */
+  uint32_t          Sequence;     /* Sequence number of the head segment             */
+  uint32_t          Open;         /* Head segment open for appends                   */
+  uint32_t          Written;      /* Bytes of the head segment submitted to the card */
+  uint32_t          Segment;      /* Read cursor segment                             */
+  uint32_t          SegmentSequence; /* Read cursor segment sequence, 0 when unset   */
+  uint32_t          Offset;       /* Read cursor byte offset in its segment          */
+  uint32_t          BlocksRead;   /* Blocks read from the card                       */
+  SDLOG_StatsTypeDef Stats;
+}SdLog;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Private_FunctionPrototypes STM324x9I EVAL SDLOG Private FunctionPrototypes
+  * @{
+  */
+static uint8_t  SDLOG_Recover(void);
+static uint8_t  SDLOG_OpenSegment(uint32_t Timestamp);
+static uint8_t  SDLOG_SubmitHalf(uint32_t Switch);
+static uint8_t  SDLOG_Wait(SD_RequestTypeDef *pRequest);
+static uint8_t  SDLOG_WaitAll(void);
+static uint8_t  SDLOG_Put(uint8_t *pData, uint32_t Length);
+static uint8_t  SDLOG_Get(uint32_t Segment, uint32_t Offset, uint8_t *pData, uint32_t Length, uint32_t *pSum);
+static uint32_t SDLOG_Record(uint32_t Segment, uint32_t Offset, uint32_t Limit, uint32_t *pTimestamp, uint32_t *pLength);
+static uint32_t SDLOG_Oldest(void);
+static uint32_t SDLOG_GetWord(uint8_t *pData);
+static void     SDLOG_SetWord(uint8_t *pData, uint32_t Value);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Private_Functions STM324x9I EVAL SDLOG Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the log and recovers its content from the card.
+  * @param  pConfig: Pointer to the log configuration
+  * @retval SDLOG status
+  */
+uint8_t BSP_SDLOG_Init(SDLOG_ConfigTypeDef *pConfig)
+{
+  HAL_SD_CardCSDTypeDef csd;
+  uint32_t group;
+  uint32_t tickstart = HAL_GetTick();
+  uint8_t status;
+
+  if((pConfig->pBuffer == NULL) || (pConfig->pIndex == NULL) || (pConfig->BufferBlocks == 0) ||
+     (pConfig->NbSegments < 2) || (pConfig->SegmentBlocks < 2) || (pConfig->Priority >= SD_QUEUE_PRIORITIES) ||
+     (HAL_SD_GetCardCSD(&uSdHandle, &csd) != HAL_OK))
+  {
+    return SDLOG_ERROR;
+  }
+
+  /* Segments are erased whole: align them on the erase groups */
+  group = csd.EraseGrMul + 1;
+  if(((pConfig->StartBlock % group) != 0) || ((pConfig->SegmentBlocks % group) != 0))
+  {
+    return SDLOG_ERROR;
+  }
+
+  BSP_EnableCycleCounter();
+
+  SdLog.Config    = *pConfig;
+  SdLog.pHalf[0]  = (uint8_t *)pConfig->pBuffer;
+  SdLog.pHalf[1]  = SdLog.pHalf[0] + (pConfig->BufferBlocks * SDLOG_BLOCK_SIZE);
+  SdLog.pRead     = SdLog.pHalf[1] + (pConfig->BufferBlocks * SDLOG_BLOCK_SIZE);
+  SdLog.ReadBlock = 0xFFFFFFFF;
+
+  SdLog.Request[0].Status = MSD_OK;
+  SdLog.Request[1].Status = MSD_OK;
+  SdLog.Erase.Status      = MSD_OK;
+
+  SdLog.Stats.Records    = 0;
+  SdLog.Stats.Bytes      = 0;
+  SdLog.Stats.Segments   = 0;
+  SdLog.Stats.Recycled   = 0;
+  SdLog.Stats.Flushes    = 0;
+  SdLog.Stats.Stalls     = 0;
+  SdLog.Stats.MaxStallUs = 0;
+  SdLog.Stats.Errors     = 0;
+
+  SdLog.SegmentSequence = 0;
+
+  status = SDLOG_Recover();
+
+  SdLog.Stats.RecoveryMs = HAL_GetTick() - tickstart;
+
+  return status;
+}
+
+/**
+  * @brief  Appends a record to the log.
+  * @param  Timestamp: Record timestamp, not lower than the one of the previous record
+  * @param  pData: Record data
+  * @param  Length: Record data length in bytes, up to SDLOG_RECORD_MAX_LENGTH
+  * @retval SDLOG status
+  */
+uint8_t BSP_SDLOG_Append(uint32_t Timestamp, uint8_t *pData, uint32_t Length)
+{
+  uint8_t header[SDLOG_RECORD_HEADER_SIZE];
+  uint8_t padding[4] = {0, 0, 0, 0};
+  uint32_t size = (SDLOG_RECORD_HEADER_SIZE + Length + 3) & ~(uint32_t)3;
+  uint32_t sum = Length, index;
+
+  if((Length == 0) || (Length > SDLOG_RECORD_MAX_LENGTH) ||
+     (size > ((SdLog.Config.SegmentBlocks - 1) * SDLOG_BLOCK_SIZE)))
+  {
+    return SDLOG_ERROR;
+  }
+
+  /* Start the queued requests which were waiting for the card */
+  BSP_SD_QueueProcess();
+
+  /* Records do not span segments */
+  if((SdLog.Open == 0) ||
+     (((SdLog.HalfBase * SDLOG_BLOCK_SIZE) + SdLog.Fill + size) > (SdLog.Config.SegmentBlocks * SDLOG_BLOCK_SIZE)))
+  {
+    if(SDLOG_OpenSegment(Timestamp) != SDLOG_OK)
+    {
+      return SDLOG_ERROR;
+    }
+  }
+
+  SDLOG_SetWord(&header[4], Timestamp);
+  for(index = 4; index < SDLOG_RECORD_HEADER_SIZE; index++)
+  {
+    sum += header[index];
+  }
+  for(index = 0; index < Length; index++)
+  {
+    sum += pData[index];
+  }
+  header[0] = (uint8_t)Length;
+  header[1] = (uint8_t)(Length >> 8);
+  header[2] = (uint8_t)~sum;
+  header[3] = (uint8_t)(~sum >> 8);
+
+  if((SDLOG_Put(header, SDLOG_RECORD_HEADER_SIZE) != SDLOG_OK) || (SDLOG_Put(pData, Length) != SDLOG_OK) ||
+     (SDLOG_Put(padding, size - SDLOG_RECORD_HEADER_SIZE - Length) != SDLOG_OK))
+  {
+    return SDLOG_ERROR;
+  }
+
+  SdLog.Stats.Records++;
+  SdLog.Stats.Bytes += Length;
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Writes the buffered records to the card and waits for the end of the writes.
+  * @retval SDLOG status
+  */
+uint8_t BSP_SDLOG_Flush(void)
+{
+  uint8_t *pHalf = SdLog.pHalf[SdLog.Half];
+  uint32_t blocks, index;
+
+  if((SdLog.Open == 0) || (SdLog.Fill == 0))
+  {
+    return SDLOG_WaitAll();
+  }
+
+  SdLog.Stats.Flushes++;
+  blocks = SdLog.Fill / SDLOG_BLOCK_SIZE;
+
+  if((SDLOG_SubmitHalf(0) != SDLOG_OK) || (SDLOG_WaitAll() != SDLOG_OK))
+  {
+    return SDLOG_ERROR;
+  }
+
+  /* The last block is partial: keep appending to it from the start of the buffer */
+  if((SdLog.Fill != 0) && (blocks != 0))
+  {
+    for(index = 0; index < (SdLog.Fill - (blocks * SDLOG_BLOCK_SIZE)); index++)
+    {
+      pHalf[index] = pHalf[(blocks * SDLOG_BLOCK_SIZE) + index];
+    }
+    SdLog.HalfBase += blocks;
+    SdLog.Fill     -= blocks * SDLOG_BLOCK_SIZE;
+  }
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Moves the read cursor to the first record not older than a timestamp.
+  * @param  Timestamp: Timestamp to seek
+  * @retval SDLOG_OK, or SDLOG_END when every record is older
+  */
+uint8_t BSP_SDLOG_Seek(uint32_t Timestamp)
+{
+  uint32_t oldest = SDLOG_Oldest();
+  uint32_t low = 0, high, middle, segment, offset, timestamp, length, size;
+
+  if(SDLOG_WaitAll() != SDLOG_OK)
+  {
+    return SDLOG_ERROR;
+  }
+
+  if(SdLog.Count == 0)
+  {
+    return SDLOG_END;
+  }
+
+  /* Last segment starting at or before the timestamp */
+  high = SdLog.Count - 1;
+  while(low < high)
+  {
+    middle  = (low + high + 1) / 2;
+    segment = (oldest + middle) % SdLog.Config.NbSegments;
+    if(SdLog.Config.pIndex[segment].FirstTimestamp <= Timestamp)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+
+  segment = (oldest + low) % SdLog.Config.NbSegments;
+  offset  = SDLOG_BLOCK_SIZE;
+
+  SdLog.Segment         = segment;
+  SdLog.SegmentSequence = SdLog.Config.pIndex[segment].Sequence;
+
+  /* First record of the following segments not older than the timestamp */
+  for(;;)
+  {
+    size = SDLOG_Record(segment, offset, (segment == SdLog.Head) ? SdLog.Written : (SdLog.Config.SegmentBlocks * SDLOG_BLOCK_SIZE),
+                        &timestamp, &length);
+    if(size == 0)
+    {
+      if(segment == SdLog.Head)
+      {
+        SdLog.Offset = offset;
+        return SDLOG_END;
+      }
+      segment = (segment + 1) % SdLog.Config.NbSegments;
+      offset  = SDLOG_BLOCK_SIZE;
+      SdLog.Segment         = segment;
+      SdLog.SegmentSequence = SdLog.Config.pIndex[segment].Sequence;
+      continue;
+    }
+
+    if(timestamp >= Timestamp)
+    {
+      SdLog.Offset = offset;
+      return SDLOG_OK;
+    }
+    offset += size;
+  }
+}
+
+/**
+  * @brief  Reads the record at the read cursor and moves the cursor to the next one.
+  * @param  pTimestamp: Pointer to the record timestamp
+  * @param  pData: Buffer receiving the record data
+  * @param  MaxLength: Size of the buffer
+  * @param  pLength: Pointer to the record data length
+  * @retval SDLOG_OK, SDLOG_END after the last record, or SDLOG_ERROR when the
+  *         record is larger than the buffer
+  */
+uint8_t BSP_SDLOG_Read(uint32_t *pTimestamp, uint8_t *pData, uint32_t MaxLength, uint32_t *pLength)
+{
+  uint32_t size, limit, sum;
+
+  if(SDLOG_WaitAll() != SDLOG_OK)
+  {
+    return SDLOG_ERROR;
+  }
+
+  if(SdLog.Count == 0)
+  {
+    return SDLOG_END;
+  }
+
+  /* No seek yet, or the segment of the cursor was erased */
+  if((SdLog.SegmentSequence == 0) || (SdLog.Config.pIndex[SdLog.Segment].Sequence != SdLog.SegmentSequence))
+  {
+    SdLog.Segment         = SDLOG_Oldest();
+    SdLog.SegmentSequence = SdLog.Config.pIndex[SdLog.Segment].Sequence;
+    SdLog.Offset          = SDLOG_BLOCK_SIZE;
+  }
+
+  for(;;)
+  {
+    limit = (SdLog.Segment == SdLog.Head) ? SdLog.Written : (SdLog.Config.SegmentBlocks * SDLOG_BLOCK_SIZE);
+    size  = SDLOG_Record(SdLog.Segment, SdLog.Offset, limit, pTimestamp, pLength);
+    if(size != 0)
+    {
+      break;
+    }
+
+    if(SdLog.Segment == SdLog.Head)
+    {
+      return SDLOG_END;
+    }
+    SdLog.Segment         = (SdLog.Segment + 1) % SdLog.Config.NbSegments;
+    SdLog.SegmentSequence = SdLog.Config.pIndex[SdLog.Segment].Sequence;
+    SdLog.Offset          = SDLOG_BLOCK_SIZE;
+  }
+
+  if(*pLength > MaxLength)
+  {
+    return SDLOG_ERROR;
+  }
+
+  if(SDLOG_Get(SdLog.Segment, SdLog.Offset + SDLOG_RECORD_HEADER_SIZE, pData, *pLength, &sum) != SDLOG_OK)
+  {
+    return SDLOG_ERROR;
+  }
+  SdLog.Offset += size;
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Gets the SD log statistics.
+  * @param  pStats: Pointer to the statistics structure
+  * @retval None
+  */
+void BSP_SDLOG_GetStats(SDLOG_StatsTypeDef *pStats)
+{
+  *pStats = SdLog.Stats;
+}
+
+/**
+  * @brief  Rebuilds the segment index from the segment headers and finds the end of the log.
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_Recover(void)
+{
+  SDLOG_SegmentTypeDef *pIndex = SdLog.Config.pIndex;
+  uint32_t segments = SdLog.Config.NbSegments;
+  uint32_t segment, sequence, timestamp, check, offset, size, length, index;
+  uint32_t head = 0;
+
+  SdLog.Stats.RecoveredSegments = 0;
+  SdLog.BlocksRead = 0;
+
+  for(segment = 0; segment < segments; segment++)
+  {
+    pIndex[segment].Sequence       = 0;
+    pIndex[segment].FirstTimestamp = 0;
+
+    if(SDLOG_Get(segment, 0, NULL, 0, &check) != SDLOG_OK)
+    {
+      return SDLOG_ERROR;
+    }
+
+    sequence  = SDLOG_GetWord(&SdLog.pRead[4]);
+    timestamp = SDLOG_GetWord(&SdLog.pRead[8]);
+    check     = SDLOG_GetWord(&SdLog.pRead[0]) ^ sequence ^ timestamp ^ SDLOG_GetWord(&SdLog.pRead[12]);
+    if((SDLOG_GetWord(&SdLog.pRead[0]) == SDLOG_MAGIC) && (sequence != 0) &&
+       (SDLOG_GetWord(&SdLog.pRead[12]) == SdLog.Config.SegmentBlocks) && (SDLOG_GetWord(&SdLog.pRead[16]) == ~check))
+    {
+      pIndex[segment].Sequence       = sequence;
+      pIndex[segment].FirstTimestamp = timestamp;
+      if(sequence > pIndex[head].Sequence)
+      {
+        head = segment;
+      }
+    }
+  }
+
+  SdLog.Half     = 0;
+  SdLog.HalfBase = 0;
+  SdLog.Fill     = 0;
+
+  if(pIndex[head].Sequence == 0)
+  {
+    /* Empty log: the first segment opened is the segment 0 */
+    SdLog.Head     = segments - 1;
+    SdLog.Count    = 0;
+    SdLog.Sequence = 0;
+    SdLog.Open     = 0;
+    SdLog.Written  = 0;
+    SdLog.Stats.RecoveryBlocks = SdLog.BlocksRead;
+    return SDLOG_OK;
+  }
+
+  /* The log is made of the segments preceding the head with consecutive sequence numbers */
+  SdLog.Head     = head;
+  SdLog.Sequence = pIndex[head].Sequence;
+  SdLog.Count    = 1;
+  while((SdLog.Count < segments) &&
+        (pIndex[(head + segments - SdLog.Count) % segments].Sequence == (SdLog.Sequence - SdLog.Count)))
+  {
+    SdLog.Count++;
+  }
+  for(index = SdLog.Count; index < segments; index++)
+  {
+    pIndex[(head + segments - index) % segments].Sequence = 0;
+  }
+  SdLog.Stats.RecoveredSegments = SdLog.Count;
+
+  /* The end of the log is the first invalid record of the head segment */
+  offset = SDLOG_BLOCK_SIZE;
+  do
+  {
+    size = SDLOG_Record(head, offset, SdLog.Config.SegmentBlocks * SDLOG_BLOCK_SIZE, &timestamp, &length);
+    offset += size;
+  } while(size != 0);
+
+  /* Reload the partial last block to append to it */
+  SdLog.HalfBase = offset / SDLOG_BLOCK_SIZE;
+  SdLog.Fill     = offset % SDLOG_BLOCK_SIZE;
+  SdLog.Written  = offset;
+  SdLog.Open     = 1;
+  if(SdLog.Fill != 0)
+  {
+    if(SDLOG_Get(head, SdLog.HalfBase * SDLOG_BLOCK_SIZE, SdLog.pHalf[0], SdLog.Fill, &check) != SDLOG_OK)
+    {
+      return SDLOG_ERROR;
+    }
+  }
+  SdLog.Stats.RecoveryBlocks = SdLog.BlocksRead;
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Closes the head segment and opens the next one, erasing it.
+  * @param  Timestamp: Timestamp of the first record of the segment
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_OpenSegment(uint32_t Timestamp)
+{
+  SDLOG_SegmentTypeDef *pIndex = SdLog.Config.pIndex;
+  uint8_t *pHeader;
+  uint32_t segment = (SdLog.Head + 1) % SdLog.Config.NbSegments;
+  uint32_t index;
+
+  /* Write the end of the head segment */
+  if((SdLog.Open != 0) && (SdLog.Fill != 0))
+  {
+    if(SDLOG_SubmitHalf(1) != SDLOG_OK)
+    {
+      return SDLOG_ERROR;
+    }
+  }
+
+  if(SDLOG_Wait(&SdLog.Erase) != SDLOG_OK)
+  {
+    return SDLOG_ERROR;
+  }
+
+  if(pIndex[segment].Sequence != 0)
+  {
+    SdLog.Stats.Recycled++;
+    SdLog.Count--;
+  }
+
+  /* Erase the segment: its stale records must not follow the new ones */
+  SdLog.Erase.Operation   = SD_REQUEST_ERASE;
+  SdLog.Erase.Priority    = SdLog.Config.Priority;
+  SdLog.Erase.pData       = NULL;
+  SdLog.Erase.BlockAddr   = SdLog.Config.StartBlock + (segment * SdLog.Config.SegmentBlocks);
+  SdLog.Erase.NumOfBlocks = SdLog.Config.SegmentBlocks;
+  SdLog.Erase.Callback    = NULL;
+  SdLog.Erase.pContext    = NULL;
+  if(BSP_SD_Submit(&SdLog.Erase) != MSD_OK)
+  {
+    SdLog.Stats.Errors++;
+    return SDLOG_ERROR;
+  }
+
+  SdLog.Sequence++;
+  pIndex[segment].Sequence       = SdLog.Sequence;
+  pIndex[segment].FirstTimestamp = Timestamp;
+
+  SdLog.Head      = segment;
+  SdLog.ReadBlock = 0xFFFFFFFF;
+  SdLog.Count++;
+  SdLog.Open     = 1;
+  SdLog.HalfBase = 0;
+  SdLog.Written  = 0;
+  SdLog.Stats.Segments++;
+
+  /* The segment header is written with the first records */
+  pHeader = SdLog.pHalf[SdLog.Half];
+  SDLOG_SetWord(&pHeader[0], SDLOG_MAGIC);
+  SDLOG_SetWord(&pHeader[4], SdLog.Sequence);
+  SDLOG_SetWord(&pHeader[8], Timestamp);
+  SDLOG_SetWord(&pHeader[12], SdLog.Config.SegmentBlocks);
+  SDLOG_SetWord(&pHeader[16], ~(SDLOG_MAGIC ^ SdLog.Sequence ^ Timestamp ^ SdLog.Config.SegmentBlocks));
+  for(index = 20; index < SDLOG_BLOCK_SIZE; index++)
+  {
+    pHeader[index] = 0;
+  }
+  SdLog.Fill = SDLOG_BLOCK_SIZE;
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Writes the write buffer being filled and switches to the other one.
+  * @note   A partial last block is padded with zeros, which end the records.
+  * @param  Switch: 0 to keep filling a buffer ending with a partial block
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_SubmitHalf(uint32_t Switch)
+{
+  SD_RequestTypeDef *pRequest = &SdLog.Request[SdLog.Half];
+  uint8_t *pHalf = SdLog.pHalf[SdLog.Half];
+  uint32_t blocks = (SdLog.Fill + SDLOG_BLOCK_SIZE - 1) / SDLOG_BLOCK_SIZE;
+  uint32_t index;
+
+  for(index = SdLog.Fill; index < (blocks * SDLOG_BLOCK_SIZE); index++)
+  {
+    pHalf[index] = 0;
+  }
+
+  pRequest->Operation   = SD_REQUEST_WRITE;
+  pRequest->Priority    = SdLog.Config.Priority;
+  pRequest->pData       = (uint32_t *)pHalf;
+  pRequest->BlockAddr   = SdLog.Config.StartBlock + (SdLog.Head * SdLog.Config.SegmentBlocks) + SdLog.HalfBase;
+  pRequest->NumOfBlocks = blocks;
+  pRequest->Callback    = NULL;
+  pRequest->pContext    = NULL;
+  if(BSP_SD_Submit(pRequest) != MSD_OK)
+  {
+    SdLog.Stats.Errors++;
+    return SDLOG_ERROR;
+  }
+
+  SdLog.Written   = (SdLog.HalfBase * SDLOG_BLOCK_SIZE) + SdLog.Fill;
+  SdLog.ReadBlock = 0xFFFFFFFF;
+
+  /* A flushed buffer keeps its partial block, a full one is replaced */
+  if((Switch != 0) || ((SdLog.Fill % SDLOG_BLOCK_SIZE) == 0))
+  {
+    SdLog.Half     ^= 1;
+    SdLog.HalfBase += blocks;
+    SdLog.Fill      = 0;
+
+    /* The other buffer must be written before it is filled again */
+    return SDLOG_Wait(&SdLog.Request[SdLog.Half]);
+  }
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Waits for the completion of a request.
+  * @param  pRequest: Pointer to the request
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_Wait(SD_RequestTypeDef *pRequest)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t start = BSP_GetCycleCount();
+  uint32_t duration;
+
+  if(pRequest->Status == SD_REQUEST_PENDING)
+  {
+    SdLog.Stats.Stalls++;
+    while(pRequest->Status == SD_REQUEST_PENDING)
+    {
+      BSP_SD_QueueProcess();
+      if((HAL_GetTick() - tickstart) >= SDLOG_TIMEOUT)
+      {
+        SdLog.Stats.Errors++;
+        return SDLOG_ERROR;
+      }
+    }
+
+    duration = BSP_GetElapsedUs(start);
+    if(duration > SdLog.Stats.MaxStallUs)
+    {
+      SdLog.Stats.MaxStallUs = duration;
+    }
+
+    if(pRequest->Status != MSD_OK)
+    {
+      SdLog.Stats.Errors++;
+      return SDLOG_ERROR;
+    }
+  }
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Waits for the completion of every request.
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_WaitAll(void)
+{
+  uint8_t status = SDLOG_OK;
+
+  if((SDLOG_Wait(&SdLog.Erase) != SDLOG_OK) || (SDLOG_Wait(&SdLog.Request[0]) != SDLOG_OK) ||
+     (SDLOG_Wait(&SdLog.Request[1]) != SDLOG_OK))
+  {
+    status = SDLOG_ERROR;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Copies data in the write buffers, writing the full ones.
+  * @param  pData: Data to copy
+  * @param  Length: Length in bytes
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_Put(uint8_t *pData, uint32_t Length)
+{
+  uint8_t *pHalf;
+  uint32_t capacity, count, index;
+
+  while(Length != 0)
+  {
+    /* A write buffer does not span segments */
+    capacity = SdLog.Config.SegmentBlocks - SdLog.HalfBase;
+    if(capacity > SdLog.Config.BufferBlocks)
+    {
+      capacity = SdLog.Config.BufferBlocks;
+    }
+    capacity *= SDLOG_BLOCK_SIZE;
+
+    count = capacity - SdLog.Fill;
+    if(count > Length)
+    {
+      count = Length;
+    }
+
+    pHalf = SdLog.pHalf[SdLog.Half] + SdLog.Fill;
+    for(index = 0; index < count; index++)
+    {
+      pHalf[index] = pData[index];
+    }
+    pData      += count;
+    Length     -= count;
+    SdLog.Fill += count;
+
+    if(SdLog.Fill == capacity)
+    {
+      if(SDLOG_SubmitHalf(1) != SDLOG_OK)
+      {
+        return SDLOG_ERROR;
+      }
+    }
+  }
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Reads data from a segment through the read block.
+  * @param  Segment: Segment
+  * @param  Offset: Byte offset in the segment
+  * @param  pData: Buffer receiving the data, NULL to only compute their sum
+  * @param  Length: Length in bytes, 0 to only load the block of the offset
+  * @param  pSum: Pointer to the byte sum of the data
+  * @retval SDLOG status
+  */
+static uint8_t SDLOG_Get(uint32_t Segment, uint32_t Offset, uint8_t *pData, uint32_t Length, uint32_t *pSum)
+{
+  uint32_t block, position;
+
+  *pSum = 0;
+
+  do
+  {
+    block = SdLog.Config.StartBlock + (Segment * SdLog.Config.SegmentBlocks) + (Offset / SDLOG_BLOCK_SIZE);
+    if(block != SdLog.ReadBlock)
+    {
+      SdLog.ReadBlock = 0xFFFFFFFF;
+      if(BSP_SD_ReadBlocks((uint32_t *)SdLog.pRead, block, 1, SD_DATATIMEOUT) != MSD_OK)
+      {
+        SdLog.Stats.Errors++;
+        return SDLOG_ERROR;
+      }
+      SdLog.ReadBlock = block;
+      SdLog.BlocksRead++;
+    }
+
+    for(position = Offset % SDLOG_BLOCK_SIZE; (position < SDLOG_BLOCK_SIZE) && (Length != 0); position++)
+    {
+      *pSum += SdLog.pRead[position];
+      if(pData != NULL)
+      {
+        *pData++ = SdLog.pRead[position];
+      }
+      Offset++;
+      Length--;
+    }
+  } while(Length != 0);
+
+  return SDLOG_OK;
+}
+
+/**
+  * @brief  Checks the record at an offset of a segment.
+  * @param  Segment: Segment
+  * @param  Offset: Byte offset of the record in the segment
+  * @param  Limit: Byte offset of the end of the written records
+  * @param  pTimestamp: Pointer to the record timestamp
+  * @param  pLength: Pointer to the record data length
+  * @retval Record size in bytes, 0 when no valid record is found
+  */
+static uint32_t SDLOG_Record(uint32_t Segment, uint32_t Offset, uint32_t Limit, uint32_t *pTimestamp, uint32_t *pLength)
+{
+  uint8_t header[SDLOG_RECORD_HEADER_SIZE];
+  uint32_t sum, data, size;
+
+  if(((Offset + SDLOG_RECORD_HEADER_SIZE) > Limit) ||
+     (SDLOG_Get(Segment, Offset, header, SDLOG_RECORD_HEADER_SIZE, &sum) != SDLOG_OK))
+  {
+    return 0;
+  }
+
+  *pLength   = header[0] | ((uint32_t)header[1] << 8);
+  *pTimestamp = SDLOG_GetWord(&header[4]);
+  size = (SDLOG_RECORD_HEADER_SIZE + *pLength + 3) & ~(uint32_t)3;
+
+  /* Erased blocks and the zero padding give a null or oversized length */
+  if((*pLength == 0) || ((Offset + size) > Limit) ||
+     (SDLOG_Get(Segment, Offset + SDLOG_RECORD_HEADER_SIZE, NULL, *pLength, &data) != SDLOG_OK))
+  {
+    return 0;
+  }
+
+  sum = *pLength + data + header[4] + header[5] + header[6] + header[7];
+  if((uint16_t)~sum != (header[2] | ((uint32_t)header[3] << 8)))
+  {
+    return 0;
+  }
+
+  return size;
+}
+
+/**
+  * @brief  Gets the oldest segment of the log.
+  * @retval Segment
+  */
+static uint32_t SDLOG_Oldest(void)
+{
+  return (SdLog.Head + SdLog.Config.NbSegments + 1 - SdLog.Count) % SdLog.Config.NbSegments;
+}
+
+/**
+  * @brief  Reads a little endian word.
+  * @param  pData: Pointer to the word bytes
+  * @retval Word
+  */
+static uint32_t SDLOG_GetWord(uint8_t *pData)
+{
+  return pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+/**
+  * @brief  Writes a little endian word.
+  * @param  pData: Pointer to the word bytes
+  * @param  Value: Word
+  * @retval None
+  */
+static void SDLOG_SetWord(uint8_t *pData, uint32_t Value)
+{
+  pData[0] = (uint8_t)Value;
+  pData[1] = (uint8_t)(Value >> 8);
+  pData[2] = (uint8_t)(Value >> 16);
+  pData[3] = (uint8_t)(Value >> 24);
+}
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
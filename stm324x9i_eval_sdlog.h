@@ -0,0 +1,147 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdlog.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_sdlog.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_SDLOG_H
+#define __STM324x9I_EVAL_SDLOG_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sd.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_SDLOG
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Exported_Types STM324x9I EVAL SDLOG Exported Types
+  * @{
+  */
+
+/**
+  * @brief  SD log segment index entry
+  */
+typedef struct
+{
+  uint32_t Sequence;        /* Segment sequence number, 0 when the segment is unused */
+  uint32_t FirstTimestamp;  /* Timestamp of the first record of the segment          */
+}SDLOG_SegmentTypeDef;
+
+/**
+  * @brief  SD log configuration
+  */
+typedef struct
+{
+  uint32_t *pBuffer;        /* BSP_SDLOG_BUFFER_SIZE() bytes, word aligned, DMA reachable */
+  uint32_t BufferBlocks;    /* Blocks of each of the two write buffers                    */
+  SDLOG_SegmentTypeDef *pIndex; /* Segment index, one entry per segment                   */
+  uint32_t StartBlock;      /* First block of the log area, aligned on an erase group     */
+  uint32_t NbSegments;      /* Number of segments of the log area                         */
+  uint32_t SegmentBlocks;   /* Segment size in blocks, multiple of the erase group size   */
+  uint32_t Priority;        /* Priority class of the SD requests                          */
+}SDLOG_ConfigTypeDef;
+
+/**
+  * @brief  SD log statistics
+  */
+typedef struct
+{
+  uint32_t Records;         /* Records appended                                 */
+  uint32_t Bytes;           /* Record data bytes appended                       */
+  uint32_t Segments;        /* Segments opened                                  */
+  uint32_t Recycled;        /* Oldest segments erased to make room              */
+  uint32_t Flushes;         /* Partial buffers written by BSP_SDLOG_Flush()     */
+  uint32_t Stalls;          /* Waits for a pending card request                 */
+  uint32_t MaxStallUs;      /* Longest wait for a pending card request (us)     */
+  uint32_t Errors;          /* Failed card requests                             */
+  uint32_t RecoveredSegments; /* Segments found by BSP_SDLOG_Init()             */
+  uint32_t RecoveryBlocks;  /* Blocks read by BSP_SDLOG_Init()                  */
+  uint32_t RecoveryMs;      /* Duration of BSP_SDLOG_Init() (ms)                */
+}SDLOG_StatsTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Exported_Constants STM324x9I EVAL SDLOG Exported Constants
+  * @{
+  */
+/**
+  * @brief  SD log status definition
+  */
+#define SDLOG_OK                 ((uint8_t)0x00)
+#define SDLOG_ERROR              ((uint8_t)0x01)
+#define SDLOG_END                ((uint8_t)0x02)
+
+#define SDLOG_BLOCK_SIZE         ((uint32_t)512)
+#define SDLOG_MAGIC              ((uint32_t)0x474F4C53)
+
+/* Record header: length, checksum and timestamp */
+#define SDLOG_RECORD_HEADER_SIZE ((uint32_t)8)
+/* Largest record data length, stored in 16 bits */
+#define SDLOG_RECORD_MAX_LENGTH  ((uint32_t)0xFFFF)
+
+/* Completion timeout of a card request in ms */
+#define SDLOG_TIMEOUT            ((uint32_t)5000)
+
+/* Log buffer memory size: two write buffers and a read block */
+#define BSP_SDLOG_BUFFER_SIZE(BufferBlocks)  ((((BufferBlocks) * 2) + 1) * SDLOG_BLOCK_SIZE)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDLOG_Exported_Functions STM324x9I EVAL SDLOG Exported Functions
+  * @{
+  */
+uint8_t BSP_SDLOG_Init(SDLOG_ConfigTypeDef *pConfig);
+uint8_t BSP_SDLOG_Append(uint32_t Timestamp, uint8_t *pData, uint32_t Length);
+uint8_t BSP_SDLOG_Flush(void);
+uint8_t BSP_SDLOG_Seek(uint32_t Timestamp);
+uint8_t BSP_SDLOG_Read(uint32_t *pTimestamp, uint8_t *pData, uint32_t MaxLength, uint32_t *pLength);
+void    BSP_SDLOG_GetStats(SDLOG_StatsTypeDef *pStats);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_SDLOG_H */
@@ -55,6 +55,8 @@
      o You can send a command to the SDRAM device in runtime using the function 
        BSP_SDRAM_Sendcmd(), and giving the desired command as parameter chosen between 
        the predefined commands of the "FMC_SDRAM_CommandTypeDef" structure. 
+     o The geometry of the SDRAM (rows, columns, internal banks) is returned by
+       BSP_SDRAM_GetGeometry(), once BSP_SDRAM_Init() has been called.
  
 ------------------------------------------------------------------------------*/
 
@@ -286,6 +288,24 @@ uint8_t BSP_SDRAM_Sendcmd(FMC_SDRAM_CommandTypeDef *SdramCmd)
   }
 }
 
+/**
+  * @brief  Gets the SDRAM geometry configured by BSP_SDRAM_Init().
+  * @param  pGeometry: Pointer to the SDRAM geometry
+  * @retval None
+  */
+void BSP_SDRAM_GetGeometry(SDRAM_GeometryTypeDef *pGeometry)
+{
+  pGeometry->ColumnBits = 8 + (sdramHandle.Init.ColumnBitsNumber - FMC_SDRAM_COLUMN_BITS_NUM_8);
+  pGeometry->RowBits    = 11 + ((sdramHandle.Init.RowBitsNumber - FMC_SDRAM_ROW_BITS_NUM_11) /
+                                (FMC_SDRAM_ROW_BITS_NUM_12 - FMC_SDRAM_ROW_BITS_NUM_11));
+  pGeometry->Banks      = (sdramHandle.Init.InternalBankNumber == FMC_SDRAM_INTERN_BANKS_NUM_4) ? 4 : 2;
+  pGeometry->BusWidth   = 1 << ((sdramHandle.Init.MemoryDataWidth - FMC_SDRAM_MEM_BUS_WIDTH_8) /
+                                (FMC_SDRAM_MEM_BUS_WIDTH_16 - FMC_SDRAM_MEM_BUS_WIDTH_8));
+  
+  /* The FMC maps the addresses as row, bank, column: a bank row is contiguous */
+  pGeometry->RowSize    = (1 << pGeometry->ColumnBits) * pGeometry->BusWidth;
+}
+
 /**
   * @brief  Handles SDRAM DMA transfer interrupt request.
   */
@@ -40,6 +40,25 @@
   * @{
   */    
 
+/** @defgroup STM324x9I_EVAL_SDRAM_Exported_Types STM324x9I EVAL SDRAM Exported Types
+  * @{
+  */
+
+/**
+  * @brief  SDRAM geometry, as configured by BSP_SDRAM_Init()
+  */
+typedef struct
+{
+  uint32_t ColumnBits;      /* Column address bits                                    */
+  uint32_t RowBits;         /* Row address bits                                       */
+  uint32_t Banks;           /* Internal banks                                         */
+  uint32_t BusWidth;        /* Data bus width in bytes                                */
+  uint32_t RowSize;         /* Bytes of a bank row, consecutive in the address space  */
+}SDRAM_GeometryTypeDef;
+/**
+  * @}
+  */
+
 /** @defgroup STM324x9I_EVAL_SDRAM_Exported_Constants STM324x9I EVAL SDRAM Exported Constants
   * @{
   */
@@ -95,6 +114,7 @@ uint8_t BSP_SDRAM_ReadData_DMA(uint32_t uwStartAddress, uint32_t *pData, uint32_
 uint8_t BSP_SDRAM_WriteData(uint32_t uwStartAddress, uint32_t *pData, uint32_t uwDataSize);
 uint8_t BSP_SDRAM_WriteData_DMA(uint32_t uwStartAddress, uint32_t *pData, uint32_t uwDataSize);
 uint8_t BSP_SDRAM_Sendcmd(FMC_SDRAM_CommandTypeDef *SdramCmd);
+void    BSP_SDRAM_GetGeometry(SDRAM_GeometryTypeDef *pGeometry);
 void    BSP_SDRAM_DMA_IRQHandler(void);  
 void    BSP_SDRAM_MspInit(void);   
 /**
@@ -0,0 +1,553 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdramalloc.c
+  * @author  MCD Application Team
+  * @brief   This file includes an allocator of the SDRAM memory mounted on
+  *          STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - This driver shares the SDRAM between its users (LCD frame buffers, audio and
+     camera buffers, DMA2D scratch buffers...) instead of each one picking raw
+     addresses, which leads to overlapping buffers.
+   - The SDRAM must be initialized first (BSP_SDRAM_Init()), then the allocator
+     by BSP_SDRAMALLOC_Init(), with SDRAM_DEVICE_ADDR and SDRAM_DEVICE_SIZE as
+     managed region.
+   - The allocator only computes addresses and never accesses the managed
+     region: it runs as well on a host, over a region got from malloc().
+
+2. Driver description:
+---------------------
+  + Pools
+     o The pools hold fixed-size buffers, such as the frame buffers or the audio
+       buffers, allocated by BSP_SDRAMALLOC_PoolAlloc(). They are placed from the
+       start of the region, in the configuration order: when the first pool is
+       the LCD frame buffer pool, its first buffer is LCD_FB_START_ADDRESS.
+       The buffer addresses are then given to BSP_LCD_LayerDefaultInit().
+     o The allocated buffers of a pool are tracked by a bitmap: a pool holds up
+       to SDRAMALLOC_POOL_MAX_BLOCKS buffers.
+
+  + Arena
+     o The rest of the region is an arena of variable-size blocks allocated by
+       BSP_SDRAMALLOC_Alloc(), with the alignment required by the DMA or DMA2D
+       user. The free block wasting the least memory is selected (best fit).
+       Freed blocks are merged with their free neighbors.
+     o BSP_SDRAMALLOC_AllocOffset() places a block at an offset from its
+       alignment, to choose the SDRAM internal bank where the block starts.
+     o The blocks are described by a table of SDRAMALLOC_MAX_BLOCKS entries in
+       internal RAM, so a DMA overrun in SDRAM cannot corrupt the allocator.
+
+  + Statistics
+     o BSP_SDRAMALLOC_GetPoolStats() and BSP_SDRAMALLOC_GetStats() return the
+       usage and its high watermark, the allocation failures and, for the arena,
+       the fragmentation of the free memory.
+
+  + Allocations and frees may be called from interrupt handlers.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sdramalloc.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC STM324x9I EVAL SDRAMALLOC
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Private_Variables STM324x9I EVAL SDRAMALLOC Private Variables
+  * @{
+  */
+static struct
+{
+  uint8_t  *pStart;
+  uint32_t Stride;
+  uint32_t NbBlocks;
+  uint32_t Map;             /* Allocated buffers, one bit per buffer */
+  uint32_t Used;
+  uint32_t MaxUsed;
+  uint32_t Failures;
+}SdramPool[SDRAMALLOC_MAX_POOLS];
+
+static struct
+{
+  uint32_t NbPools;
+  uint8_t  *pStart;
+  uint32_t Size;
+  struct
+  {
+    uint32_t Offset;        /* Block offset from the arena start */
+    uint32_t Size;
+    uint32_t Used;
+  }Block[SDRAMALLOC_MAX_BLOCKS]; /* Blocks sorted by offset, covering the arena */
+  uint32_t NbBlocks;
+  uint32_t Used;
+  uint32_t MaxUsed;
+  uint32_t Allocs;
+  uint32_t Frees;
+  uint32_t Failures;
+}SdramArena;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Private_FunctionPrototypes STM324x9I EVAL SDRAMALLOC Private FunctionPrototypes
+  * @{
+  */
+static uint32_t SDRAMALLOC_Padding(uint8_t *pAddress, uint32_t Alignment, uint32_t Offset);
+static void     SDRAMALLOC_Insert(uint32_t Index, uint32_t Offset, uint32_t Size);
+static void     SDRAMALLOC_Delete(uint32_t Index);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Private_Functions STM324x9I EVAL SDRAMALLOC Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the SDRAM allocator: places the pools and the arena.
+  * @param  pConfig: Pointer to the allocator configuration
+  * @retval SDRAMALLOC status
+  */
+uint8_t BSP_SDRAMALLOC_Init(SDRAMALLOC_ConfigTypeDef *pConfig)
+{
+  SDRAMALLOC_PoolConfigTypeDef *pPool;
+  uint32_t offset = 0, alignment, stride, size, index;
+
+  SdramArena.NbPools  = 0;
+  SdramArena.Size     = 0;
+  SdramArena.NbBlocks = 0;
+
+  if((pConfig->pBase == NULL) || (pConfig->NbPools > SDRAMALLOC_MAX_POOLS))
+  {
+    return SDRAMALLOC_ERROR;
+  }
+
+  for(index = 0; index < pConfig->NbPools; index++)
+  {
+    pPool = &pConfig->pPools[index];
+    alignment = (pPool->Alignment != 0) ? pPool->Alignment : SDRAMALLOC_ALIGNMENT;
+    if(((alignment & (alignment - 1)) != 0) || (pPool->BlockSize == 0) ||
+       (pPool->NbBlocks == 0) || (pPool->NbBlocks > SDRAMALLOC_POOL_MAX_BLOCKS))
+    {
+      return SDRAMALLOC_ERROR;
+    }
+
+    /* Consecutive buffers keep the pool alignment */
+    stride = (pPool->BlockSize + alignment - 1) & ~(alignment - 1);
+    offset += SDRAMALLOC_Padding(pConfig->pBase + offset, alignment, 0);
+    if((offset > pConfig->Size) || (stride > ((pConfig->Size - offset) / pPool->NbBlocks)))
+    {
+      return SDRAMALLOC_ERROR;
+    }
+
+    SdramPool[index].pStart   = pConfig->pBase + offset;
+    SdramPool[index].Stride   = stride;
+    SdramPool[index].NbBlocks = pPool->NbBlocks;
+    SdramPool[index].Map      = 0;
+    SdramPool[index].Used     = 0;
+    SdramPool[index].MaxUsed  = 0;
+    SdramPool[index].Failures = 0;
+    offset += stride * pPool->NbBlocks;
+  }
+
+  /* The arena takes the rest of the region */
+  offset += SDRAMALLOC_Padding(pConfig->pBase + offset, SDRAMALLOC_ALIGNMENT, 0);
+  size = (offset < pConfig->Size) ? ((pConfig->Size - offset) & ~(SDRAMALLOC_ALIGNMENT - 1)) : 0;
+
+  SdramArena.NbPools  = pConfig->NbPools;
+  SdramArena.pStart   = pConfig->pBase + offset;
+  SdramArena.Size     = size;
+  SdramArena.Used     = 0;
+  SdramArena.MaxUsed  = 0;
+  SdramArena.Allocs   = 0;
+  SdramArena.Frees    = 0;
+  SdramArena.Failures = 0;
+  if(size != 0)
+  {
+    SDRAMALLOC_Insert(0, 0, size);
+  }
+
+  return SDRAMALLOC_OK;
+}
+
+/**
+  * @brief  Allocates a buffer of a pool.
+  * @param  Pool: Pool index, in the configuration order
+  * @retval Buffer address, NULL when the pool is exhausted
+  */
+void *BSP_SDRAMALLOC_PoolAlloc(uint32_t Pool)
+{
+  uint8_t *pBlock = NULL;
+  uint32_t primask, index;
+
+  if(Pool >= SdramArena.NbPools)
+  {
+    return NULL;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for(index = 0; index < SdramPool[Pool].NbBlocks; index++)
+  {
+    if((SdramPool[Pool].Map & (1UL << index)) == 0)
+    {
+      SdramPool[Pool].Map |= (1UL << index);
+      pBlock = SdramPool[Pool].pStart + (index * SdramPool[Pool].Stride);
+      break;
+    }
+  }
+
+  if(pBlock != NULL)
+  {
+    SdramPool[Pool].Used++;
+    if(SdramPool[Pool].Used > SdramPool[Pool].MaxUsed)
+    {
+      SdramPool[Pool].MaxUsed = SdramPool[Pool].Used;
+    }
+  }
+  else
+  {
+    SdramPool[Pool].Failures++;
+  }
+
+  __set_PRIMASK(primask);
+
+  return pBlock;
+}
+
+/**
+  * @brief  Frees a buffer of a pool.
+  * @param  Pool: Pool index, in the configuration order
+  * @param  pBlock: Buffer address returned by BSP_SDRAMALLOC_PoolAlloc()
+  * @retval SDRAMALLOC status
+  */
+uint8_t BSP_SDRAMALLOC_PoolFree(uint32_t Pool, void *pBlock)
+{
+  uint32_t offset, index, primask;
+  uint8_t status = SDRAMALLOC_ERROR;
+
+  if((Pool >= SdramArena.NbPools) || ((uint8_t *)pBlock < SdramPool[Pool].pStart))
+  {
+    return SDRAMALLOC_ERROR;
+  }
+
+  offset = (uint32_t)((uint8_t *)pBlock - SdramPool[Pool].pStart);
+  index  = offset / SdramPool[Pool].Stride;
+  if(((offset % SdramPool[Pool].Stride) != 0) || (index >= SdramPool[Pool].NbBlocks))
+  {
+    return SDRAMALLOC_ERROR;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if((SdramPool[Pool].Map & (1UL << index)) != 0)
+  {
+    SdramPool[Pool].Map &= ~(1UL << index);
+    SdramPool[Pool].Used--;
+    status = SDRAMALLOC_OK;
+  }
+
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+/**
+  * @brief  Allocates a block of the arena.
+  * @param  Size: Block size in bytes
+  * @param  Alignment: Block alignment in bytes, power of 2, 0 for default
+  * @retval Block address, NULL when no free block fits
+  */
+void *BSP_SDRAMALLOC_Alloc(uint32_t Size, uint32_t Alignment)
+{
+  return BSP_SDRAMALLOC_AllocOffset(Size, Alignment, 0);
+}
+
+/**
+  * @brief  Allocates a block of the arena at a given offset from an alignment,
+  *         for instance to start a buffer in a given SDRAM internal bank.
+  * @param  Size: Block size in bytes
+  * @param  Alignment: Alignment in bytes, power of 2, 0 for default
+  * @param  Offset: Block address modulo Alignment, multiple of SDRAMALLOC_ALIGNMENT
+  * @retval Block address, NULL when no free block fits
+  */
+void *BSP_SDRAMALLOC_AllocOffset(uint32_t Size, uint32_t Alignment, uint32_t Offset)
+{
+  uint8_t *pBlock = NULL;
+  uint32_t primask, index, padding, waste, best = SDRAMALLOC_MAX_BLOCKS, bestpadding = 0, bestwaste = 0;
+  uint32_t needed;
+
+  if(Alignment == 0)
+  {
+    Alignment = SDRAMALLOC_ALIGNMENT;
+  }
+  if((Size == 0) || (Size > SdramArena.Size) || ((Alignment & (Alignment - 1)) != 0) ||
+     (Offset >= Alignment) || ((Offset & (SDRAMALLOC_ALIGNMENT - 1)) != 0))
+  {
+    /* The counter is also updated by allocations from interrupt context */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    SdramArena.Failures++;
+    __set_PRIMASK(primask);
+    return NULL;
+  }
+  Size = (Size + SDRAMALLOC_ALIGNMENT - 1) & ~(SDRAMALLOC_ALIGNMENT - 1);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  /* Best fit: the free block leaving the smallest remainder */
+  for(index = 0; index < SdramArena.NbBlocks; index++)
+  {
+    if(SdramArena.Block[index].Used != 0)
+    {
+      continue;
+    }
+    padding = SDRAMALLOC_Padding(SdramArena.pStart + SdramArena.Block[index].Offset, Alignment, Offset);
+    if((SdramArena.Block[index].Size < padding) || ((SdramArena.Block[index].Size - padding) < Size))
+    {
+      continue;
+    }
+    /* The alignment padding becomes a free block: it needs a table entry */
+    if((padding != 0) && (SdramArena.NbBlocks >= SDRAMALLOC_MAX_BLOCKS))
+    {
+      continue;
+    }
+    waste = SdramArena.Block[index].Size - padding - Size;
+    if((best == SDRAMALLOC_MAX_BLOCKS) || (waste < bestwaste))
+    {
+      best        = index;
+      bestpadding = padding;
+      bestwaste   = waste;
+    }
+  }
+
+  if(best != SDRAMALLOC_MAX_BLOCKS)
+  {
+    if(bestpadding != 0)
+    {
+      SdramArena.Block[best].Size = bestpadding;
+      SDRAMALLOC_Insert(best + 1, SdramArena.Block[best].Offset + bestpadding, Size + bestwaste);
+      best++;
+    }
+
+    /* Without a free table entry, the remainder stays in the allocated block */
+    needed = (bestwaste != 0) ? 1 : 0;
+    if((needed != 0) && (SdramArena.NbBlocks < SDRAMALLOC_MAX_BLOCKS))
+    {
+      SdramArena.Block[best].Size = Size;
+      SDRAMALLOC_Insert(best + 1, SdramArena.Block[best].Offset + Size, bestwaste);
+    }
+
+    SdramArena.Block[best].Used = 1;
+    SdramArena.Used += SdramArena.Block[best].Size;
+    if(SdramArena.Used > SdramArena.MaxUsed)
+    {
+      SdramArena.MaxUsed = SdramArena.Used;
+    }
+    SdramArena.Allocs++;
+    pBlock = SdramArena.pStart + SdramArena.Block[best].Offset;
+  }
+  else
+  {
+    SdramArena.Failures++;
+  }
+
+  __set_PRIMASK(primask);
+
+  return pBlock;
+}
+
+/**
+  * @brief  Frees a block of the arena.
+  * @param  pBlock: Block address returned by BSP_SDRAMALLOC_Alloc()
+  * @retval SDRAMALLOC status
+  */
+uint8_t BSP_SDRAMALLOC_Free(void *pBlock)
+{
+  uint32_t primask, index;
+  uint8_t status = SDRAMALLOC_ERROR;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for(index = 0; index < SdramArena.NbBlocks; index++)
+  {
+    if((SdramArena.pStart + SdramArena.Block[index].Offset) == (uint8_t *)pBlock)
+    {
+      break;
+    }
+  }
+
+  if((index < SdramArena.NbBlocks) && (SdramArena.Block[index].Used != 0))
+  {
+    SdramArena.Block[index].Used = 0;
+    SdramArena.Used -= SdramArena.Block[index].Size;
+    SdramArena.Frees++;
+
+    /* Merge with the free neighbors */
+    if(((index + 1) < SdramArena.NbBlocks) && (SdramArena.Block[index + 1].Used == 0))
+    {
+      SdramArena.Block[index].Size += SdramArena.Block[index + 1].Size;
+      SDRAMALLOC_Delete(index + 1);
+    }
+    if((index != 0) && (SdramArena.Block[index - 1].Used == 0))
+    {
+      SdramArena.Block[index - 1].Size += SdramArena.Block[index].Size;
+      SDRAMALLOC_Delete(index);
+    }
+    status = SDRAMALLOC_OK;
+  }
+
+  __set_PRIMASK(primask);
+
+  return status;
+}
+
+/**
+  * @brief  Gets the usage of a pool.
+  * @param  Pool: Pool index, in the configuration order
+  * @param  pStats: Pointer to the pool usage
+  * @retval SDRAMALLOC status
+  */
+uint8_t BSP_SDRAMALLOC_GetPoolStats(uint32_t Pool, SDRAMALLOC_PoolStatsTypeDef *pStats)
+{
+  if(Pool >= SdramArena.NbPools)
+  {
+    return SDRAMALLOC_ERROR;
+  }
+
+  pStats->pStart    = SdramPool[Pool].pStart;
+  pStats->BlockSize = SdramPool[Pool].Stride;
+  pStats->NbBlocks  = SdramPool[Pool].NbBlocks;
+  pStats->Used      = SdramPool[Pool].Used;
+  pStats->MaxUsed   = SdramPool[Pool].MaxUsed;
+  pStats->Failures  = SdramPool[Pool].Failures;
+
+  return SDRAMALLOC_OK;
+}
+
+/**
+  * @brief  Gets the usage and the fragmentation of the arena.
+  * @param  pStats: Pointer to the arena usage
+  * @retval None
+  */
+void BSP_SDRAMALLOC_GetStats(SDRAMALLOC_StatsTypeDef *pStats)
+{
+  uint32_t primask, index, free;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  pStats->pStart      = SdramArena.pStart;
+  pStats->Size        = SdramArena.Size;
+  pStats->Used        = SdramArena.Used;
+  pStats->MaxUsed     = SdramArena.MaxUsed;
+  pStats->Allocs      = SdramArena.Allocs;
+  pStats->Frees       = SdramArena.Frees;
+  pStats->Failures    = SdramArena.Failures;
+  pStats->LargestFree = 0;
+  pStats->FreeBlocks  = 0;
+  for(index = 0; index < SdramArena.NbBlocks; index++)
+  {
+    if(SdramArena.Block[index].Used == 0)
+    {
+      pStats->FreeBlocks++;
+      if(SdramArena.Block[index].Size > pStats->LargestFree)
+      {
+        pStats->LargestFree = SdramArena.Block[index].Size;
+      }
+    }
+  }
+
+  __set_PRIMASK(primask);
+
+  free = pStats->Size - pStats->Used;
+  pStats->Fragmentation = (free != 0) ? (100 - (uint32_t)(((uint64_t)pStats->LargestFree * 100) / free)) : 0;
+}
+
+/**
+  * @brief  Computes the padding moving an address at an offset from an alignment.
+  * @param  pAddress: Address
+  * @param  Alignment: Alignment in bytes, power of 2
+  * @param  Offset: Offset from the alignment, lower than Alignment
+  * @retval Padding in bytes
+  */
+static uint32_t SDRAMALLOC_Padding(uint8_t *pAddress, uint32_t Alignment, uint32_t Offset)
+{
+  return (Offset - ((uint32_t)pAddress & (Alignment - 1))) & (Alignment - 1);
+}
+
+/**
+  * @brief  Inserts a free block in the arena table.
+  * @param  Index: Table index of the new block
+  * @param  Offset: Block offset from the arena start
+  * @param  Size: Block size in bytes
+  * @retval None
+  */
+static void SDRAMALLOC_Insert(uint32_t Index, uint32_t Offset, uint32_t Size)
+{
+  uint32_t index;
+
+  for(index = SdramArena.NbBlocks; index > Index; index--)
+  {
+    SdramArena.Block[index] = SdramArena.Block[index - 1];
+  }
+  SdramArena.Block[Index].Offset = Offset;
+  SdramArena.Block[Index].Size   = Size;
+  SdramArena.Block[Index].Used   = 0;
+  SdramArena.NbBlocks++;
+}
+
+/**
+  * @brief  Deletes a block from the arena table.
+  * @param  Index: Table index of the block
+  * @retval None
+  */
+static void SDRAMALLOC_Delete(uint32_t Index)
+{
+  SdramArena.NbBlocks--;
+  for(; Index < SdramArena.NbBlocks; Index++)
+  {
+    SdramArena.Block[Index] = SdramArena.Block[Index + 1];
+  }
+}
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,157 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdramalloc.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_sdramalloc.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_SDRAMALLOC_H
+#define __STM324x9I_EVAL_SDRAMALLOC_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sdram.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_SDRAMALLOC
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Exported_Types STM324x9I EVAL SDRAMALLOC Exported Types
+  * @{
+  */
+
+/**
+  * @brief  SDRAM pool of fixed-size buffers
+  */
+typedef struct
+{
+  uint32_t BlockSize;       /* Buffer size in bytes                                   */
+  uint32_t NbBlocks;        /* Number of buffers, up to SDRAMALLOC_POOL_MAX_BLOCKS    */
+  uint32_t Alignment;       /* Buffer alignment in bytes, power of 2, 0 for default   */
+}SDRAMALLOC_PoolConfigTypeDef;
+
+/**
+  * @brief  SDRAM allocator configuration
+  */
+typedef struct
+{
+  uint8_t  *pBase;          /* Managed region, SDRAM_DEVICE_ADDR on the board         */
+  uint32_t Size;            /* Managed region size in bytes                           */
+  SDRAMALLOC_PoolConfigTypeDef *pPools; /* Pools, placed from the region start        */
+  uint32_t NbPools;         /* Number of pools, up to SDRAMALLOC_MAX_POOLS            */
+}SDRAMALLOC_ConfigTypeDef;
+
+/**
+  * @brief  SDRAM pool usage
+  */
+typedef struct
+{
+  uint8_t  *pStart;         /* First buffer of the pool                         */
+  uint32_t BlockSize;       /* Buffer stride in bytes, alignment included       */
+  uint32_t NbBlocks;        /* Number of buffers                                */
+  uint32_t Used;            /* Buffers allocated                                */
+  uint32_t MaxUsed;         /* High watermark of the allocated buffers          */
+  uint32_t Failures;        /* Allocations failed, pool exhausted               */
+}SDRAMALLOC_PoolStatsTypeDef;
+
+/**
+  * @brief  SDRAM arena usage
+  */
+typedef struct
+{
+  uint8_t  *pStart;         /* Arena start, after the pools                     */
+  uint32_t Size;            /* Arena size in bytes                              */
+  uint32_t Used;            /* Bytes allocated, alignment padding included      */
+  uint32_t MaxUsed;         /* High watermark of the allocated bytes            */
+  uint32_t LargestFree;     /* Largest free block in bytes                      */
+  uint32_t FreeBlocks;      /* Number of free blocks                            */
+  uint32_t Fragmentation;   /* Free bytes out of the largest free block (%)     */
+  uint32_t Allocs;          /* Allocations done                                 */
+  uint32_t Frees;           /* Blocks freed                                     */
+  uint32_t Failures;        /* Allocations failed                               */
+}SDRAMALLOC_StatsTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Exported_Constants STM324x9I EVAL SDRAMALLOC Exported Constants
+  * @{
+  */
+/**
+  * @brief  SDRAM allocator status definition
+  */
+#define SDRAMALLOC_OK            ((uint8_t)0x00)
+#define SDRAMALLOC_ERROR         ((uint8_t)0x01)
+
+/* Default alignment, enough for the DMA and DMA2D word accesses */
+#define SDRAMALLOC_ALIGNMENT     ((uint32_t)4)
+
+#if !defined(SDRAMALLOC_MAX_POOLS)
+ #define SDRAMALLOC_MAX_POOLS    ((uint32_t)4)
+#endif
+#define SDRAMALLOC_POOL_MAX_BLOCKS ((uint32_t)32)
+
+/* Arena blocks, free and allocated, tracked in internal RAM */
+#if !defined(SDRAMALLOC_MAX_BLOCKS)
+ #define SDRAMALLOC_MAX_BLOCKS   ((uint32_t)32)
+#endif
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMALLOC_Exported_Functions STM324x9I EVAL SDRAMALLOC Exported Functions
+  * @{
+  */
+uint8_t BSP_SDRAMALLOC_Init(SDRAMALLOC_ConfigTypeDef *pConfig);
+void    *BSP_SDRAMALLOC_PoolAlloc(uint32_t Pool);
+uint8_t BSP_SDRAMALLOC_PoolFree(uint32_t Pool, void *pBlock);
+void    *BSP_SDRAMALLOC_Alloc(uint32_t Size, uint32_t Alignment);
+void    *BSP_SDRAMALLOC_AllocOffset(uint32_t Size, uint32_t Alignment, uint32_t Offset);
+uint8_t BSP_SDRAMALLOC_Free(void *pBlock);
+uint8_t BSP_SDRAMALLOC_GetPoolStats(uint32_t Pool, SDRAMALLOC_PoolStatsTypeDef *pStats);
+void    BSP_SDRAMALLOC_GetStats(SDRAMALLOC_StatsTypeDef *pStats);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_SDRAMALLOC_H */
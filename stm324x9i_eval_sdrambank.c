@@ -0,0 +1,314 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdrambank.c
+  * @author  MCD Application Team
+  * @brief   This file includes a bank-aware placement of the buffers in the
+  *          SDRAM memory mounted on STM324x9I-EVAL evaluation board.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* File Info : -----------------------------------------------------------------
+                                   User NOTES
+1. How To use this driver:
+--------------------------
+   - The SDRAM has 4 internal banks, each one keeping one row open. An access to
+     another row of an open bank costs a precharge and an activation. This
+     driver places the buffers accessed together (LCD frame buffers, camera
+     buffers, DMA2D scratch buffers) so that they use different banks.
+   - BSP_SDRAMBANK_Init() is called with SDRAM_DEVICE_ADDR and the geometry
+     returned by BSP_SDRAM_GetGeometry(), after the SDRAM allocator
+     initialization (BSP_SDRAMALLOC_Init()).
+
+2. Driver description:
+---------------------
+  + Address mapping
+     o The FMC maps the addresses as row, bank, column: the banks alternate every
+       bank row (RowSize bytes, 2 KBytes on the board). A buffer larger than a
+       row thus spans every bank, and the buffers cannot be confined in a bank.
+     o The DMA2D, camera and LTDC transfers between buffers progress at the same
+       offset in each buffer. The planner starts the buffers in different banks,
+       so that the same offset of two buffers never falls in the same bank: both
+       rows then stay open.
+
+  + Placement
+     o BSP_SDRAMBANK_Plan() allocates a set of buffers used together from the
+       SDRAM allocator arena, each one starting in the least used bank, or in
+       the bank given by the caller. Up to RowSize x (Banks - 1) bytes of
+       padding are left free before each buffer.
+     o BSP_SDRAMBANK_Stride() returns a buffer size such that consecutive
+       buffers of an allocator pool, such as double frame buffers, start in
+       consecutive banks. It is used as BlockSize of the pool configuration.
+     o BSP_SDRAMBANK_GetBank() returns the bank of an address.
+
+  + Test
+     o BSP_SDRAMBANK_Test() compares the two placements on the SDRAM: it copies a
+       buffer to a destination starting in the same bank, then in the next bank,
+       and measures both throughputs. The content of the test area is lost.
+
+------------------------------------------------------------------------------*/
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval_sdrambank.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK STM324x9I EVAL SDRAMBANK
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Private_Variables STM324x9I EVAL SDRAMBANK Private Variables
+  * @{
+  */
+static struct
+{
+  uint8_t  *pBase;
+  uint32_t RowSize;
+  uint32_t Banks;
+  uint32_t Cycle;           /* Bytes between two rows of the same bank */
+}SdramBank;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Private_FunctionPrototypes STM324x9I EVAL SDRAMBANK Private FunctionPrototypes
+  * @{
+  */
+static uint32_t SDRAMBANK_Copy(uint32_t *pDestination, uint32_t *pSource, uint32_t NumOfWords);
+static uint32_t SDRAMBANK_KBytesPerSec(uint32_t Bytes, uint32_t Cycles);
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Private_Functions STM324x9I EVAL SDRAMBANK Private Functions
+  * @{
+  */
+
+/**
+  * @brief  Initializes the SDRAM bank planner.
+  * @param  pBase: SDRAM start address, SDRAM_DEVICE_ADDR on the board
+  * @param  pGeometry: Pointer to the SDRAM geometry
+  * @retval SDRAMBANK status
+  */
+uint8_t BSP_SDRAMBANK_Init(uint8_t *pBase, SDRAM_GeometryTypeDef *pGeometry)
+{
+  if((pGeometry->Banks == 0) || ((pGeometry->Banks & (pGeometry->Banks - 1)) != 0) ||
+     (pGeometry->RowSize < SDRAMALLOC_ALIGNMENT) || ((pGeometry->RowSize & (pGeometry->RowSize - 1)) != 0))
+  {
+    return SDRAMBANK_ERROR;
+  }
+
+  SdramBank.pBase   = pBase;
+  SdramBank.RowSize = pGeometry->RowSize;
+  SdramBank.Banks   = pGeometry->Banks;
+  SdramBank.Cycle   = pGeometry->RowSize * pGeometry->Banks;
+
+  return SDRAMBANK_OK;
+}
+
+/**
+  * @brief  Gets the SDRAM bank of an address.
+  * @param  pAddress: SDRAM address
+  * @retval Bank index
+  */
+uint32_t BSP_SDRAMBANK_GetBank(void *pAddress)
+{
+  return ((uint32_t)((uint8_t *)pAddress - SdramBank.pBase) / SdramBank.RowSize) % SdramBank.Banks;
+}
+
+/**
+  * @brief  Gets the buffer stride starting consecutive buffers in consecutive banks.
+  * @param  Size: Buffer size in bytes
+  * @retval Stride in bytes, not lower than Size
+  */
+uint32_t BSP_SDRAMBANK_Stride(uint32_t Size)
+{
+  if(Size <= SdramBank.RowSize)
+  {
+    return SdramBank.RowSize;
+  }
+
+  return (((Size - SdramBank.RowSize + SdramBank.Cycle - 1) / SdramBank.Cycle) * SdramBank.Cycle) + SdramBank.RowSize;
+}
+
+/**
+  * @brief  Allocates a set of buffers accessed together in different banks.
+  * @param  pBuffers: Buffers to place, their address and bank are set
+  * @param  NbBuffers: Number of buffers
+  * @retval SDRAMBANK status, no buffer is allocated on error
+  */
+uint8_t BSP_SDRAMBANK_Plan(SDRAMBANK_BufferTypeDef *pBuffers, uint32_t NbBuffers)
+{
+  uint32_t users[4] = {0};
+  uint32_t index, bank, offset;
+
+  if((SdramBank.Banks == 0) || (SdramBank.Banks > 4))
+  {
+    return SDRAMBANK_ERROR;
+  }
+
+  /* Banks requested by the caller first */
+  for(index = 0; index < NbBuffers; index++)
+  {
+    if(pBuffers[index].Bank != SDRAMBANK_ANY)
+    {
+      if(pBuffers[index].Bank >= SdramBank.Banks)
+      {
+        return SDRAMBANK_ERROR;
+      }
+      users[pBuffers[index].Bank]++;
+    }
+  }
+
+  for(index = 0; index < NbBuffers; index++)
+  {
+    if(pBuffers[index].Bank == SDRAMBANK_ANY)
+    {
+      pBuffers[index].Bank = 0;
+      for(bank = 1; bank < SdramBank.Banks; bank++)
+      {
+        if(users[bank] < users[pBuffers[index].Bank])
+        {
+          pBuffers[index].Bank = bank;
+        }
+      }
+      users[pBuffers[index].Bank]++;
+    }
+
+    offset = ((uint32_t)SdramBank.pBase + (pBuffers[index].Bank * SdramBank.RowSize)) & (SdramBank.Cycle - 1);
+    pBuffers[index].pAddress = BSP_SDRAMALLOC_AllocOffset(pBuffers[index].Size, SdramBank.Cycle, offset);
+    if(pBuffers[index].pAddress == NULL)
+    {
+      while(index-- != 0)
+      {
+        BSP_SDRAMALLOC_Free(pBuffers[index].pAddress);
+        pBuffers[index].pAddress = NULL;
+      }
+      return SDRAMBANK_ERROR;
+    }
+  }
+
+  return SDRAMBANK_OK;
+}
+
+/**
+  * @brief  Measures the copy throughput between buffers starting in the same
+  *         bank, then in two banks.
+  * @param  pArea: SDRAM test area
+  * @param  Size: Test area size in bytes, at least 3 x RowSize x Banks
+  * @param  pResult: Pointer to the test result
+  * @retval SDRAMBANK status
+  */
+uint8_t BSP_SDRAMBANK_Test(uint8_t *pArea, uint32_t Size, SDRAMBANK_TestResultTypeDef *pResult)
+{
+  uint8_t *pSource;
+  uint32_t padding, length, cycles;
+
+  pResult->Bytes                 = 0;
+  pResult->SameBankKBytesPerSec  = 0;
+  pResult->SplitBankKBytesPerSec = 0;
+
+  if(SdramBank.Cycle == 0)
+  {
+    return SDRAMBANK_ERROR;
+  }
+
+  /* The source starts in bank 0, the destinations after it */
+  padding = (uint32_t)(SdramBank.pBase - pArea) & (SdramBank.Cycle - 1);
+  if(Size < (padding + SdramBank.RowSize))
+  {
+    return SDRAMBANK_ERROR;
+  }
+  length = ((Size - padding - SdramBank.RowSize) / 2) & ~(SdramBank.Cycle - 1);
+  if(length < SdramBank.Cycle)
+  {
+    return SDRAMBANK_ERROR;
+  }
+  pSource = pArea + padding;
+
+  BSP_EnableCycleCounter();
+
+  cycles = SDRAMBANK_Copy((uint32_t *)(pSource + length), (uint32_t *)pSource, length / 4);
+  pResult->SameBankKBytesPerSec = SDRAMBANK_KBytesPerSec(length, cycles);
+
+  cycles = SDRAMBANK_Copy((uint32_t *)(pSource + length + SdramBank.RowSize), (uint32_t *)pSource, length / 4);
+  pResult->SplitBankKBytesPerSec = SDRAMBANK_KBytesPerSec(length, cycles);
+
+  pResult->Bytes = length;
+
+  return SDRAMBANK_OK;
+}
+
+/**
+  * @brief  Copies words, alternating the source and destination accesses.
+  * @param  pDestination: Destination
+  * @param  pSource: Source
+  * @param  NumOfWords: Number of words
+  * @retval Copy duration in CPU cycles
+  */
+static uint32_t SDRAMBANK_Copy(uint32_t *pDestination, uint32_t *pSource, uint32_t NumOfWords)
+{
+  __IO uint32_t *pDst = pDestination;
+  __IO uint32_t *pSrc = pSource;
+  uint32_t start, primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  start = BSP_GetCycleCount();
+  while(NumOfWords-- != 0)
+  {
+    *pDst++ = *pSrc++;
+  }
+  start = BSP_GetCycleCount() - start;
+
+  __set_PRIMASK(primask);
+
+  return start;
+}
+
+/**
+  * @brief  Converts a transfer size and duration to a throughput.
+  * @param  Bytes: Transferred bytes
+  * @param  Cycles: Transfer duration in CPU cycles
+  * @retval Throughput in KiB/s
+  */
+static uint32_t SDRAMBANK_KBytesPerSec(uint32_t Bytes, uint32_t Cycles)
+{
+  if(Cycles == 0)
+  {
+    return 0;
+  }
+
+  return (uint32_t)(((uint64_t)Bytes * SystemCoreClock) / ((uint64_t)Cycles * 1024));
+}
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
@@ -0,0 +1,113 @@
+/**
+  ******************************************************************************
+  * @file    stm324x9i_eval_sdrambank.h
+  * @author  MCD Application Team
+  * @brief   This file contains the common defines and functions prototypes for
+  *          the stm324x9i_eval_sdrambank.c driver.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2017 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM324x9I_EVAL_SDRAMBANK_H
+#define __STM324x9I_EVAL_SDRAMBANK_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm324x9i_eval.h"
+#include "stm324x9i_eval_sdramalloc.h"
+
+/** @addtogroup BSP
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL
+  * @{
+  */
+
+/** @addtogroup STM324x9I_EVAL_SDRAMBANK
+  * @{
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Exported_Types STM324x9I EVAL SDRAMBANK Exported Types
+  * @{
+  */
+
+/**
+  * @brief  Buffer placed by BSP_SDRAMBANK_Plan()
+  */
+typedef struct
+{
+  uint32_t Size;            /* Buffer size in bytes                                       */
+  uint32_t Bank;            /* Start bank, SDRAMBANK_ANY to let the planner choose it     */
+  uint8_t  *pAddress;       /* Buffer address, set by the planner                         */
+}SDRAMBANK_BufferTypeDef;
+
+/**
+  * @brief  Bank placement bandwidth test result
+  */
+typedef struct
+{
+  uint32_t Bytes;           /* Bytes copied by each test                                  */
+  uint32_t SameBankKBytesPerSec;  /* Copy throughput, source and destination in the same bank (KiB/s) */
+  uint32_t SplitBankKBytesPerSec; /* Copy throughput, source and destination in two banks (KiB/s)     */
+}SDRAMBANK_TestResultTypeDef;
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Exported_Constants STM324x9I EVAL SDRAMBANK Exported Constants
+  * @{
+  */
+/**
+  * @brief  SDRAM bank planner status definition
+  */
+#define SDRAMBANK_OK             ((uint8_t)0x00)
+#define SDRAMBANK_ERROR          ((uint8_t)0x01)
+
+#define SDRAMBANK_ANY            ((uint32_t)0xFFFFFFFF)
+/**
+  * @}
+  */
+
+/** @defgroup STM324x9I_EVAL_SDRAMBANK_Exported_Functions STM324x9I EVAL SDRAMBANK Exported Functions
+  * @{
+  */
+uint8_t  BSP_SDRAMBANK_Init(uint8_t *pBase, SDRAM_GeometryTypeDef *pGeometry);
+uint32_t BSP_SDRAMBANK_GetBank(void *pAddress);
+uint32_t BSP_SDRAMBANK_Stride(uint32_t Size);
+uint8_t  BSP_SDRAMBANK_Plan(SDRAMBANK_BufferTypeDef *pBuffers, uint32_t NbBuffers);
+uint8_t  BSP_SDRAMBANK_Test(uint8_t *pArea, uint32_t Size, SDRAMBANK_TestResultTypeDef *pResult);
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+/**
+  * @}
+  */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM324x9I_EVAL_SDRAMBANK_H */